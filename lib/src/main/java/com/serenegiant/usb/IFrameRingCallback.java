@@ -0,0 +1,49 @@
+/*
+ *  UVCCamera
+ *  library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ *  All files in the folder are under this Apache License, Version 2.0.
+ *  Files in the libjpeg-turbo, libusb, libuvc, rapidjson folder
+ *  may have a different license, see the respective files.
+ */
+
+package com.serenegiant.usb;
+
+
+import java.nio.ByteBuffer;
+/**
+ * Callback interface for UVCCamera class
+ * Same as IFrameCallback but the frame can be kept after returning from #onFrame
+ * until it is returned with UVCCamera#releaseFrame, use with UVCCamera#setFrameRingCallback.
+ * The frames are written to a fixed number of buffers that are created only once,
+ * so no Java object is created on each frame.
+ */
+public interface IFrameRingCallback {
+	/**
+	 * This method is called from native library via JNI on the same thread as UVCCamera#startCapture.
+	 * The frame is dropped when all of the buffers are kept by the application.
+	 * @param index pass this to UVCCamera#releaseFrame when the frame is no longer needed
+	 * @param frame direct ByteBuffer from JNI layer, the same instance is passed again after releasing it.
+	 * 			It stays valid after UVCCamera#stopPreview and UVCCamera#close,
+	 * 			do not access it after UVCCamera#releaseFrame or UVCCamera#destroy
+	 * @param width width of the frame
+	 * @param height height of the frame
+	 * @param captureTimeUs estimate of the time the camera captured the frame in microseconds,
+	 * 			same time base as System.nanoTime() / 1000
+	 */
+	public void onFrame(int index, ByteBuffer frame, int width, int height, long captureTimeUs);
+}
@@ -60,6 +60,13 @@ public class UVCCamera {
 	public static final int PIXEL_FORMAT_RGBX = 3;
 	public static final int PIXEL_FORMAT_YUV420SP = 4;
 	public static final int PIXEL_FORMAT_NV21 = 5;		// = YVU420SemiPlanar
+	public static final int PIXEL_FORMAT_GRAY8 = 6;		// luma only, width x height bytes
+
+	public static final int LATENCY_MODE_FIFO = 0;		// draw all frames in order
+	public static final int LATENCY_MODE_LATEST = 1;	// draw only the newest frame
+
+	public static final int MAX_TRANSFERS = 32;				// = LIBUVC_MAX_TRANSFER_BUFS
+	public static final int MAX_PACKETS_PER_TRANSFER = 128;	// = LIBUVC_MAX_PACKETS_PER_TRANSFER
 
 	//--------------------------------------------------------------------------------
     public static final int	CTRL_SCANNING		= 0x00000001;	// D0:  Scanning Mode
@@ -125,6 +132,9 @@ public class UVCCamera {
 	}
 
 	private UsbControlBlock mCtrlBlock;
+	// serializes #releaseFrame and nativeDestroy, not this object because
+	// #close waits for the thread that may call #releaseFrame from IFrameRingCallback#onFrame
+	private final Object mReleaseFrameSync = new Object();
     protected long mControlSupports;			// カメラコントロールでサポートしている機能フラグ
     protected long mProcSupports;				// プロセッシングユニットでサポートしている機能フラグ
     protected int mCurrentFrameFormat = FRAME_FORMAT_MJPEG;
@@ -333,6 +343,39 @@ public class UVCCamera {
 		}
 	}
 
+	/**
+	 * Set transfer queue of the preview stream, this is applied when the preview starts next time
+	 * Shallow queue reduces latency, deep queue avoids packet loss on busy system/hub
+	 * @param numTransfers number of USB transfers [1, MAX_TRANSFERS], 0 for default(10).
+	 * 			This is the upper limit when autoTune is true
+	 * @param packetsPerTransfer upper limit of isochronous packets (payloads for bulk transfer) per transfer
+	 * 			[1, MAX_PACKETS_PER_TRANSFER], 0 for default(32)
+	 * @param autoTune adjust the number of transfers in flight while previewing
+	 * @throws IllegalArgumentException numTransfers or packetsPerTransfer is out of range
+	 */
+	public void setTransferConfig(final int numTransfers, final int packetsPerTransfer, final boolean autoTune) {
+		if ((numTransfers < 0) || (numTransfers > MAX_TRANSFERS))
+			throw new IllegalArgumentException("invalid number of transfers:" + numTransfers);
+		if ((packetsPerTransfer < 0) || (packetsPerTransfer > MAX_PACKETS_PER_TRANSFER))
+			throw new IllegalArgumentException("invalid packets per transfer:" + packetsPerTransfer);
+		if (mNativePtr != 0) {
+			nativeSetTransferConfig(mNativePtr, numTransfers, packetsPerTransfer, autoTune);
+		}
+	}
+
+	/**
+	 * Set how the frames are handed to the preview, this is applied when the preview starts next time
+	 * @param mode LATENCY_MODE_FIFO: draw all frames in order, the preview may lag behind the camera under load
+	 * 			LATENCY_MODE_LATEST: draw only the newest frame and drop the older ones, for low latency e.g. teleoperation
+	 */
+	public void setLatencyMode(final int mode) {
+		if ((mode != LATENCY_MODE_FIFO) && (mode != LATENCY_MODE_LATEST))
+			throw new IllegalArgumentException("invalid latency mode:" + mode);
+		if (mNativePtr != 0) {
+			nativeSetLatencyMode(mNativePtr, mode);
+		}
+	}
+
 	public List<Size> getSupportedSizeList() {
 		final int type = (mCurrentFrameFormat > 0) ? 6 : 4;
 		return getSupportedSize(type, mSupportedSize);
@@ -406,8 +449,52 @@ public class UVCCamera {
      * @param pixelFormat
      */
     public void setFrameCallback(final IFrameCallback callback, final int pixelFormat) {
+    	setFrameCallback(callback, pixelFormat, 0, 0);
+    }
+
+    /**
+     * set frame callback with the frame size passed to the callback.
+     * the frame is scaled in native code while converting to pixelFormat
+     * @param callback
+     * @param pixelFormat
+     * @param width width of the callback frame, 0 means same as the preview size
+     * @param height height of the callback frame, 0 means same as the preview size
+     */
+    public void setFrameCallback(final IFrameCallback callback, final int pixelFormat, final int width, final int height) {
     	if (mNativePtr != 0) {
-        	nativeSetFrameCallback(mNativePtr, callback, pixelFormat);
+        	nativeSetFrameCallback(mNativePtr, callback, pixelFormat, width, height);
+    	}
+    }
+
+    /**
+     * set frame callback that can keep the frames after returning from the callback.
+     * The frames are written to numBuffers of buffers that are reused,
+     * each frame must be returned with #releaseFrame.
+     * This replaces the callback set by #setFrameCallback and vice versa.
+     * @param callback null to remove the callback
+     * @param pixelFormat
+     * @param width width of the callback frame, 0 means same as the preview size
+     * @param height height of the callback frame, 0 means same as the preview size
+     * @param numBuffers number of buffers [1, 16], the frames are dropped while the application keeps all of them
+     */
+    public void setFrameRingCallback(final IFrameRingCallback callback, final int pixelFormat, final int width, final int height, final int numBuffers) {
+    	if ((numBuffers < 1) || (numBuffers > 16))
+    		throw new IllegalArgumentException("invalid number of buffers:" + numBuffers);
+    	if (mNativePtr != 0) {
+        	nativeSetFrameRingCallback(mNativePtr, callback, pixelFormat, width, height, numBuffers);
+    	}
+    }
+
+    /**
+     * return the frame that was passed to IFrameRingCallback#onFrame, this can be called from any thread.
+     * The frames that are kept over #close are also returned with this until #destroy
+     * @param index index that was passed to IFrameRingCallback#onFrame
+     */
+    public void releaseFrame(final int index) {
+    	synchronized (mReleaseFrameSync) {
+    		if (mNativePtr != 0) {
+    			nativeReleaseFrame(mNativePtr, index);
+    		}
     	}
     }
 
@@ -435,9 +522,12 @@ public class UVCCamera {
      */
     public synchronized void destroy() {
     	close();
-    	if (mNativePtr != 0) {
-    		nativeDestroy(mNativePtr);
-    		mNativePtr = 0;
+    	// the buffers of IFrameRingCallback that the application still keeps are freed here
+    	synchronized (mReleaseFrameSync) {
+    		if (mNativePtr != 0) {
+    			nativeDestroy(mNativePtr);
+    			mNativePtr = 0;
+    		}
     	}
     }
 
@@ -1039,11 +1129,15 @@ public class UVCCamera {
 	private static final native int nativeSetButtonCallback(final long mNativePtr, final IButtonCallback callback);
 
     private static final native int nativeSetPreviewSize(final long id_camera, final int width, final int height, final int min_fps, final int max_fps, final int mode, final float bandwidth);
+    private static final native int nativeSetTransferConfig(final long id_camera, final int numTransfers, final int packetsPerTransfer, final boolean autoTune);
+    private static final native int nativeSetLatencyMode(final long id_camera, final int mode);
     private static final native String nativeGetSupportedSize(final long id_camera);
     private static final native int nativeStartPreview(final long id_camera);
     private static final native int nativeStopPreview(final long id_camera);
     private static final native int nativeSetPreviewDisplay(final long id_camera, final Surface surface);
-    private static final native int nativeSetFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat);
+    private static final native int nativeSetFrameCallback(final long mNativePtr, final IFrameCallback callback, final int pixelFormat, final int width, final int height);
+    private static final native int nativeSetFrameRingCallback(final long mNativePtr, final IFrameRingCallback callback, final int pixelFormat, final int width, final int height, final int numBuffers);
+    private static final native int nativeReleaseFrame(final long mNativePtr, final int index);
 
 //**********************************************************************
     /**
@@ -1067,6 +1161,49 @@ public class UVCCamera {
     }
     private static final native int nativeSetCaptureDisplay(final long id_camera, final Surface surface);
 
+    /**
+     * get transport statistics of current preview stream as JSON string
+     * @return null if not previewing
+     */
+    public synchronized String getStreamStats() {
+    	return mCtrlBlock != null ? nativeGetStreamStats(mNativePtr) : null;
+    }
+    private static final native String nativeGetStreamStats(final long id_camera);
+
+    /**
+     * get end-to-end latency of the frames drawn to the preview as JSON string.
+     * Percentiles in microseconds of the latest frames of each latency mode,
+     * from USB transfer completion and from the capture time the camera reported to posting to the Surface.
+     * The values of a mode are kept until the preview starts with the mode again
+     * @return null if the camera is not opened
+     */
+    public synchronized String getLatencyStats() {
+    	return mCtrlBlock != null ? nativeGetLatencyStats(mNativePtr) : null;
+    }
+    private static final native String nativeGetLatencyStats(final long id_camera);
+
+    /**
+     * set the file to keep stream control blocks that cameras accepted.
+     * Preview of the same camera and mode starts without probe negotiation next time.
+     * The cache is shared by all cameras in this process.
+     * @param path e.g. new File(context.getCacheDir(), "uvc_negotiation").getAbsolutePath(),
+     * 			null to keep the cache in memory only
+     */
+    public static void setNegotiationCacheFile(final String path) {
+    	nativeSetNegotiationCacheFile(path);
+    }
+    private static final native int nativeSetNegotiationCacheFile(final String path);
+
+    /**
+     * get heap allocations of the native code per thread and subsystem as JSON string.
+     * The counts are cleared when the preview warmed up, so they should stay zero while previewing.
+     * @return null unless the native library is built with UVC_ALLOC_TRACKING
+     */
+    public static String getAllocStats() {
+    	return nativeGetAllocStats();
+    }
+    private static final native String nativeGetAllocStats();
+
     private static final native long nativeGetCtrlSupports(final long id_camera);
     private static final native long nativeGetProcSupports(final long id_camera);
 
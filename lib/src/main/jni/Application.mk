@@ -30,3 +30,6 @@ APP_PLATFORM := android-21
 APP_ABI := armeabi-v7a arm64-v8a
 #APP_OPTIM := debug
 APP_OPTIM := release
+# Debug build that counts the heap allocations of libuvc/UVCCamera per thread and subsystem,
+# see UVCCamera#getAllocStats
+#APP_CFLAGS += -DUVC_ALLOC_TRACKING
@@ -60,6 +60,9 @@ LOCAL_SRC_FILES := \
 		UVCButtonCallback.cpp \
 		UVCStatusCallback.cpp \
 		Parameters.cpp \
+		NegotiationCache.cpp \
+		LatencyStats.cpp \
+		FrameRing.cpp \
 		serenegiant_usb_UVCCamera.cpp
 
 LOCAL_MODULE    := UVCCamera
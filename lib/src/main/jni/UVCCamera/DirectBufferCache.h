@@ -0,0 +1,158 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: DirectBufferCache.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef DIRECTBUFFERCACHE_H_
+#define DIRECTBUFFERCACHE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <jni.h>
+
+#include "utilbase.h"
+#include "libuvc.h"
+
+#define DIRECT_BUFFER_CACHE_SZ 16
+
+/**
+ * global reference of direct ByteBuffer on the memory,
+ * created once and handed to Java again while the memory is the same.
+ * Only access from one thread that is attached to JavaVM.
+ */
+class GlobalDirectBuffer {
+private:
+	jobject m_buf;		// global reference
+	void *m_data;
+	size_t m_bytes;
+public:
+	GlobalDirectBuffer() : m_buf(NULL), m_data(NULL), m_bytes(0) {}
+
+	inline bool is(const void *data, const size_t bytes) const {
+		return m_buf && (m_data == data) && (m_bytes == bytes);
+	}
+
+	/**
+	 * @param clear java.nio.Buffer#clear of the owner, looked up on the first call
+	 * @param subsystem subsystem of UVC_ALLOC_TRACK for the new ByteBuffer
+	 * @return direct ByteBuffer of the memory with position 0 and limit bytes, NULL on error,
+	 * the owner keeps the reference, do not delete it
+	 */
+	jobject get(JNIEnv *env, void *data, size_t bytes, jmethodID &clear, enum uvc_alloc_subsystem subsystem) {
+		if (LIKELY(is(data, bytes))) {
+			// the callback may have moved position/limit last time
+			jobject self = env->CallObjectMethod(m_buf, clear);
+			env->ExceptionClear();
+			if (self) env->DeleteLocalRef(self);
+			return m_buf;
+		}
+		release(env);
+		if (UNLIKELY(!clear)) {
+			jclass clazz = env->FindClass("java/nio/Buffer");
+			clear = env->GetMethodID(clazz, "clear", "()Ljava/nio/Buffer;");
+			env->DeleteLocalRef(clazz);
+		}
+		jobject buf = env->NewDirectByteBuffer(data, bytes);
+		if (UNLIKELY(!buf)) {
+			env->ExceptionClear();
+			return NULL;
+		}
+		UVC_ALLOC_TRACK(subsystem, 0);	// Java object, size is unknown
+		m_buf = env->NewGlobalRef(buf);
+		env->DeleteLocalRef(buf);
+		m_data = data;
+		m_bytes = bytes;
+		return m_buf;
+	}
+
+	/**
+	 * delete the global reference, Java may still keep its own reference of the ByteBuffer
+	 */
+	void release(JNIEnv *env) {
+		if (m_buf) {
+			env->DeleteGlobalRef(m_buf);
+		}
+		m_buf = NULL;
+		m_data = NULL;
+		m_bytes = 0;
+	}
+};
+
+/**
+ * direct ByteBuffers for IFrameCallback#onFrame kept as global references,
+ * the frames are reused from the frame arena/frame pool, so the same buffers
+ * are handed to Java again and no Java object is created on each frame after warming up.
+ * Only access from one thread that is attached to JavaVM.
+ */
+class DirectBufferCache {
+private:
+	typedef struct {
+		GlobalDirectBuffer buffer;
+		uint32_t last_used;
+	} entry_t;
+	entry_t m_entries[DIRECT_BUFFER_CACHE_SZ];
+	uint32_t m_clock;
+	jmethodID m_clear;		// java.nio.Buffer#clear
+	const enum uvc_alloc_subsystem m_subsystem;
+public:
+	DirectBufferCache(enum uvc_alloc_subsystem subsystem)
+		: m_clock(0), m_clear(NULL), m_subsystem(subsystem) {
+		for (int i = 0; i < DIRECT_BUFFER_CACHE_SZ; i++) {
+			m_entries[i].last_used = 0;
+		}
+	}
+
+	/**
+	 * @return direct ByteBuffer of the memory with position 0 and limit bytes,
+	 * the cache owns the reference, do not delete it
+	 */
+	jobject get(JNIEnv *env, void *data, size_t bytes) {
+		entry_t *entry = &m_entries[0];
+		int i;
+
+		m_clock++;
+		for (i = 0; i < DIRECT_BUFFER_CACHE_SZ; i++) {
+			if (m_entries[i].buffer.is(data, bytes)) {
+				entry = &m_entries[i];
+				break;
+			}
+			if (m_entries[i].last_used < entry->last_used) {
+				entry = &m_entries[i];
+			}
+		}
+		// same one, or replace the least recently used one
+		entry->last_used = m_clock;
+		return entry->buffer.get(env, data, bytes, m_clear, m_subsystem);
+	}
+
+	/**
+	 * delete all global references, call before the thread detaches from JavaVM
+	 */
+	void clear(JNIEnv *env) {
+		for (int i = 0; i < DIRECT_BUFFER_CACHE_SZ; i++) {
+			m_entries[i].buffer.release(env);
+			m_entries[i].last_used = 0;
+		}
+	}
+};
+
+#endif /* DIRECTBUFFERCACHE_H_ */
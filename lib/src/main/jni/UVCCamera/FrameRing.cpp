@@ -0,0 +1,214 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameRing.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include "utilbase.h"
+#include "FrameRing.h"
+
+// index handed to Java = generation << 8 | slot number
+#define INDEX_SLOT_BITS 8
+#define INDEX_SLOT_MASK ((1 << INDEX_SLOT_BITS) - 1)
+#define INDEX_GENERATION_MASK 0x7fffff
+
+FrameRing::FrameRing(enum uvc_alloc_subsystem subsystem)
+:	m_num_slots(0),
+	m_frame_bytes(0),
+	m_generation(0),
+	m_next(0),
+	m_waiting(false),
+	m_clear(NULL),
+	m_dropped(0),
+	m_subsystem(subsystem) {
+
+	for (int i = 0; i < FRAME_RING_MAX_BUFFERS; i++) {
+		m_slots[i].frame = NULL;
+		m_slots[i].index = 0;
+	}
+}
+
+/**
+ * the global references should have been deleted with clear,
+ * the frames that Java still keeps are freed here, UVCCamera owns the ring
+ * so that this is called from UVCCamera#destroy, not from UVCCamera#close
+ */
+FrameRing::~FrameRing() {
+	for (int i = 0; i < FRAME_RING_MAX_BUFFERS; i++) {
+		if (m_slots[i].frame) {
+			uvc_free_frame(m_slots[i].frame);
+		}
+	}
+}
+
+/**
+ * delete the global references and free the frames of the slots that Java does not keep.
+ * The slots that Java keeps are left as they are, their frames are freed
+ * by the next call after Java released them, or by the destructor.
+ */
+void FrameRing::destroy(JNIEnv *env) {
+	for (int i = 0; i < FRAME_RING_MAX_BUFFERS; i++) {
+		slot_t *slot = &m_slots[i];
+		// Java keeps its own reference of the ByteBuffer if it still has the slot
+		slot->buffer.release(env);
+		if (slot->frame) {
+			// release only makes the kept slot free, so the slot can not become busy after this check
+			if (__atomic_load_n(&slot->index, __ATOMIC_ACQUIRE)) {
+				continue;
+			}
+			uvc_free_frame(slot->frame);
+			slot->frame = NULL;
+		}
+	}
+	m_num_slots = 0;
+	m_frame_bytes = 0;
+}
+
+/**
+ * (re)create the slots if the number of buffers or the size of the frame changed.
+ * The slots are not re-created while Java keeps any of them,
+ * the frames should be dropped until Java releases them.
+ * @return true if the slots are ready
+ */
+bool FrameRing::prepare(JNIEnv *env, int num_buffers, size_t frame_bytes) {
+	if (num_buffers > FRAME_RING_MAX_BUFFERS) {
+		num_buffers = FRAME_RING_MAX_BUFFERS;
+	} else if (num_buffers < 1) {
+		num_buffers = 1;
+	}
+	if (LIKELY((num_buffers == m_num_slots) && (frame_bytes == m_frame_bytes))) {
+		return true;
+	}
+	for (int i = 0; i < FRAME_RING_MAX_BUFFERS; i++) {
+		// also the slots that were kept over clear
+		if (m_slots[i].frame && __atomic_load_n(&m_slots[i].index, __ATOMIC_ACQUIRE)) {
+			if (!m_waiting) {
+				LOGW("wait for releasing frame buffers to change the ring");
+				m_waiting = true;
+			}
+			return false;
+		}
+	}
+	m_waiting = false;
+	destroy(env);
+	m_generation = (m_generation + 1) & INDEX_GENERATION_MASK;
+	if (!m_generation) {
+		m_generation = 1;
+	}
+	for (int i = 0; i < num_buffers; i++) {
+		m_slots[i].frame = uvc_arena_allocate_frame(frame_bytes);
+		if (UNLIKELY(!m_slots[i].frame)) {
+			LOGW("failed to allocate frame buffer");
+			destroy(env);
+			return false;
+		}
+	}
+	m_num_slots = num_buffers;
+	m_frame_bytes = frame_bytes;
+	m_next = 0;
+	return true;
+}
+
+/**
+ * get the next free slot, never blocks
+ * @return index of the slot, -1 if Java keeps all of them
+ */
+int32_t FrameRing::acquire() {
+	for (int n = 0; n < m_num_slots; n++) {
+		const int i = (m_next + n) % m_num_slots;
+		if (!__atomic_load_n(&m_slots[i].index, __ATOMIC_ACQUIRE)) {
+			const int32_t index = (m_generation << INDEX_SLOT_BITS) | i;
+			// only this thread makes the slot busy
+			__atomic_store_n(&m_slots[i].index, index, __ATOMIC_RELAXED);
+			m_next = (i + 1) % m_num_slots;
+			return index;
+		}
+	}
+	__sync_fetch_and_add(&m_dropped, 1);
+	return -1;
+}
+
+/**
+ * @param index return value of acquire
+ * @return frame of the slot, write the data to this frame
+ */
+uvc_frame_t *FrameRing::frame(int32_t index) {
+	return m_slots[index & INDEX_SLOT_MASK].frame;
+}
+
+/**
+ * @param index return value of acquire
+ * @param bytes limit of the buffer
+ * @return direct ByteBuffer of the frame of the slot with position 0 and limit bytes,
+ * the ring owns the reference, do not delete it
+ */
+jobject FrameRing::buffer(JNIEnv *env, int32_t index, size_t bytes) {
+	slot_t *slot = &m_slots[index & INDEX_SLOT_MASK];
+
+	if (bytes > slot->frame->data_bytes) {
+		bytes = slot->frame->data_bytes;
+	}
+	// created the first time or when the frame arena replaced the memory of the frame
+	return slot->buffer.get(env, slot->frame->data, bytes, m_clear, m_subsystem);
+}
+
+/**
+ * return the slot to the ring, this can be called from any thread
+ * @param index value that was passed to Java, the index of the slots before re-creating them is ignored
+ * @return false if the index is not in use
+ */
+bool FrameRing::release(int32_t index) {
+	if (UNLIKELY((index <= INDEX_SLOT_MASK) || ((index & INDEX_SLOT_MASK) >= FRAME_RING_MAX_BUFFERS))) {
+		return false;
+	}
+	int32_t expected = index;
+	return __atomic_compare_exchange_n(&m_slots[index & INDEX_SLOT_MASK].index, &expected, 0,
+		false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/**
+ * free the slots and delete the global references, call before the thread detaches from JavaVM.
+ * The buffers that Java still keeps stay valid until Java releases them
+ * (freed by the next prepare/clear) or UVCCamera is destroyed
+ */
+void FrameRing::clear(JNIEnv *env) {
+	destroy(env);
+	m_waiting = false;
+	m_dropped = 0;
+}
+
+/**
+ * @return number of frames dropped because Java kept all slots
+ */
+uint32_t FrameRing::dropped() const {
+	return __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+}
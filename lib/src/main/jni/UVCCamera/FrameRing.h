@@ -0,0 +1,72 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: FrameRing.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef FRAMERING_H_
+#define FRAMERING_H_
+
+#include "libUVCCamera.h"
+#include <jni.h>
+#include "DirectBufferCache.h"
+
+#define FRAME_RING_MAX_BUFFERS 16
+
+/**
+ * fixed number of frames from the frame arena, each of them is passed to Java
+ * as a direct ByteBuffer that is created only once and kept as a global reference.
+ * A slot is handed to Java with an index and comes back when Java calls release with it,
+ * so Java can keep the frame after returning from the callback without copying.
+ * acquire/buffer/prepare/clear are only called from one thread that is attached to JavaVM,
+ * release can be called from any thread.
+ */
+class FrameRing {
+private:
+	typedef struct {
+		uvc_frame_t *frame;		// owns the memory, from the frame arena
+		GlobalDirectBuffer buffer;	// direct ByteBuffer on frame->data
+		volatile int32_t index;	// index handed to Java, 0 if the slot is free
+	} slot_t;
+	slot_t m_slots[FRAME_RING_MAX_BUFFERS];
+	int m_num_slots;
+	size_t m_frame_bytes;
+	int32_t m_generation;		// changes when the slots are re-created so that stale indices are ignored
+	int m_next;
+	bool m_waiting;				// waiting for Java to release the slots to re-create them
+	jmethodID m_clear;			// java.nio.Buffer#clear
+	volatile uint32_t m_dropped;
+	const enum uvc_alloc_subsystem m_subsystem;
+	void destroy(JNIEnv *env);
+public:
+	FrameRing(enum uvc_alloc_subsystem subsystem);
+	~FrameRing();
+
+	bool prepare(JNIEnv *env, int num_buffers, size_t frame_bytes);
+	int32_t acquire();
+	uvc_frame_t *frame(int32_t index);
+	jobject buffer(JNIEnv *env, int32_t index, size_t bytes);
+	bool release(int32_t index);
+	void clear(JNIEnv *env);
+	uint32_t dropped() const;
+};
+
+#endif /* FRAMERING_H_ */
@@ -0,0 +1,162 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: LatencyStats.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include "utilbase.h"
+#include "LatencyStats.h"
+
+LatencyStats::LatencyStats()
+:	head(0),
+	count(0),
+	frames(0),
+	dropped(0) {
+
+	pthread_mutex_init(&stats_mutex, NULL);
+}
+
+LatencyStats::~LatencyStats() {
+	pthread_mutex_destroy(&stats_mutex);
+}
+
+/**
+ * current time of CLOCK_MONOTONIC in microseconds, same clock as uvc_frame_t#capture_time/complete_time
+ */
+/*static*/
+int64_t LatencyStats::now_us() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @return 0 if the time is not set
+ */
+/*static*/
+int64_t LatencyStats::to_us(const struct timeval *tv) {
+	return tv->tv_sec * 1000000LL + tv->tv_usec;
+}
+
+static inline int32_t interval(const int64_t from_us, const int64_t to_us) {
+	return (from_us && (to_us >= from_us)) ? (int32_t)(to_us - from_us) : -1;
+}
+
+/**
+ * record the frame that was posted to the preview display
+ * @param frame the frame that was drawn, or the one it was decoded/converted from
+ * @param taken_us time the preview thread took the frame from the queue
+ * @param posted_us time the frame was posted to the preview display
+ */
+void LatencyStats::add(const uvc_frame_t *frame, const int64_t taken_us, const int64_t posted_us) {
+	const int64_t complete_us = to_us(&frame->complete_time);
+	const int64_t capture_us = to_us(&frame->capture_time);
+
+	pthread_mutex_lock(&stats_mutex);
+	{
+		const uint32_t ix = (head + count) % LATENCY_MAX_SAMPLES;
+		queued[ix] = interval(complete_us, taken_us);
+		complete[ix] = interval(complete_us, posted_us);
+		capture[ix] = interval(capture_us, posted_us);
+		if (count < LATENCY_MAX_SAMPLES) {
+			count++;
+		} else {
+			head = (head + 1) % LATENCY_MAX_SAMPLES;
+		}
+		frames++;
+	}
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * count the frame that was dropped without drawing
+ */
+void LatencyStats::drop() {
+	__sync_fetch_and_add(&dropped, 1);
+}
+
+static int compare_int32(const void *a, const void *b) {
+	const int32_t va = *(const int32_t *)a;
+	const int32_t vb = *(const int32_t *)b;
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/**
+ * must be called with stats_mutex held
+ */
+void LatencyStats::percentiles(const int32_t *values, latency_percentiles_t *result) {
+	uint32_t n = 0;
+
+	memset(result, 0, sizeof(latency_percentiles_t));
+	for (uint32_t i = 0; i < count; i++) {
+		const int32_t v = values[(head + i) % LATENCY_MAX_SAMPLES];
+		if (v >= 0) {
+			sorted[n++] = v;
+		}
+	}
+	if (n) {
+		qsort(sorted, n, sizeof(int32_t), compare_int32);
+		result->samples = n;
+		// nearest rank
+		result->p50 = sorted[(n * 50 + 99) / 100 - 1];
+		result->p90 = sorted[(n * 90 + 99) / 100 - 1];
+		result->p99 = sorted[(n * 99 + 99) / 100 - 1];
+		result->max = sorted[n - 1];
+	}
+}
+
+void LatencyStats::get(latency_summary_t *summary) {
+	pthread_mutex_lock(&stats_mutex);
+	{
+		summary->frames = frames;
+		summary->dropped = __sync_fetch_and_add(&dropped, 0);
+		percentiles(queued, &summary->queued);
+		percentiles(complete, &summary->complete);
+		percentiles(capture, &summary->capture);
+	}
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+void LatencyStats::reset() {
+	pthread_mutex_lock(&stats_mutex);
+	{
+		head = count = 0;
+		frames = 0;
+		__sync_lock_test_and_set(&dropped, 0);
+	}
+	pthread_mutex_unlock(&stats_mutex);
+}
@@ -0,0 +1,85 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: LatencyStats.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef LATENCYSTATS_H_
+#define LATENCYSTATS_H_
+
+#include "libUVCCamera.h"
+#include <pthread.h>
+
+#pragma interface
+
+#define LATENCY_MODE_FIFO 0		// queue the frames and draw all of them
+#define LATENCY_MODE_LATEST 1	// draw only the newest frame, drop older ones
+#define LATENCY_MODE_NUM 2
+
+#define LATENCY_MAX_SAMPLES 512		// percentiles are of the latest this number of frames
+
+// percentiles of one interval in microseconds
+typedef struct latency_percentiles {
+	uint32_t samples;
+	int32_t p50;
+	int32_t p90;
+	int32_t p99;
+	int32_t max;
+} latency_percentiles_t;
+
+typedef struct latency_summary {
+	uint64_t frames;		// frames drawn to the preview display
+	uint64_t dropped;		// frames dropped between the libuvc callback and the preview thread
+	latency_percentiles_t queued;	// USB transfer completion => taken by the preview thread
+	latency_percentiles_t complete;	// USB transfer completion => posted to the preview display
+	latency_percentiles_t capture;	// capture time(PTS/SCR) => posted to the preview display
+} latency_summary_t;
+
+/**
+ * end-to-end latency of the preview frames,
+ * add is called from the preview thread and drop from the libuvc callback thread,
+ * get can be called from any thread.
+ */
+class LatencyStats {
+private:
+	pthread_mutex_t stats_mutex;
+	uint32_t head, count;
+	int32_t queued[LATENCY_MAX_SAMPLES];	// -1 if unknown
+	int32_t complete[LATENCY_MAX_SAMPLES];
+	int32_t capture[LATENCY_MAX_SAMPLES];
+	int32_t sorted[LATENCY_MAX_SAMPLES];	// work area for get
+	uint64_t frames;
+	volatile uint64_t dropped;
+	void percentiles(const int32_t *values, latency_percentiles_t *result);
+public:
+	LatencyStats();
+	~LatencyStats();
+
+	static int64_t now_us();
+	static int64_t to_us(const struct timeval *tv);
+
+	void add(const uvc_frame_t *frame, const int64_t taken_us, const int64_t posted_us);
+	void drop();
+	void get(latency_summary_t *summary);
+	void reset();
+};
+
+#endif /* LATENCYSTATS_H_ */
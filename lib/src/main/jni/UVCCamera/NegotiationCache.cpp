@@ -0,0 +1,267 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: NegotiationCache.cpp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if 1	// set 1 if you don't need debug log
+	#ifndef LOG_NDEBUG
+		#define	LOG_NDEBUG		// w/o LOGV/LOGD/MARK
+	#endif
+	#undef USE_LOGALL
+#else
+	#define USE_LOGALL
+	#undef LOG_NDEBUG
+//	#undef NDEBUG
+#endif
+
+#include "utilbase.h"
+#include "NegotiationCache.h"
+#include "libuvc_internal.h"
+
+#define CACHE_MAGIC 0x4e435655	// 'UVCN'
+#define CACHE_VERSION 1
+
+// header of the cache file, followed by num_entries of negotiation_entry_t
+typedef struct cache_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_bytes;
+	uint32_t num_entries;
+} cache_file_header_t;
+
+NegotiationCache::NegotiationCache()
+:	mPath(NULL),
+	num_entries(0) {
+
+	ENTER();
+	pthread_mutex_init(&cache_mutex, NULL);
+	EXIT();
+}
+
+NegotiationCache::~NegotiationCache() {
+
+	ENTER();
+	free(mPath);
+	pthread_mutex_destroy(&cache_mutex);
+	EXIT();
+}
+
+NegotiationCache &NegotiationCache::getInstance() {
+	static NegotiationCache sInstance;
+	return sInstance;
+}
+
+/**
+ * build the cache key of the requested stream
+ * vendor id, product id and bcdDevice come from the cached device descriptor of libusb
+ */
+/*static*/
+void NegotiationCache::makeKey(uvc_device_handle_t *devh, negotiation_key_t *key,
+	int mode, int width, int height, int min_fps, int max_fps, float bandwidth) {
+
+	struct libusb_device_descriptor desc;
+
+	memset(key, 0, sizeof(negotiation_key_t));
+	if (LIKELY(!libusb_get_device_descriptor(devh->dev->usb_dev, &desc))) {
+		key->vendor_id = desc.idVendor;
+		key->product_id = desc.idProduct;
+		key->bcd_device = desc.bcdDevice;
+	}
+	key->mode = mode;
+	key->width = width;
+	key->height = height;
+	key->min_fps = min_fps;
+	key->max_fps = max_fps;
+	key->bandwidth = bandwidth;
+}
+
+/**
+ * set the path of the cache file and load entries from it
+ * @param path NULL to keep the cache in memory only
+ */
+int NegotiationCache::setPath(const char *path) {
+	ENTER();
+
+	pthread_mutex_lock(&cache_mutex);
+	{
+		free(mPath);
+		mPath = path ? strdup(path) : NULL;
+		if (mPath) {
+			load();
+		}
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	RETURN(0, int);
+}
+
+/**
+ * look up the committed control block
+ * @return true if found
+ */
+bool NegotiationCache::get(const negotiation_key_t *key, uvc_stream_ctrl_t *ctrl, uint8_t *alt_setting) {
+	bool result = false;
+
+	pthread_mutex_lock(&cache_mutex);
+	{
+		const int index = find(key);
+		if (index >= 0) {
+			*ctrl = entries[index].ctrl;
+			if (alt_setting)
+				*alt_setting = entries[index].alt_setting;
+			moveToFront(index);
+			result = true;
+		}
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	return result;
+}
+
+/**
+ * add or update the control block that the camera accepted,
+ * the least recently used entry is discarded when the cache is full
+ */
+void NegotiationCache::put(const negotiation_key_t *key, const uvc_stream_ctrl_t *ctrl, uint8_t alt_setting) {
+	ENTER();
+
+	pthread_mutex_lock(&cache_mutex);
+	{
+		int index = find(key);
+		if (index < 0) {
+			if (num_entries < NEGOTIATION_CACHE_MAX_ENTRIES)
+				num_entries++;
+			index = num_entries - 1;
+		}
+		entries[index].key = *key;
+		entries[index].ctrl = *ctrl;
+		entries[index].alt_setting = alt_setting;
+		moveToFront(index);
+		save();
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	EXIT();
+}
+
+/**
+ * remove the entry that the camera rejected
+ */
+void NegotiationCache::remove(const negotiation_key_t *key) {
+	ENTER();
+
+	pthread_mutex_lock(&cache_mutex);
+	{
+		const int index = find(key);
+		if (index >= 0) {
+			memmove(&entries[index], &entries[index + 1],
+				sizeof(negotiation_entry_t) * (num_entries - index - 1));
+			num_entries--;
+			save();
+		}
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	EXIT();
+}
+
+// must be called with cache_mutex held
+int NegotiationCache::find(const negotiation_key_t *key) {
+	for (int i = 0; i < num_entries; i++) {
+		if (!memcmp(&entries[i].key, key, sizeof(negotiation_key_t)))
+			return i;
+	}
+	return -1;
+}
+
+// must be called with cache_mutex held
+void NegotiationCache::moveToFront(int index) {
+	if (index > 0) {
+		negotiation_entry_t entry = entries[index];
+		memmove(&entries[1], &entries[0], sizeof(negotiation_entry_t) * index);
+		entries[0] = entry;
+	}
+}
+
+// must be called with cache_mutex held
+void NegotiationCache::load() {
+	ENTER();
+
+	FILE *fp = fopen(mPath, "rb");
+	if (fp) {
+		cache_file_header_t header;
+		if ((fread(&header, sizeof(header), 1, fp) == 1)
+			&& (header.magic == CACHE_MAGIC)
+			&& (header.version == CACHE_VERSION)
+			&& (header.entry_bytes == sizeof(negotiation_entry_t))
+			&& (header.num_entries <= NEGOTIATION_CACHE_MAX_ENTRIES)) {
+
+			num_entries = fread(entries, sizeof(negotiation_entry_t), header.num_entries, fp);
+			LOGI("loaded %d negotiation cache entries", num_entries);
+		} else {
+			LOGW("ignore incompatible negotiation cache %s", mPath);
+		}
+		fclose(fp);
+	}
+
+	EXIT();
+}
+
+// must be called with cache_mutex held
+void NegotiationCache::save() {
+	ENTER();
+
+	if (!mPath)
+		EXIT();
+
+	// write to temporary file and rename it not to leave a broken cache file
+	const size_t len = strlen(mPath) + 5;
+	char *tmp_path = (char *)malloc(len);
+	if (UNLIKELY(!tmp_path))
+		EXIT();
+	snprintf(tmp_path, len, "%s.tmp", mPath);
+
+	FILE *fp = fopen(tmp_path, "wb");
+	if (LIKELY(fp)) {
+		cache_file_header_t header;
+		header.magic = CACHE_MAGIC;
+		header.version = CACHE_VERSION;
+		header.entry_bytes = sizeof(negotiation_entry_t);
+		header.num_entries = num_entries;
+		const bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1)
+			&& (fwrite(entries, sizeof(negotiation_entry_t), num_entries, fp) == (size_t)num_entries);
+		if ((fclose(fp) || !ok) || rename(tmp_path, mPath)) {
+			LOGW("failed to write negotiation cache %s", mPath);
+			unlink(tmp_path);
+		}
+	} else {
+		LOGW("failed to open %s", tmp_path);
+	}
+	free(tmp_path);
+
+	EXIT();
+}
@@ -0,0 +1,83 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: NegotiationCache.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef NEGOTIATIONCACHE_H_
+#define NEGOTIATIONCACHE_H_
+
+#include "libUVCCamera.h"
+#include <pthread.h>
+
+#pragma interface
+
+#define NEGOTIATION_CACHE_MAX_ENTRIES 64
+
+// what was requested from the camera
+typedef struct negotiation_key {
+	uint16_t vendor_id;
+	uint16_t product_id;
+	uint16_t bcd_device;
+	uint16_t mode;			// 0: YUYV, 1: MJPEG
+	uint16_t width;
+	uint16_t height;
+	uint16_t min_fps;
+	uint16_t max_fps;
+	float bandwidth;
+} negotiation_key_t;
+
+// what the camera committed
+typedef struct negotiation_entry {
+	negotiation_key_t key;
+	uvc_stream_ctrl_t ctrl;
+	uint8_t alt_setting;
+} negotiation_entry_t;
+
+/**
+ * process wide cache of committed stream control blocks,
+ * a hit skips probe negotiation so that only the commit is sent to the camera.
+ * Entries are kept in most recently used order and persisted to a file when a path is set.
+ */
+class NegotiationCache {
+private:
+	pthread_mutex_t cache_mutex;
+	char *mPath;
+	negotiation_entry_t entries[NEGOTIATION_CACHE_MAX_ENTRIES];
+	int num_entries;
+	int find(const negotiation_key_t *key);
+	void moveToFront(int index);
+	void load();
+	void save();
+	NegotiationCache();
+	~NegotiationCache();
+public:
+	static NegotiationCache &getInstance();
+	static void makeKey(uvc_device_handle_t *devh, negotiation_key_t *key,
+		int mode, int width, int height, int min_fps, int max_fps, float bandwidth);
+
+	int setPath(const char *path);
+	bool get(const negotiation_key_t *key, uvc_stream_ctrl_t *ctrl, uint8_t *alt_setting);
+	void put(const negotiation_key_t *key, const uvc_stream_ctrl_t *ctrl, uint8_t alt_setting);
+	void remove(const negotiation_key_t *key);
+};
+
+#endif /* NEGOTIATIONCACHE_H_ */
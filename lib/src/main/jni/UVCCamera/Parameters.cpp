@@ -339,6 +339,117 @@ char *UVCDiags::getCurrentStream(const uvc_stream_ctrl_t *ctrl) {
 	RETURN(strdup(buffer.GetString()), char *);
 }
 
+char *UVCDiags::getStreamStats(const uvc_stream_stats_t *stats) {
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+
+	ENTER();
+	writer.StartObject();
+	{
+		write(writer, "transfersCompleted", stats->transfers_completed);
+		write(writer, "transfersFailed", stats->transfers_failed);
+		write(writer, "resubmitFailed", stats->resubmit_failed);
+		write(writer, "packetsError", stats->packets_error);
+		write(writer, "packetsEmpty", stats->packets_empty);
+		write(writer, "headerErrors", stats->header_errors);
+		write(writer, "fidToggles", stats->fid_toggles);
+		write(writer, "oversizeFrames", stats->oversize_frames);
+		write(writer, "framesCompleted", stats->frames_completed);
+		write(writer, "framesBroken", stats->frames_broken);
+		write(writer, "framesDropped", stats->frames_dropped);
+		write(writer, "recoveries", stats->recoveries);
+		write(writer, "transferDepth", stats->transfer_depth);
+		write(writer, "bytesReceived", stats->bytes_received);
+	}
+	writer.EndObject();
+	RETURN(strdup(buffer.GetString()), char *);
+}
+
+static const char *alloc_subsystem_names[UVC_ALLOC_SUBSYSTEM_COUNT] = {
+	"stream", "frame", "preview", "pipeline",
+};
+
+static void writeAllocCounts(Writer<StringBuffer> &writer, const uint32_t *allocs, const size_t *bytes) {
+	for (int i = 0; i < UVC_ALLOC_SUBSYSTEM_COUNT; i++) {
+		writer.String(alloc_subsystem_names[i]);
+		writer.StartObject();
+		{
+			write(writer, "allocs", allocs[i]);
+			write(writer, "bytes", (uint64_t)bytes[i]);
+		}
+		writer.EndObject();
+	}
+}
+
+char *UVCDiags::getAllocStats(const uvc_alloc_stats_t *stats) {
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+
+	ENTER();
+	writer.StartObject();
+	{
+		writeAllocCounts(writer, stats->allocs, stats->bytes);
+		writer.String("threads");
+		writer.StartArray();
+		for (int i = 0; i < stats->num_threads; i++) {
+			const uvc_alloc_thread_stats_t *thread = &stats->threads[i];
+			writer.StartObject();
+			{
+				write(writer, "tid", (int32_t)thread->tid);
+				write(writer, "name", thread->name);
+				writeAllocCounts(writer, thread->allocs, thread->bytes);
+			}
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+	writer.EndObject();
+	RETURN(strdup(buffer.GetString()), char *);
+}
+
+static const char *latency_mode_names[LATENCY_MODE_NUM] = {
+	"fifo", "latest",
+};
+
+static void writePercentiles(Writer<StringBuffer> &writer, const char *name, const latency_percentiles_t *percentiles) {
+	writer.String(name);
+	writer.StartObject();
+	{
+		write(writer, "samples", percentiles->samples);
+		write(writer, "p50", percentiles->p50);
+		write(writer, "p90", percentiles->p90);
+		write(writer, "p99", percentiles->p99);
+		write(writer, "max", percentiles->max);
+	}
+	writer.EndObject();
+}
+
+char *UVCDiags::getLatencyStats(const latency_summary_t *summaries, const int num_modes) {
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+
+	ENTER();
+	writer.StartObject();
+	{
+		for (int i = 0; i < num_modes; i++) {
+			const latency_summary_t *summary = &summaries[i];
+			writer.String(latency_mode_names[i]);
+			writer.StartObject();
+			{
+				write(writer, "frames", summary->frames);
+				write(writer, "dropped", summary->dropped);
+				// microseconds
+				writePercentiles(writer, "queued", &summary->queued);
+				writePercentiles(writer, "usbToDisplay", &summary->complete);
+				writePercentiles(writer, "captureToDisplay", &summary->capture);
+			}
+			writer.EndObject();
+		}
+	}
+	writer.EndObject();
+	RETURN(strdup(buffer.GetString()), char *);
+}
+
 char *UVCDiags::getSupportedSize(const uvc_device_handle_t *deviceHandle) {
 	StringBuffer buffer;
 	Writer<StringBuffer> writer(buffer);
@@ -27,6 +27,7 @@
 #pragma interface
 
 #include "libUVCCamera.h"
+#include "LatencyStats.h"
 
 class UVCDiags {
 private:
@@ -36,6 +37,9 @@ public:
 	char *getDescriptions(const uvc_device_handle_t *deviceHandle);
 	char *getCurrentStream(const uvc_stream_ctrl_t *ctrl);
 	char *getSupportedSize(const uvc_device_handle_t *deviceHandle);
+	char *getStreamStats(const uvc_stream_stats_t *stats);
+	char *getAllocStats(const uvc_alloc_stats_t *stats);
+	char *getLatencyStats(const latency_summary_t *summaries, const int num_modes);
 };
 
 #endif /* PARAMETERS_H_ */
@@ -63,6 +63,7 @@ UVCCamera::UVCCamera()
 	mStatusCallback(NULL),
 	mButtonCallback(NULL),
 	mPreview(NULL),
+	mFrameRing(UVC_ALLOC_PREVIEW),
 	mCtrlSupports(0),
 	mPUSupports(0) {
 
@@ -166,7 +167,7 @@ int UVCCamera::connect(int vid, int pid, int fd, int busnum, int devaddr, const
 				mFd = fd;
 				mStatusCallback = new UVCStatusCallback(mDeviceHandle);
 				mButtonCallback = new UVCButtonCallback(mDeviceHandle);
-				mPreview = new UVCPreview(mDeviceHandle);
+				mPreview = new UVCPreview(mDeviceHandle, &mFrameRing);
 			} else {
 				// open出来なかった時
 				LOGE("could not open camera:err=%d", result);
@@ -255,6 +256,24 @@ int UVCCamera::setPreviewSize(int width, int height, int min_fps, int max_fps, i
 	RETURN(result, int);
 }
 
+int UVCCamera::setTransferConfig(int num_transfers, int packets_per_transfer, bool auto_tune) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setTransferConfig(num_transfers, packets_per_transfer, auto_tune);
+	}
+	RETURN(result, int);
+}
+
+int UVCCamera::setLatencyMode(int mode) {
+	ENTER();
+	int result = EXIT_FAILURE;
+	if (mPreview) {
+		result = mPreview->setLatencyMode(mode);
+	}
+	RETURN(result, int);
+}
+
 int UVCCamera::setPreviewDisplay(ANativeWindow *preview_window) {
 	ENTER();
 	int result = EXIT_FAILURE;
@@ -264,15 +283,24 @@ int UVCCamera::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(result, int);
 }
 
-int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+int UVCCamera::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int width, int height, int num_buffers) {
 	ENTER();
 	int result = EXIT_FAILURE;
 	if (mPreview) {
-		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format);
+		result = mPreview->setFrameCallback(env, frame_callback_obj, pixel_format, width, height, num_buffers);
 	}
 	RETURN(result, int);
 }
 
+/**
+ * return the buffer that was passed to IFrameRingCallback#onFrame, this can be called from any thread
+ * and also after release, the ring is not deleted with mPreview.
+ * UVCCamera#releaseFrame and UVCCamera#destroy of Java are serialized so that this object is alive
+ */
+int UVCCamera::releaseFrame(int index) {
+	return mFrameRing.release(index) ? 0 : UVC_ERROR_INVALID_PARAM;
+}
+
 int UVCCamera::startPreview() {
 	ENTER();
 
@@ -300,6 +328,54 @@ int UVCCamera::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(result, int);
 }
 
+/**
+ * transport statistics of the current preview stream as JSON string
+ * caller must free the returned string
+ */
+char *UVCCamera::getStreamStats() {
+	ENTER();
+	if (mPreview) {
+		uvc_stream_stats_t stats;
+		if (!mPreview->getStreamStats(&stats)) {
+			UVCDiags params;
+			RETURN(params.getStreamStats(&stats), char *)
+		}
+	}
+	RETURN(NULL, char *);
+}
+
+/**
+ * end-to-end latency of the preview frames of each latency mode as JSON string
+ * caller must free the returned string
+ */
+char *UVCCamera::getLatencyStats() {
+	ENTER();
+	if (mPreview) {
+		latency_summary_t summaries[LATENCY_MODE_NUM];
+		for (int i = 0; i < LATENCY_MODE_NUM; i++) {
+			mPreview->getLatencyStats(i, &summaries[i]);
+		}
+		UVCDiags params;
+		RETURN(params.getLatencyStats(summaries, LATENCY_MODE_NUM), char *)
+	}
+	RETURN(NULL, char *);
+}
+
+/**
+ * heap allocations counted after the preview warmed up as JSON string
+ * caller must free the returned string
+ * @return NULL unless libuvc is built with UVC_ALLOC_TRACKING
+ */
+char *UVCCamera::getAllocStats() {
+	ENTER();
+	uvc_alloc_stats_t stats;
+	if (!uvc_get_alloc_stats(&stats)) {
+		UVCDiags params;
+		RETURN(params.getAllocStats(&stats), char *)
+	}
+	RETURN(NULL, char *);
+}
+
 //======================================================================
 // カメラのサポートしているコントロール機能を取得する
 int UVCCamera::getCtrlSupports(uint64_t *supports) {
@@ -117,6 +117,8 @@ class UVCCamera {
 	UVCButtonCallback *mButtonCallback;
 	// プレビュー用
 	UVCPreview *mPreview;
+	// buffers of IFrameRingCallback, Java can keep them over release until destroying this object
+	FrameRing mFrameRing;
 	uint64_t mCtrlSupports;
 	uint64_t mPUSupports;
 	control_value_t mScanningMode;
@@ -189,11 +191,17 @@ public:
 
 	char *getSupportedSize();
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = DEFAULT_BANDWIDTH);
+	int setTransferConfig(int num_transfers, int packets_per_transfer, bool auto_tune);
+	int setLatencyMode(int mode);
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int width = 0, int height = 0, int num_buffers = 0);
+	int releaseFrame(int index);
 	int startPreview();
 	int stopPreview();
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	char *getStreamStats();
+	char *getLatencyStats();
+	static char *getAllocStats();
 
 	int getCtrlSupports(uint64_t *supports);
 	int getProcSupports(uint64_t *supports);
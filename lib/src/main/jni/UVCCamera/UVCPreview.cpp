@@ -43,12 +43,22 @@
 
 #define	LOCAL_DEBUG 0
 #define MAX_FRAME 4
+#define RESERVE_FRAMES (MAX_FRAME * 2)	// decoded frames in the capture queue and in the magazines of the capture thread
 #define PREVIEW_PIXEL_BYTES 4	// RGBA/RGBX
-#define FRAME_POOL_SZ MAX_FRAME + 2
+#define FRAME_RING_SZ 2
+#define FRAME_RING_SZ_LATEST 1	// LATENCY_MODE_LATEST, libuvc keeps only the newest frame too
+#define PREVIEW_BAND_ROWS 16	// rows to decode before drawing them to the Surface
+#define MAX_PREVIEW_DECODE_THREADS 4
+#define SLICE_DECODE_MIN_PIXELS (1280 * 720)	// decode larger frames than this on multiple threads
+#define ALLOC_WARMUP_FRAMES 30	// count the heap allocations after this frames(UVC_ALLOC_TRACKING)
 
-UVCPreview::UVCPreview(uvc_device_handle_t *devh)
+// number of UVCPreview instances, the frame arena is shared by all cameras and pipelines
+static volatile int32_t sNumPreviews = 0;
+
+UVCPreview::UVCPreview(uvc_device_handle_t *devh, FrameRing *frame_ring)
 :	mPreviewWindow(NULL),
 	mCaptureWindow(NULL),
+	mStreamHandle(NULL),
 	mDeviceHandle(devh),
 	requestWidth(DEFAULT_PREVIEW_WIDTH),
 	requestHeight(DEFAULT_PREVIEW_HEIGHT),
@@ -56,6 +66,15 @@ UVCPreview::UVCPreview(uvc_device_handle_t *devh)
 	requestMaxFps(DEFAULT_PREVIEW_FPS_MAX),
 	requestMode(DEFAULT_PREVIEW_MODE),
 	requestBandwidth(DEFAULT_BANDWIDTH),
+	requestTransfers(0),
+	requestPacketsPerTransfer(0),
+	requestAutoTune(false),
+	requestLatencyMode(LATENCY_MODE_FIFO),
+	mNegotiationCached(false),
+	mCachedAltSetting(0),
+	mDecoder(NULL),
+	mPreviewConverter(NULL),
+	mColorSpace(UVC_COLOR_SPACE_BT601_FULL),
 	frameWidth(DEFAULT_PREVIEW_WIDTH),
 	frameHeight(DEFAULT_PREVIEW_HEIGHT),
 	frameBytes(DEFAULT_PREVIEW_WIDTH * DEFAULT_PREVIEW_HEIGHT * 2),	// YUYV
@@ -64,19 +83,25 @@ UVCPreview::UVCPreview(uvc_device_handle_t *devh)
 	previewFormat(WINDOW_FORMAT_RGBA_8888),
 	mIsRunning(false),
 	mIsCapturing(false),
-	captureQueu(NULL),
+	mLatencyMode(LATENCY_MODE_FIFO),
+	mPreviewQueue(MAX_FRAME),
+	mPreviewTakenUs(0),
+	mPreviewFrames(0),
 	mFrameCallbackObj(NULL),
-	mFrameCallbackFunc(NULL),
-	callbackPixelBytes(2) {
+	callbackPixelBytes(2),
+	mCallbackWidth(0),
+	mCallbackHeight(0),
+	mCallbackConverter(NULL),
+	mCallbackBuffers(UVC_ALLOC_PREVIEW),
+	mFrameRingSize(0),
+	mFrameRing(frame_ring) {
 
 	ENTER();
-	pthread_cond_init(&preview_sync, NULL);
 	pthread_mutex_init(&preview_mutex, NULL);
 //
 	pthread_cond_init(&capture_sync, NULL);
 	pthread_mutex_init(&capture_mutex, NULL);
-//	
-	pthread_mutex_init(&pool_mutex, NULL);
+	__sync_add_and_fetch(&sNumPreviews, 1);
 	EXIT();
 }
 
@@ -91,80 +116,44 @@ UVCPreview::~UVCPreview() {
 	mCaptureWindow = NULL;
 	clearPreviewFrame();
 	clearCaptureFrame();
-	clear_pool();
+	if (mCallbackConverter)
+		uvc_converter_destroy(mCallbackConverter);
+	mCallbackConverter = NULL;
 	pthread_mutex_destroy(&preview_mutex);
-	pthread_cond_destroy(&preview_sync);
 	pthread_mutex_destroy(&capture_mutex);
 	pthread_cond_destroy(&capture_sync);
-	pthread_mutex_destroy(&pool_mutex);
+	// uvc_arena_trim frees the free frames of all cameras and pipelines in the depot
+	// including the ones that were reserved in advance, so only trim when the last camera closes
+	if (!__sync_sub_and_fetch(&sNumPreviews, 1)) {
+		uvc_arena_trim();
+	}
 	EXIT();
 }
 
 /**
- * get uvc_frame_t from frame pool
- * if pool is empty, create new frame
- * this function does not confirm the frame size
- * and you may need to confirm the size
+ * get uvc_frame_t from the frame arena, this can be called from any thread
+ * the data buffer is reused without reallocation for the data of similar size
  */
 uvc_frame_t *UVCPreview::get_frame(size_t data_bytes) {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&pool_mutex);
-	{
-		if (!mFramePool.isEmpty()) {
-			frame = mFramePool.last();
-		}
-	}
-	pthread_mutex_unlock(&pool_mutex);
+	uvc_frame_t *frame = uvc_arena_allocate_frame(data_bytes);
 	if UNLIKELY(!frame) {
-		LOGW("allocate new frame");
-		frame = uvc_allocate_frame(data_bytes);
+		LOGW("failed to allocate frame");
 	}
 	return frame;
 }
 
+/**
+ * return the frame to libuvc or the frame arena, this can be called from any thread
+ */
 void UVCPreview::recycle_frame(uvc_frame_t *frame) {
-	pthread_mutex_lock(&pool_mutex);
-	if (LIKELY(mFramePool.size() < FRAME_POOL_SZ)) {
-		mFramePool.put(frame);
-		frame = NULL;
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	if (UNLIKELY(frame)) {
+	if (frame->pool) {
+		// frame came from zero-copy streaming, return it to libuvc
+		uvc_release_frame(frame);
+	} else {
 		uvc_free_frame(frame);
 	}
 }
 
-
-void UVCPreview::init_pool(size_t data_bytes) {
-	ENTER();
-
-	clear_pool();
-	pthread_mutex_lock(&pool_mutex);
-	{
-		for (int i = 0; i < FRAME_POOL_SZ; i++) {
-			mFramePool.put(uvc_allocate_frame(data_bytes));
-		}
-	}
-	pthread_mutex_unlock(&pool_mutex);
-
-	EXIT();
-}
-
-void UVCPreview::clear_pool() {
-	ENTER();
-
-	pthread_mutex_lock(&pool_mutex);
-	{
-		const int n = mFramePool.size();
-		for (int i = 0; i < n; i++) {
-			uvc_free_frame(mFramePool[i]);
-		}
-		mFramePool.clear();
-	}
-	pthread_mutex_unlock(&pool_mutex);
-	EXIT();
-}
-
 inline const bool UVCPreview::isRunning() const {return mIsRunning; }
 
 int UVCPreview::setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth) {
@@ -180,14 +169,52 @@ int UVCPreview::setPreviewSize(int width, int height, int min_fps, int max_fps,
 		requestBandwidth = bandwidth;
 
 		uvc_stream_ctrl_t ctrl;
-		result = uvc_get_stream_ctrl_format_size_fps(mDeviceHandle, &ctrl,
-			!requestMode ? UVC_FRAME_FORMAT_YUYV : UVC_FRAME_FORMAT_MJPEG,
-			requestWidth, requestHeight, requestMinFps, requestMaxFps);
+		negotiation_key_t key;
+		NegotiationCache::makeKey(mDeviceHandle, &key, requestMode,
+			requestWidth, requestHeight, requestMinFps, requestMaxFps, requestBandwidth);
+		// XXX the camera already accepted this mode, skip negotiation just for checking
+		if (!NegotiationCache::getInstance().get(&key, &ctrl, NULL)) {
+			result = negotiate(&ctrl);
+		}
 	}
 	
 	RETURN(result, int);
 }
 
+/**
+ * set transfer queue of the stream, this is applied when the preview starts next time
+ * @param num_transfers number of transfers, 0 for the libuvc default
+ * @param packets_per_transfer upper limit of iso packets (bulk payloads) per transfer, 0 for the libuvc default
+ * @param auto_tune adjust the number of transfers in flight while streaming
+ */
+int UVCPreview::setTransferConfig(int num_transfers, int packets_per_transfer, bool auto_tune) {
+	ENTER();
+
+	if (UNLIKELY((num_transfers < 0) || (num_transfers > LIBUVC_MAX_TRANSFER_BUFS)
+		|| (packets_per_transfer < 0) || (packets_per_transfer > LIBUVC_MAX_PACKETS_PER_TRANSFER)))
+		RETURN(UVC_ERROR_INVALID_PARAM, int);
+	requestTransfers = num_transfers;
+	requestPacketsPerTransfer = packets_per_transfer;
+	requestAutoTune = auto_tune;
+
+	RETURN(0, int);
+}
+
+/**
+ * select how the frames are handed to the preview thread, this is applied when the preview starts next time
+ * @param mode LATENCY_MODE_FIFO: draw all frames in order, may lag behind the camera under load
+ *             LATENCY_MODE_LATEST: draw only the newest frame, drop the frames the preview thread could not catch up with
+ */
+int UVCPreview::setLatencyMode(int mode) {
+	ENTER();
+
+	if (UNLIKELY((mode < 0) || (mode >= LATENCY_MODE_NUM)))
+		RETURN(UVC_ERROR_INVALID_PARAM, int);
+	requestLatencyMode = mode;
+
+	RETURN(0, int);
+}
+
 int UVCPreview::setPreviewDisplay(ANativeWindow *preview_window) {
 	ENTER();
 	pthread_mutex_lock(&preview_mutex);
@@ -206,7 +233,11 @@ int UVCPreview::setPreviewDisplay(ANativeWindow *preview_window) {
 	RETURN(0, int);
 }
 
-int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format) {
+/**
+ * @param num_buffers 0: frame_callback_obj is IFrameCallback
+ * 				>0: frame_callback_obj is IFrameRingCallback, number of the buffers that Java can keep
+ */
+int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int width, int height, int num_buffers) {
 	
 	ENTER();
 	pthread_mutex_lock(&capture_mutex);
@@ -214,11 +245,12 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 		if (isRunning() && isCapturing()) {
 			mIsCapturing = false;
 			if (mFrameCallbackObj) {
-				pthread_cond_signal(&capture_sync);
+				mCaptureMailbox.wakeup();
 				pthread_cond_wait(&capture_sync, &capture_mutex);	// wait finishing capturing
 			}
 		}
-		if (!env->IsSameObject(mFrameCallbackObj, frame_callback_obj))	{
+		if (!env->IsSameObject(mFrameCallbackObj, frame_callback_obj)
+			|| ((mFrameRingSize > 0) != (num_buffers > 0)))	{
 			iframecallback_fields.onFrame = NULL;
 			if (mFrameCallbackObj) {
 				env->DeleteGlobalRef(mFrameCallbackObj);
@@ -229,13 +261,14 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 				jclass clazz = env->GetObjectClass(frame_callback_obj);
 				if (LIKELY(clazz)) {
 					iframecallback_fields.onFrame = env->GetMethodID(clazz,
-						"onFrame",	"(Ljava/nio/ByteBuffer;)V");
+						"onFrame",	num_buffers > 0
+							? "(ILjava/nio/ByteBuffer;IIJ)V" : "(Ljava/nio/ByteBuffer;)V");
 				} else {
 					LOGW("failed to get object class");
 				}
 				env->ExceptionClear();
 				if (!iframecallback_fields.onFrame) {
-					LOGE("Can't find IFrameCallback#onFrame");
+					LOGE("Can't find IFrameCallback#onFrame/IFrameRingCallback#onFrame");
 					env->DeleteGlobalRef(frame_callback_obj);
 					mFrameCallbackObj = frame_callback_obj = NULL;
 				}
@@ -243,6 +276,9 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 		}
 		if (frame_callback_obj) {
 			mPixelFormat = pixel_format;
+			mCallbackWidth = width > 0 ? width : 0;
+			mCallbackHeight = height > 0 ? height : 0;
+			mFrameRingSize = num_buffers > 0 ? num_buffers : 0;
 			callbackPixelFormatChanged();
 		}
 	}
@@ -250,9 +286,18 @@ int UVCPreview::setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pi
 	RETURN(0, int);
 }
 
+/**
+ * update the converter for the callback frame, should be called with capture_mutex
+ */
 void UVCPreview::callbackPixelFormatChanged() {
-	mFrameCallbackFunc = NULL;
-	const size_t sz = requestWidth * requestHeight;
+	enum uvc_frame_format format = UVC_FRAME_FORMAT_YUYV;
+	// the converter crops/scales only when the requested size differs from the frame size
+	const bool sized = mCallbackWidth && mCallbackHeight;
+	uvc_scale_t scale;
+	memset(&scale, 0, sizeof(scale));
+	scale.width = mCallbackWidth & ~1;
+	scale.height = mCallbackHeight;
+	const size_t sz = sized ? scale.width * scale.height : requestWidth * requestHeight;
 	switch (mPixelFormat) {
 	  case PIXEL_FORMAT_RAW:
 		LOGI("PIXEL_FORMAT_RAW:");
@@ -264,24 +309,38 @@ void UVCPreview::callbackPixelFormatChanged() {
 		break;
 	  case PIXEL_FORMAT_RGB565:
 		LOGI("PIXEL_FORMAT_RGB565:");
-		mFrameCallbackFunc = uvc_any2rgb565;
+		format = UVC_FRAME_FORMAT_RGB565;
 		callbackPixelBytes = sz * 2;
 		break;
 	  case PIXEL_FORMAT_RGBX:
 		LOGI("PIXEL_FORMAT_RGBX:");
-		mFrameCallbackFunc = uvc_any2rgbx;
+		format = UVC_FRAME_FORMAT_RGBX;
 		callbackPixelBytes = sz * 4;
 		break;
 	  case PIXEL_FORMAT_YUV20SP:
 		LOGI("PIXEL_FORMAT_YUV20SP:");
-		mFrameCallbackFunc = uvc_yuyv2iyuv420SP;
+		format = UVC_FRAME_FORMAT_NV21;	// same layout as uvc_yuyv2iyuv420SP
 		callbackPixelBytes = (sz * 3) / 2;
 		break;
 	  case PIXEL_FORMAT_NV21:
 		LOGI("PIXEL_FORMAT_NV21:");
-		mFrameCallbackFunc = uvc_yuyv2yuv420SP;
+		format = UVC_FRAME_FORMAT_NV12;	// same layout as uvc_yuyv2yuv420SP
 		callbackPixelBytes = (sz * 3) / 2;
 		break;
+	  case PIXEL_FORMAT_GRAY8:
+		LOGI("PIXEL_FORMAT_GRAY8:");
+		format = UVC_FRAME_FORMAT_GRAY8;
+		callbackPixelBytes = sz;
+		break;
+	}
+	if (mCallbackConverter)
+		uvc_converter_destroy(mCallbackConverter);
+	mCallbackConverter = NULL;
+	if (sized || (format != UVC_FRAME_FORMAT_YUYV)) {
+		mCallbackConverter = uvc_converter_create(format, sized ? &scale : NULL);
+		if (LIKELY(mCallbackConverter)) {
+			uvc_converter_set_color_space(mCallbackConverter, mColorSpace);
+		}
 	}
 }
 
@@ -341,11 +400,8 @@ int UVCPreview::startPreview() {
 		if (UNLIKELY(result != EXIT_SUCCESS)) {
 			LOGW("UVCCamera::window does not exist/already running/could not create thread etc.");
 			mIsRunning = false;
-			pthread_mutex_lock(&preview_mutex);
-			{
-				pthread_cond_signal(&preview_sync);
-			}
-			pthread_mutex_unlock(&preview_mutex);
+			mPreviewQueue.wakeup();
+			mPreviewMailbox.wakeup();
 		}
 	}
 	RETURN(result, int);
@@ -356,8 +412,9 @@ int UVCPreview::stopPreview() {
 	bool b = isRunning();
 	if (LIKELY(b)) {
 		mIsRunning = false;
-		pthread_cond_signal(&preview_sync);
-		pthread_cond_signal(&capture_sync);
+		mPreviewQueue.wakeup();
+		mPreviewMailbox.wakeup();
+		mCaptureMailbox.wakeup();
 		if (pthread_join(capture_thread, NULL) != EXIT_SUCCESS) {
 			LOGW("UVCPreview::terminate capture thread: pthread_join failed");
 		}
@@ -383,12 +440,48 @@ int UVCPreview::stopPreview() {
 	RETURN(0, int);
 }
 
+/**
+ * get transport statistics of the current stream
+ * @return 0 on success, -1 if not streaming
+ */
+int UVCPreview::getStreamStats(uvc_stream_stats_t *stats) {
+	int result = -1;
+	pthread_mutex_lock(&preview_mutex);
+	{
+		if (mStreamHandle && !uvc_stream_get_stats(mStreamHandle, stats)) {
+			result = 0;
+		}
+	}
+	pthread_mutex_unlock(&preview_mutex);
+	return result;
+}
+
+/**
+ * get end-to-end latency of the frames drawn to the preview display,
+ * the statistics of each mode are kept until the preview starts with the mode again
+ * @param mode LATENCY_MODE_XXX
+ */
+int UVCPreview::getLatencyStats(int mode, latency_summary_t *summary) {
+	if (UNLIKELY((mode < 0) || (mode >= LATENCY_MODE_NUM)))
+		return UVC_ERROR_INVALID_PARAM;
+	mLatencyStats[mode].get(summary);
+	return 0;
+}
+
 //**********************************************************************
 //
 //**********************************************************************
+/**
+ * streaming is started with UVC_STREAM_FLAG_ZERO_COPY,
+ * so this callback owns the frame and queues it without copying
+ */
 void UVCPreview::uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args) {
 	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
-	if UNLIKELY(!preview->isRunning() || !frame || !frame->frame_format || !frame->data || !frame->data_bytes) return;
+	if UNLIKELY(!frame) return;
+	if UNLIKELY(!preview->isRunning() || !frame->frame_format || !frame->data || !frame->data_bytes) {
+		uvc_release_frame(frame);
+		return;
+	}
 	if (UNLIKELY(
 		((frame->frame_format != UVC_FRAME_FORMAT_MJPEG) && (frame->actual_bytes < preview->frameBytes))
 		|| (frame->width != preview->frameWidth) || (frame->height != preview->frameHeight) )) {
@@ -398,62 +491,67 @@ void UVCPreview::uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args)
 			frame->frame_format, frame->actual_bytes, preview->frameBytes,
 			frame->width, frame->height, preview->frameWidth, preview->frameHeight);
 #endif
+		uvc_release_frame(frame);
 		return;
 	}
-	if (LIKELY(preview->isRunning())) {
-		uvc_frame_t *copy = preview->get_frame(frame->data_bytes);
-		if (UNLIKELY(!copy)) {
-#if LOCAL_DEBUG
-			LOGE("uvc_callback:unable to allocate duplicate frame!");
-#endif
-			return;
-		}
-		uvc_error_t ret = uvc_duplicate_frame(frame, copy);
-		if (UNLIKELY(ret)) {
-			preview->recycle_frame(copy);
-			return;
-		}
-		preview->addPreviewFrame(copy);
-	}
+	preview->addPreviewFrame(frame);
 }
 
+/**
+ * called from the libuvc callback thread
+ */
 void UVCPreview::addPreviewFrame(uvc_frame_t *frame) {
 
-	pthread_mutex_lock(&preview_mutex);
-	if (isRunning() && (previewFrames.size() < MAX_FRAME)) {
-		previewFrames.put(frame);
-		frame = NULL;
-		pthread_cond_signal(&preview_sync);
-	}
-	pthread_mutex_unlock(&preview_mutex);
-	if (frame) {
-		recycle_frame(frame);
+	if (UNLIKELY(!isRunning())) {
+		// zero-copy frame, return it to libuvc
+		uvc_release_frame(frame);
+	} else if (mLatencyMode == LATENCY_MODE_LATEST) {
+		// the newest frame wins, the one that the preview thread has not taken yet is stale
+		uvc_frame_t *prev = mPreviewMailbox.put(frame);
+		if (prev) {
+			mLatencyStats[LATENCY_MODE_LATEST].drop();
+			uvc_release_frame(prev);
+		}
+	} else if (UNLIKELY(!mPreviewQueue.put(frame))) {
+		mLatencyStats[LATENCY_MODE_FIFO].drop();
+		uvc_release_frame(frame);
 	}
 }
 
+/**
+ * get the next frame to preview, if not exist, block and wait
+ * only call from the preview thread
+ */
 uvc_frame_t *UVCPreview::waitPreviewFrame() {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&preview_mutex);
-	{
-		if (!previewFrames.size()) {
-			pthread_cond_wait(&preview_sync, &preview_mutex);
-		}
-		if (LIKELY(isRunning() && previewFrames.size() > 0)) {
-			frame = previewFrames.remove(0);
-		}
+	uvc_frame_t *frame = mLatencyMode == LATENCY_MODE_LATEST
+		? mPreviewMailbox.waitTake() : mPreviewQueue.waitTake();
+	if (UNLIKELY(frame && !isRunning())) {
+		recycle_frame(frame);
+		frame = NULL;
+	}
+	if (LIKELY(frame)) {
+		mPreviewTakenUs = LatencyStats::now_us();
+	}
+	if (UNLIKELY(frame && (++mPreviewFrames == ALLOC_WARMUP_FRAMES))) {
+		// the stream, the frame arena, the decoder and the converters have their buffers now,
+		// the allocations from here are of the steady state
+		uvc_reset_alloc_stats();
 	}
-	pthread_mutex_unlock(&preview_mutex);
 	return frame;
 }
 
+/**
+ * call from the preview thread or while the preview thread is not running
+ */
 void UVCPreview::clearPreviewFrame() {
-	pthread_mutex_lock(&preview_mutex);
-	{
-		for (int i = 0; i < previewFrames.size(); i++)
-			recycle_frame(previewFrames[i]);
-		previewFrames.clear();
+	uvc_frame_t *frame;
+	while ((frame = mPreviewQueue.take())) {
+		recycle_frame(frame);
+	}
+	frame = mPreviewMailbox.take();
+	if (frame) {
+		recycle_frame(frame);
 	}
-	pthread_mutex_unlock(&preview_mutex);
 }
 
 void *UVCPreview::preview_thread_func(void *vptr_args) {
@@ -462,6 +560,8 @@ void *UVCPreview::preview_thread_func(void *vptr_args) {
 	ENTER();
 	UVCPreview *preview = reinterpret_cast<UVCPreview *>(vptr_args);
 	if (LIKELY(preview)) {
+		// charge the frames, converters and decoders of this thread to the preview
+		uvc_set_alloc_subsystem(UVC_ALLOC_PREVIEW);
 		uvc_stream_ctrl_t ctrl;
 		result = preview->prepare_preview(&ctrl);
 		if (LIKELY(!result)) {
@@ -472,14 +572,26 @@ void *UVCPreview::preview_thread_func(void *vptr_args) {
 	pthread_exit(NULL);
 }
 
+/**
+ * full probe negotiation of the requested mode
+ */
+uvc_error_t UVCPreview::negotiate(uvc_stream_ctrl_t *ctrl) {
+	return uvc_get_stream_ctrl_format_size_fps(mDeviceHandle, ctrl,
+		!requestMode ? UVC_FRAME_FORMAT_YUYV : UVC_FRAME_FORMAT_MJPEG,
+		requestWidth, requestHeight, requestMinFps, requestMaxFps
+	);
+}
+
 int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 	uvc_error_t result;
 
 	ENTER();
-	result = uvc_get_stream_ctrl_format_size_fps(mDeviceHandle, ctrl,
-		!requestMode ? UVC_FRAME_FORMAT_YUYV : UVC_FRAME_FORMAT_MJPEG,
-		requestWidth, requestHeight, requestMinFps, requestMaxFps
-	);
+	NegotiationCache::makeKey(mDeviceHandle, &mNegotiationKey, requestMode,
+		requestWidth, requestHeight, requestMinFps, requestMaxFps, requestBandwidth);
+	// XXX replay the control block that the camera committed last time,
+	// only the commit is sent in do_preview
+	mNegotiationCached = NegotiationCache::getInstance().get(&mNegotiationKey, ctrl, &mCachedAltSetting);
+	result = mNegotiationCached ? UVC_SUCCESS : negotiate(ctrl);
 	if (LIKELY(!result)) {
 #if LOCAL_DEBUG
 		uvc_print_stream_ctrl(ctrl, stderr);
@@ -489,7 +601,9 @@ int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 		if (LIKELY(!result)) {
 			frameWidth = frame_desc->wWidth;
 			frameHeight = frame_desc->wHeight;
-			LOGI("frameSize=(%d,%d)@%s", frameWidth, frameHeight, (!requestMode ? "YUYV" : "MJPEG"));
+			mColorSpace = uvc_get_color_space(frame_desc->parent);
+			LOGI("frameSize=(%d,%d)@%s, color space=%d", frameWidth, frameHeight,
+				(!requestMode ? "YUYV" : "MJPEG"), mColorSpace);
 			pthread_mutex_lock(&preview_mutex);
 			if (LIKELY(mPreviewWindow)) {
 				ANativeWindow_setBuffersGeometry(mPreviewWindow,
@@ -499,6 +613,7 @@ int UVCPreview::prepare_preview(uvc_stream_ctrl_t *ctrl) {
 		} else {
 			frameWidth = requestWidth;
 			frameHeight = requestHeight;
+			mColorSpace = UVC_COLOR_SPACE_BT601_FULL;
 		}
 		frameMode = requestMode;
 		frameBytes = frameWidth * frameHeight * (!requestMode ? 2 : 4);
@@ -514,11 +629,59 @@ void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
 
 	uvc_frame_t *frame = NULL;
 	uvc_frame_t *frame_mjpeg = NULL;
-	uvc_error_t result = uvc_start_streaming_bandwidth(
-		mDeviceHandle, ctrl, uvc_preview_frame_callback, (void *)this, requestBandwidth, 0);
+	uvc_stream_handle_t *strmh = NULL;
+	// the libuvc callback thread reads the mode after the stream started
+	mLatencyMode = requestLatencyMode;
+	mLatencyStats[mLatencyMode].reset();
+	uvc_error_t result = uvc_stream_open_ctrl(mDeviceHandle, &strmh, ctrl);
+	if (UNLIKELY(result && mNegotiationCached)) {
+		// the camera rejected the cached control block, fall back to full negotiation
+		LOGW("cached stream control rejected:err=%d", result);
+		NegotiationCache::getInstance().remove(&mNegotiationKey);
+		mNegotiationCached = false;
+		result = negotiate(ctrl);
+		if (LIKELY(!result)) {
+			result = uvc_stream_open_ctrl(mDeviceHandle, &strmh, ctrl);
+		}
+	}
+	if (LIKELY(!result)) {
+		// keep a few frames in libuvc while the preview thread is busy
+		uvc_stream_set_frame_ring(strmh,
+			mLatencyMode == LATENCY_MODE_LATEST ? FRAME_RING_SZ_LATEST : FRAME_RING_SZ,
+			UVC_FRAME_DROP_OLDEST);
+		result = uvc_stream_set_transfer_config(strmh,
+			requestTransfers, requestPacketsPerTransfer, requestAutoTune);
+		if (UNLIKELY(result)) {
+			LOGW("invalid transfer config, use default:err=%d", result);
+			uvc_stream_set_transfer_config(strmh, 0, 0, 0);
+		}
+		result = uvc_stream_start_bandwidth(strmh, uvc_preview_frame_callback, (void *)this,
+			requestBandwidth, UVC_STREAM_FLAG_ZERO_COPY);
+		if (UNLIKELY(result)) {
+			uvc_stream_close(strmh);
+			if (mNegotiationCached) {
+				// negotiate again next time
+				NegotiationCache::getInstance().remove(&mNegotiationKey);
+			}
+		} else {
+			pthread_mutex_lock(&preview_mutex);
+			mStreamHandle = strmh;
+			pthread_mutex_unlock(&preview_mutex);
+			const uint8_t alt_setting = uvc_stream_get_alt_setting(strmh);
+			if (!mNegotiationCached || (alt_setting != mCachedAltSetting)) {
+				NegotiationCache::getInstance().put(&mNegotiationKey, ctrl, alt_setting);
+			}
+		}
+	}
 
 	if (LIKELY(!result)) {
 		clearPreviewFrame();
+		mPreviewFrames = 0;
+		// converts the whole frames to RGBX for the preview display
+		mPreviewConverter = uvc_converter_create(UVC_FRAME_FORMAT_RGBX, NULL);
+		if (LIKELY(mPreviewConverter)) {
+			uvc_converter_set_color_space(mPreviewConverter, mColorSpace);
+		}
 		pthread_create(&capture_thread, NULL, capture_thread_func, (void *)this);
 
 #if LOCAL_DEBUG
@@ -526,35 +689,81 @@ void UVCPreview::do_preview(uvc_stream_ctrl_t *ctrl) {
 #endif
 		if (frameMode) {
 			// MJPEG mode
+			// keep the decoder while streaming to avoid setting up libjpeg on every frame
+			mDecoder = uvc_mjpeg_decoder_create();
+			if (UNLIKELY(!mDecoder)) {
+				LOGW("failed to create mjpeg decoder");
+			} else if (frameWidth * frameHeight > SLICE_DECODE_MIN_PIXELS) {
+				// decode the large frames in slices when the camera emits restart markers
+				const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+				if (cpus > 1) {
+					uvc_mjpeg_decoder_set_threads(mDecoder, cpus < MAX_PREVIEW_DECODE_THREADS ? cpus : MAX_PREVIEW_DECODE_THREADS);
+				}
+			}
+			// the capture thread frees the decoded frames and returns them a magazine at a time,
+			// keep enough of them in the arena so that the steady state does not depend on the timing
+			uvc_arena_reserve(frameWidth * frameHeight * 2, RESERVE_FRAMES);
 			for ( ; LIKELY(isRunning()) ; ) {
 				frame_mjpeg = waitPreviewFrame();
 				if (LIKELY(frame_mjpeg)) {
 					frame = get_frame(frame_mjpeg->width * frame_mjpeg->height * 2);
-					result = uvc_mjpeg2yuyv(frame_mjpeg, frame);   // MJPEG => yuyv
+					if (LIKELY(mDecoder)) {
+						// MJPEG => yuyv, drawn to the preview display while decoding
+						result = decode_preview_banded(frame_mjpeg, frame);
+					} else {
+						result = uvc_mjpeg2yuyv(frame_mjpeg, frame);   // MJPEG => yuyv
+						if (LIKELY(!result)) {
+							frame = draw_preview_one(frame, &mPreviewWindow, mPreviewConverter, 4);
+						}
+					}
 					recycle_frame(frame_mjpeg);
 					if (LIKELY(!result)) {
-						frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
 						addCaptureFrame(frame);
 					} else {
 						recycle_frame(frame);
 					}
 				}
 			}
+			uvc_mjpeg_decoder_destroy(mDecoder);
+			mDecoder = NULL;
 		} else {
 			// yuvyv mode
 			for ( ; LIKELY(isRunning()) ; ) {
 				frame = waitPreviewFrame();
 				if (LIKELY(frame)) {
-					frame = draw_preview_one(frame, &mPreviewWindow, uvc_any2rgbx, 4);
+					frame = draw_preview_one(frame, &mPreviewWindow, mPreviewConverter, 4);
 					addCaptureFrame(frame);
 				}
 			}
 		}
-		pthread_cond_signal(&capture_sync);
+		mCaptureMailbox.wakeup();
 #if LOCAL_DEBUG
 		LOGI("preview_thread_func:wait for all callbacks complete");
 #endif
+		if (uvc_stream_get_dropped_frames(strmh)) {
+			LOGW("%u frames dropped", uvc_stream_get_dropped_frames(strmh));
+		}
+		uvc_arena_stats_t arena_stats;
+		uvc_arena_get_stats(&arena_stats);
+		LOGI("frame arena:allocs=%u,peak in use=%u,peak reserved=%u", arena_stats.allocs,
+			(unsigned)arena_stats.peak_in_use_bytes, (unsigned)arena_stats.peak_reserved_bytes);
+		uvc_alloc_stats_t alloc_stats;
+		if (!uvc_get_alloc_stats(&alloc_stats)) {
+			LOGI("allocations after warming up:stream=%u,frame=%u,preview=%u,pipeline=%u",
+				alloc_stats.allocs[UVC_ALLOC_STREAM], alloc_stats.allocs[UVC_ALLOC_FRAME],
+				alloc_stats.allocs[UVC_ALLOC_PREVIEW], alloc_stats.allocs[UVC_ALLOC_PIPELINE]);
+		}
+		latency_summary_t latency;
+		mLatencyStats[mLatencyMode].get(&latency);
+		LOGI("latency mode=%d:frames=%u,dropped=%u,usb to display p50=%dus,p99=%dus,capture to display p50=%dus,p99=%dus",
+			mLatencyMode, (unsigned)latency.frames, (unsigned)latency.dropped,
+			latency.complete.p50, latency.complete.p99, latency.capture.p50, latency.capture.p99);
+		pthread_mutex_lock(&preview_mutex);
+		mStreamHandle = NULL;
+		pthread_mutex_unlock(&preview_mutex);
 		uvc_stop_streaming(mDeviceHandle);
+		uvc_converter_destroy(mPreviewConverter);
+		mPreviewConverter = NULL;
 #if LOCAL_DEBUG
 		LOGI("Streaming finished");
 #endif
@@ -571,7 +780,7 @@ static void copyFrame(const uint8_t *src, uint8_t *dest, const int width, int he
 		memcpy(dest, src, width);
 		dest += stride_dest; src += stride_src;
 	}
-	for (int i = 0; i < height; i += 8) {
+	for (int i = h8; i < height; i += 8) {
 		memcpy(dest, src, width);
 		dest += stride_dest; src += stride_src;
 		memcpy(dest, src, width);
@@ -623,8 +832,8 @@ int copyToSurface(uvc_frame_t *frame, ANativeWindow **window) {
 	return result; //RETURN(result, int);
 }
 
-// changed to return original frame instead of returning converted frame even if convert_func is not null.
-uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t convert_func, int pixcelBytes) {
+// changed to return original frame instead of returning converted frame even if converter is not null.
+uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, uvc_converter_t *converter, int pixcelBytes) {
 	// ENTER();
 
 	int b = 0;
@@ -635,14 +844,17 @@ uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **wi
 	pthread_mutex_unlock(&preview_mutex);
 	if (LIKELY(b)) {
 		uvc_frame_t *converted;
-		if (convert_func) {
+		if (converter) {
 			converted = get_frame(frame->width * frame->height * pixcelBytes);
 			if LIKELY(converted) {
-				b = convert_func(frame, converted);
+				b = uvc_converter_convert(converter, frame, converted);
 				if (!b) {
 					pthread_mutex_lock(&preview_mutex);
-					copyToSurface(converted, window);
+					b = copyToSurface(converted, window);
 					pthread_mutex_unlock(&preview_mutex);
+					if (LIKELY(!b)) {
+						previewPosted(frame);
+					}
 				} else {
 					LOGE("failed converting");
 				}
@@ -650,13 +862,129 @@ uvc_frame_t *UVCPreview::draw_preview_one(uvc_frame_t *frame, ANativeWindow **wi
 			}
 		} else {
 			pthread_mutex_lock(&preview_mutex);
-			copyToSurface(frame, window);
+			b = copyToSurface(frame, window);
 			pthread_mutex_unlock(&preview_mutex);
+			if (LIKELY(!b)) {
+				previewPosted(frame);
+			}
 		}
 	}
 	return frame; //RETURN(frame, uvc_frame_t *);
 }
 
+/**
+ * record the latency of the frame that was posted to the preview display
+ * only call from the preview thread
+ */
+void UVCPreview::previewPosted(const uvc_frame_t *frame) {
+	mLatencyStats[mLatencyMode].add(frame, mPreviewTakenUs, LatencyStats::now_us());
+}
+
+/**
+ * wrap the specific buffer as uvc_frame_t without copying,
+ * the converters write rows with the step of the buffer(e.g. stride of ANativeWindow_Buffer)
+ * @param step bytes per row of the buffer
+ */
+static void setup_dest_frame(uvc_frame_t *dest, void *bits,
+	const int width, const int height, const int step, const enum uvc_frame_format format) {
+
+	memset(dest, 0, sizeof(uvc_frame_t));
+	dest->data = bits;
+	dest->data_bytes = dest->actual_bytes = (size_t)step * height;
+	dest->width = width;
+	dest->height = height;
+	dest->step = step;
+	dest->frame_format = format;
+	dest->library_owns_data = 0;
+}
+
+/**
+ * make the view of rows [row, row + rows) of the frame
+ */
+static inline void setup_band_frame(uvc_frame_t *band, const uvc_frame_t *frame, const uint32_t row, const uint32_t rows) {
+	*band = *frame;
+	band->data = (uint8_t *)frame->data + frame->step * row;
+	band->data_bytes = band->actual_bytes = frame->step * rows;
+	band->height = rows;
+	band->library_owns_data = 0;
+	band->pool = NULL;
+	band->ref_count = 0;
+	band->alloc_bytes = 0;
+}
+
+typedef struct band_draw {
+	convFunc_t convert;
+	uvc_frame_t dest;
+	int errors;
+} band_draw_t;
+
+/**
+ * band callback of uvc_mjpeg_decode_banded,
+ * convert the decoded rows into the destination while they are in the cache
+ */
+static void draw_band(uvc_frame_t *frame, uint32_t row, uint32_t rows, void *vptr_args) {
+	band_draw_t *draw = reinterpret_cast<band_draw_t *>(vptr_args);
+	if (UNLIKELY((row >= draw->dest.height) || (frame->width > draw->dest.width))) return;
+	if (rows > draw->dest.height - row) {
+		rows = draw->dest.height - row;
+	}
+	uvc_frame_t src, dest;
+	setup_band_frame(&src, frame, row, rows);
+	setup_band_frame(&dest, &draw->dest, row, rows);
+	if (UNLIKELY(draw->convert(&src, &dest))) {
+		draw->errors++;
+	}
+}
+
+/**
+ * decode MJPEG frame into yuyv frame and draw it to the preview display band by band
+ * instead of converting the whole frame to RGBX and copying it to the Surface
+ * @return result of decoding
+ */
+uvc_error_t UVCPreview::decode_preview_banded(uvc_frame_t *frame_mjpeg, uvc_frame_t *frame) {
+	ANativeWindow *window;
+	uvc_error_t result;
+
+	pthread_mutex_lock(&preview_mutex);
+	{
+		// keep the reference so that we need not hold preview_mutex while decoding
+		window = mPreviewWindow;
+		if (window)
+			ANativeWindow_acquire(window);
+	}
+	pthread_mutex_unlock(&preview_mutex);
+	if (UNLIKELY(!window)) {
+		return uvc_mjpeg_decode(mDecoder, frame_mjpeg, frame, UVC_FRAME_FORMAT_YUYV);
+	}
+	ANativeWindow_Buffer buffer;
+	if (LIKELY((ANativeWindow_getWidth(window) >= (int32_t)frame_mjpeg->width)
+		&& (ANativeWindow_lock(window, &buffer, NULL) == 0))) {
+
+		band_draw_t draw;
+		draw.convert = uvc_any2rgbx;	// decoded as BT.601 full range
+		draw.errors = 0;
+		setup_dest_frame(&draw.dest, buffer.bits, buffer.width, buffer.height,
+			buffer.stride * PREVIEW_PIXEL_BYTES, UVC_FRAME_FORMAT_RGBX);
+		result = uvc_mjpeg_decode_banded(mDecoder, frame_mjpeg, frame, UVC_FRAME_FORMAT_YUYV,
+			PREVIEW_BAND_ROWS, draw_band, &draw);
+		ANativeWindow_unlockAndPost(window);
+		if (UNLIKELY(draw.errors)) {
+			LOGE("failed converting");
+		} else if (LIKELY(!result)) {
+			previewPosted(frame_mjpeg);
+		}
+	} else {
+		// the Surface is narrower than the frame or could not be locked,
+		// fall back to whole frame drawing
+		result = uvc_mjpeg_decode(mDecoder, frame_mjpeg, frame, UVC_FRAME_FORMAT_YUYV);
+		if (LIKELY(!result)) {
+			draw_preview_one(frame, &mPreviewWindow, mPreviewConverter, 4);
+		}
+	}
+	ANativeWindow_release(window);
+	return result;
+}
+
 //======================================================================
 //
 //======================================================================
@@ -669,7 +997,7 @@ int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 		if (isRunning() && isCapturing()) {
 			mIsCapturing = false;
 			if (mCaptureWindow) {
-				pthread_cond_signal(&capture_sync);
+				mCaptureMailbox.wakeup();
 				pthread_cond_wait(&capture_sync, &capture_mutex);	// wait finishing capturing
 			}
 		}
@@ -700,49 +1028,40 @@ int UVCPreview::setCaptureDisplay(ANativeWindow *capture_window) {
 	RETURN(0, int);
 }
 
+/**
+ * pass the frame to the capture thread, only call from the preview thread
+ */
 void UVCPreview::addCaptureFrame(uvc_frame_t *frame) {
-	pthread_mutex_lock(&capture_mutex);
 	if (LIKELY(isRunning())) {
 		// keep only latest one
-		if (captureQueu) {
-			recycle_frame(captureQueu);
-		}
-		captureQueu = frame;
-		pthread_cond_broadcast(&capture_sync);
+		frame = mCaptureMailbox.put(frame);
+	}
+	if (frame) {
+		recycle_frame(frame);
 	}
-	pthread_mutex_unlock(&capture_mutex);
 }
 
 /**
  * get frame data for capturing, if not exist, block and wait
+ * only call from the capture thread
  */
 uvc_frame_t *UVCPreview::waitCaptureFrame() {
-	uvc_frame_t *frame = NULL;
-	pthread_mutex_lock(&capture_mutex);
-	{
-		if (!captureQueu) {
-			pthread_cond_wait(&capture_sync, &capture_mutex);
-		}
-		if (LIKELY(isRunning() && captureQueu)) {
-			frame = captureQueu;
-			captureQueu = NULL;
-		}
+	uvc_frame_t *frame = mCaptureMailbox.waitTake();
+	if (UNLIKELY(frame && !isRunning())) {
+		recycle_frame(frame);
+		frame = NULL;
 	}
-	pthread_mutex_unlock(&capture_mutex);
 	return frame;
 }
 
 /**
  * clear drame data for capturing
+ * call from the capture thread or while the capture thread is not running
  */
 void UVCPreview::clearCaptureFrame() {
-	pthread_mutex_lock(&capture_mutex);
-	{
-		if (captureQueu)
-			recycle_frame(captureQueu);
-		captureQueu = NULL;
-	}
-	pthread_mutex_unlock(&capture_mutex);
+	uvc_frame_t *frame = mCaptureMailbox.take();
+	if (frame)
+		recycle_frame(frame);
 }
 
 //======================================================================
@@ -759,6 +1078,7 @@ void *UVCPreview::capture_thread_func(void *vptr_args) {
 	if (LIKELY(preview)) {
 		JavaVM *vm = getVM();
 		JNIEnv *env;
+		uvc_set_alloc_subsystem(UVC_ALLOC_PREVIEW);
 		// attach to JavaVM
 		vm->AttachCurrentThread(&env, NULL);
 		preview->do_capture(env);	// never return until finish previewing
@@ -778,7 +1098,11 @@ void UVCPreview::do_capture(JNIEnv *env) {
 	ENTER();
 
 	clearCaptureFrame();
-	callbackPixelFormatChanged();
+	pthread_mutex_lock(&capture_mutex);
+	{
+		callbackPixelFormatChanged();
+	}
+	pthread_mutex_unlock(&capture_mutex);
 	for (; isRunning() ;) {
 		mIsCapturing = true;
 		if (mCaptureWindow) {
@@ -786,8 +1110,16 @@ void UVCPreview::do_capture(JNIEnv *env) {
 		} else {
 			do_capture_idle_loop(env);
 		}
+		// under the mutex so that setFrameCallback/setCaptureDisplay never miss this
+		pthread_mutex_lock(&capture_mutex);
 		pthread_cond_broadcast(&capture_sync);
+		pthread_mutex_unlock(&capture_mutex);
 	}	// end of for (; isRunning() ;)
+	mCallbackBuffers.clear(env);
+	if (mFrameRing->dropped()) {
+		LOGW("%u callback frames dropped, IFrameRingCallback kept all buffers", mFrameRing->dropped());
+	}
+	mFrameRing->clear(env);
 	EXIT();
 }
 
@@ -809,8 +1141,13 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 
 	uvc_frame_t *frame = NULL;
 	uvc_frame_t *converted = NULL;
+	uvc_converter_t *converter = uvc_converter_create(UVC_FRAME_FORMAT_RGBX, NULL);
 	char *local_picture_path;
 
+	if (LIKELY(converter)) {
+		uvc_converter_set_color_space(converter, mColorSpace);
+	}
+
 	for (; isRunning() && isCapturing() ;) {
 		frame = waitCaptureFrame();
 		if (LIKELY(frame)) {
@@ -819,8 +1156,8 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 				if (UNLIKELY(!converted)) {
 					converted = get_frame(previewBytes);
 				}
-				if (LIKELY(converted)) {
-					int b = uvc_any2rgbx(frame, converted);
+				if (LIKELY(converted && converter)) {
+					int b = uvc_converter_convert(converter, frame, converted);
 					if (!b) {
 						if (LIKELY(mCaptureWindow)) {
 							copyToSurface(converted, &mCaptureWindow);
@@ -834,6 +1171,7 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 	if (converted) {
 		recycle_frame(converted);
 	}
+	uvc_converter_destroy(converter);
 	if (mCaptureWindow) {
 		ANativeWindow_release(mCaptureWindow);
 		mCaptureWindow = NULL;
@@ -843,19 +1181,63 @@ void UVCPreview::do_capture_surface(JNIEnv *env) {
 }
 
 /**
-* call IFrameCallback#onFrame if needs
+ * write the frame to a buffer of the ring for IFrameRingCallback, should be called with capture_mutex
+ * @return index of the buffer, -1 if the frame is dropped
+ */
+int32_t UVCPreview::prepare_ring_frame(JNIEnv *env, uvc_frame_t *frame, jobject *buf) {
+	int32_t index = -1;
+
+	*buf = NULL;
+	if (LIKELY(mFrameRing->prepare(env, mFrameRingSize, callbackPixelBytes))) {
+		index = mFrameRing->acquire();
+	}
+	if (LIKELY(index >= 0)) {
+		uvc_frame_t *ring_frame = mFrameRing->frame(index);
+		const int b = mCallbackConverter
+			? uvc_converter_convert(mCallbackConverter, frame, ring_frame)
+			: uvc_duplicate_frame(frame, ring_frame);
+		if (LIKELY(!b)) {
+			*buf = mFrameRing->buffer(env, index, callbackPixelBytes);
+		} else {
+			LOGW("failed to convert for callback frame");
+		}
+		if (UNLIKELY(!*buf)) {
+			mFrameRing->release(index);
+			index = -1;
+		}
+	}
+	return index;
+}
+
+/**
+ * call IFrameCallback#onFrame/IFrameRingCallback#onFrame if needs,
+ * Java code runs without capture_mutex so that setFrameCallback/setCaptureDisplay
+ * do not wait for it
  */
 void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 	ENTER();
-	pthread_mutex_lock(&capture_mutex);
 	if (LIKELY(frame)) {
 		uvc_frame_t *callback_frame = frame;
+		jobject callback = NULL;
+		jmethodID onFrame = NULL;
+		jobject buf = NULL;
+		int32_t index = -1;
+		pthread_mutex_lock(&capture_mutex);
 		if (mFrameCallbackObj) {
-			if (mFrameCallbackFunc) {
+			if (mFrameRingSize) {
+				// the frame is written to the buffer of the ring that Java keeps until releasing it
+				index = prepare_ring_frame(env, frame, &buf);
+				if (LIKELY(index >= 0)) {
+					callback_frame = mFrameRing->frame(index);
+					recycle_frame(frame);
+					frame = NULL;
+				}
+			} else if (mCallbackConverter) {
 				callback_frame = get_frame(callbackPixelBytes);
 				if (LIKELY(callback_frame)) {
-					int b = mFrameCallbackFunc(frame, callback_frame);
+					int b = uvc_converter_convert(mCallbackConverter, frame, callback_frame);
 					recycle_frame(frame);
+					frame = NULL;
 					if (UNLIKELY(b)) {
 						LOGW("failed to convert for callback frame");
 						goto SKIP;
@@ -866,14 +1248,40 @@ void UVCPreview::do_capture_callback(JNIEnv *env, uvc_frame_t *frame) {
 					goto SKIP;
 				}
 			}
-			jobject buf = env->NewDirectByteBuffer(callback_frame->data, callbackPixelBytes);
-			env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
-			env->ExceptionClear();
-			env->DeleteLocalRef(buf);
+			if (!mFrameRingSize) {
+				buf = mCallbackBuffers.get(env, callback_frame->data, callbackPixelBytes);
+			}
+			if (LIKELY(buf)) {
+				// keep the callback object even if setFrameCallback replaces it while calling
+				callback = env->NewLocalRef(mFrameCallbackObj);
+				onFrame = iframecallback_fields.onFrame;
+			}
 		}
  SKIP:
-		recycle_frame(callback_frame);
+		pthread_mutex_unlock(&capture_mutex);
+		if (callback) {
+			if (index >= 0) {
+				const jlong capture_time_us = callback_frame->capture_time.tv_sec * 1000000LL
+					+ callback_frame->capture_time.tv_usec;
+				env->CallVoidMethod(callback, onFrame, index, buf,
+					(jint)callback_frame->width, (jint)callback_frame->height, capture_time_us);
+				// Java returns the buffer with UVCCamera#releaseFrame
+				callback_frame = NULL;
+			} else {
+				env->CallVoidMethod(callback, onFrame, buf);
+			}
+			env->ExceptionClear();
+			env->DeleteLocalRef(callback);
+		} else if (index >= 0) {
+			mFrameRing->release(index);
+			callback_frame = NULL;
+		}
+		if (callback_frame && (callback_frame != frame)) {
+			recycle_frame(callback_frame);
+		}
+		if (frame) {
+			recycle_frame(frame);
+		}
 	}
-	pthread_mutex_unlock(&capture_mutex);
 	EXIT();
 }
@@ -28,7 +28,11 @@
 #include "libUVCCamera.h"
 #include <pthread.h>
 #include <android/native_window.h>
-#include "objectarray.h"
+#include "spscqueue.h"
+#include "DirectBufferCache.h"
+#include "FrameRing.h"
+#include "LatencyStats.h"
+#include "NegotiationCache.h"
 
 #pragma interface
 
@@ -47,6 +51,7 @@ typedef uvc_error_t (*convFunc_t)(uvc_frame_t *in, uvc_frame_t *out);
 #define PIXEL_FORMAT_RGBX 3
 #define PIXEL_FORMAT_YUV20SP 4
 #define PIXEL_FORMAT_NV21 5		// YVU420SemiPlanar
+#define PIXEL_FORMAT_GRAY8 6	// luma only
 
 // for callback to Java object
 typedef struct {
@@ -61,13 +66,27 @@ private:
 	int requestWidth, requestHeight, requestMode;
 	int requestMinFps, requestMaxFps;
 	float requestBandwidth;
+	int requestTransfers, requestPacketsPerTransfer;
+	bool requestAutoTune;
+	int requestLatencyMode;
+	negotiation_key_t mNegotiationKey;
+	bool mNegotiationCached;
+	uint8_t mCachedAltSetting;
 	int frameWidth, frameHeight;
 	int frameMode;
 	size_t frameBytes;
 	pthread_t preview_thread;
+	uvc_stream_handle_t *mStreamHandle;	// only access with preview_mutex
 	pthread_mutex_t preview_mutex;
-	pthread_cond_t preview_sync;
-	ObjectArray<uvc_frame_t *> previewFrames;
+	int mLatencyMode;					// LATENCY_MODE_XXX while previewing
+	SpscQueue<uvc_frame_t *> mPreviewQueue;	// libuvc callback thread => preview thread, LATENCY_MODE_FIFO
+	SpscMailbox<uvc_frame_t *> mPreviewMailbox;	// libuvc callback thread => preview thread, LATENCY_MODE_LATEST
+	LatencyStats mLatencyStats[LATENCY_MODE_NUM];
+	int64_t mPreviewTakenUs;			// time the preview thread took the current frame, only access from preview thread
+	uint32_t mPreviewFrames;			// frames taken by the preview thread since startPreview
+	uvc_mjpeg_decoder_t *mDecoder;		// only access from preview thread
+	uvc_converter_t *mPreviewConverter;	// only access from preview thread
+	enum uvc_color_space mColorSpace;	// color space of the uncompressed frames
 	int previewFormat;
 	size_t previewBytes;
 //
@@ -75,20 +94,20 @@ private:
 	ANativeWindow *mCaptureWindow;
 	pthread_t capture_thread;
 	pthread_mutex_t capture_mutex;
-	pthread_cond_t capture_sync;
-	uvc_frame_t *captureQueu;			// keep latest frame
+	pthread_cond_t capture_sync;		// only for changing the capture settings
+	SpscMailbox<uvc_frame_t *> mCaptureMailbox;	// preview thread => capture thread, keep latest frame
 	jobject mFrameCallbackObj;
-	convFunc_t mFrameCallbackFunc;
 	Fields_iframecallback iframecallback_fields;
 	int mPixelFormat;
 	size_t callbackPixelBytes;
-// improve performance by reducing memory allocation
-	pthread_mutex_t pool_mutex;
-	ObjectArray<uvc_frame_t *> mFramePool;
+	int mCallbackWidth, mCallbackHeight;	// 0 means same as the frame size
+	uvc_converter_t *mCallbackConverter;	// NULL if the frame is passed as is, only access with capture_mutex
+	DirectBufferCache mCallbackBuffers;	// IFrameCallback, only access from capture thread
+	int mFrameRingSize;					// number of buffers for IFrameRingCallback, 0 for IFrameCallback, only access with capture_mutex
+	FrameRing *mFrameRing;				// IFrameRingCallback, owned by UVCCamera, only access from capture thread
+// improve performance by reducing memory allocation, the frames come from the shared frame arena of libuvc
 	uvc_frame_t *get_frame(size_t data_bytes);
 	void recycle_frame(uvc_frame_t *frame);
-	void init_pool(size_t data_bytes);
-	void clear_pool();
 //
 	void clearDisplay();
 	static void uvc_preview_frame_callback(uvc_frame_t *frame, void *vptr_args);
@@ -96,9 +115,12 @@ private:
 	uvc_frame_t *waitPreviewFrame();
 	void clearPreviewFrame();
 	static void *preview_thread_func(void *vptr_args);
+	uvc_error_t negotiate(uvc_stream_ctrl_t *ctrl);
 	int prepare_preview(uvc_stream_ctrl_t *ctrl);
 	void do_preview(uvc_stream_ctrl_t *ctrl);
-	uvc_frame_t *draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, convFunc_t func, int pixelBytes);
+	uvc_frame_t *draw_preview_one(uvc_frame_t *frame, ANativeWindow **window, uvc_converter_t *converter, int pixelBytes);
+	uvc_error_t decode_preview_banded(uvc_frame_t *frame_mjpeg, uvc_frame_t *frame);
+	void previewPosted(const uvc_frame_t *frame);
 //
 	void addCaptureFrame(uvc_frame_t *frame);
 	uvc_frame_t *waitCaptureFrame();
@@ -107,20 +129,25 @@ private:
 	void do_capture(JNIEnv *env);
 	void do_capture_surface(JNIEnv *env);
 	void do_capture_idle_loop(JNIEnv *env);
+	int32_t prepare_ring_frame(JNIEnv *env, uvc_frame_t *frame, jobject *buf);
 	void do_capture_callback(JNIEnv *env, uvc_frame_t *frame);
 	void callbackPixelFormatChanged();
 public:
-	UVCPreview(uvc_device_handle_t *devh);
+	UVCPreview(uvc_device_handle_t *devh, FrameRing *frame_ring);
 	~UVCPreview();
 
 	inline const bool isRunning() const;
 	int setPreviewSize(int width, int height, int min_fps, int max_fps, int mode, float bandwidth = 1.0f);
+	int setTransferConfig(int num_transfers, int packets_per_transfer, bool auto_tune);
+	int setLatencyMode(int mode);
 	int setPreviewDisplay(ANativeWindow *preview_window);
-	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format);
+	int setFrameCallback(JNIEnv *env, jobject frame_callback_obj, int pixel_format, int width = 0, int height = 0, int num_buffers = 0);
 	int startPreview();
 	int stopPreview();
 	inline const bool isCapturing() const;
 	int setCaptureDisplay(ANativeWindow *capture_window);
+	int getStreamStats(uvc_stream_stats_t *stats);
+	int getLatencyStats(int mode, latency_summary_t *summary);
 };
 
 #endif /* UVCPREVIEW_H_ */
@@ -23,7 +23,8 @@ AbstractBufferedPipeline::AbstractBufferedPipeline(const int &_max_buffer_num, c
 	max_buffer_num(_max_buffer_num),
 	init_pool_num(_init_pool_num),
 	drop_frames(drop_frames_when_buffer_empty),
-	total_frame_num(0)
+	total_frame_num(0),
+	frame_buffers(_max_buffer_num)
 {
 	ENTER();
 
@@ -47,7 +48,6 @@ int AbstractBufferedPipeline::release() {
 	setState(PIPELINE_STATE_RELEASING);
 	stop();
 	clear_frames();
-	clear_pool();
 	setState(PIPELINE_STATE_UNINITIALIZED);
 
 	RETURN(0, int);
@@ -89,7 +89,11 @@ int AbstractBufferedPipeline::stop() {
 	if (LIKELY(b)) {
 		setState(PIPELINE_STATE_STOPPING);
 		mIsRunning = false;
-		pool_sync.broadcast();
+		pool_mutex.lock();
+		{
+			pool_sync.broadcast();
+		}
+		pool_mutex.unlock();
 		buffer_sync.broadcast();
 		LOGD("pthread_join:handler_thread");
 		if (pthread_join(handler_thread, NULL) != EXIT_SUCCESS) {
@@ -108,7 +112,11 @@ int AbstractBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 	ENTER();
 
 	int ret = UVC_ERROR_OTHER;
-	if (LIKELY(frame)) {
+	if (frame && frame->pool) {
+		// frame came from zero-copy streaming, share it instead of duplicating
+		uvc_frame_t *leased = uvc_lease_frame(frame);
+		ret = LIKELY(leased) ? add_frame(leased) : UVC_ERROR_NO_MEM;
+	} else if (LIKELY(frame)) {
 		// get empty frame from frame pool
 		uvc_frame_t *copy = get_frame(frame->data_bytes);
 		if (UNLIKELY(!copy)) {
@@ -132,40 +140,43 @@ int AbstractBufferedPipeline::queueFrame(uvc_frame_t *frame) {
 //
 //********************************************************************************
 /**
- * get uvc_frame_t from frame pool
- * if pool is empty, create new frame
- * this function does not confirm the frame size
- * and you may need to confirm the size
+ * count up total_frame_num if it does not exceed max_buffer_num
+ */
+bool AbstractBufferedPipeline::reserve_frame() {
+	uint32_t n = total_frame_num;
+	while (n < max_buffer_num) {
+		if (__sync_bool_compare_and_swap(&total_frame_num, n, n + 1)) {
+			return true;
+		}
+		n = total_frame_num;
+	}
+	return false;
+}
+
+/**
+ * get uvc_frame_t from the frame arena
+ * if max_buffer_num frames are already in use, return NULL
+ * or wait for recycling when the frames should not be dropped
  */
 uvc_frame_t *AbstractBufferedPipeline::get_frame(const size_t &data_bytes) {
 	uvc_frame_t *frame = NULL;
-	Mutex::Autolock lock(pool_mutex);
 
-	if (UNLIKELY(frame_pool.empty() && (total_frame_num < max_buffer_num))) {
-		uint32_t n = total_frame_num * 2;
-		if (n > max_buffer_num) {
-			n = max_buffer_num;
-		}
-		n -= total_frame_num;
-		if (LIKELY(n > 0)) {
-			for (int i = 0; i < n; i++) {
-				frame = uvc_allocate_frame(data_bytes);
-				total_frame_num++;
-			}
-			LOGW("allocate new frame:%d", total_frame_num);
-		} else {
-			LOGW("number of allocated frame exceeds limit");
-		}
-	}
-	if (UNLIKELY(frame_pool.empty() && !drop_frames)) {
-		// if pool is empty and need to block(avoid dropping frames), wait frame recycling.
-		for (; mIsRunning && frame_pool.empty() ; ) {
+	bool reserved = reserve_frame();
+	if (UNLIKELY(!reserved && !drop_frames)) {
+		// if the limit is reached and need to block(avoid dropping frames), wait frame recycling.
+		Mutex::Autolock lock(pool_mutex);
+		for (; mIsRunning && !(reserved = reserve_frame()) ; ) {
 			pool_sync.wait(pool_mutex);
 		}
 	}
-	if (!frame_pool.empty()) {
-		frame = frame_pool.front();
-		frame_pool.pop_front();
+	if (LIKELY(reserved)) {
+		frame = uvc_arena_allocate_frame(data_bytes);
+		if (UNLIKELY(!frame)) {
+			LOGW("failed to allocate new frame:%d", total_frame_num);
+			__sync_sub_and_fetch(&total_frame_num, 1);
+		}
+	} else {
+		LOGW("number of allocated frame exceeds limit");
 	}
 
 	return frame;
@@ -174,62 +185,36 @@ uvc_frame_t *AbstractBufferedPipeline::get_frame(const size_t &data_bytes) {
 void AbstractBufferedPipeline::recycle_frame(uvc_frame_t *frame) {
 	ENTER();
 
-	if (LIKELY(frame)) {
-		Mutex::Autolock lock(pool_mutex);
-		if (LIKELY(frame_pool.size() < max_buffer_num)) {
-			frame_pool.push_back(frame);
-			frame = NULL;
-		}
-		if (UNLIKELY(frame)) {
-			// if pool overflowed
-			total_frame_num--;
-			uvc_free_frame(frame);
+	if (frame && frame->pool) {
+		// leased frame, drop our reference
+		uvc_release_frame(frame);
+	} else if (LIKELY(frame)) {
+		// return to the frame arena
+		uvc_free_frame(frame);
+		__sync_sub_and_fetch(&total_frame_num, 1);
+		if (UNLIKELY(!drop_frames)) {
+			Mutex::Autolock lock(pool_mutex);
+			pool_sync.signal();
 		}
-		pool_sync.signal();
 	}
 
 	EXIT();
 }
 
+/**
+ * allocate the frames in the frame arena in advance
+ */
 void AbstractBufferedPipeline::init_pool(const size_t &data_bytes) {
 	ENTER();
 
-	uvc_frame_t *frame = NULL;
-
-	clear_pool();
-	pool_mutex.lock();
-	{
-
-		size_t frame_sz = data_bytes / 4;	// expects 25%, this will be able to much lower
-		if (!frame_sz) {
-			frame_sz = DEFAULT_FRAME_SZ;
-		}
-		for (uint32_t i = 0; i < init_pool_num; i++) {
-			frame = uvc_allocate_frame(frame_sz);
-			if (LIKELY(frame)) {
-				frame_pool.push_back(frame);
-				total_frame_num++;
-			} else {
-				LOGW("failed to allocate new frame:%d", total_frame_num);
-				break;
-			}
-		}
+	size_t frame_sz = data_bytes / 4;	// expects 25%, this will be able to much lower
+	if (!frame_sz) {
+		frame_sz = DEFAULT_FRAME_SZ;
 	}
-	pool_mutex.unlock();
-
-	EXIT();
-}
-
-void AbstractBufferedPipeline::clear_pool() {
-	ENTER();
-
-	Mutex::Autolock lock(pool_mutex);
-
-	for (auto iter = frame_pool.begin(); iter != frame_pool.end(); iter++) {
-		total_frame_num--;
-		uvc_free_frame(*iter);
+	if (UNLIKELY((uint32_t)uvc_arena_reserve(frame_sz, init_pool_num) < init_pool_num)) {
+		LOGW("failed to reserve frames:%d", init_pool_num);
 	}
-	frame_pool.clear();
+
 	EXIT();
 }
 
@@ -240,8 +225,8 @@ void AbstractBufferedPipeline::clear_pool() {
 void AbstractBufferedPipeline::clear_frames() {
 	Mutex::Autolock lock(buffer_mutex);
 
-	for (auto iter = frame_buffers.begin(); iter != frame_buffers.end(); iter++) {
-		recycle_frame(*iter);
+	for (int i = 0; i < frame_buffers.size(); i++) {
+		recycle_frame(frame_buffers[i]);
 	}
 	frame_buffers.clear();
 }
@@ -252,19 +237,11 @@ int AbstractBufferedPipeline::add_frame(uvc_frame_t *frame) {
 	buffer_mutex.lock();
 	{
 		// FIXME as current implementation, transferring frame data on my device is slower than that coming from UVC camera... just drop them now
-		if (frame_buffers.size() > max_buffer_num) {
-			// erase old frames
-			int cnt = 0;
-			for (auto iter = frame_buffers.begin();
-				 (iter != frame_buffers.end()) && (cnt < 5); iter++, cnt++) {
-				recycle_frame(*iter);
-				iter = frame_buffers.erase(iter);
-			}
-			LOGW("droped frame data");
-		}
-		if (isRunning() && (frame_buffers.size() < max_buffer_num)) {
-			frame_buffers.push_back(frame);
+		if (isRunning() && ((uint32_t)frame_buffers.size() < max_buffer_num)) {
+			frame_buffers.put(frame);
 			frame = NULL;
+		} else if (isRunning()) {
+			LOGW("droped frame data");
 		}
 		buffer_sync.signal();
 	}
@@ -281,12 +258,11 @@ uvc_frame_t *AbstractBufferedPipeline::wait_frame() {
 
 	Mutex::Autolock lock(buffer_mutex);
 
-	if (!frame_buffers.size()) {
+	if (frame_buffers.isEmpty()) {
 		buffer_sync.wait(buffer_mutex);
 	}
-	if (LIKELY(isRunning() && frame_buffers.size() > 0)) {
-		frame = frame_buffers.front();
-		frame_buffers.pop_front();
+	if (LIKELY(isRunning() && !frame_buffers.isEmpty())) {
+		frame = frame_buffers.remove(0);
 	}
 	return frame;
 }
@@ -308,6 +284,8 @@ void *AbstractBufferedPipeline::handler_thread_func(void *vptr_args) {
 	ENTER();
 	AbstractBufferedPipeline *pipeline = reinterpret_cast<AbstractBufferedPipeline *>(vptr_args);
 	if (LIKELY(pipeline)) {
+		// charge the frames of this thread to the pipeline
+		uvc_set_alloc_subsystem(UVC_ALLOC_PIPELINE);
 		pipeline->do_loop();
 	}
 	PRE_EXIT();
@@ -7,11 +7,11 @@
 
 #include <stdlib.h>
 #include <pthread.h>
-#include <list>
 #include "Mutex.h"
 #include "Condition.h"
 
 #include "libUVCCamera.h"
+#include "objectarray.h"
 #include "IPipeline.h"
 
 #pragma interface
@@ -28,17 +28,18 @@ private:
 	const uint32_t max_buffer_num;
 	const uint32_t init_pool_num;
 	const bool drop_frames;
-	volatile uint32_t total_frame_num;
+	volatile uint32_t total_frame_num;	// frames taken from the frame arena and not recycled yet
 
-// frame buffer pool to improve performance by reducing memory allocation
+// the frames come from the shared frame arena of libuvc to improve performance by reducing memory allocation,
+// pool_mutex/pool_sync are only used to wait for recycling when the frames should not be dropped
 	mutable Mutex pool_mutex;
 	Condition pool_sync;
-	std::list<uvc_frame_t *> frame_pool;
+	bool reserve_frame();
 // frame buffers
 	pthread_t handler_thread;
 	mutable Mutex buffer_mutex;
 	Condition buffer_sync;
-	std::list<uvc_frame_t *> frame_buffers;
+	ObjectArray<uvc_frame_t *> frame_buffers;	// fixed capacity of max_buffer_num, never allocates while running
 	static void *handler_thread_func(void *vptr_args);
 
 protected:
@@ -46,7 +47,6 @@ protected:
 	uvc_frame_t *get_frame(const size_t &data_bytes);
 	void recycle_frame(uvc_frame_t *frame);
 	void init_pool(const size_t &data_bytes);
-	void clear_pool();
 // frame buffers
 	void clear_frames();
 	int add_frame(uvc_frame_t *frame);
@@ -26,8 +26,9 @@
 
 CallbackPipeline::CallbackPipeline(const size_t &_data_bytes)
 :	CaptureBasePipeline(MAX_FRAME_NUM, INIT_FRAME_POOL_SZ, _data_bytes),
-	mFrameCallbackFunc(NULL),
-	callbackPixelBytes(0)
+	mCallbackConverter(NULL),
+	callbackPixelBytes(0),
+	mCallbackBuffers(UVC_ALLOC_PIPELINE)
 {
 	ENTER();
 
@@ -39,6 +40,10 @@ CallbackPipeline::CallbackPipeline(const size_t &_data_bytes)
 CallbackPipeline::~CallbackPipeline() {
 	ENTER();
 
+	if (mCallbackConverter)
+		uvc_converter_destroy(mCallbackConverter);
+	mCallbackConverter = NULL;
+
 	EXIT();
 }
 
@@ -84,7 +89,7 @@ int CallbackPipeline::setFrameCallback(JNIEnv *env, jobject frame_callback_obj,
 }
 
 void CallbackPipeline::callbackPixelFormatChanged(const uint32_t &width, const uint32_t &height) {
-	mFrameCallbackFunc = NULL;
+	enum uvc_frame_format format = UVC_FRAME_FORMAT_UNKNOWN;
 	const size_t sz = width * height;
 	switch (mPixelFormat) {
 	  case PIXEL_FORMAT_RAW:
@@ -93,30 +98,38 @@ void CallbackPipeline::callbackPixelFormatChanged(const uint32_t &width, const u
 		break;
 	  case PIXEL_FORMAT_YUV:
 		LOGI("PIXEL_FORMAT_YUV:");
-		mFrameCallbackFunc = uvc_any2yuyv;
+		format = UVC_FRAME_FORMAT_YUYV;
 		callbackPixelBytes = sz * 2;
 		break;
 	  case PIXEL_FORMAT_RGB565:
 		LOGI("PIXEL_FORMAT_RGB565:");
-		mFrameCallbackFunc = uvc_any2rgb565;
+		format = UVC_FRAME_FORMAT_RGB565;
 		callbackPixelBytes = sz * 2;
 		break;
 	  case PIXEL_FORMAT_RGBX:
 		LOGI("PIXEL_FORMAT_RGBX:");
-		mFrameCallbackFunc = uvc_any2rgbx;
+		format = UVC_FRAME_FORMAT_RGBX;
 		callbackPixelBytes = sz * 4;
 		break;
 	  case PIXEL_FORMAT_YUV20SP:
 		LOGI("PIXEL_FORMAT_YUV20SP:");
-		mFrameCallbackFunc = uvc_any2yuv420SP;
+		format = UVC_FRAME_FORMAT_NV12;
 		callbackPixelBytes = (sz * 3) / 2;
 		break;
 	  case PIXEL_FORMAT_NV21:
 		LOGI("PIXEL_FORMAT_NV21:");
-		mFrameCallbackFunc = uvc_any2iyuv420SP;
+		format = UVC_FRAME_FORMAT_NV21;
 		callbackPixelBytes = (sz * 3) / 2;
 		break;
+	  case PIXEL_FORMAT_GRAY8:
+		LOGI("PIXEL_FORMAT_GRAY8:");
+		format = UVC_FRAME_FORMAT_GRAY8;
+		callbackPixelBytes = sz;
+		break;
 	}
+	if (mCallbackConverter)
+		uvc_converter_destroy(mCallbackConverter);
+	mCallbackConverter = format != UVC_FRAME_FORMAT_UNKNOWN ? uvc_converter_create(format, NULL) : NULL;
 }
 
 void CallbackPipeline::do_capture(JNIEnv *env) {
@@ -142,19 +155,20 @@ void CallbackPipeline::do_capture(JNIEnv *env) {
 				if (mFrameCallbackObj) {
 					callback_frame = frame;
 					sz = frame->actual_bytes;
-					if (mFrameCallbackFunc) {
+					if (mCallbackConverter) {
 						callback_frame = temp;
 						sz = callbackPixelBytes;
-						int b = mFrameCallbackFunc(frame, temp);
+						int b = uvc_converter_convert(mCallbackConverter, frame, temp);
 						if (UNLIKELY(b)) {
 							LOGW("failed to convert to callback frame");
 							goto SKIP;
 						}
 					}
-					jobject buf = env->NewDirectByteBuffer(callback_frame->data, callbackPixelBytes);
-					env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
-					env->ExceptionClear();
-					env->DeleteLocalRef(buf);
+					jobject buf = mCallbackBuffers.get(env, callback_frame->data, callbackPixelBytes);
+					if (LIKELY(buf)) {
+						env->CallVoidMethod(mFrameCallbackObj, iframecallback_fields.onFrame, buf);
+						env->ExceptionClear();
+					}
 				}
 SKIP:
 				recycle_frame(frame);
@@ -162,6 +176,7 @@ SKIP:
 		}
 		recycle_frame(temp);
 	}
+	mCallbackBuffers.clear(env);
 
 	EXIT();
 }
@@ -6,15 +6,17 @@
 #define PUPILMOBILE_CALLBACKPIPELINE_H
 
 #include "libUVCCamera.h"
+#include "DirectBufferCache.h"
 #include "CaptureBasePipeline.h"
 
 class CallbackPipeline : virtual public CaptureBasePipeline {
 private:
 	jobject mFrameCallbackObj;
-	convFunc_t mFrameCallbackFunc;
+	uvc_converter_t *mCallbackConverter;
 	Fields_iframecallback iframecallback_fields;
 	int mPixelFormat;
 	size_t callbackPixelBytes;
+	DirectBufferCache mCallbackBuffers;	// only access from capture thread
 	void callbackPixelFormatChanged(const uint32_t &width, const uint32_t &height);
 protected:
 	virtual void do_capture(JNIEnv *env);
@@ -135,7 +135,13 @@ void CaptureBasePipeline::on_stop() {
 int CaptureBasePipeline::handle_frame(uvc_frame_t *frame) {
 //	ENTER();
 
-	if (LIKELY(frame)) {
+	if (frame && frame->pool) {
+		// frame came from zero-copy streaming, share it instead of duplicating
+		uvc_frame_t *leased = uvc_lease_frame(frame);
+		if (LIKELY(leased)) {
+			addCaptureFrame(leased);
+		}
+	} else if (LIKELY(frame)) {
 		// get empty frame from frame pool
 		uvc_frame_t *copy = get_frame(frame->data_bytes);
 		if (LIKELY(copy)) {
@@ -168,6 +174,7 @@ void *CaptureBasePipeline::capture_thread_func(void *vptr_args) {
 	if (LIKELY(pipeline)) {
 		JavaVM *vm = getVM();
 		JNIEnv *env;
+		uvc_set_alloc_subsystem(UVC_ALLOC_PIPELINE);
 		// attach to JavaVM
 		vm->AttachCurrentThread(&env, NULL);
 		pipeline->internal_do_capture(env);	// never return until finish streaming
@@ -28,11 +28,11 @@
 ConvertPipeline::ConvertPipeline(const size_t &_data_bytes, const int &_target_pixel_format)
 :	AbstractBufferedPipeline(MAX_FRAME_NUM, INIT_FRAME_POOL_SZ, _data_bytes),
 	target_pixel_format(_target_pixel_format),
-	mFrameConvFunc(NULL)
+	mConverter(NULL)
 {
 	ENTER();
 
-	updateConvFunc();
+	updateConverter();
 	setState(PIPELINE_STATE_INITIALIZED);
 
 	EXIT();
@@ -42,39 +42,50 @@ ConvertPipeline::ConvertPipeline(const size_t &_data_bytes, const int &_target_p
 ConvertPipeline::~ConvertPipeline() {
 	ENTER();
 
+	if (mConverter)
+		uvc_converter_destroy(mConverter);
+	mConverter = NULL;
+
 	EXIT();
 }
 
-void ConvertPipeline::updateConvFunc() {
+void ConvertPipeline::updateConverter() {
 	ENTER();
 
 	Mutex::Autolock lock(pipeline_mutex);
-	mFrameConvFunc = NULL;
+	enum uvc_frame_format format = UVC_FRAME_FORMAT_UNKNOWN;
 	switch (target_pixel_format) {
 		case PIXEL_FORMAT_RAW:
 			LOGI("PIXEL_FORMAT_RAW:");
 			break;
 		case PIXEL_FORMAT_YUV:
 			LOGI("PIXEL_FORMAT_YUV:");
-			mFrameConvFunc = uvc_any2yuyv;
+			format = UVC_FRAME_FORMAT_YUYV;
 			break;
 		case PIXEL_FORMAT_RGB565:
 			LOGI("PIXEL_FORMAT_RGB565:");
-			mFrameConvFunc = uvc_any2rgb565;
+			format = UVC_FRAME_FORMAT_RGB565;
 			break;
 		case PIXEL_FORMAT_RGBX:
 			LOGI("PIXEL_FORMAT_RGBX:");
-			mFrameConvFunc = uvc_any2rgbx;
+			format = UVC_FRAME_FORMAT_RGBX;
 			break;
 		case PIXEL_FORMAT_YUV20SP:
 			LOGI("PIXEL_FORMAT_YUV20SP:");
-			mFrameConvFunc = uvc_any2yuv420SP;
+			format = UVC_FRAME_FORMAT_NV12;
 			break;
 		case PIXEL_FORMAT_NV21:
 			LOGI("PIXEL_FORMAT_NV21:");
-			mFrameConvFunc = uvc_any2iyuv420SP;
+			format = UVC_FRAME_FORMAT_NV21;
+			break;
+		case PIXEL_FORMAT_GRAY8:
+			LOGI("PIXEL_FORMAT_GRAY8:");
+			format = UVC_FRAME_FORMAT_GRAY8;
 			break;
 	}
+	if (mConverter)
+		uvc_converter_destroy(mConverter);
+	mConverter = format != UVC_FRAME_FORMAT_UNKNOWN ? uvc_converter_create(format, NULL) : NULL;
 
 	EXIT();
 };
@@ -82,7 +93,7 @@ void ConvertPipeline::updateConvFunc() {
 void ConvertPipeline::on_start() {
 	ENTER();
 
-	updateConvFunc();
+	updateConverter();
 
 	EXIT();
 }
@@ -100,10 +111,10 @@ int ConvertPipeline::handle_frame(uvc_frame_t *frame) {
 
 	if (next_pipeline) {
 		uvc_frame_t *copy = frame;
-		if (mFrameConvFunc) {
+		if (mConverter) {
 			copy = get_frame(frame->actual_bytes);
 			if (LIKELY(copy)) {
-				const uvc_error_t r = mFrameConvFunc(frame, copy);
+				const uvc_error_t r = uvc_converter_convert(mConverter, frame, copy);
 				if (UNLIKELY(r)) {
 					LOGW("failed to convert:%d", r);
 					recycle_frame(copy);
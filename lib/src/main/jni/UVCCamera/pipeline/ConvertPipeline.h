@@ -11,8 +11,8 @@
 class ConvertPipeline : virtual public AbstractBufferedPipeline {
 private:
 	const int target_pixel_format;
-	convFunc_t mFrameConvFunc;
-	void updateConvFunc();
+	uvc_converter_t *mConverter;
+	void updateConverter();
 protected:
 	virtual void on_start();
 	virtual void on_stop();
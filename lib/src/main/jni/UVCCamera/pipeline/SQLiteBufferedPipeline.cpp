@@ -259,6 +259,8 @@ void *SQLiteBufferedPipeline::handler_thread_func(void *vptr_args) {
 	ENTER();
 	SQLiteBufferedPipeline *pipeline = reinterpret_cast<SQLiteBufferedPipeline *>(vptr_args);
 	if (LIKELY(pipeline)) {
+		// charge the frames of this thread to the pipeline
+		uvc_set_alloc_subsystem(UVC_ALLOC_PIPELINE);
 		pipeline->do_loop();
 	}
 	PRE_EXIT();
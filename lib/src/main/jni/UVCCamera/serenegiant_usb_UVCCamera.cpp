@@ -226,6 +226,30 @@ static jint nativeSetPreviewSize(JNIEnv *env, jobject thiz,
 	RETURN(JNI_ERR, jint);
 }
 
+// 転送キューの設定
+static jint nativeSetTransferConfig(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint num_transfers, jint packets_per_transfer, jboolean auto_tune) {
+
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		return camera->setTransferConfig(num_transfers, packets_per_transfer, auto_tune);
+	}
+	RETURN(JNI_ERR, jint);
+}
+
+// プレビューのレイテンシーモードの設定
+static jint nativeSetLatencyMode(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint mode) {
+
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		return camera->setLatencyMode(mode);
+	}
+	RETURN(JNI_ERR, jint);
+}
+
 static jint nativeStartPreview(JNIEnv *env, jobject thiz,
 	ID_TYPE id_camera) {
 
@@ -264,18 +288,43 @@ static jint nativeSetPreviewDisplay(JNIEnv *env, jobject thiz,
 }
 
 static jint nativeSetFrameCallback(JNIEnv *env, jobject thiz,
-	ID_TYPE id_camera, jobject jIFrameCallback, jint pixel_format) {
+	ID_TYPE id_camera, jobject jIFrameCallback, jint pixel_format, jint width, jint height) {
 
 	jint result = JNI_ERR;
 	ENTER();
 	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
 	if (LIKELY(camera)) {
 		jobject frame_callback_obj = env->NewGlobalRef(jIFrameCallback);
-		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format);
+		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format, width, height);
+	}
+	RETURN(result, jint);
+}
+
+static jint nativeSetFrameRingCallback(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jobject jIFrameRingCallback, jint pixel_format, jint width, jint height, jint num_buffers) {
+
+	jint result = JNI_ERR;
+	ENTER();
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		jobject frame_callback_obj = env->NewGlobalRef(jIFrameRingCallback);
+		result = camera->setFrameCallback(env, frame_callback_obj, pixel_format, width, height,
+			jIFrameRingCallback ? num_buffers : 0);
 	}
 	RETURN(result, jint);
 }
 
+// called for every frame, so without ENTER/RETURN
+static jint nativeReleaseFrame(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera, jint index) {
+
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		return camera->releaseFrame(index);
+	}
+	return JNI_ERR;
+}
+
 static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	ID_TYPE id_camera, jobject jSurface) {
 
@@ -289,6 +338,70 @@ static jint nativeSetCaptureDisplay(JNIEnv *env, jobject thiz,
 	RETURN(result, jint);
 }
 
+//======================================================================
+// ネゴシエーションキャッシュの保存先を設定
+static jint nativeSetNegotiationCacheFile(JNIEnv *env, jobject thiz,
+	jstring path_str) {
+
+	ENTER();
+	const char *c_path = path_str ? env->GetStringUTFChars(path_str, JNI_FALSE) : NULL;
+	int result = NegotiationCache::getInstance().setPath(c_path);
+	if (c_path) {
+		env->ReleaseStringUTFChars(path_str, c_path);
+	}
+	RETURN(result, jint);
+}
+
+//======================================================================
+// heap allocations after warming up the preview as JSON string, only on the debug build with UVC_ALLOC_TRACKING
+static jobject nativeGetAllocStats(JNIEnv *env, jobject thiz) {
+
+	ENTER();
+	jstring result = NULL;
+	char *c_str = UVCCamera::getAllocStats();
+	if (LIKELY(c_str)) {
+		result = env->NewStringUTF(c_str);
+		free(c_str);
+	}
+	RETURN(result, jobject);
+}
+
+//======================================================================
+// end-to-end latency of the preview frames of each latency mode as JSON string
+static jobject nativeGetLatencyStats(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	ENTER();
+	jstring result = NULL;
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		char *c_str = camera->getLatencyStats();
+		if (LIKELY(c_str)) {
+			result = env->NewStringUTF(c_str);
+			free(c_str);
+		}
+	}
+	RETURN(result, jobject);
+}
+
+//======================================================================
+// transport statistics of the preview stream as JSON string
+static jobject nativeGetStreamStats(JNIEnv *env, jobject thiz,
+	ID_TYPE id_camera) {
+
+	ENTER();
+	jstring result = NULL;
+	UVCCamera *camera = reinterpret_cast<UVCCamera *>(id_camera);
+	if (LIKELY(camera)) {
+		char *c_str = camera->getStreamStats();
+		if (LIKELY(c_str)) {
+			result = env->NewStringUTF(c_str);
+			free(c_str);
+		}
+	}
+	RETURN(result, jobject);
+}
+
 //======================================================================
 // カメラコントロールでサポートしている機能を取得する
 static jlong nativeGetCtrlSupports(JNIEnv *env, jobject thiz,
@@ -2024,12 +2137,20 @@ static JNINativeMethod methods[] = {
 
 	{ "nativeGetSupportedSize",			"(J)Ljava/lang/String;", (void *) nativeGetSupportedSize },
 	{ "nativeSetPreviewSize",			"(JIIIIIF)I", (void *) nativeSetPreviewSize },
+	{ "nativeSetTransferConfig",		"(JIIZ)I", (void *) nativeSetTransferConfig },
+	{ "nativeSetLatencyMode",			"(JI)I", (void *) nativeSetLatencyMode },
 	{ "nativeStartPreview",				"(J)I", (void *) nativeStartPreview },
 	{ "nativeStopPreview",				"(J)I", (void *) nativeStopPreview },
 	{ "nativeSetPreviewDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetPreviewDisplay },
-	{ "nativeSetFrameCallback",			"(JLcom/serenegiant/usb/IFrameCallback;I)I", (void *) nativeSetFrameCallback },
+	{ "nativeSetFrameCallback",			"(JLcom/serenegiant/usb/IFrameCallback;III)I", (void *) nativeSetFrameCallback },
+	{ "nativeSetFrameRingCallback",		"(JLcom/serenegiant/usb/IFrameRingCallback;IIII)I", (void *) nativeSetFrameRingCallback },
+	{ "nativeReleaseFrame",				"(JI)I", (void *) nativeReleaseFrame },
 
 	{ "nativeSetCaptureDisplay",		"(JLandroid/view/Surface;)I", (void *) nativeSetCaptureDisplay },
+	{ "nativeGetStreamStats",			"(J)Ljava/lang/String;", (void *) nativeGetStreamStats },
+	{ "nativeGetLatencyStats",			"(J)Ljava/lang/String;", (void *) nativeGetLatencyStats },
+	{ "nativeSetNegotiationCacheFile",	"(Ljava/lang/String;)I", (void *) nativeSetNegotiationCacheFile },
+	{ "nativeGetAllocStats",			"()Ljava/lang/String;", (void *) nativeGetAllocStats },
 
 	{ "nativeGetCtrlSupports",			"(J)J", (void *) nativeGetCtrlSupports },
 	{ "nativeGetProcSupports",			"(J)J", (void *) nativeGetProcSupports },
@@ -0,0 +1,233 @@
+/*
+ * UVCCamera
+ * library and sample to access to UVC web camera on non-rooted Android device
+ *
+ * Copyright (c) 2014-2017 saki t_saki@serenegiant.com
+ *
+ * File name: spscqueue.h
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * All files in the folder are under this Apache License, Version 2.0.
+ * Files in the jni/libjpeg, jni/libusb, jin/libuvc, jni/rapidjson folder may have a different license, see the respective files.
+*/
+
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "utilbase.h"
+
+/**
+ * futex based wakeup of one waiting thread.
+ * notify() issues the system call only when the other thread sleeps,
+ * so the handoff costs a few atomic operations while both threads are busy.
+ */
+class SpscWaiter {
+private:
+	volatile int32_t m_seq;			// futex word, changed on every notify/kick
+	volatile int32_t m_waiting;		// the consumer sleeps or is about to sleep
+	volatile int32_t m_kicked;		// sticky wakeup request from kick()
+
+	inline void wake() {
+		__atomic_add_fetch(&m_seq, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&m_waiting, __ATOMIC_SEQ_CST)) {
+			syscall(__NR_futex, &m_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+		}
+	}
+public:
+	SpscWaiter() : m_seq(0), m_waiting(0), m_kicked(0) {}
+
+	/**
+	 * producer side, call after publishing the data
+	 */
+	inline void notify() { wake(); }
+	/**
+	 * wake the consumer even if nothing was published e.g. to stop it,
+	 * the request is kept until the next wait so that it is never lost
+	 */
+	inline void kick() {
+		__atomic_store_n(&m_kicked, 1, __ATOMIC_SEQ_CST);
+		wake();
+	}
+	/**
+	 * consumer side, call before checking whether there is something to do
+	 * @return token for wait
+	 */
+	inline int32_t prepare() {
+		__atomic_store_n(&m_waiting, 1, __ATOMIC_SEQ_CST);
+		return __atomic_load_n(&m_seq, __ATOMIC_SEQ_CST);
+	}
+	/**
+	 * consumer side, there was something to do after prepare
+	 */
+	inline void cancel() {
+		__atomic_store_n(&m_waiting, 0, __ATOMIC_SEQ_CST);
+	}
+	/**
+	 * consumer side, block until notify/kick,
+	 * returns immediately if either was called after prepare
+	 * @param seq return value of prepare
+	 * @return false if woken by kick()
+	 */
+	bool wait(const int32_t seq) {
+		bool result = !__atomic_exchange_n(&m_kicked, 0, __ATOMIC_SEQ_CST);
+		if (result) {
+			syscall(__NR_futex, &m_seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+			result = !__atomic_exchange_n(&m_kicked, 0, __ATOMIC_SEQ_CST);
+		}
+		__atomic_store_n(&m_waiting, 0, __ATOMIC_SEQ_CST);
+		return result;
+	}
+};
+
+/**
+ * bounded lock-free queue of one producer thread and one consumer thread.
+ * Only the producer calls put, only the consumer calls take/waitTake.
+ * @param T pointer type
+ */
+template <class T>
+class SpscQueue {
+private:
+	T *m_elements;
+	const uint32_t m_mask;		// capacity - 1, the capacity is power of 2
+	volatile uint32_t m_head;	// next index to take, written only by the consumer
+	volatile uint32_t m_tail;	// next index to put, written only by the producer
+	SpscWaiter m_waiter;
+
+	static uint32_t roundup(uint32_t n) {
+		uint32_t result = 2;
+		while (result < n) result <<= 1;
+		return result;
+	}
+	inline bool hasElements() const {
+		return __atomic_load_n(&m_head, __ATOMIC_RELAXED)
+			!= __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+	}
+public:
+	SpscQueue(int capacity)
+		: m_mask(roundup(capacity) - 1),
+		  m_head(0),
+		  m_tail(0) {
+		m_elements = new T[m_mask + 1];
+	}
+	~SpscQueue() { SAFE_DELETE_ARRAY(m_elements); }
+
+	inline int capacity() const { return m_mask + 1; }
+	inline int size() const {
+		return __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+	}
+	/**
+	 * producer side
+	 * @return false if the queue is full, the caller still owns the object
+	 */
+	bool put(T object) {
+		const uint32_t tail = m_tail;
+		if (UNLIKELY(tail - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) > m_mask))
+			return false;
+		m_elements[tail & m_mask] = object;
+		__atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+		m_waiter.notify();
+		return true;
+	}
+	/**
+	 * consumer side, never blocks
+	 * @return NULL if the queue is empty
+	 */
+	T take() {
+		const uint32_t head = m_head;
+		if (head == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE))
+			return NULL;
+		T object = m_elements[head & m_mask];
+		__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+		return object;
+	}
+	/**
+	 * consumer side, block until an object is put or wakeup() is called
+	 * @return NULL if woken without any object
+	 */
+	T waitTake() {
+		T object = take();
+		if (!object) {
+			const int32_t seq = m_waiter.prepare();
+			if (hasElements()) {
+				m_waiter.cancel();
+			} else {
+				m_waiter.wait(seq);
+			}
+			object = take();
+		}
+		return object;
+	}
+	/**
+	 * let the consumer return from waitTake e.g. when stopping
+	 */
+	inline void wakeup() { m_waiter.kick(); }
+};
+
+/**
+ * single slot handoff of one producer thread and one consumer thread,
+ * a new object replaces the one that the consumer has not taken yet.
+ * @param T pointer type
+ */
+template <class T>
+class SpscMailbox {
+private:
+	T volatile m_slot;
+	SpscWaiter m_waiter;
+public:
+	SpscMailbox() : m_slot(NULL) {}
+
+	/**
+	 * producer side
+	 * @return the object that was replaced (not taken by the consumer), the caller owns it
+	 */
+	T put(T object) {
+		T prev = __atomic_exchange_n(&m_slot, object, __ATOMIC_ACQ_REL);
+		m_waiter.notify();
+		return prev;
+	}
+	/**
+	 * consumer side (or either side after both threads stopped), never blocks
+	 */
+	inline T take() {
+		return __atomic_exchange_n(&m_slot, (T)NULL, __ATOMIC_ACQ_REL);
+	}
+	/**
+	 * consumer side, block until an object is put or wakeup() is called
+	 * @return NULL if woken without any object
+	 */
+	T waitTake() {
+		T object = take();
+		if (!object) {
+			const int32_t seq = m_waiter.prepare();
+			if (__atomic_load_n(&m_slot, __ATOMIC_ACQUIRE)) {
+				m_waiter.cancel();
+			} else {
+				m_waiter.wait(seq);
+			}
+			object = take();
+		}
+		return object;
+	}
+	/**
+	 * let the consumer return from waitTake e.g. when stopping
+	 */
+	inline void wakeup() { m_waiter.kick(); }
+};
+
+#endif /* SPSCQUEUE_H_ */
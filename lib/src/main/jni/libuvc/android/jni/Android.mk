@@ -62,14 +62,25 @@ LOCAL_SHARED_LIBRARIES += jpeg-turbo1500
 LOCAL_SHARED_LIBRARIES += usb100
 
 LOCAL_SRC_FILES := \
+	src/alloc-track.c \
+	src/clock.c \
 	src/ctrl.c \
 	src/device.c \
 	src/diag.c \
 	src/frame.c \
+	src/frame-convert.c \
+	src/frame-arena.c \
 	src/frame-mjpeg.c \
 	src/init.c \
 	src/stream.c
 
+# SIMD kernels of the color conversion, NEON is optional on ARMv7
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES += src/frame-simd.c.neon
+else
+LOCAL_SRC_FILES += src/frame-simd.c
+endif
+
 LOCAL_MODULE := libuvc_static
 include $(BUILD_STATIC_LIBRARY)
 
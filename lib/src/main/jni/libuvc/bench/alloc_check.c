@@ -0,0 +1,556 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Host check that the frame code of libuvc does not allocate in the steady state.
+ * One thread plays the preview thread of UVCPreview: it takes the MJPEG frames
+ * from a frame pool like the zero-copy stream, decodes them on multiple threads
+ * into the frames of the arena and converts them for the display.
+ * Another thread plays the capture thread: it converts the frames for the callback
+ * (scaled with BT.709 and through uvc_any2format) and returns them to the arena.
+ * Both threads charge their allocations to the preview like UVCPreview does.
+ * The allocations are counted after warming up, any allocation is a failure.
+ * Besides the UVC_ALLOC_TRACK call sites, this program replaces malloc and its family
+ * of glibc to count every heap call of the process including those of libjpeg,
+ * so that the allocations that no call site reports fail the check too.
+ * Then one thread allocates frames that another thread frees, the arena should
+ * move them through the depot a magazine at a time, not with a lock per frame.
+ *
+ * usage: uvc_alloc_check [--frames N]
+ * Built with UVC_ALLOC_TRACKING, see CMakeLists.txt in this directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <jpeglib.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define WARMUP_FRAMES 30
+#define DEFAULT_FRAMES 300
+#define DECODE_THREADS 4
+#define QUEUE_SZ 4
+#define FLOW_FRAMES 1000
+// slack of the locks for warming up and for the magazines left in the threads
+#define FLOW_SLACK_LOCKS 16
+
+#ifndef __GLIBC__
+#error "uvc_alloc_check counts the heap calls through the malloc of glibc"
+#endif
+
+/*
+ * Replacement of malloc and its family of glibc, the definitions in the executable
+ * take precedence over libc for the shared libraries too (libjpeg, libc itself).
+ * The memory still comes from the allocator of glibc through its __libc_ entries.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+// count the heap calls only while set, between warming up and stopping
+static volatile int heap_counting;
+static uint32_t heap_allocs;
+static uint32_t heap_frees;
+static size_t heap_bytes;
+
+static inline void count_alloc(const size_t bytes) {
+	if (heap_counting) {
+		__sync_add_and_fetch(&heap_allocs, 1);
+		__sync_add_and_fetch(&heap_bytes, bytes);
+	}
+}
+
+void *malloc(size_t size) {
+	count_alloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	count_alloc(nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	count_alloc(size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	if (ptr && heap_counting)
+		__sync_add_and_fetch(&heap_frees, 1);
+	__libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+	count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+	void *ptr;
+
+	if (!alignment || (alignment & (alignment - 1)) || (alignment % sizeof(void *)))
+		return EINVAL;
+	count_alloc(size);
+	ptr = __libc_memalign(alignment, size);
+	if (!ptr)
+		return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
+
+void *valloc(size_t size) {
+	count_alloc(size);
+	return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size) {
+	count_alloc(size);
+	return __libc_pvalloc(size);
+}
+
+static const char *subsystem_names[UVC_ALLOC_SUBSYSTEM_COUNT] = {
+	"stream", "frame", "preview", "pipeline",
+};
+
+typedef struct check_context {
+	uvc_frame_t *mjpeg;				// source frame that the camera would send
+	uvc_frame_pool_t *pool;
+	uvc_mjpeg_decoder_t *decoder;
+	uvc_converter_t *preview_converter;
+	uvc_converter_t *callback_converter;
+	int num_frames;
+	// preview thread => capture thread, drops the oldest frame when full
+	pthread_mutex_t mutex;
+	pthread_cond_t sync;
+	uvc_frame_t *queue[QUEUE_SZ];
+	int head, count;
+	int running;
+	int errors;
+} check_context_t;
+
+/** MJPEG frame like the UVC cameras send: 4:2:2 with a restart marker every MCU row */
+static uvc_frame_t *make_mjpeg(const uint32_t width, const uint32_t height) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *buf = NULL;
+	unsigned long size = 0;
+	uint8_t *row_buf = malloc(width * 3);
+	uvc_frame_t *frame = NULL;
+	JSAMPROW row = row_buf;
+	uint32_t x;
+
+	if (!row_buf)
+		return NULL;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buf, &size);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	cinfo.comp_info[0].h_samp_factor = 2;
+	cinfo.comp_info[0].v_samp_factor = 1;
+	cinfo.restart_in_rows = 1;
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		for (x = 0; x < width; x++) {
+			row_buf[x * 3] = x * 255 / width;
+			row_buf[x * 3 + 1] = cinfo.next_scanline * 255 / height;
+			row_buf[x * 3 + 2] = ((x >> 4) ^ (cinfo.next_scanline >> 4)) & 1 ? 200 : 50;
+		}
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row_buf);
+
+	frame = uvc_allocate_frame(size);
+	if (frame) {
+		memcpy(frame->data, buf, size);
+		frame->width = width;
+		frame->height = height;
+		frame->step = 0;
+		frame->frame_format = UVC_FRAME_FORMAT_MJPEG;
+		frame->actual_bytes = size;
+	}
+	free(buf);
+	return frame;
+}
+
+static void put_frame(check_context_t *ctx, uvc_frame_t *frame) {
+	uvc_frame_t *dropped = NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	{
+		if (ctx->count >= QUEUE_SZ) {
+			dropped = ctx->queue[ctx->head];
+			ctx->head = (ctx->head + 1) % QUEUE_SZ;
+			ctx->count--;
+		}
+		ctx->queue[(ctx->head + ctx->count) % QUEUE_SZ] = frame;
+		ctx->count++;
+		pthread_cond_signal(&ctx->sync);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+	if (dropped)
+		uvc_free_frame(dropped);
+}
+
+static uvc_frame_t *take_frame(check_context_t *ctx) {
+	uvc_frame_t *frame = NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	{
+		while (ctx->running && !ctx->count)
+			pthread_cond_wait(&ctx->sync, &ctx->mutex);
+		if (ctx->count) {
+			frame = ctx->queue[ctx->head];
+			ctx->head = (ctx->head + 1) % QUEUE_SZ;
+			ctx->count--;
+		}
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+	return frame;
+}
+
+/** the capture thread */
+static void *capture_thread_func(void *arg) {
+	check_context_t *ctx = arg;
+	uvc_frame_t *frame, *callback_frame, *temp;
+
+	uvc_set_alloc_subsystem(UVC_ALLOC_PREVIEW);
+	while ((frame = take_frame(ctx))) {
+		callback_frame = uvc_arena_allocate_frame(WIDTH * HEIGHT * 2);
+		temp = uvc_arena_allocate_frame(WIDTH * HEIGHT * 2);
+		if (!callback_frame || !temp
+			|| uvc_converter_convert(ctx->callback_converter, frame, callback_frame)
+			|| uvc_any2format(frame, temp, UVC_FRAME_FORMAT_RGB565)) {
+
+			__sync_add_and_fetch(&ctx->errors, 1);
+		}
+		if (callback_frame)
+			uvc_free_frame(callback_frame);
+		if (temp)
+			uvc_free_frame(temp);
+		uvc_free_frame(frame);
+	}
+	return NULL;
+}
+
+/** one frame of the preview thread */
+static int preview_one(check_context_t *ctx) {
+	uvc_frame_t *mjpeg = uvc_frame_pool_get(ctx->pool);
+	uvc_frame_t *frame, *rgbx, *yuyv;
+	int result = -1;
+
+	if (!mjpeg)
+		return -1;
+	// what the stream does in zero-copy mode
+	memcpy(mjpeg->data, ctx->mjpeg->data, ctx->mjpeg->actual_bytes);
+	mjpeg->width = ctx->mjpeg->width;
+	mjpeg->height = ctx->mjpeg->height;
+	mjpeg->step = 0;
+	mjpeg->frame_format = UVC_FRAME_FORMAT_MJPEG;
+	mjpeg->actual_bytes = ctx->mjpeg->actual_bytes;
+
+	frame = uvc_arena_allocate_frame(WIDTH * HEIGHT * 2);
+	rgbx = uvc_arena_allocate_frame(WIDTH * HEIGHT * 4);
+	yuyv = uvc_arena_allocate_frame(WIDTH * HEIGHT * 2);
+	if (frame && rgbx && yuyv
+		&& !uvc_mjpeg_decode(ctx->decoder, mjpeg, frame, UVC_FRAME_FORMAT_YUYV)
+		&& !uvc_converter_convert(ctx->preview_converter, frame, rgbx)
+		&& !uvc_mjpeg2yuyv(mjpeg, yuyv)) {
+
+		put_frame(ctx, frame);
+		frame = NULL;
+		result = 0;
+	}
+	uvc_release_frame(mjpeg);
+	if (frame)
+		uvc_free_frame(frame);
+	if (rgbx)
+		uvc_free_frame(rgbx);
+	if (yuyv)
+		uvc_free_frame(yuyv);
+	return result;
+}
+
+/** frames from the producer to the consumer, the producer waits while full */
+typedef struct flow_context {
+	pthread_mutex_t mutex;
+	pthread_cond_t sync;
+	uvc_frame_t *queue[QUEUE_SZ];
+	int head, count;
+	int done;
+	size_t data_bytes;
+	int errors;
+} flow_context_t;
+
+/** the consumer thread, frees the frames that the other thread allocated */
+static void *flow_consumer_func(void *arg) {
+	flow_context_t *flow = arg;
+	uvc_frame_t *frame;
+
+	for ( ; ; ) {
+		pthread_mutex_lock(&flow->mutex);
+		{
+			while (!flow->done && !flow->count)
+				pthread_cond_wait(&flow->sync, &flow->mutex);
+			frame = NULL;
+			if (flow->count) {
+				frame = flow->queue[flow->head];
+				flow->head = (flow->head + 1) % QUEUE_SZ;
+				flow->count--;
+				pthread_cond_broadcast(&flow->sync);
+			}
+		}
+		pthread_mutex_unlock(&flow->mutex);
+		if (!frame)
+			break;
+		uvc_free_frame(frame);
+	}
+	return NULL;
+}
+
+/** the producer thread, allocates the frames for the consumer */
+static void *flow_producer_func(void *arg) {
+	flow_context_t *flow = arg;
+	uvc_frame_t *frame;
+	int i;
+
+	for (i = 0; i < FLOW_FRAMES; i++) {
+		frame = uvc_arena_allocate_frame(flow->data_bytes);
+		if (!frame) {
+			flow->errors++;
+			continue;
+		}
+		pthread_mutex_lock(&flow->mutex);
+		{
+			while (flow->count >= QUEUE_SZ)
+				pthread_cond_wait(&flow->sync, &flow->mutex);
+			flow->queue[(flow->head + flow->count) % QUEUE_SZ] = frame;
+			flow->count++;
+			pthread_cond_broadcast(&flow->sync);
+		}
+		pthread_mutex_unlock(&flow->mutex);
+	}
+	pthread_mutex_lock(&flow->mutex);
+	flow->done = 1;
+	pthread_cond_broadcast(&flow->sync);
+	pthread_mutex_unlock(&flow->mutex);
+	return NULL;
+}
+
+/**
+ * frames allocated on one thread and freed on another
+ * @param capacity frames per magazine of the class in frame-arena.c
+ * @return 0 when the depot was locked about once per magazine, not per frame
+ */
+static int check_cross_thread(const size_t data_bytes, const int capacity) {
+	flow_context_t flow;
+	uvc_arena_stats_t before, after;
+	pthread_t producer, consumer;
+	uint32_t gets, locks, max_locks;
+
+	memset(&flow, 0, sizeof(flow));
+	pthread_mutex_init(&flow.mutex, NULL);
+	pthread_cond_init(&flow.sync, NULL);
+	flow.data_bytes = data_bytes;
+	uvc_arena_get_stats(&before);
+	pthread_create(&consumer, NULL, flow_consumer_func, &flow);
+	pthread_create(&producer, NULL, flow_producer_func, &flow);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	uvc_arena_get_stats(&after);
+	pthread_cond_destroy(&flow.sync);
+	pthread_mutex_destroy(&flow.mutex);
+
+	gets = after.gets - before.gets;
+	locks = after.depot_locks - before.depot_locks;
+	// one exchange per magazine on each side
+	max_locks = gets * 2 / capacity + FLOW_SLACK_LOCKS;
+	printf("cross-thread %lu bytes: gets=%u magazine=%u depot=%u locks=%u allocs=%u\n",
+		(unsigned long)data_bytes, gets, after.magazine_hits - before.magazine_hits,
+		after.depot_hits - before.depot_hits, locks, after.allocs - before.allocs);
+	if (flow.errors || (gets != FLOW_FRAMES)) {
+		printf("FAILED: %d frames were not allocated\n", FLOW_FRAMES - gets);
+		return 1;
+	}
+	if (locks > max_locks) {
+		printf("FAILED: %u locks of the depot for %u frames, expected at most %u\n",
+			locks, gets, max_locks);
+		return 1;
+	}
+	return 0;
+}
+
+static int print_stats(const uvc_alloc_stats_t *stats) {
+	int i, j, total = 0;
+
+	for (j = 0; j < UVC_ALLOC_SUBSYSTEM_COUNT; j++) {
+		printf("%-8s allocs=%u bytes=%lu\n", subsystem_names[j],
+			stats->allocs[j], (unsigned long)stats->bytes[j]);
+		total += stats->allocs[j];
+	}
+	for (i = 0; i < stats->num_threads; i++) {
+		const uvc_alloc_thread_stats_t *thread = &stats->threads[i];
+		for (j = 0; j < UVC_ALLOC_SUBSYSTEM_COUNT; j++) {
+			if (thread->allocs[j]) {
+				printf("  thread %d(%s) %s allocs=%u bytes=%lu\n", (int)thread->tid, thread->name,
+					subsystem_names[j], thread->allocs[j], (unsigned long)thread->bytes[j]);
+			}
+		}
+	}
+	return total;
+}
+
+int main(int argc, char **argv) {
+	check_context_t ctx;
+	uvc_alloc_stats_t stats;
+	uvc_scale_t scale = { 0, 0, 0, 0, WIDTH / 2, HEIGHT / 2 };
+	pthread_t capture_thread;
+	int i, total, num_frames = DEFAULT_FRAMES;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--frames") && (i + 1 < argc)) {
+			num_frames = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (uvc_get_alloc_stats(&stats) == UVC_ERROR_NOT_SUPPORTED) {
+		fprintf(stderr, "built without UVC_ALLOC_TRACKING\n");
+		return 2;
+	}
+
+	uvc_set_alloc_subsystem(UVC_ALLOC_PREVIEW);
+	memset(&ctx, 0, sizeof(ctx));
+	pthread_mutex_init(&ctx.mutex, NULL);
+	pthread_cond_init(&ctx.sync, NULL);
+	ctx.mjpeg = make_mjpeg(WIDTH, HEIGHT);
+	ctx.pool = uvc_frame_pool_create(WIDTH * HEIGHT * 2, 8, 4);
+	ctx.decoder = uvc_mjpeg_decoder_create();
+	ctx.preview_converter = uvc_converter_create(UVC_FRAME_FORMAT_RGBX, NULL);
+	ctx.callback_converter = uvc_converter_create(UVC_FRAME_FORMAT_RGB565, &scale);
+	if (!ctx.mjpeg || !ctx.pool || !ctx.decoder || !ctx.preview_converter || !ctx.callback_converter) {
+		fprintf(stderr, "failed to set up\n");
+		return 2;
+	}
+	uvc_mjpeg_decoder_set_threads(ctx.decoder, DECODE_THREADS);
+	uvc_converter_set_color_space(ctx.callback_converter, UVC_COLOR_SPACE_BT709_LIMITED);
+	// same as UVCPreview, the capture thread returns the frames a magazine at a time
+	uvc_arena_reserve(WIDTH * HEIGHT * 2, QUEUE_SZ * 2);
+	ctx.running = 1;
+	pthread_create(&capture_thread, NULL, capture_thread_func, &ctx);
+
+	for (i = 0; i < WARMUP_FRAMES + num_frames; i++) {
+		if (i == WARMUP_FRAMES) {
+			// the frames, converters and decoders were allocated for the preview
+			uvc_get_alloc_stats(&stats);
+			if (stats.allocs[UVC_ALLOC_FRAME] || !stats.allocs[UVC_ALLOC_PREVIEW]) {
+				printf("FAILED: warming up charged %u allocations to frame and %u to preview\n",
+					stats.allocs[UVC_ALLOC_FRAME], stats.allocs[UVC_ALLOC_PREVIEW]);
+				return 1;
+			}
+			// same as UVCPreview
+			uvc_reset_alloc_stats();
+			heap_allocs = heap_frees = 0;
+			heap_bytes = 0;
+			__sync_synchronize();
+			heap_counting = 1;
+		}
+		if (preview_one(&ctx))
+			ctx.errors++;
+	}
+	// before stopping, tearing down allocates/frees nothing of the steady state
+	heap_counting = 0;
+	__sync_synchronize();
+	uvc_get_alloc_stats(&stats);
+
+	pthread_mutex_lock(&ctx.mutex);
+	ctx.running = 0;
+	pthread_cond_signal(&ctx.sync);
+	pthread_mutex_unlock(&ctx.mutex);
+	pthread_join(capture_thread, NULL);
+
+	uvc_converter_destroy(ctx.callback_converter);
+	uvc_converter_destroy(ctx.preview_converter);
+	uvc_mjpeg_decoder_destroy(ctx.decoder);
+	uvc_frame_pool_detach(ctx.pool);
+	uvc_free_frame(ctx.mjpeg);
+	uvc_arena_trim();
+	// the classes hold 2 and 6 frames per magazine
+	if (check_cross_thread(WIDTH * HEIGHT * 4, 2)
+		|| check_cross_thread(640 * 480 * 2, 6)) {
+
+		return 1;
+	}
+	uvc_arena_trim();
+
+	printf("allocations in %d frames after %d frames of warming up:\n", num_frames, WARMUP_FRAMES);
+	total = print_stats(&stats);
+	printf("heap     allocs=%u bytes=%lu frees=%u\n",
+		heap_allocs, (unsigned long)heap_bytes, heap_frees);
+	if (ctx.errors) {
+		printf("FAILED: %d conversion errors\n", ctx.errors);
+		return 1;
+	}
+	if (total) {
+		printf("FAILED: %d allocations in the steady state\n", total);
+		return 1;
+	}
+	if (heap_allocs) {
+		// e.g. in libjpeg or in the code without UVC_ALLOC_TRACK
+		printf("FAILED: %u heap allocations in the steady state that no call site counted\n", heap_allocs);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
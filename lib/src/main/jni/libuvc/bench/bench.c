@@ -0,0 +1,472 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Micro-benchmark of the frame conversion and the MJPEG decoding on a Linux host.
+ * Synthetic YUYV/UYVY/RGB frames and MJPEG frames encoded from them
+ * (4:2:2, quality 85 and a restart marker every MCU row like most UVC cameras)
+ * are converted repeatedly, and the median time per frame is reported.
+ *
+ * usage: uvc_bench [--json] [--no-simd] [--size WxH] [--filter text] [--min-time ms]
+ * The JSON output has one result per line so that it can be diffed between commits.
+ * See CMakeLists.txt in this directory for building.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <jpeglib.h>
+
+#include "libuvc/libuvc.h"
+
+#define MAX_SAMPLES 1000
+#define DEFAULT_MIN_TIME_MS 200
+#define MIN_ITERATIONS 3
+#define MJPEG_QUALITY 85
+#define DECODE_THREADS 4
+
+typedef struct bench_size {
+	uint32_t width, height;
+} bench_size_t;
+
+static const bench_size_t sizes[] = {
+	{ 640, 480 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+#define NUM_SIZES (sizeof(sizes) / sizeof(bench_size_t))
+
+/** source frames of one size */
+typedef struct bench_frames {
+	uvc_frame_t *yuyv, *uyvy, *rgb, *mjpeg;
+	uvc_mjpeg_decoder_t *decoder;
+	uvc_scale_t half, two_thirds;
+} bench_frames_t;
+
+typedef uvc_error_t (*convert_func_t)(uvc_frame_t *in, uvc_frame_t *out);
+
+typedef enum bench_kind {
+	KIND_CONVERT,		// convert(in, out)
+	KIND_SCALED,		// scaled(in, out, format, half size)
+	KIND_SCALED_2_3,	// scaled(in, out, format, 2/3 size), not the 1/2, 1/4 fast paths of the box filter
+	KIND_FORMAT,		// uvc_any2format(in, out, format)
+	KIND_COLOR,			// uvc_yuv2rgb(in, out, format, color_space)
+	KIND_DECODE,		// uvc_mjpeg_decode(decoder with DECODE_THREADS, in, out, format)
+} bench_kind_t;
+
+typedef struct bench_case {
+	const char *name;
+	enum uvc_frame_format src;
+	bench_kind_t kind;
+	convert_func_t convert;
+	uvc_error_t (*scaled)(uvc_frame_t *in, uvc_frame_t *out,
+		enum uvc_frame_format format, const uvc_scale_t *scale);
+	enum uvc_frame_format format;
+	enum uvc_color_space color_space;
+} bench_case_t;
+
+#define CONVERT(func, src) { #func, UVC_FRAME_FORMAT_##src, KIND_CONVERT, func }
+#define SCALED(func, src, format) \
+	{ #func "(" #format ",1/2)", UVC_FRAME_FORMAT_##src, KIND_SCALED, NULL, func, UVC_FRAME_FORMAT_##format }
+#define SCALED_2_3(func, src, format) \
+	{ #func "(" #format ",2/3)", UVC_FRAME_FORMAT_##src, KIND_SCALED_2_3, NULL, func, UVC_FRAME_FORMAT_##format }
+// uvc_any2scaled with the source format in the name
+#define ANY2SCALED(src, format) \
+	{ "uvc_any2scaled(" #src "," #format ",1/2)", UVC_FRAME_FORMAT_##src, KIND_SCALED, NULL, \
+		uvc_any2scaled, UVC_FRAME_FORMAT_##format }
+#define ANY2SCALED_2_3(src, format) \
+	{ "uvc_any2scaled(" #src "," #format ",2/3)", UVC_FRAME_FORMAT_##src, KIND_SCALED_2_3, NULL, \
+		uvc_any2scaled, UVC_FRAME_FORMAT_##format }
+#define FORMAT(src, format) \
+	{ "uvc_any2format(" #src "," #format ")", UVC_FRAME_FORMAT_##src, KIND_FORMAT, NULL, NULL, \
+		UVC_FRAME_FORMAT_##format }
+#define COLOR(src, format, color_space) \
+	{ "uvc_yuv2rgb(" #src "," #format "," #color_space ")", UVC_FRAME_FORMAT_##src, KIND_COLOR, NULL, NULL, \
+		UVC_FRAME_FORMAT_##format, UVC_COLOR_SPACE_##color_space }
+#define DECODE(format) \
+	{ "uvc_mjpeg_decode(" #format ",threads)", UVC_FRAME_FORMAT_MJPEG, KIND_DECODE, NULL, NULL, \
+		UVC_FRAME_FORMAT_##format }
+
+static const bench_case_t cases[] = {
+	CONVERT(uvc_yuyv2rgb, YUYV),
+	CONVERT(uvc_yuyv2bgr, YUYV),
+	CONVERT(uvc_yuyv2rgb565, YUYV),
+	CONVERT(uvc_yuyv2rgbx, YUYV),
+	CONVERT(uvc_yuyv2yuv420P, YUYV),
+	CONVERT(uvc_yuyv2yuv420SP, YUYV),
+	CONVERT(uvc_yuyv2iyuv420SP, YUYV),
+	CONVERT(uvc_yuyv2gray8, YUYV),
+	CONVERT(uvc_uyvy2rgb, UYVY),
+	CONVERT(uvc_uyvy2bgr, UYVY),
+	CONVERT(uvc_uyvy2rgb565, UYVY),
+	CONVERT(uvc_uyvy2rgbx, UYVY),
+	CONVERT(uvc_uyvy2gray8, UYVY),
+	CONVERT(uvc_rgb2rgbx, RGB),
+	CONVERT(uvc_rgb2rgb565, RGB),
+	COLOR(YUYV, RGBX, BT709_LIMITED),
+	COLOR(UYVY, RGBX, BT709_LIMITED),
+	CONVERT(uvc_any2rgb, YUYV),
+	CONVERT(uvc_any2bgr, YUYV),
+	CONVERT(uvc_any2rgb565, YUYV),
+	CONVERT(uvc_any2rgbx, YUYV),
+	CONVERT(uvc_any2yuv420SP, YUYV),
+	CONVERT(uvc_any2iyuv420SP, YUYV),
+	CONVERT(uvc_any2gray8, YUYV),
+	FORMAT(YUYV, RGBX),
+	FORMAT(YUYV, NV21),
+	SCALED(uvc_yuyv2scaled, YUYV, RGBX),
+	SCALED(uvc_yuyv2scaled, YUYV, NV21),
+	SCALED_2_3(uvc_yuyv2scaled, YUYV, YUYV),
+	SCALED_2_3(uvc_yuyv2scaled, YUYV, RGBX),
+	SCALED_2_3(uvc_yuyv2scaled, YUYV, RGB),
+	SCALED_2_3(uvc_yuyv2scaled, YUYV, NV21),
+	ANY2SCALED(YUYV, RGBX),
+	ANY2SCALED_2_3(YUYV, RGBX),
+	ANY2SCALED_2_3(YUYV, RGB),
+	CONVERT(uvc_mjpeg2rgb, MJPEG),
+	CONVERT(uvc_mjpeg2bgr, MJPEG),
+	CONVERT(uvc_mjpeg2rgb565, MJPEG),
+	CONVERT(uvc_mjpeg2rgbx, MJPEG),
+	CONVERT(uvc_mjpeg2yuyv, MJPEG),
+	CONVERT(uvc_mjpeg2yuv420SP, MJPEG),
+	CONVERT(uvc_mjpeg2iyuv420SP, MJPEG),
+	CONVERT(uvc_mjpeg2i420, MJPEG),
+	CONVERT(uvc_mjpeg2gray8, MJPEG),
+	CONVERT(uvc_any2yuyv, MJPEG),
+	FORMAT(MJPEG, RGBX),
+	SCALED(uvc_mjpeg2scaled, MJPEG, RGBX),
+	SCALED(uvc_mjpeg2scaled, MJPEG, NV21),
+	ANY2SCALED(MJPEG, RGBX),
+	ANY2SCALED_2_3(MJPEG, RGBX),
+	DECODE(YUYV),
+	DECODE(NV21),
+};
+#define NUM_CASES (sizeof(cases) / sizeof(bench_case_t))
+
+static inline uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint8_t clamp8(int v) {
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/**
+ * RGB888 frame that looks like a camera image rather than noise:
+ * smooth gradients, a few edges and a little sensor noise
+ */
+static uvc_frame_t *make_rgb(const uint32_t width, const uint32_t height) {
+	uvc_frame_t *frame = uvc_allocate_frame(width * height * 3);
+	uint32_t seed = 12345;
+	uint32_t x, y;
+
+	if (!frame)
+		return NULL;
+	frame->width = width;
+	frame->height = height;
+	frame->step = width * 3;
+	frame->frame_format = UVC_FRAME_FORMAT_RGB;
+	frame->actual_bytes = width * height * 3;
+	for (y = 0; y < height; y++) {
+		uint8_t *p = (uint8_t *)frame->data + frame->step * y;
+		for (x = 0; x < width; x++) {
+			seed = seed * 1103515245 + 12345;
+			const int noise = (int)((seed >> 16) & 7) - 4;
+			const int block = (((x * 8 / width) + (y * 6 / height)) & 1) ? 40 : 0;
+			p[0] = clamp8((int)(x * 255 / width) + block + noise);
+			p[1] = clamp8((int)(y * 255 / height) - block + noise);
+			p[2] = clamp8((int)((x + y) * 255 / (width + height)) + noise);
+			p += 3;
+		}
+	}
+	return frame;
+}
+
+/** packed YUV422 of the RGB frame, @p uyvy selects the byte order */
+static uvc_frame_t *make_yuv422(const uvc_frame_t *rgb, const int uyvy) {
+	const uint32_t width = rgb->width, height = rgb->height;
+	uvc_frame_t *frame = uvc_allocate_frame(width * height * 2);
+	uint32_t x, y;
+
+	if (!frame)
+		return NULL;
+	frame->width = width;
+	frame->height = height;
+	frame->step = width * 2;
+	frame->frame_format = uyvy ? UVC_FRAME_FORMAT_UYVY : UVC_FRAME_FORMAT_YUYV;
+	frame->actual_bytes = width * height * 2;
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = (const uint8_t *)rgb->data + rgb->step * y;
+		uint8_t *d = (uint8_t *)frame->data + frame->step * y;
+		for (x = 0; x < width; x += 2) {
+			const int y0 = (77 * s[0] + 150 * s[1] + 29 * s[2]) >> 8;
+			const int y1 = (77 * s[3] + 150 * s[4] + 29 * s[5]) >> 8;
+			const int u = clamp8(((-43 * s[0] - 85 * s[1] + 128 * s[2]) >> 8) + 128);
+			const int v = clamp8(((128 * s[0] - 107 * s[1] - 21 * s[2]) >> 8) + 128);
+			d[uyvy ? 1 : 0] = y0;
+			d[uyvy ? 0 : 1] = u;
+			d[uyvy ? 3 : 2] = y1;
+			d[uyvy ? 2 : 3] = v;
+			s += 6;
+			d += 4;
+		}
+	}
+	return frame;
+}
+
+/** MJPEG frame like the UVC cameras send: 4:2:2 with a restart marker every MCU row */
+static uvc_frame_t *make_mjpeg(const uvc_frame_t *rgb) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *buf = NULL;
+	unsigned long size = 0;
+	uvc_frame_t *frame;
+	JSAMPROW row;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buf, &size);
+	cinfo.image_width = rgb->width;
+	cinfo.image_height = rgb->height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, MJPEG_QUALITY, TRUE);
+	cinfo.comp_info[0].h_samp_factor = 2;
+	cinfo.comp_info[0].v_samp_factor = 1;
+	cinfo.restart_in_rows = 1;
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		row = (JSAMPROW)rgb->data + rgb->step * cinfo.next_scanline;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	frame = uvc_allocate_frame(size);
+	if (frame) {
+		memcpy(frame->data, buf, size);
+		frame->width = rgb->width;
+		frame->height = rgb->height;
+		frame->step = 0;
+		frame->frame_format = UVC_FRAME_FORMAT_MJPEG;
+		frame->actual_bytes = size;
+	}
+	free(buf);
+	return frame;
+}
+
+static void free_frames(bench_frames_t *frames) {
+	if (frames->yuyv)
+		uvc_free_frame(frames->yuyv);
+	if (frames->uyvy)
+		uvc_free_frame(frames->uyvy);
+	if (frames->rgb)
+		uvc_free_frame(frames->rgb);
+	if (frames->mjpeg)
+		uvc_free_frame(frames->mjpeg);
+	if (frames->decoder)
+		uvc_mjpeg_decoder_destroy(frames->decoder);
+	memset(frames, 0, sizeof(bench_frames_t));
+}
+
+static int make_frames(bench_frames_t *frames, const bench_size_t *size) {
+	memset(frames, 0, sizeof(bench_frames_t));
+	frames->rgb = make_rgb(size->width, size->height);
+	if (frames->rgb) {
+		frames->yuyv = make_yuv422(frames->rgb, 0);
+		frames->uyvy = make_yuv422(frames->rgb, 1);
+		frames->mjpeg = make_mjpeg(frames->rgb);
+	}
+	frames->decoder = uvc_mjpeg_decoder_create();
+	if (frames->decoder)
+		uvc_mjpeg_decoder_set_threads(frames->decoder, DECODE_THREADS);
+	frames->half.width = size->width / 2;
+	frames->half.height = size->height / 2;
+	// even width for YUYV
+	frames->two_thirds.width = (size->width * 2 / 3) & ~1U;
+	frames->two_thirds.height = size->height * 2 / 3;
+	if (!frames->yuyv || !frames->uyvy || !frames->mjpeg || !frames->decoder) {
+		free_frames(frames);
+		return -1;
+	}
+	return 0;
+}
+
+static uvc_frame_t *source_frame(const bench_frames_t *frames, const enum uvc_frame_format format) {
+	switch (format) {
+	case UVC_FRAME_FORMAT_YUYV:
+		return frames->yuyv;
+	case UVC_FRAME_FORMAT_UYVY:
+		return frames->uyvy;
+	case UVC_FRAME_FORMAT_RGB:
+		return frames->rgb;
+	default:
+		return frames->mjpeg;
+	}
+}
+
+static inline uvc_error_t run_case(const bench_case_t *c, bench_frames_t *frames,
+	uvc_frame_t *in, uvc_frame_t *out) {
+
+	switch (c->kind) {
+	case KIND_SCALED:
+		return c->scaled(in, out, c->format, &frames->half);
+	case KIND_SCALED_2_3:
+		return c->scaled(in, out, c->format, &frames->two_thirds);
+	case KIND_FORMAT:
+		return uvc_any2format(in, out, c->format);
+	case KIND_COLOR:
+		return uvc_yuv2rgb(in, out, c->format, c->color_space);
+	case KIND_DECODE:
+		return uvc_mjpeg_decode(frames->decoder, in, out, c->format);
+	default:
+		return c->convert(in, out);
+	}
+}
+
+static int compare_u64(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [--json] [--no-simd] [--size WxH] [--filter text] [--min-time ms]\n", name);
+}
+
+int main(int argc, char **argv) {
+	static uint64_t samples[MAX_SAMPLES];
+	int json = 0, simd = 1, min_time_ms = DEFAULT_MIN_TIME_MS;
+	uint32_t only_width = 0, only_height = 0;
+	const char *filter = NULL;
+	int i, first = 1, result = 0;
+	size_t s, k;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json")) {
+			json = 1;
+		} else if (!strcmp(argv[i], "--no-simd")) {
+			simd = 0;
+		} else if (!strcmp(argv[i], "--size") && (i + 1 < argc)) {
+			if (sscanf(argv[++i], "%ux%u", &only_width, &only_height) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--filter") && (i + 1 < argc)) {
+			filter = argv[++i];
+		} else if (!strcmp(argv[i], "--min-time") && (i + 1 < argc)) {
+			min_time_ms = atoi(argv[++i]);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	uvc_set_simd_enabled(simd);
+
+	if (json) {
+		printf("{\n\"simd_features\": %d,\n\"min_time_ms\": %d,\n\"results\": [\n",
+			simd ? uvc_get_simd_features() : 0, min_time_ms);
+	} else {
+		printf("simd features: 0x%02x\n", simd ? uvc_get_simd_features() : 0);
+		printf("%-40s %10s %8s %14s %10s\n", "function", "size", "iters", "ns/frame", "MPix/s");
+	}
+	for (s = 0; s < NUM_SIZES; s++) {
+		const bench_size_t *size = &sizes[s];
+		bench_frames_t frames;
+
+		if (only_width && ((size->width != only_width) || (size->height != only_height)))
+			continue;
+		if (make_frames(&frames, size)) {
+			fprintf(stderr, "failed to prepare %ux%u frames\n", size->width, size->height);
+			result = 1;
+			continue;
+		}
+		for (k = 0; k < NUM_CASES; k++) {
+			const bench_case_t *c = &cases[k];
+			uvc_frame_t *in = source_frame(&frames, c->src);
+			uvc_frame_t *out;
+			uint64_t start, elapsed = 0;
+			int n = 0;
+
+			if (filter && !strstr(c->name, filter))
+				continue;
+			out = uvc_allocate_frame(size->width * size->height * 4);
+			if (!out) {
+				result = 1;
+				break;
+			}
+			// warm up, and skip the functions that do not support this frame
+			if (run_case(c, &frames, in, out)) {
+				fprintf(stderr, "%s failed at %ux%u\n", c->name, size->width, size->height);
+				uvc_free_frame(out);
+				result = 1;
+				continue;
+			}
+			while ((n < MAX_SAMPLES)
+				&& ((n < MIN_ITERATIONS) || (elapsed < (uint64_t)min_time_ms * 1000000ULL))) {
+
+				start = now_ns();
+				run_case(c, &frames, in, out);
+				samples[n] = now_ns() - start;
+				elapsed += samples[n++];
+			}
+			uvc_free_frame(out);
+			qsort(samples, n, sizeof(uint64_t), compare_u64);
+			const uint64_t median = samples[n / 2];
+			const double mpix = median
+				? (double)size->width * size->height * 1000.0 / median : 0.0;
+			if (json) {
+				printf("%s{\"function\": \"%s\", \"width\": %u, \"height\": %u, \"iterations\": %d, "
+					"\"ns_per_frame\": %llu, \"min_ns_per_frame\": %llu, \"mpix_per_s\": %.1f}\n",
+					first ? "" : ",", c->name, size->width, size->height, n,
+					(unsigned long long)median, (unsigned long long)samples[0], mpix);
+			} else {
+				char dim[24];
+				snprintf(dim, sizeof(dim), "%ux%u", size->width, size->height);
+				printf("%-40s %10s %8d %14llu %10.1f\n",
+					c->name, dim, n, (unsigned long long)median, mpix);
+			}
+			first = 0;
+			fflush(stdout);
+		}
+		free_frames(&frames);
+	}
+	if (json) {
+		printf("]\n}\n");
+	}
+	return result;
+}
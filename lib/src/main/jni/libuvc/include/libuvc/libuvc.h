@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stdio.h> // FILE
+#include <sys/types.h> // pid_t
 #include <libusb/libusb.h>
 #include <libuvc/libuvc_config.h>
 
@@ -105,6 +106,12 @@ enum uvc_frame_format {
 	UVC_FRAME_FORMAT_MJPEG,
 	UVC_FRAME_FORMAT_GRAY8,
 	UVC_FRAME_FORMAT_BY8,
+	/** YUV420 planar: Y plane followed by U and V planes (decode output only) */
+	UVC_FRAME_FORMAT_I420,
+	/** YUV420 semi planar: Y plane followed by interleaved UV plane (yuv420SP) */
+	UVC_FRAME_FORMAT_NV12,
+	/** YUV420 semi planar: Y plane followed by interleaved VU plane (iyuv420SP) */
+	UVC_FRAME_FORMAT_NV21,
 	/** Number of formats understood */
 	UVC_FRAME_FORMAT_COUNT,
 };
@@ -216,6 +223,10 @@ typedef struct uvc_format_desc {
   uint8_t bmInterlaceFlags;
   uint8_t bCopyProtect;
   uint8_t bVariableSize;
+  /** Color matching descriptor that follows the format, 0 means unspecified */
+  uint8_t bColorPrimaries;
+  uint8_t bTransferCharacteristics;
+  uint8_t bMatrixCoefficients;
   /** Available frame specifications for this format */
   struct uvc_frame_desc *frame_descs;
 } uvc_format_desc_t;
@@ -449,6 +460,8 @@ typedef struct uvc_device_descriptor {
 	const char *product;
 } uvc_device_descriptor_t;
 
+struct uvc_frame_pool;
+
 /** An image frame received from the UVC device
  * @ingroup streaming
  */
@@ -470,8 +483,12 @@ typedef struct uvc_frame {
 	size_t step;
 	/** Frame number (may skip, but is strictly monotonically increasing) */
 	uint32_t sequence;
-	/** Estimate of system time when the device started capturing the image */
+	/** Estimate of system time (CLOCK_MONOTONIC) when the device started capturing the image,
+	 * recovered from PTS/SCR when the device sends them, otherwise the time the frame was received */
 	struct timeval capture_time;
+	/** XXX System time (CLOCK_MONOTONIC) when libuvc handled the USB transfer that completed the frame,
+	 * zero if the frame was broken. The frame reaches the user callback after this */
+	struct timeval complete_time;
 	/** Handle on the device that produced the image.
 	 * @warning You must not call any uvc_* functions during a callback. */
 	uvc_device_handle_t *source;
@@ -482,10 +499,23 @@ typedef struct uvc_frame {
 	 * Set this field to zero if you are supplying the buffer.
 	 */
 	uint8_t library_owns_data;
+	/** XXX Pool that owns this frame when it was delivered by zero-copy streaming.
+	 * NULL for frames from uvc_allocate_frame. Return pooled frames with uvc_release_frame */
+	struct uvc_frame_pool *pool;
+	/** XXX Reference count, 1 for frames from uvc_allocate_frame and zero-copy streaming.
+	 * 0 means the frame is not reference counted (e.g. the frame handed to the user
+	 * callback without UVC_STREAM_FLAG_ZERO_COPY). Use uvc_lease_frame/uvc_release_frame */
+	volatile int32_t ref_count;
+	/** XXX Size of the data buffer when the frame came from uvc_arena_allocate_frame,
+	 * 0 otherwise. uvc_free_frame returns such frames to the arena */
+	size_t alloc_bytes;
 } uvc_frame_t;
 
 /** A callback function to handle incoming assembled UVC frames
  * @ingroup streaming
+ * @note when the stream was started with UVC_STREAM_FLAG_ZERO_COPY, the callee owns
+ * the frame and must return it with uvc_release_frame. Otherwise the frame is only
+ * valid during the callback, call uvc_lease_frame to keep it longer.
  */
 typedef void(uvc_frame_callback_t)(struct uvc_frame *frame, void *user_ptr);
 
@@ -521,6 +551,128 @@ typedef struct uvc_stream_ctrl {
 	uint8_t bInterfaceNumber;
 } uvc_stream_ctrl_t;
 
+/** Stream setup flags for uvc_start_streaming / uvc_stream_start
+ * @ingroup streaming
+ * bit0 is reserved for backward compatibility
+ */
+/** XXX assemble payloads directly into pooled frames and hand them to the consumer
+ * without copying. The user callback / uvc_stream_get_frame caller owns the frame
+ * and must return it with uvc_release_frame */
+#define UVC_STREAM_FLAG_ZERO_COPY	0x02
+
+/** Transport statistics of a stream, see uvc_stream_get_stats
+ * @ingroup streaming
+ */
+typedef struct uvc_stream_stats {
+	/** transfers completed successfully */
+	uint32_t transfers_completed;
+	/** transfers finished with error, timeout, stall or overflow */
+	uint32_t transfers_failed;
+	/** transfers that could not be resubmitted */
+	uint32_t resubmit_failed;
+	/** iso packets with non-zero status */
+	uint32_t packets_error;
+	/** iso packets without any data */
+	uint32_t packets_empty;
+	/** payload headers with UVC_STREAM_ERR */
+	uint32_t header_errors;
+	/** frames ended by FID toggle without EOF */
+	uint32_t fid_toggles;
+	/** frames that did not fit into the frame buffer */
+	uint32_t oversize_frames;
+	/** frames assembled without error */
+	uint32_t frames_completed;
+	/** frames discarded because of transfer or payload errors */
+	uint32_t frames_broken;
+	/** frames lost because the consumer did not keep up */
+	uint32_t frames_dropped;
+	/** error recoveries executed (clear_halt / error code query) */
+	uint32_t recoveries;
+	/** transfers allowed in flight, changes while auto tuning */
+	uint32_t transfer_depth;
+	/** payload bytes received including headers */
+	uint64_t bytes_received;
+} uvc_stream_stats_t;
+
+/** Statistics of the shared frame arena, see uvc_arena_get_stats
+ * @ingroup frame
+ */
+typedef struct uvc_arena_stats {
+	/** frames taken from the arena */
+	uint32_t gets;
+	/** gets served by the magazines of the calling thread */
+	uint32_t magazine_hits;
+	/** gets that loaded a full magazine from the shared depot */
+	uint32_t depot_hits;
+	/** exchanges of magazines with the depot (locks of the depot) on get and free */
+	uint32_t depot_locks;
+	/** data buffers allocated from / returned to the system */
+	uint32_t allocs;
+	uint32_t frees;
+	/** bytes of the data buffers held by the arena including the frames in use, and the peak */
+	size_t reserved_bytes;
+	size_t peak_reserved_bytes;
+	/** bytes of the data buffers of the frames in use, and the peak */
+	size_t in_use_bytes;
+	size_t peak_in_use_bytes;
+} uvc_arena_stats_t;
+
+/** Subsystems of the heap allocation tracking, see uvc_get_alloc_stats
+ * @ingroup frame
+ */
+enum uvc_alloc_subsystem {
+	/** not a subsystem, charges the subsystem of the calling thread (see uvc_set_alloc_subsystem)
+	 * for the allocations of the shared frame code, UVC_ALLOC_FRAME when the thread set none */
+	UVC_ALLOC_CALLER = -1,
+	/** stream handle, transfers and frame buffers of libuvc streaming */
+	UVC_ALLOC_STREAM = 0,
+	/** frames, frame arena, converters and MJPEG decoders on the threads that set no subsystem */
+	UVC_ALLOC_FRAME,
+	/** UVCPreview and its callbacks */
+	UVC_ALLOC_PREVIEW,
+	/** pipelines */
+	UVC_ALLOC_PIPELINE,
+	UVC_ALLOC_SUBSYSTEM_COUNT
+};
+
+/** number of threads whose allocations are counted separately */
+#define UVC_ALLOC_MAX_THREADS 16
+#define UVC_ALLOC_THREAD_NAME_SZ 16
+
+/** Heap allocations of one thread, see uvc_get_alloc_stats
+ * @ingroup frame
+ */
+typedef struct uvc_alloc_thread_stats {
+	/** kernel thread id and the name of the thread */
+	pid_t tid;
+	char name[UVC_ALLOC_THREAD_NAME_SZ];
+	/** allocations and allocated bytes of each subsystem */
+	uint32_t allocs[UVC_ALLOC_SUBSYSTEM_COUNT];
+	size_t bytes[UVC_ALLOC_SUBSYSTEM_COUNT];
+} uvc_alloc_thread_stats_t;
+
+/** Heap allocations since uvc_reset_alloc_stats, see uvc_get_alloc_stats
+ * @ingroup frame
+ */
+typedef struct uvc_alloc_stats {
+	/** allocations and allocated bytes of each subsystem on all threads */
+	uint32_t allocs[UVC_ALLOC_SUBSYSTEM_COUNT];
+	size_t bytes[UVC_ALLOC_SUBSYSTEM_COUNT];
+	/** threads that allocated, the threads over UVC_ALLOC_MAX_THREADS are only in the totals */
+	int num_threads;
+	uvc_alloc_thread_stats_t threads[UVC_ALLOC_MAX_THREADS];
+} uvc_alloc_stats_t;
+
+/** Policy of the completed frame ring when the consumer can not keep up with the camera
+ * @ingroup streaming
+ */
+enum uvc_frame_drop_policy {
+	/** discard the oldest queued frame to make room for the new one */
+	UVC_FRAME_DROP_OLDEST = 0,
+	/** keep the queued frames and discard the new one */
+	UVC_FRAME_DROP_NEWEST = 1,
+};
+
 uvc_error_t uvc_init(uvc_context_t **ctx, struct libusb_context *usb_ctx);
 uvc_error_t uvc_init2(uvc_context_t **ctx, struct libusb_context *usb_ctx, const char *usbfs);
 void uvc_exit(uvc_context_t *ctx);
@@ -607,6 +759,13 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 		uvc_frame_t **frame, int32_t timeout_us);
 uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh);
 void uvc_stream_close(uvc_stream_handle_t *strmh);
+uvc_error_t uvc_stream_set_frame_ring(uvc_stream_handle_t *strmh,
+		int num_slots, enum uvc_frame_drop_policy policy);	// XXX
+uint32_t uvc_stream_get_dropped_frames(uvc_stream_handle_t *strmh);	// XXX
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh, uvc_stream_stats_t *stats);	// XXX
+uvc_error_t uvc_stream_set_transfer_config(uvc_stream_handle_t *strmh,
+		int num_transfers, int packets_per_transfer, uint8_t auto_tune);	// XXX
+uint8_t uvc_stream_get_alt_setting(uvc_stream_handle_t *strmh);	// XXX
 
 // Generic Controls
 int uvc_get_ctrl_len(uvc_device_handle_t *devh, uint8_t unit, uint8_t ctrl);
@@ -784,9 +943,45 @@ void uvc_print_stream_ctrl(uvc_stream_ctrl_t *ctrl, FILE *stream);
 
 uvc_frame_t *uvc_allocate_frame(size_t data_bytes);
 void uvc_free_frame(uvc_frame_t *frame);
+uvc_frame_t *uvc_lease_frame(uvc_frame_t *frame);
+void uvc_release_frame(uvc_frame_t *frame);
+uvc_frame_t *uvc_arena_allocate_frame(size_t data_bytes);	// XXX
+int uvc_arena_reserve(size_t data_bytes, int num_frames);	// XXX
+void uvc_arena_trim(void);	// XXX
+void uvc_arena_get_stats(uvc_arena_stats_t *stats);	// XXX
+uvc_error_t uvc_get_alloc_stats(uvc_alloc_stats_t *stats);	// XXX
+void uvc_reset_alloc_stats(void);	// XXX
+void uvc_alloc_track(enum uvc_alloc_subsystem subsystem, size_t bytes);	// XXX
+void uvc_set_alloc_subsystem(enum uvc_alloc_subsystem subsystem);	// XXX
+enum uvc_alloc_subsystem uvc_get_alloc_subsystem(void);	// XXX
+
+/** count the heap allocation of the subsystem on the debug build with UVC_ALLOC_TRACKING */
+#ifdef UVC_ALLOC_TRACKING
+#define UVC_ALLOC_TRACK(subsystem, bytes) uvc_alloc_track(subsystem, bytes)
+#else
+#define UVC_ALLOC_TRACK(subsystem, bytes)
+#endif
 
 uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out);
 //----------------------------------------------------------------------
+/** Color matrix and range of YUV for the conversion to RGB
+ * @ingroup frame
+ */
+enum uvc_color_space {
+	/** BT.601 full range(same as JPEG), used by uvc_yuyv2rgb etc. */
+	UVC_COLOR_SPACE_BT601_FULL = 0,
+	/** BT.601 limited range(Y:16-235, UV:16-240) */
+	UVC_COLOR_SPACE_BT601_LIMITED = 1,
+	/** BT.709 full range */
+	UVC_COLOR_SPACE_BT709_FULL = 2,
+	/** BT.709 limited range */
+	UVC_COLOR_SPACE_BT709_LIMITED = 3,
+	UVC_COLOR_SPACE_COUNT,
+};
+enum uvc_color_space uvc_get_color_space(const uvc_format_desc_t *format_desc);	// XXX
+uvc_error_t uvc_yuv2rgb(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, enum uvc_color_space color_space);	// XXX
+//----------------------------------------------------------------------
 uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out);
@@ -801,6 +996,24 @@ uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out);	// XXX
 uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_mjpeg2yuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX
+uvc_error_t uvc_mjpeg2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_mjpeg2gray8(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+
+/** reusable MJPEG decoder, see uvc_mjpeg_decoder_create */
+typedef struct uvc_mjpeg_decoder uvc_mjpeg_decoder_t;
+uvc_mjpeg_decoder_t *uvc_mjpeg_decoder_create(void);				// XXX
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder);		// XXX
+uvc_error_t uvc_mjpeg_decoder_set_threads(uvc_mjpeg_decoder_t *decoder, int num_threads);	// XXX
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format);	// XXX
+/** A callback function to handle the rows decoded by uvc_mjpeg_decode_banded,
+ * rows [row, row + rows) of frame are valid */
+typedef void(uvc_mjpeg_band_callback_t)(uvc_frame_t *frame, uint32_t row, uint32_t rows, void *user_ptr);
+uvc_error_t uvc_mjpeg_decode_banded(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format,
+	uint32_t band_rows, uvc_mjpeg_band_callback_t *cb, void *user_ptr);	// XXX
 #endif
 
 uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out);		// XXX
@@ -823,8 +1036,50 @@ uvc_error_t uvc_any2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out);	// XXX
 
 uvc_error_t uvc_any2yuyv(uvc_frame_t *in, uvc_frame_t *out);		// XXX
 
+uvc_error_t uvc_yuyv2gray8(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_uyvy2gray8(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_any2gray8(uvc_frame_t *in, uvc_frame_t *out);		// XXX
+uvc_error_t uvc_any2format(uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format);	// XXX
+
+/** Crop rectangle and output size for the scaled conversion
+ * @ingroup frame
+ */
+typedef struct uvc_scale {
+	/** crop rectangle in the input frame, zero width/height means to the right/bottom edge */
+	uint32_t crop_x, crop_y, crop_width, crop_height;
+	/** output size, zero means same as the crop rectangle */
+	uint32_t width, height;
+} uvc_scale_t;
+uvc_error_t uvc_yuyv2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale);			// XXX
+uvc_error_t uvc_any2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale);			// XXX
+#ifdef LIBUVC_HAS_JPEG
+uvc_error_t uvc_mjpeg2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale);			// XXX
+uvc_error_t uvc_mjpeg_decode_scaled(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale);			// XXX
+#endif
+
+/** Converter for the frames of a stream, keeps the cheapest chain of
+ * the conversions and the intermediate frames
+ * @ingroup frame
+ */
+typedef struct uvc_converter uvc_converter_t;
+uvc_converter_t *uvc_converter_create(enum uvc_frame_format format, const uvc_scale_t *scale);	// XXX
+void uvc_converter_destroy(uvc_converter_t *converter);		// XXX
+void uvc_converter_set_color_space(uvc_converter_t *converter, enum uvc_color_space color_space);	// XXX
+uvc_error_t uvc_converter_convert(uvc_converter_t *converter, uvc_frame_t *in, uvc_frame_t *out);	// XXX
+
 uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes); // XXX
 
+/** SIMD instruction sets used by the color conversion */
+#define UVC_SIMD_NEON	0x01
+#define UVC_SIMD_SSE2	0x02
+#define UVC_SIMD_AVX2	0x04
+int uvc_get_simd_features(void);						// XXX
+void uvc_set_simd_enabled(int enabled);					// XXX
+
 //**********************************************************************
 // added for diagnostic
 // t_saki@serenegiant.com
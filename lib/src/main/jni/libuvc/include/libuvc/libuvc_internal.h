@@ -120,6 +120,10 @@ enum uvc_vc_desc_subtype {
   UVC_VC_EXTENSION_UNIT = 0x06
 };
 
+/** XXX SuperSpeedPlus isochronous endpoint companion descriptor type (USB 3.1),
+ * not defined in libusb */
+#define UVC_DT_SSP_ISOC_ENDPOINT_COMPANION 0x31
+
 /** UVC endpoint descriptor subtype (A.7) */
 enum uvc_ep_desc_subtype {
   UVC_EP_UNDEFINED = 0x00,
@@ -217,6 +221,8 @@ typedef struct uvc_control_interface {
   struct uvc_processing_unit *processing_unit_descs;
   struct uvc_extension_unit *extension_unit_descs;
   uint16_t bcdUVC;
+  /** XXX device clock frequency of PTS/SCR (deprecated since UVC 1.5, see uvc_stream_ctrl_t) */
+  uint32_t dwClockFrequency;
   uint8_t bEndpointAddress;
   /** Interface number */
   uint8_t bInterfaceNumber;
@@ -246,11 +252,202 @@ typedef struct uvc_device_info {
   scheduled (if we have root).
   We could/should change this to allow reduce it to, say, 5 by default
   and then allow the user to change the number of buffers as required.
+  XXX this is the default now, uvc_stream_set_transfer_config changes it per stream.
  */
 #define LIBUVC_NUM_TRANSFER_BUFS 10
+/** XXX upper limit of transfers per stream, see uvc_stream_set_transfer_config */
+#define LIBUVC_MAX_TRANSFER_BUFS 32
+/** XXX lower limit of transfers in flight while auto tuning */
+#define LIBUVC_MIN_TRANSFER_BUFS 2
+/** XXX default upper limit of iso packets per transfer */
+#define LIBUVC_PACKETS_PER_TRANSFER 32
+/** XXX upper limit of iso packets per transfer, usbfs rejects larger iso urbs */
+#define LIBUVC_MAX_PACKETS_PER_TRANSFER 128
+/** XXX upper limit of the buffer size of a bulk transfer that receives multiple payloads */
+#define LIBUVC_MAX_BULK_TRANSFER_SIZE ( 1024 * 1024 )
+/** XXX number of transfer completions evaluated at once by transfer auto tuning */
+#define LIBUVC_XFER_TUNE_WINDOW 64
+/** XXX consecutive windows with enough slack before the transfer depth is reduced */
+#define LIBUVC_XFER_TUNE_SHRINK_WINDOWS 4
 
 #define LIBUVC_XFER_BUF_SIZE	( 16 * 1024 * 1024 )
 
+/** XXX maximum number of frames kept for reuse in the zero-copy frame pool */
+#define LIBUVC_FRAME_POOL_SIZE 8
+/** XXX number of frames allocated in advance when zero-copy streaming starts */
+#define LIBUVC_FRAME_POOL_PREALLOC 4
+/** XXX maximum number of slots of the completed frame ring */
+#define LIBUVC_MAX_FRAME_RING 16
+/** XXX minimum interval of error recovery, error packets during the interval are coalesced */
+#define LIBUVC_ERROR_RECOVERY_INTERVAL_MS 100
+
+/** XXX lock-free update of uvc_stream_handle::stats,
+ * counters are updated from the libusb event thread and from consumer threads */
+#define UVC_STATS_ADD(strmh, field, n) __sync_fetch_and_add(&(strmh)->stats.field, (n))
+#define UVC_STATS_INC(strmh, field) UVC_STATS_ADD(strmh, field, 1)
+
+/** XXX error recovery requests queued from the transfer completion callback */
+#define UVC_RECOVERY_CLEAR_HALT		0x01
+#define UVC_RECOVERY_ERROR_CODE		0x02
+
+/** XXX number of SCR samples kept for the device clock recovery */
+#define LIBUVC_CLOCK_SAMPLES 32
+/** XXX minimum interval between SCR samples, the window covers about LIBUVC_CLOCK_SAMPLES * this */
+#define LIBUVC_CLOCK_SAMPLE_INTERVAL_MS 20
+/** XXX consecutive SCR samples rejected before the sample window is discarded */
+#define LIBUVC_CLOCK_MAX_REJECTS 4
+
+/** @internal
+ * One SCR observation: device STC, SOF token counter and the host time it was received
+ */
+typedef struct uvc_clock_sample {
+  /** unwrapped 64 bit source time clock */
+  uint64_t dev_stc;
+  /** 11 bit USB SOF token counter */
+  uint16_t dev_sof;
+  /** host CLOCK_MONOTONIC in nanoseconds */
+  int64_t host_ns;
+} uvc_clock_sample_t;
+
+/** @internal
+ * Recovery of the device clock (PTS/SCR) against host CLOCK_MONOTONIC.
+ * A line host_ns = host_base + slope * (stc - stc_base) is fitted to a sliding
+ * window of SCR samples with least squares. Only accessed from the libusb event thread.
+ */
+typedef struct uvc_clock {
+  /** device clock frequency in Hz, 0 if unknown */
+  uint32_t dev_frequency;
+  uvc_clock_sample_t samples[LIBUVC_CLOCK_SAMPLES];
+  int head, count, rejects;
+  /** latest raw STC/SOF and the unwrapped STC */
+  uint32_t last_stc;
+  uint16_t last_sof;
+  uint64_t stc_ext;
+  uint8_t has_stc;
+  /** host time and latest SCR of the transfer that is currently processed */
+  int64_t xfer_host_ns;
+  uint32_t xfer_stc;
+  uint16_t xfer_sof;
+  uint8_t xfer_has_scr;
+  /** fitted line, refitted lazily when dirty */
+  uint8_t dirty, valid;
+  uint64_t stc_base;
+  int64_t host_base;
+  double slope;
+  /** capture time of the previous frame to keep capture time monotonic */
+  int64_t last_frame_ns;
+} uvc_clock_t;
+
+void uvc_clock_init(uvc_clock_t *clock, uint32_t dev_frequency);
+void uvc_clock_begin_transfer(uvc_clock_t *clock);
+void uvc_clock_add_scr(uvc_clock_t *clock, uint32_t stc, uint16_t sof);
+void uvc_clock_end_transfer(uvc_clock_t *clock);
+int64_t uvc_clock_frame_time(uvc_clock_t *clock, uint32_t pts);
+
+/** @internal
+ * Pool of frames for zero-copy streaming.
+ * Frames taken from the pool keep a back pointer in uvc_frame_t::pool
+ * and are returned with uvc_release_frame. The pool is freed
+ * when the stream detached it and all outstanding frames have been returned.
+ */
+typedef struct uvc_frame_pool {
+  pthread_mutex_t mutex;
+  /** size of data buffer of each frame */
+  size_t frame_bytes;
+  /** frames available for reuse */
+  uvc_frame_t **free_frames;
+  int num_free, max_free;
+  /** number of frames owned by the stream or by consumers */
+  int num_outstanding;
+  uint8_t detached;
+} uvc_frame_pool_t;
+
+uvc_frame_pool_t *uvc_frame_pool_create(size_t frame_bytes, int max_free, int num_prealloc);
+uvc_frame_t *uvc_frame_pool_get(uvc_frame_pool_t *pool);
+void uvc_frame_pool_set_frame_bytes(uvc_frame_pool_t *pool, size_t frame_bytes);
+void uvc_frame_pool_detach(uvc_frame_pool_t *pool);
+
+void uvc_arena_free_frame(uvc_frame_t *frame);
+uvc_error_t uvc_arena_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes);
+void *uvc_thread_scratch(size_t bytes);
+
+/** @internal
+ * Row kernel of the color conversion, converts up to @p pixels pixels
+ * and returns the number of pixels actually converted. The caller converts
+ * the rest of the row with the scalar code.
+ */
+typedef int (*uvc_convert_row_t)(const uint8_t *src, uint8_t *dst, int pixels);
+/** @internal
+ * Row kernel that splits packed YUV422 into the Y plane and the interleaved
+ * chroma plane, @p uv is NULL for the rows that do not carry chroma of 4:2:0
+ */
+typedef int (*uvc_split_row_t)(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels);
+/** @internal
+ * Row kernel of the box scaling by 1/2 of packed YUYV, averages the rows @p src0 and @p src1
+ * and then the pixels of them in twos into up to @p pixels output pixels
+ * (rounding up on both averages like pavgb/vrhadd), returns the number of output pixels
+ */
+typedef int (*uvc_half_row_t)(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int pixels);
+
+/** @internal
+ * Color conversion kernels selected by the CPU features at runtime
+ */
+typedef struct uvc_convert_kernels {
+  /** combination of UVC_SIMD_XXX */
+  int features;
+  uvc_convert_row_t yuyv2rgbx, yuyv2rgb, yuyv2bgr, yuyv2rgb565;
+  uvc_convert_row_t uyvy2rgbx, uyvy2rgb, uyvy2bgr, uyvy2rgb565;
+  uvc_convert_row_t rgb2rgbx, rgb2rgb565;
+  /** yuv420SP(NV12) and iyuv420SP(NV21) */
+  uvc_split_row_t yuyv2nv12, yuyv2nv21;
+  /** luma only(GRAY8) */
+  uvc_convert_row_t yuyv2gray, uyvy2gray;
+  /** box scaling of YUYV by 1/2 */
+  uvc_half_row_t yuyv_half;
+} uvc_convert_kernels_t;
+
+const uvc_convert_kernels_t *uvc_get_convert_kernels(void);
+uvc_error_t uvc_normalize_scale(const uvc_scale_t *scale,
+	const uint32_t width, const uint32_t height, uvc_scale_t *result);
+uvc_error_t uvc_yuyv2scaled_color(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale,
+	enum uvc_color_space color_space);
+
+/** @internal
+ * Conversion kernel(edge of the conversion graph) in frame-convert.c,
+ * either convert or convert_scaled is set
+ */
+typedef struct uvc_convert_kernel {
+  enum uvc_frame_format src, dst;
+  /** relative cost per pixel(per source pixel for convert_scaled) */
+  uint32_t cost;
+  uvc_error_t (*convert)(uvc_frame_t *in, uvc_frame_t *out);
+  /** crop/scale while converting, called with dst as format */
+  uvc_error_t (*convert_scaled)(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale);
+  /** YUV to RGB with the color space, used instead of convert/convert_scaled
+   * when the color space is not BT.601 full range, can be NULL */
+  uvc_error_t (*convert_color)(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale,
+	enum uvc_color_space color_space);
+} uvc_convert_kernel_t;
+
+#define UVC_CONVERT_MAX_STEPS 3
+
+/** @internal
+ * Chain of the conversion kernels found by uvc_convert_plan
+ */
+typedef struct uvc_convert_plan {
+  enum uvc_frame_format src, dst;
+  int num_steps;
+  const uvc_convert_kernel_t *kernels[UVC_CONVERT_MAX_STEPS];
+  /** total cost x 256 */
+  uint32_t cost;
+} uvc_convert_plan_t;
+
+uvc_error_t uvc_convert_plan(enum uvc_frame_format src, enum uvc_frame_format dst,
+	const int scaled, uint32_t ratio, uvc_convert_plan_t *plan);
+
 struct uvc_stream_handle {
   struct uvc_device_handle *devh;
   struct uvc_stream_handle *prev, *next;
@@ -268,6 +465,10 @@ struct uvc_stream_handle {
   uint32_t seq, hold_seq;
   uint32_t pts, hold_pts;
   uint32_t last_scr, hold_last_scr;
+  /** capture time and transfer completion time of the frame in hold*, copy mode only */
+  struct timeval hold_capture_time, hold_complete_time;
+  /** device to host clock recovery */
+  struct uvc_clock clock;
   size_t got_bytes, hold_bytes;
   size_t size_buf;	// XXX add for boundary check
   uint8_t *outbuf, *holdbuf;
@@ -277,10 +478,52 @@ struct uvc_stream_handle {
   uint32_t last_polled_seq;
   uvc_frame_callback_t *user_cb;
   void *user_ptr;
-  struct libusb_transfer *transfers[LIBUVC_NUM_TRANSFER_BUFS];
-  uint8_t *transfer_bufs[LIBUVC_NUM_TRANSFER_BUFS];
+  struct libusb_transfer *transfers[LIBUVC_MAX_TRANSFER_BUFS];
+  uint8_t *transfer_bufs[LIBUVC_MAX_TRANSFER_BUFS];
+  /** XXX number of allocated transfers and limit of iso packets (or bulk payloads) per transfer */
+  int num_transfer_bufs;
+  int max_packets_per_transfer;
+  /** XXX transfer auto tuning, the depth is adjusted between LIBUVC_MIN_TRANSFER_BUFS and num_transfer_bufs */
+  uint8_t xfer_auto_tune;
+  /** transfers allowed in flight and transfers currently submitted */
+  volatile int xfer_depth;
+  volatile int xfer_in_flight;
+  /** transfers that are allocated but not submitted while the depth is reduced, only access with cb_mutex */
+  struct libusb_transfer *parked_transfers[LIBUVC_MAX_TRANSFER_BUFS];
+  int num_parked;
+  /** measurement window of auto tuning, only accessed from the libusb event thread */
+  int tune_count, tune_clean_windows;
+  uint32_t tune_errors;
+  int64_t tune_start_ns, tune_last_ns, tune_max_gap_ns;
   struct uvc_frame frame;
   enum uvc_frame_format frame_format;
+  /** XXX zero-copy mode (UVC_STREAM_FLAG_ZERO_COPY), payloads are assembled
+   * into frames from frame_pool and outbuf points to cur_frame->data */
+  uint8_t zero_copy;
+  struct uvc_frame_pool *frame_pool;
+  /** frame that is currently assembled */
+  uvc_frame_t *cur_frame;
+  /** ring of completed frames waiting for the consumer, only access with cb_mutex */
+  uvc_frame_t *hold_frames[LIBUVC_MAX_FRAME_RING];
+  int hold_head, hold_count;
+  /** number of ring slots and what to discard when the ring is full */
+  int hold_slots;
+  enum uvc_frame_drop_policy drop_policy;
+  /** transport statistics, only update with UVC_STATS_XXX */
+  struct uvc_stream_stats stats;
+  /** XXX error recovery worker, clear_halt and the error code query are executed here
+   * instead of in the transfer completion callback on the libusb event thread */
+  pthread_t recovery_thread;
+  pthread_mutex_t recovery_mutex;
+  pthread_cond_t recovery_cond;
+  /** UVC_RECOVERY_XXX bits requested but not executed yet */
+  uint8_t recovery_request;
+  uint8_t recovery_running;
+  /** XXX alternate setting selected on start, 0 for bulk transfer */
+  uint8_t alt_setting;
+  /** geometry of the current stream, set on start */
+  uint32_t frame_width, frame_height;
+  size_t frame_step;
 };
 
 /** Handle on an open UVC device
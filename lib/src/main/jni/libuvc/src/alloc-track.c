@@ -0,0 +1,267 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Counting of the heap allocations for the debug build with UVC_ALLOC_TRACKING.
+ * The allocation sites of libuvc and UVCCamera report to uvc_alloc_track,
+ * the counts are kept per thread and per subsystem so that the allocations
+ * left in the steady state of streaming are found with the thread that made them.
+ * Without UVC_ALLOC_TRACKING only the stubs of the API are built.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#ifdef UVC_ALLOC_TRACKING
+
+/** @internal
+ * counters of one thread. The slot belongs to the thread that claimed it in the current
+ * generation, after uvc_reset_alloc_stats each thread claims a slot again and clears it itself
+ */
+typedef struct uvc_alloc_slot {
+	// generation that the slot was claimed in, 0 if never claimed
+	volatile uint32_t gen;
+	pid_t tid;
+	char name[UVC_ALLOC_THREAD_NAME_SZ];
+	uint32_t allocs[UVC_ALLOC_SUBSYSTEM_COUNT];
+	size_t bytes[UVC_ALLOC_SUBSYSTEM_COUNT];
+} uvc_alloc_slot_t;
+
+#define ALLOC_GENERATION_MASK 0xffffff
+
+static uvc_alloc_slot_t slots[UVC_ALLOC_MAX_THREADS];
+// the allocations of the threads that got no slot
+static uvc_alloc_slot_t overflow;
+// incremented on reset so that the threads claim a slot again, 24 bits are used and never 0
+static volatile uint32_t generation = 1;
+// (generation << 8) | (slot index + 1) of the calling thread
+static pthread_key_t slot_key;
+// subsystem + 1 of the calling thread, see uvc_set_alloc_subsystem
+static pthread_key_t subsystem_key;
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+
+static void _uvc_alloc_init_key(void) {
+	pthread_key_create(&slot_key, NULL);
+	pthread_key_create(&subsystem_key, NULL);
+}
+
+/** @internal
+ * clear the counters of the slot that the calling thread just claimed,
+ * the other threads only add to the slot atomically so that the counts are lost at worst
+ */
+static void _uvc_alloc_clear_slot(uvc_alloc_slot_t *slot) {
+	int j;
+
+	for (j = 0; j < UVC_ALLOC_SUBSYSTEM_COUNT; j++) {
+		__atomic_store_n(&slot->allocs[j], 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->bytes[j], 0, __ATOMIC_RELAXED);
+	}
+}
+
+/** @internal
+ * claim the slot if nobody claimed it in this generation
+ * @return 1 if claimed
+ */
+static int _uvc_alloc_claim(uvc_alloc_slot_t *slot, const uint32_t gen) {
+	const uint32_t cur = __atomic_load_n(&slot->gen, __ATOMIC_ACQUIRE);
+
+	if ((cur == gen) || !__sync_bool_compare_and_swap(&slot->gen, cur, gen))
+		return 0;
+	_uvc_alloc_clear_slot(slot);
+	return 1;
+}
+
+/** @internal
+ * @return slot of the calling thread, claims one when the thread has none in this generation
+ */
+static uvc_alloc_slot_t *_uvc_alloc_slot(void) {
+	const uint32_t gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE) & ALLOC_GENERATION_MASK;
+	uvc_alloc_slot_t *slot;
+	uintptr_t value;
+	int index;
+
+	pthread_once(&slot_once, _uvc_alloc_init_key);
+	value = (uintptr_t)pthread_getspecific(slot_key);
+	if (LIKELY(value && ((value >> 8) == gen)))
+		return &slots[(value & 0xff) - 1];
+	// try the slot of the last generation first, then any slot that nobody claimed in this generation
+	index = value ? (int)(value & 0xff) - 1 : -1;
+	if ((index < 0) || !_uvc_alloc_claim(&slots[index], gen)) {
+		for (index = 0; index < UVC_ALLOC_MAX_THREADS; index++) {
+			if (_uvc_alloc_claim(&slots[index], gen))
+				break;
+		}
+	}
+	if (UNLIKELY(index >= UVC_ALLOC_MAX_THREADS)) {
+		_uvc_alloc_claim(&overflow, gen);
+		return &overflow;
+	}
+	slot = &slots[index];
+	slot->tid = (pid_t)syscall(__NR_gettid);
+	prctl(PR_GET_NAME, slot->name, 0, 0, 0);
+	slot->name[UVC_ALLOC_THREAD_NAME_SZ - 1] = '\0';
+	pthread_setspecific(slot_key, (void *)(((uintptr_t)gen << 8) | (uintptr_t)(index + 1)));
+	return slot;
+}
+
+/** @brief Count the heap allocation of the subsystem
+ * @ingroup frame
+ *
+ * Called from the allocation sites through UVC_ALLOC_TRACK, does nothing
+ * unless libuvc is built with UVC_ALLOC_TRACKING. The counting itself never allocates.
+ *
+ * @param subsystem subsystem that allocated, UVC_ALLOC_CALLER for the subsystem of the calling thread
+ * @param bytes Number of the allocated bytes
+ */
+void uvc_alloc_track(enum uvc_alloc_subsystem subsystem, size_t bytes) {
+	uvc_alloc_slot_t *slot;
+
+	if (subsystem == UVC_ALLOC_CALLER)
+		subsystem = uvc_get_alloc_subsystem();
+	if (UNLIKELY((unsigned)subsystem >= UVC_ALLOC_SUBSYSTEM_COUNT))
+		return;
+	slot = _uvc_alloc_slot();
+	__sync_add_and_fetch(&slot->allocs[subsystem], 1);
+	__sync_add_and_fetch(&slot->bytes[subsystem], bytes);
+}
+
+/** @brief Set the subsystem that the calling thread allocates for
+ * @ingroup frame
+ *
+ * The allocations of the frames, the frame arena, the converters and the MJPEG decoders
+ * on this thread are charged to @p subsystem instead of UVC_ALLOC_FRAME.
+ *
+ * @param subsystem subsystem of the calling thread, UVC_ALLOC_CALLER to clear it
+ */
+void uvc_set_alloc_subsystem(enum uvc_alloc_subsystem subsystem) {
+	pthread_once(&slot_once, _uvc_alloc_init_key);
+	if ((unsigned)subsystem >= UVC_ALLOC_SUBSYSTEM_COUNT)
+		subsystem = UVC_ALLOC_CALLER;
+	pthread_setspecific(subsystem_key, (void *)(intptr_t)(subsystem + 1));
+}
+
+/** @brief Get the subsystem that the calling thread allocates for
+ * @ingroup frame
+ *
+ * @return subsystem set with uvc_set_alloc_subsystem, UVC_ALLOC_FRAME if none
+ */
+enum uvc_alloc_subsystem uvc_get_alloc_subsystem(void) {
+	intptr_t value;
+
+	pthread_once(&slot_once, _uvc_alloc_init_key);
+	value = (intptr_t)pthread_getspecific(subsystem_key);
+	return value ? (enum uvc_alloc_subsystem)(value - 1) : UVC_ALLOC_FRAME;
+}
+
+/** @brief Get the heap allocations counted since uvc_reset_alloc_stats
+ * @ingroup frame
+ *
+ * The counters are read without lock and may be slightly inconsistent with each other.
+ *
+ * @param[out] stats counts per thread and per subsystem
+ * @return UVC_ERROR_NOT_SUPPORTED if libuvc is built without UVC_ALLOC_TRACKING
+ */
+uvc_error_t uvc_get_alloc_stats(uvc_alloc_stats_t *stats) {
+	const uint32_t gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE) & ALLOC_GENERATION_MASK;
+	uvc_alloc_thread_stats_t *thread;
+	int i, j;
+
+	if (UNLIKELY(!stats))
+		return UVC_ERROR_INVALID_PARAM;
+	memset(stats, 0, sizeof(uvc_alloc_stats_t));
+	for (i = 0; i < UVC_ALLOC_MAX_THREADS; i++) {
+		// the slots of the last generations were not used since the reset
+		if (__atomic_load_n(&slots[i].gen, __ATOMIC_ACQUIRE) != gen)
+			continue;
+		thread = &stats->threads[stats->num_threads++];
+		thread->tid = slots[i].tid;
+		memcpy(thread->name, slots[i].name, UVC_ALLOC_THREAD_NAME_SZ);
+		for (j = 0; j < UVC_ALLOC_SUBSYSTEM_COUNT; j++) {
+			thread->allocs[j] = __atomic_load_n(&slots[i].allocs[j], __ATOMIC_RELAXED);
+			thread->bytes[j] = __atomic_load_n(&slots[i].bytes[j], __ATOMIC_RELAXED);
+			stats->allocs[j] += thread->allocs[j];
+			stats->bytes[j] += thread->bytes[j];
+		}
+	}
+	if (__atomic_load_n(&overflow.gen, __ATOMIC_ACQUIRE) == gen) {
+		for (j = 0; j < UVC_ALLOC_SUBSYSTEM_COUNT; j++) {
+			stats->allocs[j] += __atomic_load_n(&overflow.allocs[j], __ATOMIC_RELAXED);
+			stats->bytes[j] += __atomic_load_n(&overflow.bytes[j], __ATOMIC_RELAXED);
+		}
+	}
+	return UVC_SUCCESS;
+}
+
+/** @brief Clear the counts of the heap allocations
+ * @ingroup frame
+ *
+ * Call after warming up e.g. when the first frames were drawn
+ * so that the following counts show the allocations of the steady state.
+ * This only starts a new generation, each thread clears its own slot
+ * when it allocates next time, so the counters in use are never overwritten.
+ * The allocations on the other threads while resetting may be lost.
+ */
+void uvc_reset_alloc_stats(void) {
+	uint32_t gen;
+
+	do {
+		gen = __sync_add_and_fetch(&generation, 1);
+	} while (UNLIKELY(!(gen & ALLOC_GENERATION_MASK)));
+}
+
+#else	// #ifdef UVC_ALLOC_TRACKING
+
+void uvc_alloc_track(enum uvc_alloc_subsystem subsystem, size_t bytes) {
+}
+
+uvc_error_t uvc_get_alloc_stats(uvc_alloc_stats_t *stats) {
+	return UVC_ERROR_NOT_SUPPORTED;
+}
+
+void uvc_reset_alloc_stats(void) {
+}
+
+void uvc_set_alloc_subsystem(enum uvc_alloc_subsystem subsystem) {
+}
+
+enum uvc_alloc_subsystem uvc_get_alloc_subsystem(void) {
+	return UVC_ALLOC_FRAME;
+}
+
+#endif	// #ifdef UVC_ALLOC_TRACKING
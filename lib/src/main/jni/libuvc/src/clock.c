@@ -0,0 +1,226 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * @defgroup clock Device clock recovery
+ * @brief Map PTS/SCR of the payload headers to host CLOCK_MONOTONIC
+ *
+ * The device stamps each frame with PTS and each payload with SCR
+ * (source time clock and USB SOF token counter) in its own clock domain.
+ * The host time every SCR was received is recorded and a line is fitted
+ * to the recent samples so that PTS can be converted to the host time
+ * the device started capturing the frame.
+ */
+#include <math.h>
+#include <time.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+/** permissible deviation of the fitted slope from the nominal clock frequency */
+#define CLOCK_SLOPE_TOLERANCE 0.05
+/** permissible difference between STC and SOF progress in milliseconds */
+#define CLOCK_SOF_TOLERANCE_MS 2
+/** PTS that maps outside [received - CLOCK_MAX_LATENCY_NS, received] is ignored */
+#define CLOCK_MAX_LATENCY_NS NSEC_PER_SEC
+
+static inline int64_t _uvc_clock_now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/** @internal
+ * @brief Reset clock recovery, called when the stream starts
+ * @param dev_frequency clock frequency of PTS/SCR in Hz, 0 if unknown
+ */
+void uvc_clock_init(uvc_clock_t *clock, uint32_t dev_frequency) {
+	memset(clock, 0, sizeof(uvc_clock_t));
+	clock->dev_frequency = dev_frequency;
+}
+
+/** @internal
+ * @brief Mark the start of processing of a completed transfer
+ */
+void uvc_clock_begin_transfer(uvc_clock_t *clock) {
+	clock->xfer_host_ns = _uvc_clock_now_ns();
+	clock->xfer_has_scr = 0;
+}
+
+/** @internal
+ * @brief Record SCR of a payload header, only the latest SCR of each transfer is used
+ */
+void uvc_clock_add_scr(uvc_clock_t *clock, uint32_t stc, uint16_t sof) {
+	clock->xfer_stc = stc;
+	clock->xfer_sof = sof & 0x07ff;
+	clock->xfer_has_scr = 1;
+}
+
+/** @internal
+ * @brief Validate STC progress against the SOF token counter
+ * SOF is driven by the host controller at 1kHz, so STC must advance by
+ * about dev_frequency / 1000 per SOF tick. Some devices do not fill SOF,
+ * those are not validated.
+ */
+static int _uvc_clock_check_sof(uvc_clock_t *clock, int64_t stc_delta, uint16_t sof) {
+	const int64_t ticks_per_ms = clock->dev_frequency / 1000;
+	const int64_t sof_delta = (sof - clock->last_sof) & 0x07ff;
+
+	if (!ticks_per_ms || !sof_delta)
+		return 1;
+	return llabs(stc_delta - sof_delta * ticks_per_ms) <= CLOCK_SOF_TOLERANCE_MS * ticks_per_ms;
+}
+
+/** @internal
+ * @brief Unwrap the SCR of the transfer that has been processed and add it to the sample window
+ */
+void uvc_clock_end_transfer(uvc_clock_t *clock) {
+	uvc_clock_sample_t *sample;
+	int64_t stc_delta;
+
+	if (!clock->xfer_has_scr)
+		return;
+
+	if (UNLIKELY(!clock->has_stc)) {
+		clock->stc_ext = clock->xfer_stc;
+		clock->has_stc = 1;
+	} else {
+		stc_delta = (int32_t)(clock->xfer_stc - clock->last_stc);
+		if (UNLIKELY((stc_delta < 0) || !_uvc_clock_check_sof(clock, stc_delta, clock->xfer_sof))) {
+			// STC went backwards or jumped, the device clock may have been reset
+			if (++clock->rejects >= LIBUVC_CLOCK_MAX_REJECTS) {
+				MARK("device clock discontinuity, reset clock recovery");
+				clock->count = clock->rejects = 0;
+				clock->has_stc = clock->valid = 0;
+			}
+			return;
+		}
+		clock->stc_ext += stc_delta;
+	}
+	clock->rejects = 0;
+	clock->last_stc = clock->xfer_stc;
+	clock->last_sof = clock->xfer_sof;
+
+	if (clock->count) {
+		sample = &clock->samples[(clock->head + clock->count - 1) % LIBUVC_CLOCK_SAMPLES];
+		if (clock->xfer_host_ns - sample->host_ns < LIBUVC_CLOCK_SAMPLE_INTERVAL_MS * NSEC_PER_MSEC)
+			return;
+	}
+	if (clock->count < LIBUVC_CLOCK_SAMPLES) {
+		sample = &clock->samples[(clock->head + clock->count) % LIBUVC_CLOCK_SAMPLES];
+		clock->count++;
+	} else {
+		// overwrite the oldest sample
+		sample = &clock->samples[clock->head];
+		clock->head = (clock->head + 1) % LIBUVC_CLOCK_SAMPLES;
+	}
+	sample->dev_stc = clock->stc_ext;
+	sample->dev_sof = clock->xfer_sof;
+	sample->host_ns = clock->xfer_host_ns;
+	clock->dirty = 1;
+}
+
+/** @internal
+ * @brief Least squares fit of host time against STC over the sample window
+ * values are centered on the mean to keep precision with double.
+ * Falls back to the nominal clock frequency when the fitted slope is implausible.
+ */
+static void _uvc_clock_fit(uvc_clock_t *clock) {
+	const uvc_clock_sample_t *base = &clock->samples[clock->head];
+	const double nominal = clock->dev_frequency ? (double)NSEC_PER_SEC / clock->dev_frequency : 0;
+	double x, y, mean_x = 0, mean_y = 0, sxx = 0, sxy = 0, slope = 0;
+	int i;
+
+	clock->dirty = 0;
+	clock->valid = 0;
+	if (clock->count < 2)
+		return;
+
+	for (i = 0; i < clock->count; i++) {
+		const uvc_clock_sample_t *sample = &clock->samples[(clock->head + i) % LIBUVC_CLOCK_SAMPLES];
+		mean_x += (double)(int64_t)(sample->dev_stc - base->dev_stc);
+		mean_y += (double)(sample->host_ns - base->host_ns);
+	}
+	mean_x /= clock->count;
+	mean_y /= clock->count;
+	for (i = 0; i < clock->count; i++) {
+		const uvc_clock_sample_t *sample = &clock->samples[(clock->head + i) % LIBUVC_CLOCK_SAMPLES];
+		x = (double)(int64_t)(sample->dev_stc - base->dev_stc) - mean_x;
+		y = (double)(sample->host_ns - base->host_ns) - mean_y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	if (LIKELY(sxx > 0))
+		slope = sxy / sxx;
+	if (UNLIKELY((slope <= 0) || (nominal && (fabs(slope - nominal) > nominal * CLOCK_SLOPE_TOLERANCE)))) {
+		if (!nominal)
+			return;
+		slope = nominal;
+	}
+	// the line passes through the mean of the samples
+	clock->stc_base = base->dev_stc + (int64_t)mean_x;
+	clock->host_base = base->host_ns + (int64_t)mean_y;
+	clock->slope = slope;
+	clock->valid = 1;
+}
+
+/** @internal
+ * @brief Capture time of a frame in nanoseconds of CLOCK_MONOTONIC
+ * Converts PTS with the fitted clock. When PTS is not available or the clock
+ * is not locked yet, the time the frame was received is used instead.
+ * The returned value is strictly increasing.
+ * @param pts presentation time stamp of the frame, 0 if the device did not send it
+ */
+int64_t uvc_clock_frame_time(uvc_clock_t *clock, uint32_t pts) {
+	int64_t ns = clock->xfer_host_ns;
+	int64_t t;
+
+	if (pts && clock->has_stc) {
+		if (clock->dirty)
+			_uvc_clock_fit(clock);
+		if (LIKELY(clock->valid)) {
+			// PTS is close to the latest STC, unwrap it relative to that
+			const uint64_t pts_ext = clock->stc_ext + (int32_t)(pts - clock->last_stc);
+			t = clock->host_base + (int64_t)(clock->slope * (double)(int64_t)(pts_ext - clock->stc_base));
+			if (LIKELY((t <= ns) && (ns - t <= CLOCK_MAX_LATENCY_NS)))
+				ns = t;
+		}
+	}
+	if (UNLIKELY(ns <= clock->last_frame_ns))
+		ns = clock->last_frame_ns + 1000;	// keep at least 1 usec apart for struct timeval
+	clock->last_frame_ns = ns;
+	return ns;
+}
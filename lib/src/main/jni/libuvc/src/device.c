@@ -102,6 +102,8 @@ uvc_error_t uvc_parse_vs_frame_frame(uvc_streaming_interface_t *stream_if,
 	    size_t block_size);
 uvc_error_t uvc_parse_vs_input_header(uvc_streaming_interface_t *stream_if,
 		const unsigned char *block, size_t block_size);
+uvc_error_t uvc_parse_vs_color_format(uvc_streaming_interface_t *stream_if,
+		const unsigned char *block, size_t block_size);
 
 void _uvc_status_callback(struct libusb_transfer *transfer);
 
@@ -988,6 +990,8 @@ uvc_error_t uvc_parse_vc_header(uvc_device_t *dev, uvc_device_info_t *info,
 	 */
 
 	info->ctrl_if.bcdUVC = SW_TO_SHORT(&block[3]);
+	// XXX clock frequency of PTS/SCR, used for clock recovery
+	info->ctrl_if.dwClockFrequency = LIKELY(block_size >= 11) ? DW_TO_INT(&block[7]) : 0;
 
 	switch (info->ctrl_if.bcdUVC) {
 	case 0x0100:
@@ -1358,6 +1362,27 @@ uvc_error_t uvc_parse_vs_format_mjpeg(uvc_streaming_interface_t *stream_if,
 	return UVC_SUCCESS;
 }
 
+/** @internal
+ * @brief Parse a VideoStreaming color matching block.
+ * The block follows the frame blocks of the format it applies to.
+ * @ingroup device
+ */
+uvc_error_t uvc_parse_vs_color_format(uvc_streaming_interface_t *stream_if,
+		const unsigned char *block, size_t block_size) {
+	UVC_ENTER();
+
+	uvc_format_desc_t *format = stream_if->format_descs ? stream_if->format_descs->prev : NULL;
+
+	if (LIKELY(format && (block_size >= 6))) {
+		format->bColorPrimaries = block[3];
+		format->bTransferCharacteristics = block[4];
+		format->bMatrixCoefficients = block[5];
+	}
+
+	UVC_EXIT(UVC_SUCCESS);
+	return UVC_SUCCESS;
+}
+
 /** @internal
  * @brief Parse a VideoStreaming uncompressed frame block.
  * @ingroup device
@@ -1513,8 +1538,9 @@ uvc_error_t uvc_parse_vs(uvc_device_t *dev, uvc_device_info_t *info,
 	case UVC_VS_FRAME_FRAME_BASED:
 		ret = uvc_parse_vs_frame_frame(stream_if, block, block_size );
 		break;
-//	case UVC_VS_COLORFORMAT:	// FIXME unsupported now
-//		break;
+	case UVC_VS_COLORFORMAT:
+		ret = uvc_parse_vs_color_format(stream_if, block, block_size);
+		break;
 	default:
 		/** @todo handle JPEG and maybe still frames or even DV... */
 		LOGV("unsupported descriptor_subtype(0x%02x)", descriptor_subtype);
@@ -0,0 +1,530 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Shared arena of frames with size classed data buffers.
+ * The data buffers are page aligned and their size is rounded up to the class,
+ * 4 classes per power of 2, so that frames of similar size are reused without realloc.
+ * Free frames are kept in magazines. Each thread holds a loaded and a previous magazine
+ * per class and takes/returns the frames without lock, only when both of them are empty
+ * (or full) it exchanges a whole magazine with the depot shared by all threads.
+ * So the frames that one thread allocates and another thread frees go through
+ * the depot with one lock per magazine instead of one lock per frame.
+ * The magazines are arrays in the threads and in the depot, the exchange copies
+ * the frames, so the magazines themselves are never allocated while streaming.
+ * After warming up, streaming takes and returns the frames without malloc/free.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+// alignment of the data buffers, enough for SIMD and DMA
+#define ARENA_ALIGN 4096
+// smallest class is 4KiB, the buffers larger than 64MiB are not cached
+#define ARENA_MIN_SHIFT 12
+#define ARENA_MAX_SHIFT 26
+#define ARENA_SUB_CLASSES 4
+#define ARENA_NUM_CLASSES ((ARENA_MAX_SHIFT - ARENA_MIN_SHIFT) * ARENA_SUB_CLASSES + 1)
+// frames in a magazine, the large classes hold fewer frames to limit what a thread caches
+#define ARENA_MAGAZINE_SZ 8
+#define ARENA_MAGAZINE_MIN 2
+#define ARENA_MAGAZINE_BYTES (4 * 1024 * 1024)
+// upper limit of the full magazines per class and of the bytes kept in the depot
+#define ARENA_DEPOT_MAGAZINES 4
+#define ARENA_DEPOT_MAX_BYTES (48 * 1024 * 1024)
+
+/** @internal
+ * stack of free frames of one class
+ */
+typedef struct uvc_arena_magazine {
+	int count;
+	uvc_frame_t *frames[ARENA_MAGAZINE_SZ];
+} uvc_arena_magazine_t;
+
+/** @internal
+ * magazines of the calling thread, loaded and previous point to either of magazines
+ */
+typedef struct uvc_arena_cache {
+	uvc_arena_magazine_t *loaded[ARENA_NUM_CLASSES];
+	uvc_arena_magazine_t *previous[ARENA_NUM_CLASSES];
+	uvc_arena_magazine_t magazines[ARENA_NUM_CLASSES][2];
+} uvc_arena_cache_t;
+
+/** @internal
+ * full magazines shared by all threads, only access with mutex
+ */
+typedef struct uvc_arena_depot {
+	pthread_mutex_t mutex;
+	uvc_arena_magazine_t full[ARENA_NUM_CLASSES][ARENA_DEPOT_MAGAZINES];
+	uint8_t num_full[ARENA_NUM_CLASSES];
+	size_t bytes;
+} uvc_arena_depot_t;
+
+static uvc_arena_depot_t depot = { PTHREAD_MUTEX_INITIALIZER };
+static uvc_arena_stats_t arena_stats;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static void _uvc_arena_release(uvc_frame_t *frame);
+
+/** @internal
+ * @return index of the smallest class that holds @p bytes, -1 if it is too large to cache
+ */
+static inline int _uvc_arena_class(const size_t bytes) {
+	if (bytes <= ((size_t)1 << ARENA_MIN_SHIFT))
+		return 0;
+	if (UNLIKELY(bytes > ((size_t)1 << ARENA_MAX_SHIFT)))
+		return -1;
+	// bytes is in (2^shift, 2^(shift + 1)]
+	const int shift = (int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl((unsigned long)(bytes - 1));
+	const int sub = (int)(((bytes - 1) - ((size_t)1 << shift)) >> (shift - 2)) + 1;
+	return (shift - ARENA_MIN_SHIFT) * ARENA_SUB_CLASSES + sub;
+}
+
+/** @internal
+ * @return size of the data buffer of the class
+ */
+static inline size_t _uvc_arena_class_bytes(const int index) {
+	if (!index)
+		return (size_t)1 << ARENA_MIN_SHIFT;
+	const int shift = ARENA_MIN_SHIFT + (index - 1) / ARENA_SUB_CLASSES;
+	const int sub = (index - 1) % ARENA_SUB_CLASSES + 1;
+	return ((size_t)1 << shift) + ((size_t)sub << (shift - 2));
+}
+
+/** @internal
+ * @return number of frames a magazine of the class holds
+ */
+static inline int _uvc_arena_capacity(const int index) {
+	const size_t n = ARENA_MAGAZINE_BYTES / _uvc_arena_class_bytes(index);
+	return n < ARENA_MAGAZINE_MIN ? ARENA_MAGAZINE_MIN
+		: (n > ARENA_MAGAZINE_SZ ? ARENA_MAGAZINE_SZ : (int)n);
+}
+
+static inline void _uvc_arena_update_peak(size_t *peak, const size_t value) {
+	size_t cur = *peak;
+	while (UNLIKELY(value > cur)) {
+		if (__sync_bool_compare_and_swap(peak, cur, value))
+			break;
+		cur = *peak;
+	}
+}
+
+/** @internal
+ * copy the frames of the magazine, src becomes empty
+ */
+static inline void _uvc_arena_move(uvc_arena_magazine_t *dst, uvc_arena_magazine_t *src) {
+	memcpy(dst->frames, src->frames, src->count * sizeof(uvc_frame_t *));
+	dst->count = src->count;
+	src->count = 0;
+}
+
+static inline void _uvc_arena_swap(uvc_arena_cache_t *cache, const int index) {
+	uvc_arena_magazine_t *magazine = cache->loaded[index];
+	cache->loaded[index] = cache->previous[index];
+	cache->previous[index] = magazine;
+}
+
+/** @internal
+ * hand the full magazine to the depot, should be called with mutex
+ * @return 0 if the depot has no room, the magazine is kept as is
+ */
+static inline int _uvc_arena_depot_push(const int index, uvc_arena_magazine_t *magazine) {
+	const size_t bytes = magazine->count * _uvc_arena_class_bytes(index);
+
+	if ((depot.num_full[index] < ARENA_DEPOT_MAGAZINES)
+		&& (depot.bytes + bytes <= ARENA_DEPOT_MAX_BYTES)) {
+
+		_uvc_arena_move(&depot.full[index][depot.num_full[index]++], magazine);
+		depot.bytes += bytes;
+		return 1;
+	}
+	return 0;
+}
+
+/** @internal
+ * return the frames of the magazine to the system
+ */
+static void _uvc_arena_empty(uvc_arena_magazine_t *magazine) {
+	while (magazine->count) {
+		_uvc_arena_release(magazine->frames[--magazine->count]);
+	}
+}
+
+/** @internal
+ * hand the frames of the magazine to the depot when it has room, otherwise return them to the system
+ */
+static void _uvc_arena_depot_return(const int index, uvc_arena_magazine_t *magazine) {
+	if (!magazine->count)
+		return;
+	pthread_mutex_lock(&depot.mutex);
+	{
+		_uvc_arena_depot_push(index, magazine);
+	}
+	pthread_mutex_unlock(&depot.mutex);
+	_uvc_arena_empty(magazine);
+}
+
+/** @internal
+ * move the magazines of the exiting thread to the depot
+ */
+static void _uvc_arena_cache_destructor(void *ptr) {
+	uvc_arena_cache_t *cache = ptr;
+	int i;
+
+	pthread_setspecific(cache_key, NULL);
+	for (i = 0; i < ARENA_NUM_CLASSES; i++) {
+		_uvc_arena_depot_return(i, cache->loaded[i]);
+		_uvc_arena_depot_return(i, cache->previous[i]);
+	}
+	free(cache);
+}
+
+static void _uvc_arena_init_key(void) {
+	pthread_key_create(&cache_key, _uvc_arena_cache_destructor);
+}
+
+/** @internal
+ * @param create allocate the cache when the thread has none
+ * @return magazines of the calling thread, NULL if none
+ */
+static inline uvc_arena_cache_t *_uvc_arena_cache(const int create) {
+	uvc_arena_cache_t *cache;
+	int i;
+
+	pthread_once(&cache_once, _uvc_arena_init_key);
+	cache = pthread_getspecific(cache_key);
+	if (UNLIKELY(!cache && create)) {
+		cache = calloc(1, sizeof(uvc_arena_cache_t));
+		if (LIKELY(cache)) {
+			UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_arena_cache_t));
+			for (i = 0; i < ARENA_NUM_CLASSES; i++) {
+				cache->loaded[i] = &cache->magazines[i][0];
+				cache->previous[i] = &cache->magazines[i][1];
+			}
+			pthread_setspecific(cache_key, cache);
+		}
+	}
+	return cache;
+}
+
+/** @internal
+ * allocate new frame and its data buffer from the system
+ */
+static uvc_frame_t *_uvc_arena_alloc(const size_t alloc_bytes) {
+	uvc_frame_t *frame = malloc(sizeof(uvc_frame_t));
+	void *data = NULL;
+
+	if (UNLIKELY(!frame))
+		return NULL;
+	if (UNLIKELY(posix_memalign(&data, ARENA_ALIGN, alloc_bytes))) {
+		free(frame);
+		return NULL;
+	}
+	UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_frame_t) + alloc_bytes);
+	frame->data = data;
+	frame->alloc_bytes = alloc_bytes;
+	__sync_add_and_fetch(&arena_stats.allocs, 1);
+	_uvc_arena_update_peak(&arena_stats.peak_reserved_bytes,
+		__sync_add_and_fetch(&arena_stats.reserved_bytes, alloc_bytes));
+	return frame;
+}
+
+/** @internal
+ * return the frame and its data buffer to the system
+ */
+static void _uvc_arena_release(uvc_frame_t *frame) {
+	__sync_add_and_fetch(&arena_stats.frees, 1);
+	__sync_sub_and_fetch(&arena_stats.reserved_bytes, frame->alloc_bytes);
+	free(frame->data);
+	free(frame);
+}
+
+/** @internal
+ * take a free frame of the class from the magazines, the depot or the system,
+ * the fields other than data and alloc_bytes are not set
+ */
+static uvc_frame_t *_uvc_arena_get(const size_t data_bytes) {
+	const int index = _uvc_arena_class(data_bytes);
+	uvc_arena_cache_t *cache;
+	uvc_arena_magazine_t *loaded, *previous;
+
+	if (UNLIKELY(index < 0)) {
+		// too large to cache
+		return _uvc_arena_alloc(data_bytes);
+	}
+	cache = _uvc_arena_cache(1);
+	if (UNLIKELY(!cache))
+		return _uvc_arena_alloc(_uvc_arena_class_bytes(index));
+	loaded = cache->loaded[index];
+	if (LIKELY(loaded->count)) {
+		__sync_add_and_fetch(&arena_stats.magazine_hits, 1);
+		return loaded->frames[--loaded->count];
+	}
+	previous = cache->previous[index];
+	if (previous->count) {
+		_uvc_arena_swap(cache, index);
+		__sync_add_and_fetch(&arena_stats.magazine_hits, 1);
+		return previous->frames[--previous->count];
+	}
+	// both magazines are empty, refill the previous one with a full magazine of the depot,
+	// peek without lock so that the allocations while warming up do not take the lock
+	if (!__atomic_load_n(&depot.num_full[index], __ATOMIC_RELAXED))
+		return _uvc_arena_alloc(_uvc_arena_class_bytes(index));
+	__sync_add_and_fetch(&arena_stats.depot_locks, 1);
+	pthread_mutex_lock(&depot.mutex);
+	{
+		if (depot.num_full[index]) {
+			_uvc_arena_move(previous, &depot.full[index][--depot.num_full[index]]);
+			depot.bytes -= previous->count * _uvc_arena_class_bytes(index);
+		}
+	}
+	pthread_mutex_unlock(&depot.mutex);
+	if (previous->count) {
+		_uvc_arena_swap(cache, index);
+		__sync_add_and_fetch(&arena_stats.depot_hits, 1);
+		return previous->frames[--previous->count];
+	}
+	return _uvc_arena_alloc(_uvc_arena_class_bytes(index));
+}
+
+/** @internal
+ * keep the free frame in the magazines or the depot, or return it to the system
+ */
+static void _uvc_arena_put(uvc_frame_t *frame) {
+	const int index = _uvc_arena_class(frame->alloc_bytes);
+	uvc_arena_cache_t *cache;
+	uvc_arena_magazine_t *loaded, *previous;
+	int capacity;
+
+	if (UNLIKELY((index < 0) || (_uvc_arena_class_bytes(index) != frame->alloc_bytes))) {
+		_uvc_arena_release(frame);
+		return;
+	}
+	cache = _uvc_arena_cache(1);
+	if (UNLIKELY(!cache)) {
+		_uvc_arena_release(frame);
+		return;
+	}
+	capacity = _uvc_arena_capacity(index);
+	loaded = cache->loaded[index];
+	if (LIKELY(loaded->count < capacity)) {
+		loaded->frames[loaded->count++] = frame;
+		return;
+	}
+	previous = cache->previous[index];
+	if (previous->count >= capacity) {
+		// both magazines are full, hand the previous one to the depot
+		__sync_add_and_fetch(&arena_stats.depot_locks, 1);
+		pthread_mutex_lock(&depot.mutex);
+		{
+			_uvc_arena_depot_push(index, previous);
+		}
+		pthread_mutex_unlock(&depot.mutex);
+		// return the frames to the system if the depot had no room
+		_uvc_arena_empty(previous);
+	}
+	_uvc_arena_swap(cache, index);
+	previous->frames[previous->count++] = frame;
+}
+
+/** @brief Allocate a frame from the shared frame arena
+ * @ingroup frame
+ *
+ * The data buffer is page aligned and its size is rounded up to the size class,
+ * so uvc_ensure_frame_size does not reallocate it while the frame is reused
+ * for the data of similar size. Free the frame with uvc_free_frame
+ * (or uvc_release_frame) on any thread to return it to the arena.
+ *
+ * @param data_bytes Number of bytes of the data buffer
+ * @return New frame, or NULL on error
+ */
+uvc_frame_t *uvc_arena_allocate_frame(size_t data_bytes) {
+	uvc_frame_t *frame;
+	void *data;
+	size_t alloc_bytes;
+
+	if (UNLIKELY(!data_bytes))
+		return NULL;
+	frame = _uvc_arena_get(data_bytes);
+	if (UNLIKELY(!frame))
+		return NULL;
+	data = frame->data;
+	alloc_bytes = frame->alloc_bytes;
+	memset(frame, 0, sizeof(uvc_frame_t));
+	frame->data = data;
+	frame->alloc_bytes = alloc_bytes;
+	frame->data_bytes = frame->actual_bytes = data_bytes;
+	frame->library_owns_data = 1;
+	frame->ref_count = 1;
+	__sync_add_and_fetch(&arena_stats.gets, 1);
+	_uvc_arena_update_peak(&arena_stats.peak_in_use_bytes,
+		__sync_add_and_fetch(&arena_stats.in_use_bytes, alloc_bytes));
+
+	return frame;
+}
+
+/** @brief Allocate frames in advance so that they are reused later
+ * @ingroup frame
+ *
+ * @param data_bytes Number of bytes of the data buffer
+ * @param num_frames Number of frames
+ * @return Number of frames of the class kept in the shared depot of the arena
+ */
+int uvc_arena_reserve(size_t data_bytes, int num_frames) {
+	const int index = _uvc_arena_class(data_bytes);
+	const size_t alloc_bytes = index >= 0 ? _uvc_arena_class_bytes(index) : 0;
+	const int capacity = index >= 0 ? _uvc_arena_capacity(index) : 0;
+	uvc_arena_magazine_t *magazine;
+	uvc_frame_t *frame;
+	int i, result = 0;
+
+	if (UNLIKELY(index < 0))
+		return 0;
+	pthread_mutex_lock(&depot.mutex);
+	{
+		for (i = 0; i < depot.num_full[index]; i++) {
+			result += depot.full[index][i].count;
+		}
+		while ((result < num_frames) && (depot.num_full[index] < ARENA_DEPOT_MAGAZINES)) {
+			magazine = &depot.full[index][depot.num_full[index]];
+			magazine->count = 0;
+			while ((result < num_frames) && (magazine->count < capacity)
+				&& (depot.bytes + alloc_bytes <= ARENA_DEPOT_MAX_BYTES)) {
+
+				frame = _uvc_arena_alloc(alloc_bytes);
+				if (UNLIKELY(!frame))
+					break;
+				magazine->frames[magazine->count++] = frame;
+				depot.bytes += alloc_bytes;
+				result++;
+			}
+			if (UNLIKELY(!magazine->count))
+				break;
+			depot.num_full[index]++;
+		}
+	}
+	pthread_mutex_unlock(&depot.mutex);
+
+	return result;
+}
+
+/** @brief Return the free frames of the depot and of the calling thread to the system
+ * @ingroup frame
+ *
+ * The frames in use and in the magazines of the other threads are kept.
+ */
+void uvc_arena_trim(void) {
+	uvc_arena_cache_t *cache = _uvc_arena_cache(0);
+	int i;
+
+	if (cache) {
+		for (i = 0; i < ARENA_NUM_CLASSES; i++) {
+			_uvc_arena_empty(cache->loaded[i]);
+			_uvc_arena_empty(cache->previous[i]);
+		}
+	}
+	pthread_mutex_lock(&depot.mutex);
+	{
+		for (i = 0; i < ARENA_NUM_CLASSES; i++) {
+			while (depot.num_full[i]) {
+				_uvc_arena_empty(&depot.full[i][--depot.num_full[i]]);
+			}
+		}
+		depot.bytes = 0;
+	}
+	pthread_mutex_unlock(&depot.mutex);
+}
+
+/** @brief Get statistics of the shared frame arena
+ * @ingroup frame
+ *
+ * The counters are read without lock and may be slightly inconsistent with each other.
+ *
+ * @param[out] stats statistics since the process started
+ */
+void uvc_arena_get_stats(uvc_arena_stats_t *stats) {
+	if (LIKELY(stats)) {
+		*stats = arena_stats;
+	}
+}
+
+/** @internal
+ * @brief Return the frame from uvc_arena_allocate_frame to the arena, called from uvc_free_frame
+ */
+void uvc_arena_free_frame(uvc_frame_t *frame) {
+	__sync_sub_and_fetch(&arena_stats.in_use_bytes, frame->alloc_bytes);
+	if (UNLIKELY(!frame->library_owns_data)) {
+		// the user replaced the data buffer, the buffer of the arena is already lost
+		__sync_sub_and_fetch(&arena_stats.reserved_bytes, frame->alloc_bytes);
+		free(frame);
+		return;
+	}
+	_uvc_arena_put(frame);
+}
+
+/** @internal
+ * @brief uvc_ensure_frame_size for the frame from the arena
+ *
+ * The data buffer is kept while it is large enough, otherwise it is exchanged
+ * for the buffer of the larger class. The content is not preserved in that case.
+ */
+uvc_error_t uvc_arena_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
+	uvc_frame_t *larger;
+	void *data;
+	size_t alloc_bytes;
+
+	if (UNLIKELY(!need_bytes))
+		return UVC_ERROR_NO_MEM;
+	if (UNLIKELY(need_bytes > frame->alloc_bytes)) {
+		larger = _uvc_arena_get(need_bytes);
+		if (UNLIKELY(!larger))
+			return UVC_ERROR_NO_MEM;
+		// swap the data buffers and return the smaller one with the frame struct of larger
+		data = frame->data;
+		alloc_bytes = frame->alloc_bytes;
+		frame->data = larger->data;
+		frame->alloc_bytes = larger->alloc_bytes;
+		larger->data = data;
+		larger->alloc_bytes = alloc_bytes;
+		_uvc_arena_put(larger);
+		_uvc_arena_update_peak(&arena_stats.peak_in_use_bytes,
+			__sync_add_and_fetch(&arena_stats.in_use_bytes, frame->alloc_bytes - alloc_bytes));
+	}
+	frame->data_bytes = frame->actual_bytes = need_bytes;
+
+	return UVC_SUCCESS;
+}
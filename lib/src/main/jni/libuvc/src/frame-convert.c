@@ -0,0 +1,420 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * Conversion graph of the frame formats.
+ * Each conversion(kernel) declares the source/destination format and the relative
+ * cost per pixel, and the planner finds the cheapest chain of the kernels for
+ * the pair of the formats(and scaling) as the shortest path on the graph.
+ * A new format only needs the kernels from/to the existing formats in convert_kernels.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+// cost of writing and reading back an intermediate frame, per pixel
+#define PASS_COST 2
+// fixed point of the costs, 1.0 = 256
+#define COST_ONE 256
+#define COST_INFINITE UINT32_MAX
+
+static uvc_error_t _uvc_yuv2rgb_color(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale,
+	enum uvc_color_space color_space) {
+
+	return uvc_yuv2rgb(in, out, format, color_space);
+}
+
+/** relative costs per pixel measured on ARMv8/x86-64, MJPEG decoding dominates */
+static const uvc_convert_kernel_t convert_kernels[] = {
+#ifdef LIBUVC_HAS_JPEG
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_YUYV, 56, uvc_mjpeg2yuyv, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGBX, 60, uvc_mjpeg2rgbx, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGB, 58, uvc_mjpeg2rgb, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_BGR, 58, uvc_mjpeg2bgr, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGB565, 60, uvc_mjpeg2rgb565, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_NV12, 52, uvc_mjpeg2yuv420SP, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_NV21, 52, uvc_mjpeg2iyuv420SP, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_I420, 52, uvc_mjpeg2i420, NULL },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_GRAY8, 44, uvc_mjpeg2gray8, NULL },
+	// DCT scaling, cost per source pixel
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_YUYV, 40, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGBX, 42, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGB, 42, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_BGR, 42, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGB565, 42, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_NV12, 41, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_NV21, 41, NULL, uvc_mjpeg2scaled },
+	{ UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_GRAY8, 41, NULL, uvc_mjpeg2scaled },
+#endif
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGBX, 4, uvc_yuyv2rgbx, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGB, 6, uvc_yuyv2rgb, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_BGR, 6, uvc_yuyv2bgr, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGB565, 4, uvc_yuyv2rgb565, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_NV12, 2, uvc_yuyv2yuv420SP, NULL },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_NV21, 2, uvc_yuyv2iyuv420SP, NULL },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_GRAY8, 1, uvc_yuyv2gray8, NULL },
+	// box filter, cost per source pixel from uvc_bench uvc_yuyv2scaled(*,2/3) at 1920x1080
+	// (uvc_yuyv2rgbx = 4): the generic filter is 20 and the rows are converted
+	// after it on 4/9 of the pixels, capped to 20 + PASS_COST because converting
+	// in the same pass never loses against a scaled YUYV intermediate frame.
+	// The unscaled, 1/2 and 1/4 fast paths cost about 2, the plan does not know
+	// the scale but the chains rank same with either costs
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_YUYV, 20, NULL, uvc_yuyv2scaled },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGBX, 22, NULL, uvc_yuyv2scaled, uvc_yuyv2scaled_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGB, 22, NULL, uvc_yuyv2scaled, uvc_yuyv2scaled_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_BGR, 22, NULL, uvc_yuyv2scaled, uvc_yuyv2scaled_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGB565, 22, NULL, uvc_yuyv2scaled, uvc_yuyv2scaled_color },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_NV12, 21, NULL, uvc_yuyv2scaled },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_NV21, 21, NULL, uvc_yuyv2scaled },
+	{ UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_GRAY8, 20, NULL, uvc_yuyv2scaled },
+
+	{ UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_RGBX, 4, uvc_uyvy2rgbx, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_RGB, 6, uvc_uyvy2rgb, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_BGR, 6, uvc_uyvy2bgr, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_RGB565, 4, uvc_uyvy2rgb565, NULL, _uvc_yuv2rgb_color },
+	{ UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_GRAY8, 1, uvc_uyvy2gray8, NULL },
+
+	{ UVC_FRAME_FORMAT_RGB, UVC_FRAME_FORMAT_RGBX, 3, uvc_rgb2rgbx, NULL },
+	{ UVC_FRAME_FORMAT_RGB, UVC_FRAME_FORMAT_RGB565, 3, uvc_rgb2rgb565, NULL },
+};
+
+#define NUM_KERNELS (sizeof(convert_kernels) / sizeof(uvc_convert_kernel_t))
+// node of the graph is the pair of the format and whether the frame is already scaled
+#define NUM_NODES (UVC_FRAME_FORMAT_COUNT * 2)
+#define NODE(format, scaled) ((format) * 2 + (scaled))
+
+/** @internal
+ * @brief Find the cheapest chain of the kernels from src to dst
+ *
+ * @param src format of the source frame
+ * @param dst format of the converted frame
+ * @param scaled whether the chain has to crop/scale(exactly one kernel with convert_scaled)
+ * @param ratio number of the output pixels per source pixel x COST_ONE, used for the kernels after scaling
+ * @param plan result, num_steps is 0 if src and dst are same and not scaled
+ * @return UVC_ERROR_NOT_SUPPORTED if there is no chain within UVC_CONVERT_MAX_STEPS
+ */
+uvc_error_t uvc_convert_plan(enum uvc_frame_format src, enum uvc_frame_format dst,
+	const int scaled, uint32_t ratio, uvc_convert_plan_t *plan) {
+
+	// Bellman-Ford limited to UVC_CONVERT_MAX_STEPS kernels, the graph is tiny
+	uint32_t cost[UVC_CONVERT_MAX_STEPS + 1][NUM_NODES];
+	int16_t via[UVC_CONVERT_MAX_STEPS + 1][NUM_NODES];	// kernel index or -1 if not changed
+	uint8_t prev[UVC_CONVERT_MAX_STEPS + 1][NUM_NODES];
+	int step, node, i;
+	size_t k;
+
+	memset(plan, 0, sizeof(uvc_convert_plan_t));
+	plan->src = src;
+	plan->dst = dst;
+	if (UNLIKELY(((unsigned)src >= UVC_FRAME_FORMAT_COUNT) || ((unsigned)dst >= UVC_FRAME_FORMAT_COUNT)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (!ratio)
+		ratio = 1;
+
+	for (node = 0; node < NUM_NODES; node++)
+		cost[0][node] = COST_INFINITE;
+	cost[0][NODE(src, 0)] = 0;
+	for (step = 1; step <= UVC_CONVERT_MAX_STEPS; step++) {
+		for (node = 0; node < NUM_NODES; node++) {
+			cost[step][node] = cost[step - 1][node];
+			via[step][node] = -1;
+			prev[step][node] = node;
+		}
+		for (k = 0; k < NUM_KERNELS; k++) {
+			const uvc_convert_kernel_t *kernel = &convert_kernels[k];
+			const int scaling = kernel->convert_scaled != NULL;
+			for (i = 0; i < 2; i++) {
+				// scaling kernels go from not scaled to scaled, others keep the state
+				if (scaling && (i || !scaled))
+					continue;
+				const int from = NODE(kernel->src, i);
+				const int to = NODE(kernel->dst, scaling ? 1 : i);
+				if (cost[step - 1][from] == COST_INFINITE)
+					continue;
+				// the kernels after scaling run on the output size
+				const uint32_t c = cost[step - 1][from] + PASS_COST * COST_ONE
+					+ kernel->cost * (i ? ratio : COST_ONE);
+				if (c < cost[step][to]) {
+					cost[step][to] = c;
+					via[step][to] = k;
+					prev[step][to] = from;
+				}
+			}
+		}
+	}
+
+	node = NODE(dst, scaled ? 1 : 0);
+	if (!scaled && (src == dst))
+		return UVC_SUCCESS;	// just copy
+	if (cost[UVC_CONVERT_MAX_STEPS][node] == COST_INFINITE)
+		return UVC_ERROR_NOT_SUPPORTED;
+	plan->cost = cost[UVC_CONVERT_MAX_STEPS][node];
+	for (step = UVC_CONVERT_MAX_STEPS; step > 0; step--) {
+		if (via[step][node] >= 0) {
+			plan->kernels[plan->num_steps++] = &convert_kernels[via[step][node]];
+			node = prev[step][node];
+		}
+	}
+	// kernels were found from the last one
+	for (i = 0; i < plan->num_steps / 2; i++) {
+		const uvc_convert_kernel_t *t = plan->kernels[i];
+		plan->kernels[i] = plan->kernels[plan->num_steps - 1 - i];
+		plan->kernels[plan->num_steps - 1 - i] = t;
+	}
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * Run the kernels of the plan, the intermediate frames are allocated into temp
+ * when they are NULL and kept for the next call
+ */
+static uvc_error_t _uvc_convert_run(const uvc_convert_plan_t *plan, const uvc_scale_t *scale,
+	const enum uvc_color_space color_space,
+	uvc_frame_t *temp[UVC_CONVERT_MAX_STEPS - 1], uvc_frame_t *in, uvc_frame_t *out) {
+
+	uvc_frame_t *src = in, *dst;
+	uvc_error_t result;
+	int i;
+
+	if (!plan->num_steps)
+		return uvc_duplicate_frame(in, out);
+	for (i = 0; i < plan->num_steps; i++) {
+		const uvc_convert_kernel_t *kernel = plan->kernels[i];
+		if (i == plan->num_steps - 1) {
+			dst = out;
+		} else {
+			if (!temp[i]) {
+				// large enough for most formats, the kernels expand it if needed.
+				// from the arena so that uvc_any2format reuses them on the following calls
+				temp[i] = uvc_arena_allocate_frame(in->width * in->height * 4);
+				if (UNLIKELY(!temp[i]))
+					return UVC_ERROR_NO_MEM;
+			}
+			dst = temp[i];
+		}
+		if (kernel->convert_color && (color_space != UVC_COLOR_SPACE_BT601_FULL)) {
+			result = kernel->convert_color(src, dst, kernel->dst, scale, color_space);
+		} else {
+			result = kernel->convert_scaled
+				? kernel->convert_scaled(src, dst, kernel->dst, scale)
+				: kernel->convert(src, dst);
+		}
+		if (UNLIKELY(result))
+			return result;
+		dst->frame_format = kernel->dst;	// XXX some kernels do not set this
+		src = dst;
+	}
+	return UVC_SUCCESS;
+}
+
+static pthread_mutex_t plan_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uvc_convert_plan_t plan_cache[UVC_FRAME_FORMAT_COUNT][UVC_FRAME_FORMAT_COUNT];
+static uint8_t plan_cached[UVC_FRAME_FORMAT_COUNT][UVC_FRAME_FORMAT_COUNT];
+
+/** @internal
+ * @brief Plan without scaling, the plans are cached for each pair of the formats
+ */
+static uvc_error_t _uvc_convert_cached_plan(enum uvc_frame_format src, enum uvc_frame_format dst,
+	uvc_convert_plan_t *plan) {
+
+	uvc_error_t result = UVC_SUCCESS;
+
+	if (UNLIKELY(((unsigned)src >= UVC_FRAME_FORMAT_COUNT) || ((unsigned)dst >= UVC_FRAME_FORMAT_COUNT)))
+		return UVC_ERROR_NOT_SUPPORTED;
+	pthread_mutex_lock(&plan_cache_mutex);
+	{
+		if (!plan_cached[src][dst]) {
+			// the failed plans are cached too(as num_steps = 0 and src != dst)
+			uvc_convert_plan(src, dst, 0, COST_ONE, &plan_cache[src][dst]);
+			plan_cached[src][dst] = 1;
+		}
+		*plan = plan_cache[src][dst];
+	}
+	pthread_mutex_unlock(&plan_cache_mutex);
+	if (!plan->num_steps && (src != dst))
+		result = UVC_ERROR_NOT_SUPPORTED;
+	return result;
+}
+
+/** @brief Convert a frame into the specific format
+ * @ingroup frame
+ *
+ * The cheapest chain of the conversions is used, and the chain is cached
+ * for each pair of the formats. The intermediate frames are taken from the frame arena
+ * for each call, use uvc_converter_t to convert the frames of a stream.
+ * @param in source frame
+ * @param out converted frame
+ * @param format format of the converted frame
+ */
+uvc_error_t uvc_any2format(uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format) {
+	uvc_frame_t *temp[UVC_CONVERT_MAX_STEPS - 1] = { NULL };
+	uvc_convert_plan_t plan;
+	uvc_error_t result;
+	int i;
+
+	result = _uvc_convert_cached_plan(in->frame_format, format, &plan);
+	if (LIKELY(!result)) {
+		result = _uvc_convert_run(&plan, NULL, UVC_COLOR_SPACE_BT601_FULL, temp, in, out);
+		for (i = 0; i < UVC_CONVERT_MAX_STEPS - 1; i++) {
+			if (temp[i])
+				uvc_free_frame(temp[i]);
+		}
+	}
+	return result;
+}
+
+/** converter for the frames of a stream */
+struct uvc_converter {
+	/** format of the converted frame */
+	enum uvc_frame_format format;
+	uvc_scale_t scale;
+	uint8_t has_scale;
+	/** color space of the uncompressed YUV source */
+	enum uvc_color_space color_space;
+	/** source format/size of the cached plan */
+	enum uvc_frame_format src_format;
+	uint32_t src_width, src_height;
+	uint8_t has_plan;
+	uvc_error_t plan_result;
+	uvc_convert_plan_t plan;
+	/** normalized scale for the source size */
+	uvc_scale_t src_scale;
+	/** intermediate frames reused for each frame */
+	uvc_frame_t *temp[UVC_CONVERT_MAX_STEPS - 1];
+};
+
+/** @brief Create a converter for the frames of a stream
+ * @ingroup frame
+ *
+ * The converter plans the cheapest chain of the conversions on the first frame
+ * and whenever the format or the size of the source frame changes,
+ * and keeps the intermediate frames across the frames.
+ * @param format format of the converted frame
+ * @param scale crop rectangle and output size, NULL for no scaling
+ * @return converter, NULL if failed
+ */
+uvc_converter_t *uvc_converter_create(enum uvc_frame_format format, const uvc_scale_t *scale) {
+	uvc_converter_t *converter = calloc(1, sizeof(uvc_converter_t));
+
+	if (LIKELY(converter)) {
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_converter_t));
+		converter->format = format;
+		if (scale) {
+			converter->scale = *scale;
+			converter->has_scale = 1;
+		}
+	}
+	return converter;
+}
+
+/** @brief Destroy the converter
+ * @ingroup frame
+ */
+void uvc_converter_destroy(uvc_converter_t *converter) {
+	int i;
+
+	if (converter) {
+		for (i = 0; i < UVC_CONVERT_MAX_STEPS - 1; i++) {
+			if (converter->temp[i])
+				uvc_free_frame(converter->temp[i]);
+		}
+		free(converter);
+	}
+}
+
+/** @brief Set the color space of the uncompressed YUV frames to convert to RGB
+ * @ingroup frame
+ *
+ * The default is UVC_COLOR_SPACE_BT601_FULL, see uvc_get_color_space.
+ * MJPEG frames are always decoded as BT.601 full range.
+ */
+void uvc_converter_set_color_space(uvc_converter_t *converter, enum uvc_color_space color_space) {
+	if (LIKELY((unsigned)color_space < UVC_COLOR_SPACE_COUNT))
+		converter->color_space = color_space;
+}
+
+/** @internal
+ * Plan for the source frame, called when the source format/size changed
+ */
+static void _uvc_converter_plan(uvc_converter_t *converter, uvc_frame_t *in) {
+	int scaled = 0;
+	uint32_t ratio = COST_ONE;
+
+	converter->src_format = in->frame_format;
+	converter->src_width = in->width;
+	converter->src_height = in->height;
+	converter->has_plan = 1;
+	if (converter->has_scale) {
+		converter->plan_result = uvc_normalize_scale(&converter->scale,
+			in->width, in->height, &converter->src_scale);
+		if (UNLIKELY(converter->plan_result))
+			return;
+		const uvc_scale_t *s = &converter->src_scale;
+		scaled = s->crop_x || s->crop_y
+			|| (s->crop_width != in->width) || (s->crop_height != in->height)
+			|| (s->width != in->width) || (s->height != in->height);
+		if (scaled) {
+			ratio = (uint64_t)s->width * s->height * COST_ONE / ((uint64_t)in->width * in->height);
+		}
+	}
+	converter->plan_result = uvc_convert_plan(in->frame_format, converter->format,
+		scaled, ratio, &converter->plan);
+	LOGD("format %d => %d, scaled=%d, steps=%d, cost=%u, result=%d",
+		in->frame_format, converter->format, scaled, converter->plan.num_steps,
+		converter->plan.cost, converter->plan_result);
+}
+
+/** @brief Convert a frame with the converter
+ * @ingroup frame
+ *
+ * @param converter converter created by uvc_converter_create
+ * @param in source frame
+ * @param out converted frame
+ */
+uvc_error_t uvc_converter_convert(uvc_converter_t *converter, uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(!converter->has_plan
+		|| (converter->src_format != in->frame_format)
+		|| (converter->src_width != in->width)
+		|| (converter->src_height != in->height))) {
+
+		_uvc_converter_plan(converter, in);
+	}
+	if (UNLIKELY(converter->plan_result))
+		return converter->plan_result;
+	return _uvc_convert_run(&converter->plan, &converter->src_scale, converter->color_space,
+		converter->temp, in, out);
+}
@@ -42,7 +42,9 @@
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
 #include <jpeglib.h>
+#include <jerror.h>
 #include <setjmp.h>
+#include <pthread.h>
 
 extern uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes);
 
@@ -158,395 +160,1362 @@ static inline void insert_huff_tables(j_decompress_ptr dinfo) {
 #define MAX_READLINE 1
 #endif
 
-/** @brief Convert an MJPEG frame to RGB
- * @ingroup frame
- *
- * @param in MJPEG frame
- * @param out RGB frame
+/** @internal
+ * Chunk of the memory pools that the decoder gives to libjpeg,
+ * the memory is bump allocated after the header
  */
-uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+typedef struct uvc_mjpeg_mem_chunk {
+	struct uvc_mjpeg_mem_chunk *next;
+	size_t size;
+	size_t used;
+} uvc_mjpeg_mem_chunk_t;
+
+/** @internal
+ * alignment of the memory for libjpeg, the SIMD code of libjpeg-turbo needs 32 bytes at most
+ */
+#define MJPEG_MEM_ALIGN 32
+#define MJPEG_MEM_HEADER_SZ ((sizeof(uvc_mjpeg_mem_chunk_t) + MJPEG_MEM_ALIGN - 1) & ~(size_t)(MJPEG_MEM_ALIGN - 1))
+/** @internal
+ * minimum size of a chunk
+ */
+#define MJPEG_MEM_CHUNK_SZ (16 * 1024)
+
+/** @internal
+ * Memory pool of libjpeg (JPOOL_PERMANENT/JPOOL_IMAGE) that is recycled across frames
+ */
+typedef struct uvc_mjpeg_mem_pool {
+	/** the newest chunk first */
+	uvc_mjpeg_mem_chunk_t *chunks;
+	/** size of the next chunk, the total of the last image that needed multiple chunks */
+	size_t reserve;
+} uvc_mjpeg_mem_pool_t;
+
+/** @internal
+ * Reusable MJPEG decoder.
+ * The decompress object, its permanent memory pool, the source manager and
+ * the default Huffman tables are kept across frames, each frame only resets
+ * the per image state with jpeg_finish_decompress/jpeg_abort_decompress.
+ * The memory pools of libjpeg are replaced with the pools of the decoder
+ * that keep their memory when libjpeg frees the image, see _uvc_mjpeg_mem_init.
+ */
+struct uvc_mjpeg_decoder {
 	struct jpeg_decompress_struct dinfo;
 	struct error_mgr jerr;
-	size_t lines_read;
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+	/** the default Huffman tables are installed in dinfo */
+	uint8_t default_huff_tables;
+	/** header parameters of the previous frame */
+	uint8_t has_header;
+	JDIMENSION width, height;
+	int num_components;
+	J_COLOR_SPACE jpeg_color_space;
+	int samp_factors[MAX_COMPONENTS];
+	enum uvc_frame_format format;
+	/** scanline buffer for the output that needs repacking */
+	uint8_t *work;
+	size_t work_bytes;
+	JSAMPROW rows[MAX_READLINE];
+	/** worker threads for slice parallel decoding, NULL if disabled */
+	struct uvc_mjpeg_workers *workers;
+	/** cropped and scaled YUYV frame for uvc_mjpeg_decode_scaled */
+	uvc_frame_t scaled;
+	/** memory pools for libjpeg and free_pool of the memory manager of libjpeg */
+	uvc_mjpeg_mem_pool_t pools[JPOOL_NUMPOOLS];
+	void (*free_pool)(j_common_ptr cinfo, int pool_id);
+};
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+/** @internal
+ * Allocate from the memory pool of the decoder, alloc_small/alloc_large of libjpeg.
+ * The chunks are allocated only until the pool holds the largest image,
+ * libjpeg requests the same memory for every frame of the same size.
+ */
+static void *_uvc_mjpeg_mem_alloc(j_common_ptr cinfo, int pool_id, size_t bytes) {
+	// dinfo is the first member of the decoder
+	uvc_mjpeg_decoder_t *decoder = (uvc_mjpeg_decoder_t *)cinfo;
+	uvc_mjpeg_mem_pool_t *pool;
+	uvc_mjpeg_mem_chunk_t *chunk;
+	size_t size;
+	void *ptr = NULL;
+
+	if (UNLIKELY((pool_id < 0) || (pool_id >= JPOOL_NUMPOOLS)))
+		ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+	if (UNLIKELY(bytes > ((size_t)-1 >> 1)))
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 1);
+	pool = &decoder->pools[pool_id];
+	bytes = (bytes + MJPEG_MEM_ALIGN - 1) & ~(size_t)(MJPEG_MEM_ALIGN - 1);
+	chunk = pool->chunks;
+	if (UNLIKELY(!chunk || (chunk->size - chunk->used < bytes))) {
+		size = bytes > pool->reserve ? bytes : pool->reserve;
+		if (size < MJPEG_MEM_CHUNK_SZ)
+			size = MJPEG_MEM_CHUNK_SZ;
+		if (UNLIKELY(posix_memalign(&ptr, MJPEG_MEM_ALIGN, MJPEG_MEM_HEADER_SZ + size)))
+			ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 2);
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, MJPEG_MEM_HEADER_SZ + size);
+		chunk = (uvc_mjpeg_mem_chunk_t *)ptr;
+		chunk->next = pool->chunks;
+		chunk->size = size;
+		chunk->used = 0;
+		pool->chunks = chunk;
+		pool->reserve = 0;
+	}
+	ptr = (uint8_t *)chunk + MJPEG_MEM_HEADER_SZ + chunk->used;
+	chunk->used += bytes;
+	return ptr;
+}
 
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
+/** @internal
+ * alloc_sarray of libjpeg, all rows in one block
+ */
+static JSAMPARRAY _uvc_mjpeg_mem_alloc_sarray(j_common_ptr cinfo, int pool_id,
+	JDIMENSION samplesperrow, JDIMENSION numrows) {
+
+	const size_t row_bytes = ((size_t)samplesperrow * sizeof(JSAMPLE) + MJPEG_MEM_ALIGN - 1)
+		& ~(size_t)(MJPEG_MEM_ALIGN - 1);
+	JSAMPARRAY result = (JSAMPARRAY)_uvc_mjpeg_mem_alloc(cinfo, pool_id, numrows * sizeof(JSAMPROW));
+	uint8_t *workspace = (uint8_t *)_uvc_mjpeg_mem_alloc(cinfo, pool_id, numrows * row_bytes);
+	JDIMENSION i;
+
+	for (i = 0; i < numrows; i++)
+		result[i] = (JSAMPROW)(workspace + i * row_bytes);
+	return result;
+}
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
-		return UVC_ERROR_NO_MEM;
+/** @internal
+ * alloc_barray of libjpeg, all rows in one block
+ */
+static JBLOCKARRAY _uvc_mjpeg_mem_alloc_barray(j_common_ptr cinfo, int pool_id,
+	JDIMENSION blocksperrow, JDIMENSION numrows) {
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB;
-	out->step = in->width * 3;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+	const size_t row_bytes = (size_t)blocksperrow * sizeof(JBLOCK);
+	JBLOCKARRAY result = (JBLOCKARRAY)_uvc_mjpeg_mem_alloc(cinfo, pool_id, numrows * sizeof(JBLOCKROW));
+	uint8_t *workspace = (uint8_t *)_uvc_mjpeg_mem_alloc(cinfo, pool_id, numrows * row_bytes);
+	JDIMENSION i;
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+	for (i = 0; i < numrows; i++)
+		result[i] = (JBLOCKROW)(workspace + i * row_bytes);
+	return result;
+}
+
+/** @internal
+ * Reset the pool for the next image.
+ * The pool that needed multiple chunks is freed and allocates one chunk of the total next time.
+ * @param release free all chunks
+ */
+static void _uvc_mjpeg_mem_reset(uvc_mjpeg_mem_pool_t *pool, const int release) {
+	uvc_mjpeg_mem_chunk_t *chunk = pool->chunks, *next;
+	size_t total = 0;
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+	if (chunk && !chunk->next && !release) {
+		chunk->used = 0;
+		return;
 	}
+	for ( ; chunk; chunk = next) {
+		next = chunk->next;
+		total += chunk->used;
+		free(chunk);
+	}
+	pool->chunks = NULL;
+	pool->reserve = release ? 0 : total;
+}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
+/** @internal
+ * free_pool of libjpeg, jpeg_finish_decompress/jpeg_abort_decompress free JPOOL_IMAGE with this.
+ * The memory that libjpeg allocated itself (before _uvc_mjpeg_mem_init
+ * and the virtual arrays) is freed by the original free_pool.
+ */
+static void _uvc_mjpeg_mem_free_pool(j_common_ptr cinfo, int pool_id) {
+	uvc_mjpeg_decoder_t *decoder = (uvc_mjpeg_decoder_t *)cinfo;
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+	if (LIKELY((pool_id >= 0) && (pool_id < JPOOL_NUMPOOLS)))
+		_uvc_mjpeg_mem_reset(&decoder->pools[pool_id], pool_id == JPOOL_PERMANENT);
+	decoder->free_pool(cinfo, pool_id);
+}
+
+/** @internal
+ * Replace the allocation methods of the memory manager of libjpeg with the pools of the decoder.
+ * The default memory manager mallocs and frees the memory of each image in
+ * jpeg_start_decompress/jpeg_finish_decompress, i.e. tens of allocations every frame.
+ * The virtual arrays for the progressive and the multi-scan JPEG are still
+ * allocated by libjpeg, UVC cameras send baseline JPEG that needs none.
+ * Should be called just after jpeg_create_decompress.
+ */
+static void _uvc_mjpeg_mem_init(uvc_mjpeg_decoder_t *decoder) {
+	struct jpeg_memory_mgr *mem = decoder->dinfo.mem;
+
+	decoder->free_pool = mem->free_pool;
+	mem->alloc_small = _uvc_mjpeg_mem_alloc;
+	mem->alloc_large = _uvc_mjpeg_mem_alloc;
+	mem->alloc_sarray = _uvc_mjpeg_mem_alloc_sarray;
+	mem->alloc_barray = _uvc_mjpeg_mem_alloc_barray;
+	mem->free_pool = _uvc_mjpeg_mem_free_pool;
+}
+
+/** @internal
+ * Free the pools of the decoder, should be called after jpeg_destroy_decompress
+ */
+static void _uvc_mjpeg_mem_release(uvc_mjpeg_decoder_t *decoder) {
+	int i;
+
+	for (i = 0; i < JPOOL_NUMPOOLS; i++)
+		_uvc_mjpeg_mem_reset(&decoder->pools[i], 1);
+}
+
+/** @internal
+ * Check whether the frame defines its own Huffman tables.
+ * Only the marker segments before the first SOS are walked.
+ */
+static int _uvc_mjpeg_has_dht(const uint8_t *data, const size_t bytes) {
+	size_t i = 2;	// skip SOI
+	uint8_t marker;
+
+	while (i + 4 <= bytes) {
+		if (UNLIKELY(data[i] != 0xff))
+			return 0;	// broken, libjpeg will complain
+		marker = data[i + 1];
+		if (marker == 0xff) {	// fill byte
+			i++;
+			continue;
+		}
+		if (marker == 0xc4)		// DHT
+			return 1;
+		if (marker == 0xda)		// SOS
+			return 0;
+		if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd8))) {
+			i += 2;	// markers without length
+			continue;
+		}
+		i += 2 + ((data[i + 2] << 8) | data[i + 3]);
 	}
+	return 0;
+}
 
-	dinfo.out_color_space = JCS_RGB;
-	dinfo.dct_method = JDCT_IFAST;
+/** @internal
+ * Compare the header with the previous frame and remember it.
+ * @return 1 if the header parameters are same as the previous frame
+ */
+static int _uvc_mjpeg_same_header(uvc_mjpeg_decoder_t *decoder, enum uvc_frame_format format) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	int i, same;
+
+	same = decoder->has_header
+		&& (decoder->width == dinfo->image_width)
+		&& (decoder->height == dinfo->image_height)
+		&& (decoder->num_components == dinfo->num_components)
+		&& (decoder->jpeg_color_space == dinfo->jpeg_color_space)
+		&& (decoder->format == format);
+	for (i = 0; same && (i < dinfo->num_components); i++) {
+		same = decoder->samp_factors[i]
+			== ((dinfo->comp_info[i].h_samp_factor << 4) | dinfo->comp_info[i].v_samp_factor);
+	}
+	if (!same) {
+		decoder->width = dinfo->image_width;
+		decoder->height = dinfo->image_height;
+		decoder->num_components = dinfo->num_components;
+		decoder->jpeg_color_space = dinfo->jpeg_color_space;
+		decoder->format = format;
+		for (i = 0; (i < dinfo->num_components) && (i < MAX_COMPONENTS); i++) {
+			decoder->samp_factors[i]
+				= (dinfo->comp_info[i].h_samp_factor << 4) | dinfo->comp_info[i].v_samp_factor;
+		}
+		decoder->has_header = 1;
+	}
+	return same;
+}
 
-	jpeg_start_decompress(&dinfo);
+/** @internal
+ * maximum number of threads for slice parallel decoding
+ */
+#define MAX_DECODE_THREADS 8
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
+/** @internal
+ * A slice of the frame, a run of MCU rows that starts just after a restart marker
+ * and that can be decoded independently as a complete JPEG image
+ */
+typedef struct uvc_mjpeg_slice {
+	struct uvc_mjpeg_workers *workers;
+	int index;
+	/** decoder of this slice */
+	uvc_mjpeg_decoder_t *decoder;
+	/** the slice as a JPEG image: the header of the frame with the patched height,
+	 * the entropy-coded segment of the slice with the renumbered restart markers and EOI */
+	uint8_t *data;
+	size_t capacity;
+	/** MJPEG frame of data and the view of out for the rows of this slice */
+	uvc_frame_t in, out;
+	enum uvc_frame_format format;
+	uvc_error_t result;
+} uvc_mjpeg_slice_t;
+
+/** @internal
+ * Worker threads for slice parallel decoding.
+ * slices[0] is decoded on the calling thread and slices[i] on threads[i - 1].
+ */
+typedef struct uvc_mjpeg_workers {
+	pthread_mutex_t mutex;
+	pthread_cond_t start_sync;
+	pthread_cond_t done_sync;
+	/** number of threads including the calling thread */
+	int num_threads;
+	pthread_t threads[MAX_DECODE_THREADS - 1];
+	int num_created;
+	uvc_mjpeg_slice_t slices[MAX_DECODE_THREADS];
+	int num_slices;
+	uint32_t generation;
+	int pending;
+	int terminate;
+	/** offsets of the restart markers in the current frame */
+	size_t *markers;
+	size_t markers_capacity;
+	/** subsystem of the thread that created the workers, the workers allocate for it */
+	enum uvc_alloc_subsystem subsystem;
+} uvc_mjpeg_workers_t;
+
+static inline void _uvc_mjpeg_decode_slice(uvc_mjpeg_slice_t *slice) {
+	slice->result = uvc_mjpeg_decode(slice->decoder, &slice->in, &slice->out, slice->format);
+}
+
+static void *_uvc_mjpeg_worker_thread(void *arg) {
+	uvc_mjpeg_slice_t *slice = (uvc_mjpeg_slice_t *)arg;
+	uvc_mjpeg_workers_t *workers = slice->workers;
+	uint32_t generation = 0;
+
+	uvc_set_alloc_subsystem(workers->subsystem);
+	pthread_mutex_lock(&workers->mutex);
+	for ( ; ; ) {
+		while (!workers->terminate && (workers->generation == generation))
+			pthread_cond_wait(&workers->start_sync, &workers->mutex);
+		if (workers->terminate)
+			break;
+		generation = workers->generation;
+		if (slice->index < workers->num_slices) {
+			pthread_mutex_unlock(&workers->mutex);
+			_uvc_mjpeg_decode_slice(slice);
+			pthread_mutex_lock(&workers->mutex);
+			if (!--workers->pending)
+				pthread_cond_signal(&workers->done_sync);
 		}
-		out->actual_bytes = in->width * in->height * 3;	// XXX
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
+	pthread_mutex_unlock(&workers->mutex);
+	return NULL;
+}
+
+static void _uvc_mjpeg_workers_release(uvc_mjpeg_workers_t *workers) {
+	int i;
+
+	if (!workers)
+		return;
+	pthread_mutex_lock(&workers->mutex);
+	workers->terminate = 1;
+	pthread_cond_broadcast(&workers->start_sync);
+	pthread_mutex_unlock(&workers->mutex);
+	for (i = 0; i < workers->num_created; i++)
+		pthread_join(workers->threads[i], NULL);
+	for (i = 0; i < workers->num_threads; i++) {
+		uvc_mjpeg_decoder_destroy(workers->slices[i].decoder);
+		free(workers->slices[i].data);
+	}
+	free(workers->markers);
+	pthread_cond_destroy(&workers->done_sync);
+	pthread_cond_destroy(&workers->start_sync);
+	pthread_mutex_destroy(&workers->mutex);
+	free(workers);
+}
 
+static uvc_mjpeg_workers_t *_uvc_mjpeg_workers_create(const int num_threads) {
+	uvc_mjpeg_workers_t *workers = calloc(1, sizeof(uvc_mjpeg_workers_t));
+	int i;
+
+	if (UNLIKELY(!workers))
+		return NULL;
+	UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_mjpeg_workers_t));
+	pthread_mutex_init(&workers->mutex, NULL);
+	pthread_cond_init(&workers->start_sync, NULL);
+	pthread_cond_init(&workers->done_sync, NULL);
+	workers->num_threads = num_threads;
+	workers->subsystem = uvc_get_alloc_subsystem();
+	for (i = 0; i < num_threads; i++) {
+		workers->slices[i].workers = workers;
+		workers->slices[i].index = i;
+		workers->slices[i].decoder = uvc_mjpeg_decoder_create();
+		if (UNLIKELY(!workers->slices[i].decoder))
+			goto fail;
+	}
+	for (i = 1; i < num_threads; i++) {
+		if (UNLIKELY(pthread_create(&workers->threads[i - 1], NULL,
+			_uvc_mjpeg_worker_thread, &workers->slices[i])))
+			goto fail;
+		workers->num_created++;
+	}
+	return workers;
 fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+	_uvc_mjpeg_workers_release(workers);
+	return NULL;
 }
 
-/** @brief Convert an MJPEG frame to BGR
+/** @internal
+ * Split the frame into slices at the restart markers, the header should be read
+ * into decoder->dinfo already.
+ * @param sos_end offset of the entropy-coded segment
+ * @return number of slices, 0 if the frame can not be split
+ */
+static int _uvc_mjpeg_split_slices(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format,
+	const size_t sos_end) {
+
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	uvc_mjpeg_workers_t *workers = decoder->workers;
+	const uint8_t *data = in->data;
+	const size_t bytes = in->actual_bytes;
+	int mcu_w, mcu_h, i, n;
+	size_t sof = 0, pos, data_end, num_markers = 0;
+
+	if (dinfo->progressive_mode || !dinfo->restart_interval)
+		return 0;
+	if ((dinfo->comps_in_scan == 1) && (dinfo->num_components == 1)) {
+		mcu_w = mcu_h = DCTSIZE;
+	} else if (dinfo->comps_in_scan == dinfo->num_components) {
+		mcu_w = dinfo->max_h_samp_factor * DCTSIZE;
+		mcu_h = dinfo->max_v_samp_factor * DCTSIZE;
+	} else {
+		return 0;	// multi scan
+	}
+	const size_t mcus_per_row = (dinfo->image_width + mcu_w - 1) / mcu_w;
+	const int mcu_rows = (dinfo->image_height + mcu_h - 1) / mcu_h;
+	const size_t restart_interval = dinfo->restart_interval;
+	const size_t num_intervals = (mcus_per_row * mcu_rows + restart_interval - 1) / restart_interval;
+	if (mcu_rows < 2)
+		return 0;
+
+	// find SOF(baseline or extended sequential Huffman) to patch the height
+	for (pos = 2; pos + 4 <= sos_end; ) {
+		const uint8_t marker = data[pos + 1];
+		if (UNLIKELY(data[pos] != 0xff))
+			return 0;
+		if (marker == 0xff) {	// fill byte
+			pos++;
+			continue;
+		}
+		if ((marker == 0xc0) || (marker == 0xc1)) {
+			sof = pos;
+			break;
+		}
+		if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd8))) {
+			pos += 2;	// markers without length
+			continue;
+		}
+		pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+	}
+	if (!sof || (sof + 9 > sos_end))
+		return 0;
+
+	// collect the restart markers in the entropy-coded segment
+	if (workers->markers_capacity < num_intervals) {
+		size_t *markers = realloc(workers->markers, num_intervals * sizeof(size_t));
+		if (UNLIKELY(!markers))
+			return 0;
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, num_intervals * sizeof(size_t));
+		workers->markers = markers;
+		workers->markers_capacity = num_intervals;
+	}
+	data_end = bytes;
+	for (pos = sos_end; pos + 1 < bytes; ) {
+		const uint8_t *p = memchr(data + pos, 0xff, bytes - pos - 1);
+		if (!p)
+			break;
+		pos = p - data;
+		const uint8_t marker = data[pos + 1];
+		if ((marker >= 0xd0) && (marker <= 0xd7)) {
+			if (UNLIKELY(num_markers + 1 >= num_intervals))
+				return 0;	// too many restart markers
+			workers->markers[num_markers++] = pos;
+			pos += 2;
+		} else if (!marker || (marker == 0xff)) {
+			pos++;	// stuffed zero or fill byte
+		} else {
+			data_end = pos;	// EOI or other marker
+			break;
+		}
+	}
+	if (num_markers + 1 != num_intervals)
+		return 0;	// broken frame, let the single threaded decoder handle it
+
+	// choose the restart intervals that start at the beginning of MCU row
+	int rows[MAX_DECODE_THREADS + 1];
+	rows[0] = 0;
+	for (n = 1, i = 1; i < workers->num_threads; i++) {
+		int row = i * mcu_rows / workers->num_threads;
+		if (row <= rows[n - 1])
+			row = rows[n - 1] + 1;
+		for (; (row < mcu_rows) && ((row * mcus_per_row) % restart_interval); row++);
+		if (row >= mcu_rows)
+			break;
+		rows[n++] = row;
+	}
+	rows[n] = mcu_rows;
+	if (n < 2)
+		return 0;
+
+	const size_t step = out->step;
+	for (i = 0; i < n; i++) {
+		uvc_mjpeg_slice_t *slice = &workers->slices[i];
+		const size_t first = rows[i] * mcus_per_row / restart_interval;
+		const size_t last = i + 1 < n
+			? rows[i + 1] * mcus_per_row / restart_interval : num_intervals;	// exclusive
+		const size_t start = first ? workers->markers[first - 1] + 2 : sos_end;
+		const size_t end = last < num_intervals ? workers->markers[last - 1] : data_end;
+		const size_t need_bytes = sos_end + (end - start) + 2;
+		const uint32_t y = rows[i] * mcu_h;
+		const uint32_t height = (rows[i + 1] * mcu_h < out->height ? rows[i + 1] * mcu_h : out->height) - y;
+		size_t j;
+		if (slice->capacity < need_bytes) {
+			// with headroom, the size of the slices changes on every frame
+			const size_t capacity = need_bytes + (need_bytes >> 2);
+			uint8_t *buf = realloc(slice->data, capacity);
+			if (UNLIKELY(!buf))
+				return 0;
+			UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, capacity);
+			slice->data = buf;
+			slice->capacity = capacity;
+		}
+		uint8_t *dst = slice->data;
+		memcpy(dst, data, sos_end);
+		dst[sof + 5] = height >> 8;
+		dst[sof + 6] = height & 0xff;
+		memcpy(dst + sos_end, data + start, end - start);
+		for (j = first; j + 1 < last; j++)
+			dst[sos_end + workers->markers[j] - start + 1] = 0xd0 + ((j - first) & 7);
+		dst[need_bytes - 2] = 0xff;
+		dst[need_bytes - 1] = 0xd9;	// EOI
+
+		memset(&slice->in, 0, sizeof(uvc_frame_t));
+		slice->in.data = slice->data;
+		slice->in.data_bytes = slice->in.actual_bytes = need_bytes;
+		slice->in.width = out->width;
+		slice->in.height = height;
+		slice->in.frame_format = UVC_FRAME_FORMAT_MJPEG;
+		memset(&slice->out, 0, sizeof(uvc_frame_t));
+		slice->out.data = (uint8_t *)out->data + step * y;
+		slice->out.data_bytes = step * height;
+		slice->out.width = out->width;
+		slice->out.height = height;
+		slice->out.library_owns_data = 0;
+		slice->format = format;
+		slice->result = UVC_SUCCESS;
+	}
+	return n;
+}
+
+/** @internal
+ * Decode the slices prepared by _uvc_mjpeg_split_slices in parallel
+ * @return result of the first failed slice or UVC_SUCCESS
+ */
+static uvc_error_t _uvc_mjpeg_decode_slices(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *out, const int num_slices, uvc_mjpeg_band_callback_t *cb, void *user_ptr) {
+
+	uvc_mjpeg_workers_t *workers = decoder->workers;
+	uvc_error_t result = UVC_SUCCESS;
+	uint32_t row = 0;
+	int i;
+
+	pthread_mutex_lock(&workers->mutex);
+	workers->num_slices = num_slices;
+	workers->pending = num_slices - 1;
+	workers->generation++;
+	pthread_cond_broadcast(&workers->start_sync);
+	pthread_mutex_unlock(&workers->mutex);
+
+	_uvc_mjpeg_decode_slice(&workers->slices[0]);
+
+	pthread_mutex_lock(&workers->mutex);
+	while (workers->pending)
+		pthread_cond_wait(&workers->done_sync, &workers->mutex);
+	pthread_mutex_unlock(&workers->mutex);
+
+	for (i = 0; i < num_slices; i++) {
+		uvc_mjpeg_slice_t *slice = &workers->slices[i];
+		if (UNLIKELY(slice->result)) {
+			if (!result)
+				result = slice->result;
+		} else if (cb && !result) {
+			// pass the bands in order
+			cb(out, row, slice->out.height, user_ptr);
+		}
+		row += slice->out.height;
+	}
+	return result;
+}
+
+/** @brief Set the number of threads for decoding
  * @ingroup frame
  *
- * @param in MJPEG frame
- * @param out BGR frame
+ * When num_threads is more than 1 and the frame has restart markers (DRI),
+ * uvc_mjpeg_decode splits the frame into slices of MCU rows at the restart markers
+ * and decodes them in parallel on the worker threads into disjoint rows of the output.
+ * The frames without restart markers and the planar formats are decoded
+ * on the calling thread as before.
+ * As the vertical chroma upsampling can not refer the rows over the slice boundary,
+ * the rows next to the boundaries of 4:2:0 frames may differ slightly from
+ * the single threaded decoding.
+ * @param decoder decoder created by uvc_mjpeg_decoder_create
+ * @param num_threads number of threads including the calling thread, 0 or 1 to disable
  */
-uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
+uvc_error_t uvc_mjpeg_decoder_set_threads(uvc_mjpeg_decoder_t *decoder, int num_threads) {
+	if (num_threads > MAX_DECODE_THREADS)
+		num_threads = MAX_DECODE_THREADS;
+	if (num_threads < 2)
+		num_threads = 0;
+	if (decoder->workers && (decoder->workers->num_threads == num_threads))
+		return UVC_SUCCESS;
+	_uvc_mjpeg_workers_release(decoder->workers);
+	decoder->workers = NULL;
+	if (num_threads) {
+		decoder->workers = _uvc_mjpeg_workers_create(num_threads);
+		if (UNLIKELY(!decoder->workers))
+			return UVC_ERROR_NO_MEM;
+	}
+	return UVC_SUCCESS;
+}
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+/** @brief Create a reusable MJPEG decoder
+ * @ingroup frame
+ *
+ * The decoder is not thread safe, use one decoder for each thread.
+ * @return decoder, NULL if failed
+ */
+uvc_mjpeg_decoder_t *uvc_mjpeg_decoder_create(void) {
+	uvc_mjpeg_decoder_t *decoder = calloc(1, sizeof(uvc_mjpeg_decoder_t));
+
+	if (UNLIKELY(!decoder))
+		return NULL;
+	UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_mjpeg_decoder_t));
+
+	decoder->scaled.library_owns_data = 1;
+	decoder->dinfo.err = jpeg_std_error(&decoder->jerr.super);
+	decoder->jerr.super.error_exit = _error_exit;
+	if (setjmp(decoder->jerr.jmp)) {
+		free(decoder);
+		return NULL;
+	}
+	jpeg_create_decompress(&decoder->dinfo);
+	_uvc_mjpeg_mem_init(decoder);
+	return decoder;
+}
 
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
+/** @brief Destroy the MJPEG decoder
+ * @ingroup frame
+ */
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder) {
+	if (decoder) {
+		_uvc_mjpeg_workers_release(decoder->workers);
+		jpeg_destroy_decompress(&decoder->dinfo);
+		_uvc_mjpeg_mem_release(decoder);
+		free(decoder->work);
+		free(decoder->scaled.data);
+		free(decoder);
+	}
+}
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
-		return UVC_ERROR_NO_MEM;
+/** @internal
+ * Read the header of the frame, should be called after setjmp
+ */
+static void _uvc_mjpeg_read_header(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	const int has_dht = _uvc_mjpeg_has_dht(in->data, in->actual_bytes);
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_BGR;
-	out->step = in->width * 3;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+	jpeg_mem_src(dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
+	jpeg_read_header(dinfo, TRUE);
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+	if (has_dht) {
+		// the frame overwrote (some of) the tables
+		decoder->default_huff_tables = 0;
+	} else if (!decoder->default_huff_tables) {
+		/* This frame is missing the Huffman tables: fill in the standard ones */
+		insert_huff_tables(dinfo);
+		decoder->default_huff_tables = 1;
+	}
+}
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+/** @internal
+ * pass the decoded rows to the band callback of uvc_mjpeg_decode_banded if needs
+ */
+#define PASS_BAND() \
+	if (cb && ((lines_read - band_start >= band_rows) || (lines_read >= out->height))) { \
+		cb(out, band_start, lines_read - band_start, user_ptr); \
+		band_start = lines_read; \
 	}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
+#define YCbCr_YUYV_2(YCbCr, yuyv) \
+	{ \
+		*(yuyv++) = *(YCbCr+0); \
+		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
+		*(yuyv++) = *(YCbCr+3); \
+		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
+	}
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+/** @internal
+ * convert one scanline of YCbCr(row_stride bytes) to yuyv(YUV422)
+ */
+static inline void _uvc_mjpeg_ycbcr2yuyv(const uint8_t *ycbcr, uint8_t *yuyv, const int row_stride) {
+	const int row_stride8 = row_stride - row_stride % 24;
+	int i;
+
+	for (i = 0; i < row_stride8; i += 24) {	// step by YCbCr x 8 pixels = 3 x 8 bytes
+		YCbCr_YUYV_2(ycbcr + i, yuyv);
+		YCbCr_YUYV_2(ycbcr + i + 6, yuyv);
+		YCbCr_YUYV_2(ycbcr + i + 12, yuyv);
+		YCbCr_YUYV_2(ycbcr + i + 18, yuyv);
+	}
+	for (; i + 6 <= row_stride; i += 6) {
+		YCbCr_YUYV_2(ycbcr + i, yuyv);
 	}
+}
 
-	dinfo.out_color_space = JCS_EXT_BGR;
-	dinfo.dct_method = JDCT_IFAST;
+/** @internal
+ * Check whether the planar output can be read with jpeg_read_raw_data,
+ * i.e. the frame is YCbCr 4:2:2 or 4:2:0 that most of UVC cameras send.
+ * Should be called after jpeg_read_header.
+ */
+static int _uvc_mjpeg_can_read_raw(j_decompress_ptr dinfo) {
+	return (dinfo->num_components == 3)
+		&& (dinfo->jpeg_color_space == JCS_YCbCr)
+		&& (dinfo->comp_info[0].h_samp_factor == 2)
+		&& ((dinfo->comp_info[0].v_samp_factor == 1) || (dinfo->comp_info[0].v_samp_factor == 2))
+		&& (dinfo->comp_info[1].h_samp_factor == 1) && (dinfo->comp_info[1].v_samp_factor == 1)
+		&& (dinfo->comp_info[2].h_samp_factor == 1) && (dinfo->comp_info[2].v_samp_factor == 1);
+}
 
-	jpeg_start_decompress(&dinfo);
+/** @internal
+ * Grow the work buffer of the decoder if needs
+ */
+static int _uvc_mjpeg_ensure_work(uvc_mjpeg_decoder_t *decoder, const size_t need_bytes) {
+	if (decoder->work_bytes < need_bytes) {
+		uint8_t *work = realloc(decoder->work, need_bytes);
+		if (UNLIKELY(!work))
+			return UVC_ERROR_NO_MEM;
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, need_bytes);
+		decoder->work = work;
+		decoder->work_bytes = need_bytes;
+	}
+	return UVC_SUCCESS;
+}
 
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+/** @internal
+ * Write one row of chroma samples to the planar output.
+ * u1/v1 are the samples on the next row for 4:2:2 frames(averaged with u0/v0),
+ * set same as u0/v0 when the row is not subsampled vertically.
+ */
+static inline void _uvc_mjpeg_put_chroma(uvc_frame_t *out, enum uvc_frame_format format, const int row,
+	const uint8_t *u0, const uint8_t *u1, const uint8_t *v0, const uint8_t *v1) {
+
+	const int width = out->width;
+	const int cw = (width + 1) >> 1;
+	const int ch = (out->height + 1) >> 1;
+	uint8_t *plane = out->data + width * out->height;
+	int i;
+
+	switch (format) {
+	case UVC_FRAME_FORMAT_I420:
+	{
+		uint8_t *u = plane + row * cw;
+		uint8_t *v = plane + (ch + row) * cw;
+		if (u0 == u1) {
+			memcpy(u, u0, cw);
+			memcpy(v, v0, cw);
+		} else {
+			for (i = 0; i < cw; i++) {
+				u[i] = (u0[i] + u1[i] + 1) >> 1;
+				v[i] = (v0[i] + v1[i] + 1) >> 1;
+			}
+		}
+		break;
+	}
+	case UVC_FRAME_FORMAT_NV21:
+	{
+		const uint8_t *t0 = u0, *t1 = u1;
+		u0 = v0; u1 = v1;
+		v0 = t0; v1 = t1;
+	}
+		// pass through
+	default:	// UVC_FRAME_FORMAT_NV12
+	{
+		uint8_t *uv = plane + row * cw * 2;
+		for (i = 0; i < cw; i++) {
+			*(uv++) = (u0[i] + u1[i] + 1) >> 1;
+			*(uv++) = (v0[i] + v1[i] + 1) >> 1;
+		}
+		break;
+	}
+	}
+}
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
+/** @internal
+ * Read the planar output with jpeg_read_raw_data, skipping the upsampling and
+ * the color conversion of libjpeg. The luma and (for I420 4:2:0) chroma rows
+ * are decoded directly into the output when the padded width of the component
+ * is same as the output, otherwise decoded into the work buffer and copied.
+ * The work buffer should be allocated by the caller.
+ * @return number of lines read
+ */
+static size_t _uvc_mjpeg_read_raw(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *out, enum uvc_frame_format format) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	const int width = out->width;
+	const int height = out->height;
+	const int cw = (width + 1) >> 1;
+	const int ch = (height + 1) >> 1;
+	const int v_samp = dinfo->max_v_samp_factor;
+	const int y_rows = v_samp * DCTSIZE;
+	const int y_pitch = dinfo->comp_info[0].width_in_blocks * DCTSIZE;
+	const int c_pitch = dinfo->comp_info[1].width_in_blocks * DCTSIZE;
+	const int direct_y = y_pitch == width;
+	const int direct_c = (format == UVC_FRAME_FORMAT_I420) && (v_samp == 2) && (c_pitch == cw);
+	uint8_t *y_plane = out->data;
+	uint8_t *u_plane = y_plane + width * height;
+	uint8_t *v_plane = u_plane + cw * ch;
+	uint8_t *y_work = decoder->work;
+	uint8_t *u_work = y_work + y_rows * y_pitch;
+	uint8_t *v_work = u_work + DCTSIZE * c_pitch;
+	JSAMPROW y[2 * DCTSIZE], u[DCTSIZE], v[DCTSIZE];
+	JSAMPARRAY planes[3] = { y, u, v };
+	size_t lines_read = 0;
+	int i, row, n;
+
+	for (; dinfo->output_scanline < dinfo->output_height ;) {
+		const int line = dinfo->output_scanline;
+		const int c_line = line / v_samp;	// first chroma row of this iMCU row
+		for (i = 0; i < y_rows; i++) {
+			row = line + i;
+			y[i] = direct_y && (row < height) ? y_plane + row * width : y_work + i * y_pitch;
+		}
+		for (i = 0; i < DCTSIZE; i++) {
+			row = c_line + i;
+			if (direct_c && (row < ch)) {
+				u[i] = u_plane + row * cw;
+				v[i] = v_plane + row * cw;
+			} else {
+				u[i] = u_work + i * c_pitch;
+				v[i] = v_work + i * c_pitch;
+			}
 		}
-		out->actual_bytes = in->width * in->height * 3;	// XXX
+		n = jpeg_read_raw_data(dinfo, planes, y_rows);
+		if (n > height - line)
+			n = height - line;
+		if (UNLIKELY(n <= 0))
+			break;
+		if (!direct_y) {
+			for (i = 0; i < n; i++)
+				memcpy(y_plane + (line + i) * width, y[i], width);
+		}
+		if (!direct_c) {
+			if (v_samp == 2) {
+				// 4:2:0, one chroma row for two luma rows
+				for (i = 0; (i < DCTSIZE) && (c_line + i < ch); i++)
+					_uvc_mjpeg_put_chroma(out, format, c_line + i, u[i], u[i], v[i], v[i]);
+			} else {
+				// 4:2:2, average two chroma rows
+				for (i = 0; i < n; i += 2) {
+					const int next = i + 1 < n ? i + 1 : i;
+					_uvc_mjpeg_put_chroma(out, format, (line + i) >> 1, u[i], u[next], v[i], v[next]);
+				}
+			}
+		}
+		lines_read += n;
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
+	return lines_read;
+}
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+/** @internal
+ * Read the planar output through YCbCr scanlines for the frames that
+ * jpeg_read_raw_data can not handle, e.g. 4:4:4 or 4:1:1 frames.
+ * The work buffer and the scanline pointers should be prepared by the caller.
+ * @return number of lines read
+ */
+static size_t _uvc_mjpeg_read_planar(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *out, enum uvc_frame_format format) {
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	const int width = out->width;
+	const int cw = (width + 1) >> 1;
+	uint8_t *u = decoder->work + MAX_READLINE * width * 3;
+	uint8_t *v = u + cw;
+	size_t lines_read = 0;
+	int i, j, n, x1;
+
+	for (; dinfo->output_scanline < dinfo->output_height ;) {
+		n = jpeg_read_scanlines(dinfo, decoder->rows, MAX_READLINE);
+		for (j = 0; j < n; j++) {
+			const uint8_t *ycbcr = decoder->rows[j];
+			const int row = lines_read + j;
+			uint8_t *yy = out->data + row * width;
+			for (i = 0; i < width; i++)
+				yy[i] = ycbcr[i * 3];
+			if (!(row & 1)) {
+				// chroma is taken from the even row only
+				for (i = 0; i < cw; i++) {
+					x1 = (i * 2 + 1 < width ? i * 2 + 1 : i * 2) * 3;
+					u[i] = (ycbcr[i * 6 + 1] + ycbcr[x1 + 1] + 1) >> 1;
+					v[i] = (ycbcr[i * 6 + 2] + ycbcr[x1 + 2] + 1) >> 1;
+				}
+				_uvc_mjpeg_put_chroma(out, format, row >> 1, u, u, v, v);
+			}
+		}
+		lines_read += n;
+	}
+	return lines_read;
 }
 
-/** @brief Convert an MJPEG frame to RGB565
+/** @brief Decode an MJPEG frame with the reusable decoder
  * @ingroup frame
  *
+ * When consecutive frames share the same header parameters, only the per image
+ * state of the decoder is reset and the buffers of the previous frame are reused.
+ * The planar formats(I420/NV12/NV21) of 4:2:2 and 4:2:0 frames are read with
+ * jpeg_read_raw_data without the upsampling and the color conversion.
+ * @param decoder decoder created by uvc_mjpeg_decoder_create
  * @param in MJPEG frame
- * @param out RGB frame
+ * @param out decoded frame
+ * @param format UVC_FRAME_FORMAT_RGB, BGR, RGB565, RGBX, YUYV, I420, NV12, NV21 or GRAY8
  */
-uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format) {
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+	return uvc_mjpeg_decode_banded(decoder, in, out, format, 0, NULL, NULL);
+}
+
+/** @brief Decode an MJPEG frame and pass the decoded rows while decoding
+ * @ingroup frame
+ *
+ * Same as uvc_mjpeg_decode, but cb is called every time at least band_rows rows
+ * (and the last rows of the frame) are decoded into out, so the caller can
+ * process them while they are still in the cache instead of walking the whole
+ * frame again. The planar formats are passed as one band after the whole frame
+ * is decoded. When the frame is decoded in slices(see uvc_mjpeg_decoder_set_threads),
+ * each slice is passed in order after all slices are decoded.
+ * When the decoding failed, some bands may have been passed already.
+ * @param decoder decoder created by uvc_mjpeg_decoder_create
+ * @param in MJPEG frame
+ * @param out decoded frame
+ * @param format same as uvc_mjpeg_decode
+ * @param band_rows minimum number of rows for each call of cb
+ * @param cb callback function called on the calling thread, can be NULL
+ * @param user_ptr user pointer passed to cb
+ */
+uvc_error_t uvc_mjpeg_decode_banded(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format,
+	uint32_t band_rows, uvc_mjpeg_band_callback_t *cb, void *user_ptr) {
+
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	J_COLOR_SPACE out_color_space;
+	int pixel_bytes, num_scanlines, i, j;
+	int planar = 0;
+	volatile size_t lines_read = 0;
+	size_t band_start = 0;
+
+	switch (format) {
+	case UVC_FRAME_FORMAT_RGB:
+		out_color_space = JCS_RGB;
+		pixel_bytes = 3;
+		break;
+	case UVC_FRAME_FORMAT_BGR:
+		out_color_space = JCS_EXT_BGR;
+		pixel_bytes = 3;
+		break;
+	case UVC_FRAME_FORMAT_RGB565:
+		out_color_space = JCS_RGB565;
+		pixel_bytes = 2;
+		break;
+	case UVC_FRAME_FORMAT_RGBX:
+		out_color_space = JCS_EXT_RGBA;
+		pixel_bytes = 4;
+		break;
+	case UVC_FRAME_FORMAT_YUYV:
+		out_color_space = JCS_YCbCr;
+		pixel_bytes = 2;
+		break;
+	case UVC_FRAME_FORMAT_GRAY8:
+		// libjpeg skips the dequantization, IDCT and upsampling of chroma
+		out_color_space = JCS_GRAYSCALE;
+		pixel_bytes = 1;
+		break;
+	case UVC_FRAME_FORMAT_I420:
+	case UVC_FRAME_FORMAT_NV12:
+	case UVC_FRAME_FORMAT_NV21:
+		out_color_space = JCS_YCbCr;
+		pixel_bytes = 1;	// for luma plane
+		planar = 1;
+		break;
+	default:
+		return UVC_ERROR_NOT_SUPPORTED;
+	}
 
 	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
 		return UVC_ERROR_INVALID_PARAM;
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 2) < 0)
+	const size_t out_bytes = planar
+		? in->width * in->height + ((in->width + 1) >> 1) * ((in->height + 1) >> 1) * 2
+		: in->width * in->height * pixel_bytes;
+	if (uvc_ensure_frame_size(out, out_bytes) < 0)
 		return UVC_ERROR_NO_MEM;
 
 	out->width = in->width;
 	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB565;
-	out->step = in->width * 2;
+	out->frame_format = format;
+	out->step = in->width * pixel_bytes;
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
+	out->complete_time = in->complete_time;
 	out->source = in->source;
 
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+	// local copy
+	uint8_t *data = out->data;
+	const int out_step = out->step;
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+	if (setjmp(decoder->jerr.jmp)) {
+		// only reset the per image state, the decoder is reused for the next frame
+		jpeg_abort_decompress(dinfo);
+		decoder->has_header = 0;
+		// some cameras append garbage after the image
+		return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER+1;
 	}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);
-	jpeg_read_header(&dinfo, TRUE);
+	_uvc_mjpeg_read_header(decoder, in);
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+	if (decoder->workers && !planar) {
+		const size_t sos_end = dinfo->src->next_input_byte - (const JOCTET *)in->data;
+		const int num_slices = _uvc_mjpeg_split_slices(decoder, in, out, format, sos_end);
+		if (num_slices > 1) {
+			// the main decoder only read the header
+			jpeg_abort_decompress(dinfo);
+			out->actual_bytes = out_bytes;	// XXX
+			return _uvc_mjpeg_decode_slices(decoder, out, num_slices, cb, user_ptr);
+		}
 	}
 
-	dinfo.out_color_space = JCS_RGB565;
-	dinfo.dct_method = JDCT_IFAST;
+	dinfo->out_color_space = out_color_space;
+	dinfo->dct_method = JDCT_IFAST;
 
-	jpeg_start_decompress(&dinfo);
+	const int same_header = _uvc_mjpeg_same_header(decoder, format);
+	// jpeg_read_header resets raw_data_out for each frame
+	const int raw = planar && _uvc_mjpeg_can_read_raw(dinfo);
+	if (raw)
+		dinfo->raw_data_out = TRUE;
 
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+	jpeg_start_decompress(dinfo);
+
+	if (UNLIKELY(dinfo->output_height != out->height)) {
+		jpeg_abort_decompress(dinfo);
+		return UVC_ERROR_OTHER;
+	}
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
+	if (planar) {
+		// these dinfo->xxx valiables are only valid after jpeg_start_decompress
+		const int row_stride = dinfo->output_width * 3;
+		const size_t need_bytes = raw
+			? (size_t)dinfo->max_v_samp_factor * DCTSIZE * dinfo->comp_info[0].width_in_blocks * DCTSIZE
+				+ (size_t)2 * DCTSIZE * dinfo->comp_info[1].width_in_blocks * DCTSIZE
+			: (size_t)row_stride * MAX_READLINE + ((dinfo->output_width + 1) >> 1) * 2;
+		if (UNLIKELY(_uvc_mjpeg_ensure_work(decoder, need_bytes))) {
+			jpeg_abort_decompress(dinfo);
+			decoder->has_header = 0;
+			return UVC_ERROR_NO_MEM;
+		}
+		if (raw) {
+			lines_read = _uvc_mjpeg_read_raw(decoder, out, format);
+		} else {
+			for (i = 0; i < MAX_READLINE; i++)
+				decoder->rows[i] = decoder->work + i * row_stride;
+			lines_read = _uvc_mjpeg_read_planar(decoder, out, format);
+		}
+		if (cb && lines_read)
+			cb(out, 0, lines_read, user_ptr);
+	} else if (format == UVC_FRAME_FORMAT_YUYV) {
+		// these dinfo->xxx valiables are only valid after jpeg_start_decompress
+		const int row_stride = dinfo->output_width * dinfo->output_components;
+		if (UNLIKELY(!same_header || !decoder->work)) {
+			if (UNLIKELY(_uvc_mjpeg_ensure_work(decoder, (size_t)row_stride * MAX_READLINE))) {
+				jpeg_abort_decompress(dinfo);
+				decoder->has_header = 0;
+				return UVC_ERROR_NO_MEM;
+			}
+			for (i = 0; i < MAX_READLINE; i++)
+				decoder->rows[i] = decoder->work + i * row_stride;
+		}
+		for (; dinfo->output_scanline < dinfo->output_height ;) {
+			// convert lines of mjpeg data to YCbCr
+			num_scanlines = jpeg_read_scanlines(dinfo, decoder->rows, MAX_READLINE);
+			// convert YCbCr to yuyv(YUV422)
+			for (j = 0; j < num_scanlines; j++) {
+				_uvc_mjpeg_ycbcr2yuyv(decoder->rows[j], data + (lines_read + j) * out_step, row_stride);
+			}
+			lines_read += num_scanlines;
+			PASS_BAND();
+		}
+	} else {
+		JSAMPROW buffer[MAX_READLINE];
+		for (; dinfo->output_scanline < dinfo->output_height ;) {
+			buffer[0] = data + lines_read * out_step;
 			for (i = 1; i < MAX_READLINE; i++)
 				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
+			num_scanlines = jpeg_read_scanlines(dinfo, buffer, MAX_READLINE);
 			lines_read += num_scanlines;
+			PASS_BAND();
 		}
-		out->actual_bytes = in->width * in->height * 2;	// XXX
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
+	out->actual_bytes = out_bytes;	// XXX
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+	jpeg_finish_decompress(dinfo);
+	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
 }
 
-/** @brief Convert an MJPEG frame to RGBX
+/** @brief Decode an MJPEG frame into the cropped and scaled frame
  * @ingroup frame
  *
+ * The largest DCT scaling(1/2, 1/4 or 1/8) that keeps the crop rectangle at least
+ * the output size is applied while decoding, the columns out of the crop rectangle are
+ * skipped with jpeg_crop_scanline and the rows with jpeg_skip_scanlines, and then
+ * the decoded rows are box filtered into the output size with uvc_yuyv2scaled.
+ * When the DCT scaling already gives the output size (e.g. 1/2 of 1920x1080 into 960x540),
+ * uvc_yuyv2scaled only converts the rows with the SIMD kernels.
+ * @param decoder decoder created by uvc_mjpeg_decoder_create
  * @param in MJPEG frame
- * @param out RGBX frame
+ * @param out converted frame
+ * @param format same as uvc_yuyv2scaled
+ * @param scale crop rectangle and output size, NULL for no scaling
  */
-uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	size_t lines_read;
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+uvc_error_t uvc_mjpeg_decode_scaled(uvc_mjpeg_decoder_t *decoder,
+	uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format, const uvc_scale_t *scale) {
 
-	int num_scanlines, i;
-	lines_read = 0;
-	unsigned char *buffer[MAX_READLINE];
+	j_decompress_ptr dinfo = &decoder->dinfo;
+	uvc_frame_t *decoded = &decoder->scaled;
+	uvc_scale_t s, sub;
+	int denom, j, num_scanlines;
+	size_t lines_read = 0;
+	uvc_error_t result;
 
-	out->actual_bytes = 0;	// XXX
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
 		return UVC_ERROR_INVALID_PARAM;
+	result = uvc_normalize_scale(scale, in->width, in->height, &s);
+	if (UNLIKELY(result))
+		return result;
 
-	if (uvc_ensure_frame_size(out, in->width * in->height * 4) < 0)
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGBX;	// XXX
-	out->step = in->width * 4;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
-
-	if (setjmp(jerr.jmp)) {
-		goto fail;
+	for (denom = 8; denom > 1; denom >>= 1) {
+		if ((s.crop_width / denom >= s.width) && (s.crop_height / denom >= s.height))
+			break;
 	}
+	// the decoder state for uvc_mjpeg_decode is not kept
+	decoder->has_header = 0;
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
-	jpeg_read_header(&dinfo, TRUE);
-
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
+	if (setjmp(decoder->jerr.jmp)) {
+		jpeg_abort_decompress(dinfo);
+		return UVC_ERROR_OTHER+1;
 	}
 
-	dinfo.out_color_space = JCS_EXT_RGBA;
-	dinfo.dct_method = JDCT_IFAST;
-
-	jpeg_start_decompress(&dinfo);
+	_uvc_mjpeg_read_header(decoder, in);
+	dinfo->out_color_space = JCS_YCbCr;
+	dinfo->dct_method = JDCT_IFAST;
+	dinfo->scale_num = 1;
+	dinfo->scale_denom = denom;
+
+	jpeg_start_decompress(dinfo);
+
+	// crop rectangle in the scaled image
+	const JDIMENSION x0 = s.crop_x / denom;
+	const JDIMENSION y0 = s.crop_y / denom;
+	JDIMENSION cw = (s.crop_width + denom - 1) / denom;
+	JDIMENSION ch = (s.crop_height + denom - 1) / denom;
+	if (cw > dinfo->output_width - x0)
+		cw = dinfo->output_width - x0;
+	if (ch > dinfo->output_height - y0)
+		ch = dinfo->output_height - y0;
+	JDIMENSION xoffset = x0, width = cw;
+	if (xoffset || (width < dinfo->output_width)) {
+		// xoffset is aligned to the iMCU boundary and width is widened
+		jpeg_crop_scanline(dinfo, &xoffset, &width);
+	}
+	if (y0)
+		jpeg_skip_scanlines(dinfo, y0);
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			buffer[0] = data + (lines_read) * out_step;
-			for (i = 1; i < MAX_READLINE; i++)
-				buffer[i] = buffer[i-1] + out_step;
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			lines_read += num_scanlines;
+	const int row_stride = dinfo->output_width * dinfo->output_components;
+	if (UNLIKELY(_uvc_mjpeg_ensure_work(decoder, (size_t)row_stride * MAX_READLINE)
+		|| uvc_ensure_frame_size(decoded, (dinfo->output_width & ~1) * ch * 2))) {
+		jpeg_abort_decompress(dinfo);
+		return UVC_ERROR_NO_MEM;
+	}
+	for (j = 0; j < MAX_READLINE; j++)
+		decoder->rows[j] = decoder->work + j * row_stride;
+	decoded->width = dinfo->output_width & ~1;
+	decoded->height = ch;
+	decoded->step = decoded->width * 2;
+	decoded->frame_format = UVC_FRAME_FORMAT_YUYV;
+	decoded->sequence = in->sequence;
+	decoded->capture_time = in->capture_time;
+	decoded->complete_time = in->complete_time;
+	decoded->source = in->source;
+	for (; lines_read < ch ;) {
+		num_scanlines = jpeg_read_scanlines(dinfo, decoder->rows,
+			ch - lines_read < MAX_READLINE ? ch - lines_read : MAX_READLINE);
+		if (UNLIKELY(!num_scanlines))
+			break;
+		for (j = 0; j < num_scanlines; j++) {
+			_uvc_mjpeg_ycbcr2yuyv(decoder->rows[j],
+				(uint8_t *)decoded->data + (lines_read + j) * decoded->step, row_stride);
 		}
-		out->actual_bytes = in->width * in->height * 4;	// XXX
+		lines_read += num_scanlines;
 	}
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;	// XXX
+	// the rows below the crop rectangle are not needed
+	jpeg_abort_decompress(dinfo);
+	if (UNLIKELY(lines_read < ch))
+		return UVC_ERROR_OTHER;
+
+	sub.crop_x = x0 - xoffset;
+	sub.crop_y = 0;
+	sub.crop_width = cw;
+	sub.crop_height = ch;
+	sub.width = s.width;
+	sub.height = s.height;
+	return uvc_yuyv2scaled(decoded, out, format, &sub);
+}
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return UVC_ERROR_OTHER+1;
+static pthread_key_t decoder_key;
+static pthread_once_t decoder_key_once = PTHREAD_ONCE_INIT;
+
+static void _uvc_mjpeg_decoder_release(void *decoder) {
+	uvc_mjpeg_decoder_destroy((uvc_mjpeg_decoder_t *)decoder);
 }
 
-static inline unsigned char sat(int i) {
-	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
+static void _uvc_mjpeg_decoder_key_init(void) {
+	pthread_key_create(&decoder_key, _uvc_mjpeg_decoder_release);
 }
 
-#define YCbCr_YUYV_2(YCbCr, yuyv) \
-	{ \
-		*(yuyv++) = *(YCbCr+0); \
-		*(yuyv++) = (*(YCbCr+1) + *(YCbCr+4)) >> 1; \
-		*(yuyv++) = *(YCbCr+3); \
-		*(yuyv++) = (*(YCbCr+2) + *(YCbCr+5)) >> 1; \
+/** @internal
+ * decoder of the calling thread for uvc_mjpeg2xxx, destroyed when the thread exits
+ */
+static uvc_mjpeg_decoder_t *_uvc_mjpeg_thread_decoder(void) {
+	uvc_mjpeg_decoder_t *decoder;
+
+	pthread_once(&decoder_key_once, _uvc_mjpeg_decoder_key_init);
+	decoder = (uvc_mjpeg_decoder_t *)pthread_getspecific(decoder_key);
+	if (UNLIKELY(!decoder)) {
+		decoder = uvc_mjpeg_decoder_create();
+		if (LIKELY(decoder))
+			pthread_setspecific(decoder_key, decoder);
 	}
+	return decoder;
+}
 
-uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
+static inline uvc_error_t _uvc_mjpeg_convert(uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format) {
+	uvc_mjpeg_decoder_t *decoder = _uvc_mjpeg_thread_decoder();
 
-	out->actual_bytes = 0;	// XXX
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_MJPEG))
-		return UVC_ERROR_INVALID_PARAM;
-
-	if (uvc_ensure_frame_size(out, in->width * in->height * 2) < 0)
+	if (UNLIKELY(!decoder)) {
+		out->actual_bytes = 0;	// XXX
 		return UVC_ERROR_NO_MEM;
+	}
+	return uvc_mjpeg_decode(decoder, in, out, format);
+}
 
-	size_t lines_read = 0;
-	int i, j;
-	int num_scanlines;
-	register uint8_t *yuyv, *ycbcr;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_YUYV;
-	out->step = in->width * 2;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	struct jpeg_decompress_struct dinfo;
-	struct error_mgr jerr;
-	dinfo.err = jpeg_std_error(&jerr.super);
-	jerr.super.error_exit = _error_exit;
+/** @brief Convert an MJPEG frame to RGB
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_RGB);
+}
 
-	if (setjmp(jerr.jmp)) {
-		goto fail;
-	}
+/** @brief Convert an MJPEG frame to BGR
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out BGR frame
+ */
+uvc_error_t uvc_mjpeg2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_BGR);
+}
 
-	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, in->data, in->actual_bytes/*in->data_bytes*/);	// XXX
-	jpeg_read_header(&dinfo, TRUE);
+/** @brief Convert an MJPEG frame to RGB565
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_mjpeg2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_RGB565);
+}
 
-	if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
-		/* This frame is missing the Huffman tables: fill in the standard ones */
-		insert_huff_tables(&dinfo);
-	}
+/** @brief Convert an MJPEG frame to RGBX
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGBX frame
+ */
+uvc_error_t uvc_mjpeg2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_RGBX);
+}
 
-	dinfo.out_color_space = JCS_YCbCr;
-	dinfo.dct_method = JDCT_IFAST;
+/** @brief Convert an MJPEG frame to YUYV
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out YUYV frame
+ */
+uvc_error_t uvc_mjpeg2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_YUYV);
+}
 
-	// start decompressor
-	jpeg_start_decompress(&dinfo);
+/** @brief Convert an MJPEG frame to yuv420SP(NV12)
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out yuv420SP(NV12) frame
+ */
+uvc_error_t uvc_mjpeg2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_NV12);
+}
 
-	// these dinfo.xxx valiables are only valid after jpeg_start_decompress
-	const int row_stride = dinfo.output_width * dinfo.output_components;
+/** @brief Convert an MJPEG frame to iyuv420SP(NV21)
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out iyuv420SP(NV21) frame
+ */
+uvc_error_t uvc_mjpeg2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_NV21);
+}
 
-	// allocate buffer
-	register JSAMPARRAY buffer = (*dinfo.mem->alloc_sarray)
-		((j_common_ptr) &dinfo, JPOOL_IMAGE, row_stride, MAX_READLINE);
+/** @brief Convert an MJPEG frame to I420(YUV420 planar)
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out I420 frame
+ */
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_I420);
+}
 
-	// local copy
-	uint8_t *data = out->data;
-	const int out_step = out->step;
+/** @brief Convert an MJPEG frame to GRAY8(luma only)
+ * @ingroup frame
+ *
+ * Only the luma component is reconstructed, the chroma coefficients are
+ * entropy decoded(that can not be skipped in the sequential JPEG) but discarded.
+ * @param in MJPEG frame
+ * @param out GRAY8 frame
+ */
+uvc_error_t uvc_mjpeg2gray8(uvc_frame_t *in, uvc_frame_t *out) {
+	return _uvc_mjpeg_convert(in, out, UVC_FRAME_FORMAT_GRAY8);
+}
 
-	if (LIKELY(dinfo.output_height == out->height)) {
-		for (; dinfo.output_scanline < dinfo.output_height ;) {
-			// convert lines of mjpeg data to YCbCr
-			num_scanlines = jpeg_read_scanlines(&dinfo, buffer, MAX_READLINE);
-			// convert YCbCr to yuyv(YUV422)
-			for (j = 0; j < num_scanlines; j++) {
-				yuyv = data + (lines_read + j) * out_step;
-				ycbcr = buffer[j];
-				for (i = 0; i < row_stride; i += 24) {	// step by YCbCr x 8 pixels = 3 x 8 bytes
-					YCbCr_YUYV_2(ycbcr + i, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 6, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 12, yuyv);
-					YCbCr_YUYV_2(ycbcr + i + 18, yuyv);
-				}
-			}
-			lines_read += num_scanlines;
-		}
-		out->actual_bytes = in->width * in->height * 2;	// XXX
-	}
+/** @brief Crop, scale and convert an MJPEG frame
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out converted frame
+ * @param format same as uvc_yuyv2scaled
+ * @param scale crop rectangle and output size, NULL for no scaling
+ */
+uvc_error_t uvc_mjpeg2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale) {
 
-	jpeg_finish_decompress(&dinfo);
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER;
+	uvc_mjpeg_decoder_t *decoder = _uvc_mjpeg_thread_decoder();
 
-fail:
-	jpeg_destroy_decompress(&dinfo);
-	return lines_read == out->height ? UVC_SUCCESS : UVC_ERROR_OTHER+1;
+	if (UNLIKELY(!decoder))
+		return UVC_ERROR_NO_MEM;
+	return uvc_mjpeg_decode_scaled(decoder, in, out, format, scale);
 }
-
@@ -0,0 +1,746 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (C) 2014-2017 saki@serenegiant <t_saki@serenegiant.com>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the author nor other contributors may be
+ *     used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/**
+ * SIMD row kernels of the color conversion in frame.c.
+ * The kernels use exactly the same fixed point arithmetic as the BT.601 full range
+ * scalar row converters(_uvc_yuv422_rgb_row etc.), so the output does not depend
+ * on the CPU. The scalar code is the reference and converts what the kernels left.
+ *
+ * ARMv7 NEON, AArch64 ASIMD, x86 SSE2 and AVX2 are supported,
+ * the kernels are selected by the CPU features on first use.
+ */
+#include <pthread.h>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#if defined(__aarch64__)
+	#define USE_NEON 1
+	#include <arm_neon.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#define USE_NEON 1
+	#include <arm_neon.h>
+	#include <sys/auxv.h>
+	#ifndef HWCAP_NEON
+		#define HWCAP_NEON (1 << 12)
+	#endif
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define USE_X86_SIMD 1
+	#include <immintrin.h>
+#endif
+
+// coefficients of the scalar conversion, values are scaled by 2^14
+#define COEF_RV 22987
+#define COEF_GU -5636
+#define COEF_GV -11698
+#define COEF_BU 29049
+
+static int _uvc_convert_row_none(const uint8_t *src, uint8_t *dst, int pixels) {
+	return 0;
+}
+
+static int _uvc_split_row_none(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return 0;
+}
+
+static int _uvc_half_row_none(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int pixels) {
+	return 0;
+}
+
+#if USE_NEON
+/**
+ * R, G and B of 16 pixels of packed YUV422
+ */
+static inline void _neon_yuv422_rgb(const uint8_t *src, const int uyvy,
+	uint8x16_t *r, uint8x16_t *g, uint8x16_t *b) {
+
+	// YUYV: y0 u y1 v, UYVY: u y0 v y1 of each pixel pair
+	const uint8x8x4_t in = vld4_u8(src);
+	const uint8x8_t bias = vdup_n_u8(128);
+	const int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(uyvy ? in.val[1] : in.val[0]));
+	const int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(uyvy ? in.val[3] : in.val[2]));
+	const int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(uyvy ? in.val[0] : in.val[1], bias));
+	const int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(uyvy ? in.val[2] : in.val[3], bias));
+	const int16x8_t dr = vcombine_s16(
+		vshrn_n_s32(vmull_n_s16(vget_low_s16(v), COEF_RV), 14),
+		vshrn_n_s32(vmull_n_s16(vget_high_s16(v), COEF_RV), 14));
+	const int16x8_t dg = vcombine_s16(
+		vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(u), COEF_GU), vget_low_s16(v), COEF_GV), 14),
+		vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(u), COEF_GU), vget_high_s16(v), COEF_GV), 14));
+	const int16x8_t db = vcombine_s16(
+		vshrn_n_s32(vmull_n_s16(vget_low_s16(u), COEF_BU), 14),
+		vshrn_n_s32(vmull_n_s16(vget_high_s16(u), COEF_BU), 14));
+	// saturate like sat() and put even and odd pixels back in order
+	const uint8x8x2_t rr = vzip_u8(vqmovun_s16(vaddq_s16(y0, dr)), vqmovun_s16(vaddq_s16(y1, dr)));
+	const uint8x8x2_t gg = vzip_u8(vqmovun_s16(vaddq_s16(y0, dg)), vqmovun_s16(vaddq_s16(y1, dg)));
+	const uint8x8x2_t bb = vzip_u8(vqmovun_s16(vaddq_s16(y0, db)), vqmovun_s16(vaddq_s16(y1, db)));
+	*r = vcombine_u8(rr.val[0], rr.val[1]);
+	*g = vcombine_u8(gg.val[0], gg.val[1]);
+	*b = vcombine_u8(bb.val[0], bb.val[1]);
+}
+
+static inline uint16x8_t _neon_pack_rgb565(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+	uint16x8_t result = vshll_n_u8(r, 8);
+	result = vsriq_n_u16(result, vshll_n_u8(g, 8), 5);
+	return vsriq_n_u16(result, vshll_n_u8(b, 8), 11);
+}
+
+static inline void _neon_store_rgb565(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+	vst1q_u8(dst, vreinterpretq_u8_u16(
+		_neon_pack_rgb565(vget_low_u8(r), vget_low_u8(g), vget_low_u8(b))));
+	vst1q_u8(dst + 16, vreinterpretq_u8_u16(
+		_neon_pack_rgb565(vget_high_u8(r), vget_high_u8(g), vget_high_u8(b))));
+}
+
+static inline int _neon_yuv422_row(const uint8_t *src, uint8_t *dst, int pixels,
+	const int uyvy, const enum uvc_frame_format format) {
+
+	const uint8x16_t alpha = vdupq_n_u8(0xff);
+	uint8x16_t r, g, b;
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		_neon_yuv422_rgb(src, uyvy, &r, &g, &b);
+		switch (format) {
+		case UVC_FRAME_FORMAT_RGBX:
+		{
+			uint8x16x4_t rgbx = { { r, g, b, alpha } };
+			vst4q_u8(dst, rgbx);
+			dst += 64;
+			break;
+		}
+		case UVC_FRAME_FORMAT_RGB:
+		{
+			uint8x16x3_t rgb = { { r, g, b } };
+			vst3q_u8(dst, rgb);
+			dst += 48;
+			break;
+		}
+		case UVC_FRAME_FORMAT_BGR:
+		{
+			uint8x16x3_t bgr = { { b, g, r } };
+			vst3q_u8(dst, bgr);
+			dst += 48;
+			break;
+		}
+		default:	// UVC_FRAME_FORMAT_RGB565
+			_neon_store_rgb565(dst, r, g, b);
+			dst += 32;
+			break;
+		}
+		src += 32;
+	}
+	return i;
+}
+
+static int _neon_yuyv2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGBX);
+}
+
+static int _neon_yuyv2rgb(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGB);
+}
+
+static int _neon_yuyv2bgr(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_BGR);
+}
+
+static int _neon_yuyv2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGB565);
+}
+
+static int _neon_uyvy2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGBX);
+}
+
+static int _neon_uyvy2rgb(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGB);
+}
+
+static int _neon_uyvy2bgr(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_BGR);
+}
+
+static int _neon_uyvy2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGB565);
+}
+
+static int _neon_rgb2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		const uint8x16x3_t rgb = vld3q_u8(src);
+		uint8x16x4_t rgbx = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(0xff) } };
+		vst4q_u8(dst, rgbx);
+		src += 48;
+		dst += 64;
+	}
+	return i;
+}
+
+static int _neon_rgb2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		const uint8x16x3_t rgb = vld3q_u8(src);
+		_neon_store_rgb565(dst, rgb.val[0], rgb.val[1], rgb.val[2]);
+		src += 48;
+		dst += 32;
+	}
+	return i;
+}
+
+static inline int _neon_yuyv_split(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels, const int swap_uv) {
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		// val[0]: y, val[1]: u v u v...
+		const uint8x16x2_t yuv = vld2q_u8(src);
+		vst1q_u8(y, yuv.val[0]);
+		if (uv) {
+			vst1q_u8(uv, swap_uv ? vrev16q_u8(yuv.val[1]) : yuv.val[1]);
+			uv += 16;
+		}
+		src += 32;
+		y += 16;
+	}
+	return i;
+}
+
+static int _neon_yuyv2nv12(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _neon_yuyv_split(src, y, uv, pixels, 0);
+}
+
+static int _neon_yuyv2nv21(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _neon_yuyv_split(src, y, uv, pixels, 1);
+}
+
+static inline int _neon_yuv422_gray(const uint8_t *src, uint8_t *dst, int pixels, const int uyvy) {
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		// val[0]: y of YUYV, val[1]: y of UYVY
+		const uint8x16x2_t yuv = vld2q_u8(src);
+		vst1q_u8(dst, uyvy ? yuv.val[1] : yuv.val[0]);
+		src += 32;
+		dst += 16;
+	}
+	return i;
+}
+
+static int _neon_yuyv2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_gray(src, dst, pixels, 0);
+}
+
+static int _neon_uyvy2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _neon_yuv422_gray(src, dst, pixels, 1);
+}
+
+static int _neon_yuyv_half(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int pixels) {
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		// 32 pixels of each row, val[0]: y of the even pixels, val[1]: u, val[2]: y of the odd pixels, val[3]: v
+		const uint8x16x4_t a = vld4q_u8(src0);
+		const uint8x16x4_t b = vld4q_u8(src1);
+		// average of the rows and then of the pixels of each pair
+		const uint8x16_t y = vrhaddq_u8(vrhaddq_u8(a.val[0], b.val[0]), vrhaddq_u8(a.val[2], b.val[2]));
+		const uint8x16_t u = vrhaddq_u8(a.val[1], b.val[1]);
+		const uint8x16_t v = vrhaddq_u8(a.val[3], b.val[3]);
+		// the output pair takes y of two input pairs and the average of their chroma
+		const uint8x8x2_t yy = vuzp_u8(vget_low_u8(y), vget_high_u8(y));
+		const uint8x8x2_t uu = vuzp_u8(vget_low_u8(u), vget_high_u8(u));
+		const uint8x8x2_t vv = vuzp_u8(vget_low_u8(v), vget_high_u8(v));
+		uint8x8x4_t out;
+		out.val[0] = yy.val[0];
+		out.val[1] = vrhadd_u8(uu.val[0], uu.val[1]);
+		out.val[2] = yy.val[1];
+		out.val[3] = vrhadd_u8(vv.val[0], vv.val[1]);
+		vst4_u8(dst, out);
+		src0 += 64;
+		src1 += 64;
+		dst += 32;
+	}
+	return i;
+}
+#endif	// USE_NEON
+
+#if USE_X86_SIMD
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+// 32 bit lane of the coefficients of (u, v) for pmaddwd
+#define COEF_UV(cu, cv) ((int)(((uint32_t)(uint16_t)(cv) << 16) | (uint16_t)(cu)))
+
+/**
+ * R, G and B of 8 pixels of packed YUV422 as 16 bit values, not saturated yet
+ * chroma is interleaved as u0 v0 u1 v1..., so multiply-add of each 32 bit lane
+ * gives the value of a pixel pair, which is duplicated to both pixels.
+ */
+static inline TARGET_SSE2 void _sse2_yuv422_rgb(const __m128i in, const int uyvy,
+	__m128i *r, __m128i *g, __m128i *b) {
+
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i y = uyvy ? _mm_srli_epi16(in, 8) : _mm_and_si128(in, mask);
+	const __m128i uv = _mm_sub_epi16(uyvy ? _mm_and_si128(in, mask) : _mm_srli_epi16(in, 8),
+		_mm_set1_epi16(128));
+	__m128i d;
+
+	d = _mm_srai_epi32(_mm_madd_epi16(uv, _mm_set1_epi32(COEF_UV(0, COEF_RV))), 14);
+	d = _mm_packs_epi32(d, d);
+	*r = _mm_add_epi16(y, _mm_unpacklo_epi16(d, d));
+	d = _mm_srai_epi32(_mm_madd_epi16(uv, _mm_set1_epi32(COEF_UV(COEF_GU, COEF_GV))), 14);
+	d = _mm_packs_epi32(d, d);
+	*g = _mm_add_epi16(y, _mm_unpacklo_epi16(d, d));
+	d = _mm_srai_epi32(_mm_madd_epi16(uv, _mm_set1_epi32(COEF_UV(COEF_BU, 0))), 14);
+	d = _mm_packs_epi32(d, d);
+	*b = _mm_add_epi16(y, _mm_unpacklo_epi16(d, d));
+}
+
+static inline TARGET_SSE2 __m128i _sse2_pack_rgb565(const __m128i r, const __m128i g, const __m128i b) {
+	return _mm_or_si128(
+		_mm_or_si128(
+			_mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xf8)), 8),
+			_mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3)),
+		_mm_srli_epi16(b, 3));
+}
+
+static inline TARGET_SSE2 int _sse2_yuv422_row(const uint8_t *src, uint8_t *dst, int pixels,
+	const int uyvy, const enum uvc_frame_format format) {
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi8((char)0xff);
+	__m128i r0, g0, b0, r1, g1, b1, r, g, b;
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		_sse2_yuv422_rgb(_mm_loadu_si128((const __m128i *)src), uyvy, &r0, &g0, &b0);
+		_sse2_yuv422_rgb(_mm_loadu_si128((const __m128i *)(src + 16)), uyvy, &r1, &g1, &b1);
+		// saturate like sat()
+		r = _mm_packus_epi16(r0, r1);
+		g = _mm_packus_epi16(g0, g1);
+		b = _mm_packus_epi16(b0, b1);
+		if (format == UVC_FRAME_FORMAT_RGBX) {
+			const __m128i rg0 = _mm_unpacklo_epi8(r, g);
+			const __m128i rg1 = _mm_unpackhi_epi8(r, g);
+			const __m128i ba0 = _mm_unpacklo_epi8(b, alpha);
+			const __m128i ba1 = _mm_unpackhi_epi8(b, alpha);
+			_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg0, ba0));
+			_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg0, ba0));
+			_mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rg1, ba1));
+			_mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rg1, ba1));
+			dst += 64;
+		} else {	// UVC_FRAME_FORMAT_RGB565
+			_mm_storeu_si128((__m128i *)dst, _sse2_pack_rgb565(
+				_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i *)(dst + 16), _sse2_pack_rgb565(
+				_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero)));
+			dst += 32;
+		}
+		src += 32;
+	}
+	return i;
+}
+
+static TARGET_SSE2 int _sse2_yuyv2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGBX);
+}
+
+static TARGET_SSE2 int _sse2_yuyv2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGB565);
+}
+
+static TARGET_SSE2 int _sse2_uyvy2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGBX);
+}
+
+static TARGET_SSE2 int _sse2_uyvy2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGB565);
+}
+
+static inline TARGET_SSE2 int _sse2_yuyv_split(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels, const int swap_uv) {
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i a0, a1, c0, c1;
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		a0 = _mm_loadu_si128((const __m128i *)src);
+		a1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		_mm_storeu_si128((__m128i *)y, _mm_packus_epi16(_mm_and_si128(a0, mask), _mm_and_si128(a1, mask)));
+		if (uv) {
+			c0 = _mm_srli_epi16(a0, 8);
+			c1 = _mm_srli_epi16(a1, 8);
+			if (swap_uv) {
+				c0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c0, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+				c1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c1, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+			}
+			_mm_storeu_si128((__m128i *)uv, _mm_packus_epi16(c0, c1));
+			uv += 16;
+		}
+		src += 32;
+		y += 16;
+	}
+	return i;
+}
+
+static TARGET_SSE2 int _sse2_yuyv2nv12(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _sse2_yuyv_split(src, y, uv, pixels, 0);
+}
+
+static TARGET_SSE2 int _sse2_yuyv2nv21(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _sse2_yuyv_split(src, y, uv, pixels, 1);
+}
+
+static inline TARGET_SSE2 int _sse2_yuv422_gray(const uint8_t *src, uint8_t *dst, int pixels, const int uyvy) {
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i a0, a1;
+	int i;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		a0 = _mm_loadu_si128((const __m128i *)src);
+		a1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		if (uyvy) {
+			a0 = _mm_srli_epi16(a0, 8);
+			a1 = _mm_srli_epi16(a1, 8);
+		} else {
+			a0 = _mm_and_si128(a0, mask);
+			a1 = _mm_and_si128(a1, mask);
+		}
+		_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(a0, a1));
+		src += 32;
+		dst += 16;
+	}
+	return i;
+}
+
+static TARGET_SSE2 int _sse2_yuyv2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_gray(src, dst, pixels, 0);
+}
+
+static TARGET_SSE2 int _sse2_uyvy2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _sse2_yuv422_gray(src, dst, pixels, 1);
+}
+
+static TARGET_SSE2 int _sse2_yuyv_half(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int pixels) {
+	const __m128i mask_y0 = _mm_set1_epi32(0x000000ff);
+	const __m128i mask_y1 = _mm_set1_epi32(0x00ff0000);
+	const __m128i mask_uv = _mm_set1_epi32(0xff00ff00);
+	__m128i a0, a1, e, o, uv, y0, y1;
+	int i;
+
+	for (i = 0; i + 8 <= pixels; i += 8) {
+		// average of the rows, 16 pixels as 8 pairs of YUYV
+		a0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)src0), _mm_loadu_si128((const __m128i *)src1));
+		a1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(src0 + 16)), _mm_loadu_si128((const __m128i *)(src1 + 16)));
+		// even and odd pairs
+		a0 = _mm_shuffle_epi32(a0, _MM_SHUFFLE(3, 1, 2, 0));
+		a1 = _mm_shuffle_epi32(a1, _MM_SHUFFLE(3, 1, 2, 0));
+		e = _mm_unpacklo_epi64(a0, a1);
+		o = _mm_unpackhi_epi64(a0, a1);
+		// chroma of the output pair is the average of the pairs,
+		// the y of each pair is the average of its two pixels
+		uv = _mm_avg_epu8(e, o);
+		y0 = _mm_avg_epu8(e, _mm_srli_epi32(e, 16));
+		y1 = _mm_slli_epi32(_mm_avg_epu8(o, _mm_srli_epi32(o, 16)), 16);
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_and_si128(uv, mask_uv),
+			_mm_or_si128(_mm_and_si128(y0, mask_y0), _mm_and_si128(y1, mask_y1))));
+		src0 += 32;
+		src1 += 32;
+		dst += 16;
+	}
+	return i;
+}
+
+/**
+ * same as _sse2_yuv422_rgb for 16 pixels,
+ * pixel 0-7 are in the low 128 bit lane and pixel 8-15 in the high lane
+ */
+static inline TARGET_AVX2 void _avx2_yuv422_rgb(const __m256i in, const int uyvy,
+	__m256i *r, __m256i *g, __m256i *b) {
+
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	const __m256i y = uyvy ? _mm256_srli_epi16(in, 8) : _mm256_and_si256(in, mask);
+	const __m256i uv = _mm256_sub_epi16(uyvy ? _mm256_and_si256(in, mask) : _mm256_srli_epi16(in, 8),
+		_mm256_set1_epi16(128));
+	__m256i d;
+
+	d = _mm256_srai_epi32(_mm256_madd_epi16(uv, _mm256_set1_epi32(COEF_UV(0, COEF_RV))), 14);
+	d = _mm256_packs_epi32(d, d);
+	*r = _mm256_add_epi16(y, _mm256_unpacklo_epi16(d, d));
+	d = _mm256_srai_epi32(_mm256_madd_epi16(uv, _mm256_set1_epi32(COEF_UV(COEF_GU, COEF_GV))), 14);
+	d = _mm256_packs_epi32(d, d);
+	*g = _mm256_add_epi16(y, _mm256_unpacklo_epi16(d, d));
+	d = _mm256_srai_epi32(_mm256_madd_epi16(uv, _mm256_set1_epi32(COEF_UV(COEF_BU, 0))), 14);
+	d = _mm256_packs_epi32(d, d);
+	*b = _mm256_add_epi16(y, _mm256_unpacklo_epi16(d, d));
+}
+
+static inline TARGET_AVX2 __m256i _avx2_pack_rgb565(const __m256i r, const __m256i g, const __m256i b) {
+	return _mm256_or_si256(
+		_mm256_or_si256(
+			_mm256_slli_epi16(_mm256_and_si256(r, _mm256_set1_epi16(0xf8)), 8),
+			_mm256_slli_epi16(_mm256_and_si256(g, _mm256_set1_epi16(0xfc)), 3)),
+		_mm256_srli_epi16(b, 3));
+}
+
+static inline TARGET_AVX2 int _avx2_yuv422_row(const uint8_t *src, uint8_t *dst, int pixels,
+	const int uyvy, const enum uvc_frame_format format) {
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi8((char)0xff);
+	__m256i r0, g0, b0, r1, g1, b1, r, g, b;
+	int i;
+
+	for (i = 0; i + 32 <= pixels; i += 32) {
+		_avx2_yuv422_rgb(_mm256_loadu_si256((const __m256i *)src), uyvy, &r0, &g0, &b0);
+		_avx2_yuv422_rgb(_mm256_loadu_si256((const __m256i *)(src + 32)), uyvy, &r1, &g1, &b1);
+		// low lane: pixel 0-7 and 16-23, high lane: pixel 8-15 and 24-31
+		r = _mm256_packus_epi16(r0, r1);
+		g = _mm256_packus_epi16(g0, g1);
+		b = _mm256_packus_epi16(b0, b1);
+		if (format == UVC_FRAME_FORMAT_RGBX) {
+			// rg0/ba0 hold pixel 0-15 and rg1/ba1 hold pixel 16-31
+			const __m256i rg0 = _mm256_unpacklo_epi8(r, g);
+			const __m256i rg1 = _mm256_unpackhi_epi8(r, g);
+			const __m256i ba0 = _mm256_unpacklo_epi8(b, alpha);
+			const __m256i ba1 = _mm256_unpackhi_epi8(b, alpha);
+			const __m256i p0 = _mm256_unpacklo_epi16(rg0, ba0);	// pixel 0-3, 8-11
+			const __m256i p1 = _mm256_unpackhi_epi16(rg0, ba0);	// pixel 4-7, 12-15
+			const __m256i p2 = _mm256_unpacklo_epi16(rg1, ba1);	// pixel 16-19, 24-27
+			const __m256i p3 = _mm256_unpackhi_epi16(rg1, ba1);	// pixel 20-23, 28-31
+			_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+			_mm256_storeu_si256((__m256i *)(dst + 64), _mm256_permute2x128_si256(p2, p3, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+			dst += 128;
+		} else {	// UVC_FRAME_FORMAT_RGB565
+			_mm256_storeu_si256((__m256i *)dst, _avx2_pack_rgb565(
+				_mm256_unpacklo_epi8(r, zero), _mm256_unpacklo_epi8(g, zero), _mm256_unpacklo_epi8(b, zero)));
+			_mm256_storeu_si256((__m256i *)(dst + 32), _avx2_pack_rgb565(
+				_mm256_unpackhi_epi8(r, zero), _mm256_unpackhi_epi8(g, zero), _mm256_unpackhi_epi8(b, zero)));
+			dst += 64;
+		}
+		src += 64;
+	}
+	return i;
+}
+
+static TARGET_AVX2 int _avx2_yuyv2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGBX);
+}
+
+static TARGET_AVX2 int _avx2_yuyv2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_row(src, dst, pixels, 0, UVC_FRAME_FORMAT_RGB565);
+}
+
+static TARGET_AVX2 int _avx2_uyvy2rgbx(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGBX);
+}
+
+static TARGET_AVX2 int _avx2_uyvy2rgb565(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_row(src, dst, pixels, 1, UVC_FRAME_FORMAT_RGB565);
+}
+
+static inline TARGET_AVX2 int _avx2_yuyv_split(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels, const int swap_uv) {
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	__m256i a0, a1, c0, c1;
+	int i;
+
+	for (i = 0; i + 32 <= pixels; i += 32) {
+		a0 = _mm256_loadu_si256((const __m256i *)src);
+		a1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+		// packus works in each 128 bit lane, reorder the 64 bit quarters
+		_mm256_storeu_si256((__m256i *)y, _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(_mm256_and_si256(a0, mask), _mm256_and_si256(a1, mask)), 0xd8));
+		if (uv) {
+			c0 = _mm256_srli_epi16(a0, 8);
+			c1 = _mm256_srli_epi16(a1, 8);
+			if (swap_uv) {
+				c0 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c0, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+				c1 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c1, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+			}
+			_mm256_storeu_si256((__m256i *)uv, _mm256_permute4x64_epi64(_mm256_packus_epi16(c0, c1), 0xd8));
+			uv += 32;
+		}
+		src += 64;
+		y += 32;
+	}
+	return i;
+}
+
+static TARGET_AVX2 int _avx2_yuyv2nv12(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _avx2_yuyv_split(src, y, uv, pixels, 0);
+}
+
+static TARGET_AVX2 int _avx2_yuyv2nv21(const uint8_t *src, uint8_t *y, uint8_t *uv, int pixels) {
+	return _avx2_yuyv_split(src, y, uv, pixels, 1);
+}
+
+static inline TARGET_AVX2 int _avx2_yuv422_gray(const uint8_t *src, uint8_t *dst, int pixels, const int uyvy) {
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	__m256i a0, a1;
+	int i;
+
+	for (i = 0; i + 32 <= pixels; i += 32) {
+		a0 = _mm256_loadu_si256((const __m256i *)src);
+		a1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+		if (uyvy) {
+			a0 = _mm256_srli_epi16(a0, 8);
+			a1 = _mm256_srli_epi16(a1, 8);
+		} else {
+			a0 = _mm256_and_si256(a0, mask);
+			a1 = _mm256_and_si256(a1, mask);
+		}
+		// packus works in each 128 bit lane, reorder the 64 bit quarters
+		_mm256_storeu_si256((__m256i *)dst, _mm256_permute4x64_epi64(_mm256_packus_epi16(a0, a1), 0xd8));
+		src += 64;
+		dst += 32;
+	}
+	return i;
+}
+
+static TARGET_AVX2 int _avx2_yuyv2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_gray(src, dst, pixels, 0);
+}
+
+static TARGET_AVX2 int _avx2_uyvy2gray(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _avx2_yuv422_gray(src, dst, pixels, 1);
+}
+#endif	// USE_X86_SIMD
+
+static const uvc_convert_kernels_t scalar_kernels = {
+	.features = 0,
+	.yuyv2rgbx = _uvc_convert_row_none,
+	.yuyv2rgb = _uvc_convert_row_none,
+	.yuyv2bgr = _uvc_convert_row_none,
+	.yuyv2rgb565 = _uvc_convert_row_none,
+	.uyvy2rgbx = _uvc_convert_row_none,
+	.uyvy2rgb = _uvc_convert_row_none,
+	.uyvy2bgr = _uvc_convert_row_none,
+	.uyvy2rgb565 = _uvc_convert_row_none,
+	.rgb2rgbx = _uvc_convert_row_none,
+	.rgb2rgb565 = _uvc_convert_row_none,
+	.yuyv2nv12 = _uvc_split_row_none,
+	.yuyv2nv21 = _uvc_split_row_none,
+	.yuyv2gray = _uvc_convert_row_none,
+	.uyvy2gray = _uvc_convert_row_none,
+	.yuyv_half = _uvc_half_row_none,
+};
+
+static uvc_convert_kernels_t simd_kernels;
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+static volatile int simd_enabled = 1;
+
+/** @internal
+ * Select the kernels by the CPU features, kernels that are not available
+ * for the CPU are left to the scalar code
+ */
+static void _uvc_init_convert_kernels(void) {
+	simd_kernels = scalar_kernels;
+#if USE_NEON
+#if !defined(__aarch64__)
+	// NEON is optional on ARMv7
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+#endif
+	{
+		simd_kernels.features |= UVC_SIMD_NEON;
+		simd_kernels.yuyv2rgbx = _neon_yuyv2rgbx;
+		simd_kernels.yuyv2rgb = _neon_yuyv2rgb;
+		simd_kernels.yuyv2bgr = _neon_yuyv2bgr;
+		simd_kernels.yuyv2rgb565 = _neon_yuyv2rgb565;
+		simd_kernels.uyvy2rgbx = _neon_uyvy2rgbx;
+		simd_kernels.uyvy2rgb = _neon_uyvy2rgb;
+		simd_kernels.uyvy2bgr = _neon_uyvy2bgr;
+		simd_kernels.uyvy2rgb565 = _neon_uyvy2rgb565;
+		simd_kernels.rgb2rgbx = _neon_rgb2rgbx;
+		simd_kernels.rgb2rgb565 = _neon_rgb2rgb565;
+		simd_kernels.yuyv2nv12 = _neon_yuyv2nv12;
+		simd_kernels.yuyv2nv21 = _neon_yuyv2nv21;
+		simd_kernels.yuyv2gray = _neon_yuyv2gray;
+		simd_kernels.uyvy2gray = _neon_uyvy2gray;
+		simd_kernels.yuyv_half = _neon_yuyv_half;
+	}
+#elif USE_X86_SIMD
+	// XXX 24 bit RGB/BGR need pshufb(SSSE3) to be efficient, those are left to the scalar code
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		simd_kernels.features |= UVC_SIMD_SSE2;
+		simd_kernels.yuyv2rgbx = _sse2_yuyv2rgbx;
+		simd_kernels.yuyv2rgb565 = _sse2_yuyv2rgb565;
+		simd_kernels.uyvy2rgbx = _sse2_uyvy2rgbx;
+		simd_kernels.uyvy2rgb565 = _sse2_uyvy2rgb565;
+		simd_kernels.yuyv2nv12 = _sse2_yuyv2nv12;
+		simd_kernels.yuyv2nv21 = _sse2_yuyv2nv21;
+		simd_kernels.yuyv2gray = _sse2_yuyv2gray;
+		simd_kernels.uyvy2gray = _sse2_uyvy2gray;
+		simd_kernels.yuyv_half = _sse2_yuyv_half;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		simd_kernels.features |= UVC_SIMD_AVX2;
+		simd_kernels.yuyv2rgbx = _avx2_yuyv2rgbx;
+		simd_kernels.yuyv2rgb565 = _avx2_yuyv2rgb565;
+		simd_kernels.uyvy2rgbx = _avx2_uyvy2rgbx;
+		simd_kernels.uyvy2rgb565 = _avx2_uyvy2rgb565;
+		simd_kernels.yuyv2nv12 = _avx2_yuyv2nv12;
+		simd_kernels.yuyv2nv21 = _avx2_yuyv2nv21;
+		simd_kernels.yuyv2gray = _avx2_yuyv2gray;
+		simd_kernels.uyvy2gray = _avx2_uyvy2gray;
+	}
+#endif
+	LOGI("SIMD features of color conversion:0x%02x", simd_kernels.features);
+}
+
+/** @internal
+ * @brief Color conversion kernels for this CPU
+ */
+const uvc_convert_kernels_t *uvc_get_convert_kernels(void) {
+	pthread_once(&simd_once, _uvc_init_convert_kernels);
+	return LIKELY(simd_enabled) ? &simd_kernels : &scalar_kernels;
+}
+
+/** @brief SIMD instruction sets that the color conversion uses
+ * @ingroup frame
+ * @return combination of UVC_SIMD_XXX, 0 if only the scalar code is used
+ */
+int uvc_get_simd_features(void) {
+	return uvc_get_convert_kernels()->features;
+}
+
+/** @brief Enable/disable the SIMD kernels of the color conversion
+ * @ingroup frame
+ * The scalar code is the reference, disabling SIMD is useful for comparison
+ * @param enabled 0: scalar code only, otherwise SIMD kernels are used if the CPU supports them
+ */
+void uvc_set_simd_enabled(int enabled) {
+	simd_enabled = enabled;
+}
@@ -48,16 +48,77 @@
  * @defgroup frame Frame processing
  * @brief Tools for managing frame buffers and converting between image formats
  */
+#include <limits.h>
+
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
 
 #define USE_STRIDE 1
+
+static void _uvc_frame_pool_destroy(uvc_frame_pool_t *pool);
+static void _uvc_frame_pool_forget(uvc_frame_t *frame);
+
+/** @internal
+ * work buffer of a thread
+ */
+typedef struct uvc_scratch {
+	void *data;
+	size_t bytes;
+} uvc_scratch_t;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void _uvc_scratch_destructor(void *ptr) {
+	uvc_scratch_t *scratch = ptr;
+
+	free(scratch->data);
+	free(scratch);
+}
+
+static void _uvc_scratch_init_key(void) {
+	pthread_key_create(&scratch_key, _uvc_scratch_destructor);
+}
+
+/** @internal
+ * @brief Work buffer of the calling thread that is kept for the next call,
+ * so that the conversions do not malloc/free on every frame
+ * @return buffer of at least @p bytes that is valid until the next call on the same thread, NULL on error
+ */
+void *uvc_thread_scratch(size_t bytes) {
+	uvc_scratch_t *scratch;
+	void *data;
+
+	pthread_once(&scratch_once, _uvc_scratch_init_key);
+	scratch = pthread_getspecific(scratch_key);
+	if (UNLIKELY(!scratch)) {
+		scratch = calloc(1, sizeof(uvc_scratch_t));
+		if (UNLIKELY(!scratch))
+			return NULL;
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(uvc_scratch_t));
+		pthread_setspecific(scratch_key, scratch);
+	}
+	if (UNLIKELY(scratch->bytes < bytes)) {
+		data = malloc(bytes);
+		if (UNLIKELY(!data))
+			return NULL;
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, bytes);
+		free(scratch->data);
+		scratch->data = data;
+		scratch->bytes = bytes;
+	}
+	return scratch->data;
+}
+
 /** @internal */
 uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
 	if LIKELY(frame->library_owns_data) {
+		if (frame->alloc_bytes)
+			return uvc_arena_ensure_frame_size(frame, need_bytes);
 		if UNLIKELY(!frame->data || frame->data_bytes != need_bytes) {
 			frame->actual_bytes = frame->data_bytes = need_bytes;	// XXX
 			frame->data = realloc(frame->data, frame->data_bytes);
+			UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, need_bytes);
 		}
 		if (UNLIKELY(!frame->data || !need_bytes))
 			return UVC_ERROR_NO_MEM;
@@ -80,6 +141,7 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 
 	if (UNLIKELY(!frame))
 		return NULL;
+	UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(*frame));
 
 #ifndef __ANDROID__
 	// XXX in many case, it is not neccesary to clear because all fields are set before use
@@ -87,6 +149,9 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 	memset(frame, 0, sizeof(*frame));	// bzero(frame, sizeof(*frame)); // bzero is deprecated
 #endif
 //	frame->library_owns_data = 1;	// XXX moved to lower
+	frame->pool = NULL;
+	frame->ref_count = 1;
+	frame->alloc_bytes = 0;
 
 	if (LIKELY(data_bytes > 0)) {
 		frame->library_owns_data = 1;
@@ -97,6 +162,7 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 			free(frame);
 			return NULL ;
 		}
+		UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, data_bytes);
 	}
 
 	return frame;
@@ -108,12 +174,243 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
  * @param frame Frame to destroy
  */
 void uvc_free_frame(uvc_frame_t *frame) {
+	if (UNLIKELY(frame->pool)) {
+		// XXX pooled frame is freed directly, just drop it from the pool accounting
+		_uvc_frame_pool_forget(frame);
+	}
+	if (frame->alloc_bytes) {
+		// frame came from uvc_arena_allocate_frame
+		uvc_arena_free_frame(frame);
+		return;
+	}
 	if ((frame->data_bytes > 0) && frame->library_owns_data)
 		free(frame->data);
 
 	free(frame);
 }
 
+/** @brief Take a reference to a frame
+ * @ingroup frame
+ *
+ * The leased frame stays valid until it is returned with uvc_release_frame,
+ * and it can be shared between threads, each of them holding its own reference.
+ * Frames that are not reference counted (such as the frame passed to the user
+ * callback without UVC_STREAM_FLAG_ZERO_COPY) are duplicated instead.
+ *
+ * @param frame Frame to lease
+ * @return Leased frame (same as frame when it is reference counted), or NULL on error
+ */
+uvc_frame_t *uvc_lease_frame(uvc_frame_t *frame) {
+	uvc_frame_t *copy;
+
+	if (UNLIKELY(!frame))
+		return NULL;
+	if (LIKELY(frame->ref_count > 0)) {
+		__sync_add_and_fetch(&frame->ref_count, 1);
+		return frame;
+	}
+	copy = uvc_allocate_frame(frame->data_bytes);
+	if (UNLIKELY(!copy))
+		return NULL;
+	if (UNLIKELY(uvc_duplicate_frame(frame, copy))) {
+		uvc_free_frame(copy);
+		return NULL;
+	}
+	return copy;
+}
+
+/** @brief Drop a reference to a frame
+ * @ingroup frame
+ *
+ * When the last reference is dropped, the frame is returned to its pool
+ * or freed if it does not belong to a pool.
+ * Frames delivered by zero-copy streaming (UVC_STREAM_FLAG_ZERO_COPY) and
+ * frames from uvc_lease_frame must be returned with this function.
+ * The caller must not use the frame after calling this.
+ *
+ * @param frame Frame to release
+ */
+void uvc_release_frame(uvc_frame_t *frame) {
+	uvc_frame_pool_t *pool;
+	int destroy;
+
+	if (UNLIKELY(!frame))
+		return;
+	if (UNLIKELY(frame->ref_count <= 0)) {
+		// XXX not reference counted, the owner frees it
+		return;
+	}
+	if (__sync_sub_and_fetch(&frame->ref_count, 1) > 0)
+		return;	// still referenced by others
+	pool = frame->pool;
+	if (!pool) {
+		uvc_free_frame(frame);
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	{
+		if (LIKELY(!pool->detached && (pool->num_free < pool->max_free)
+			&& frame->library_owns_data && frame->data)) {
+			pool->free_frames[pool->num_free++] = frame;
+			frame = NULL;
+		}
+		pool->num_outstanding--;
+		destroy = pool->detached && !pool->num_outstanding;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (UNLIKELY(frame)) {
+		frame->pool = NULL;
+		uvc_free_frame(frame);
+	}
+	if (UNLIKELY(destroy)) {
+		_uvc_frame_pool_destroy(pool);
+	}
+}
+
+/** @internal
+ * @brief free the pool and the frames kept for reuse
+ */
+static void _uvc_frame_pool_destroy(uvc_frame_pool_t *pool) {
+	int i;
+
+	for (i = 0; i < pool->num_free; i++) {
+		pool->free_frames[i]->pool = NULL;
+		uvc_free_frame(pool->free_frames[i]);
+	}
+	free(pool->free_frames);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+/** @internal
+ * @brief remove a pooled frame from the pool accounting without returning it
+ */
+static void _uvc_frame_pool_forget(uvc_frame_t *frame) {
+	uvc_frame_pool_t *pool = frame->pool;
+	int destroy;
+
+	frame->pool = NULL;
+	pthread_mutex_lock(&pool->mutex);
+	{
+		pool->num_outstanding--;
+		destroy = pool->detached && !pool->num_outstanding;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (UNLIKELY(destroy)) {
+		_uvc_frame_pool_destroy(pool);
+	}
+}
+
+/** @internal
+ * @brief Create a frame pool for zero-copy streaming
+ *
+ * @param frame_bytes Size of data buffer of each frame
+ * @param max_free Maximum number of frames kept for reuse
+ * @param num_prealloc Number of frames allocated in advance
+ * @return New pool, or NULL on error
+ */
+uvc_frame_pool_t *uvc_frame_pool_create(size_t frame_bytes, int max_free, int num_prealloc) {
+	uvc_frame_pool_t *pool = calloc(1, sizeof(*pool));
+	uvc_frame_t *frame;
+	int i;
+
+	if (UNLIKELY(!pool))
+		return NULL;
+	pool->free_frames = calloc(max_free, sizeof(uvc_frame_t *));
+	if (UNLIKELY(!pool->free_frames)) {
+		free(pool);
+		return NULL;
+	}
+	UVC_ALLOC_TRACK(UVC_ALLOC_CALLER, sizeof(*pool) + max_free * sizeof(uvc_frame_t *));
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->frame_bytes = frame_bytes;
+	pool->max_free = max_free;
+	for (i = 0; (i < num_prealloc) && (i < max_free); i++) {
+		frame = uvc_allocate_frame(frame_bytes);
+		if (UNLIKELY(!frame))
+			break;
+		frame->pool = pool;
+		pool->free_frames[pool->num_free++] = frame;
+	}
+
+	return pool;
+}
+
+/** @internal
+ * @brief Take a frame from the pool, allocate new one if the pool is empty
+ *
+ * @return Frame that has at least frame_bytes of data buffer, or NULL on error
+ */
+uvc_frame_t *uvc_frame_pool_get(uvc_frame_pool_t *pool) {
+	uvc_frame_t *frame = NULL;
+	size_t frame_bytes;
+
+	pthread_mutex_lock(&pool->mutex);
+	{
+		if (LIKELY(pool->num_free > 0))
+			frame = pool->free_frames[--pool->num_free];
+		frame_bytes = pool->frame_bytes;
+		pool->num_outstanding++;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (UNLIKELY(!frame)) {
+		LOGW("allocate new frame");
+		frame = uvc_allocate_frame(frame_bytes);
+		if (LIKELY(frame))
+			frame->pool = pool;
+	} else if (UNLIKELY(frame->data_bytes < frame_bytes)) {
+		// pool was enlarged after this frame was allocated
+		if (UNLIKELY(uvc_ensure_frame_size(frame, frame_bytes))) {
+			frame->pool = NULL;
+			uvc_free_frame(frame);
+			frame = NULL;
+		}
+	}
+	if (LIKELY(frame)) {
+		frame->ref_count = 1;
+	} else {
+		pthread_mutex_lock(&pool->mutex);
+		pool->num_outstanding--;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return frame;
+}
+
+/** @internal
+ * @brief Change the size of data buffer of frames that will be taken from the pool
+ */
+void uvc_frame_pool_set_frame_bytes(uvc_frame_pool_t *pool, size_t frame_bytes) {
+	pthread_mutex_lock(&pool->mutex);
+	{
+		if (frame_bytes > pool->frame_bytes)
+			pool->frame_bytes = frame_bytes;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/** @internal
+ * @brief Detach the pool from its stream
+ * The pool is freed immediately when no frame is outstanding,
+ * otherwise when the last outstanding frame is released.
+ */
+void uvc_frame_pool_detach(uvc_frame_pool_t *pool) {
+	int destroy;
+
+	if (UNLIKELY(!pool))
+		return;
+	pthread_mutex_lock(&pool->mutex);
+	{
+		pool->detached = 1;
+		destroy = !pool->num_outstanding;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (destroy) {
+		_uvc_frame_pool_destroy(pool);
+	}
+}
+
 static inline unsigned char sat(int i) {
 	return (unsigned char) (i >= 255 ? 255 : (i < 0 ? 0 : i));
 }
@@ -135,6 +432,7 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
 		out->step = in->step;
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
+	out->complete_time = in->complete_time;
 	out->source = in->source;
 	out->actual_bytes = in->actual_bytes;	// XXX
 
@@ -202,709 +500,410 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
 #define PIXEL16_BGR			PIXEL_BGR * 16
 #define PIXEL16_RGBX		PIXEL_RGBX * 16
 
-#define RGB2RGBX_2(prgb, prgbx, ax, bx) { \
-		(prgbx)[bx+0] = (prgb)[ax+0]; \
-		(prgbx)[bx+1] = (prgb)[ax+1]; \
-		(prgbx)[bx+2] = (prgb)[ax+2]; \
-		(prgbx)[bx+3] = 0xff; \
-		(prgbx)[bx+4] = (prgb)[ax+3]; \
-		(prgbx)[bx+5] = (prgb)[ax+4]; \
-		(prgbx)[bx+6] = (prgb)[ax+5]; \
-		(prgbx)[bx+7] = 0xff; \
+/** @internal
+ * Convert the head of a row with the SIMD kernel and advance the pointers.
+ * The number of pixels is limited so that neither buffer is overrun.
+ * @return number of converted pixels, the rest is converted with the scalar code
+ */
+static inline int _uvc_convert_row(uvc_convert_row_t kernel, int pixels,
+	uint8_t **src, const uint8_t *src_end, const int src_pixel_bytes,
+	uint8_t **dst, const uint8_t *dst_end, const int dst_pixel_bytes) {
+
+	const int src_pixels = (src_end - *src) / src_pixel_bytes;
+	const int dst_pixels = (dst_end - *dst) / dst_pixel_bytes;
+	int n;
+
+	if (pixels > src_pixels)
+		pixels = src_pixels;
+	if (pixels > dst_pixels)
+		pixels = dst_pixels;
+	if (UNLIKELY(pixels <= 0))
+		return 0;
+	n = kernel(*src, *dst, pixels);
+	*src += n * src_pixel_bytes;
+	*dst += n * dst_pixel_bytes;
+	return n;
+}
+
+/** @internal
+ * YUV to RGB coefficients of each uvc_color_space, values are scaled by 2^14.
+ * Y is expanded by y_mul after subtracting y_offset, so the full range ones
+ * give exactly the same result as the SIMD kernels(R = Y + ((22987 * V) >> 14) etc.)
+ */
+typedef struct _uvc_yuv_coefs {
+	int y_offset, y_mul;
+	int rv, gu, gv, bu;
+} _uvc_yuv_coefs_t;
+
+static const _uvc_yuv_coefs_t yuv_coefs[UVC_COLOR_SPACE_COUNT] = {
+	{  0, 16384, 22987, -5636, -11698, 29049 },	// BT.601 full range
+	{ 16, 19077, 26149, -6419, -13320, 33050 },	// BT.601 limited range
+	{  0, 16384, 25802, -3069,  -7670, 30402 },	// BT.709 full range
+	{ 16, 19077, 29372, -3494,  -8731, 34610 },	// BT.709 limited range
+};
+
+// the generic row converters below are instantiated with constant arguments
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+static ALWAYS_INLINE int _uvc_packed_pixel_bytes(const enum uvc_frame_format format) {
+	switch (format) {
+	case UVC_FRAME_FORMAT_RGBX:
+		return PIXEL_RGBX;
+	case UVC_FRAME_FORMAT_RGB:
+	case UVC_FRAME_FORMAT_BGR:
+		return PIXEL_RGB;
+	default:	// UVC_FRAME_FORMAT_RGB565
+		return PIXEL_RGB565;
 	}
-#define RGB2RGBX_16(prgb, prgbx, ax, bx) \
-	RGB2RGBX_8(prgb, prgbx, ax, bx) \
-	RGB2RGBX_8(prgb, prgbx, ax + PIXEL8_RGB, bx +PIXEL8_RGBX);
-#define RGB2RGBX_8(prgb, prgbx, ax, bx) \
-	RGB2RGBX_4(prgb, prgbx, ax, bx) \
-	RGB2RGBX_4(prgb, prgbx, ax + PIXEL4_RGB, bx + PIXEL4_RGBX);
-#define RGB2RGBX_4(prgb, prgbx, ax, bx) \
-	RGB2RGBX_2(prgb, prgbx, ax, bx) \
-	RGB2RGBX_2(prgb, prgbx, ax + PIXEL2_RGB, bx + PIXEL2_RGBX);
+}
 
-/** @brief Convert a frame from RGB888 to RGBX8888
- * @ingroup frame
- * @param ini RGB888 frame
- * @param out RGBX8888 frame
+/** @internal
+ * Store one pixel, r/g/b are already saturated
  */
-uvc_error_t uvc_rgb2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_RGB))
-		return UVC_ERROR_INVALID_PARAM;
+static ALWAYS_INLINE void _uvc_put_rgb(uint8_t *dst, const enum uvc_frame_format format,
+	const uint8_t r, const uint8_t g, const uint8_t b) {
 
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGBX) < 0))
-		return UVC_ERROR_NO_MEM;
+	switch (format) {
+	case UVC_FRAME_FORMAT_RGBX:
+		dst[0] = r;
+		dst[1] = g;
+		dst[2] = b;
+		dst[3] = 0xff;
+		break;
+	case UVC_FRAME_FORMAT_RGB:
+		dst[0] = r;
+		dst[1] = g;
+		dst[2] = b;
+		break;
+	case UVC_FRAME_FORMAT_BGR:
+		dst[0] = b;
+		dst[1] = g;
+		dst[2] = r;
+		break;
+	default:	// UVC_FRAME_FORMAT_RGB565, little endian
+		dst[0] = ((g << 3) & 0b11100000) | (b >> 3);
+		dst[1] = (r & 0b11111000) | (g >> 5);
+		break;
+	}
+}
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGBX;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGBX;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+/** @internal
+ * Generic row converter from packed YUV422 to packed RGB,
+ * every argument except the buffers is a compile time constant of the instances
+ * so that the layouts and the coefficients are folded into the code.
+ * @return number of converted pixels(even)
+ */
+static ALWAYS_INLINE int _uvc_yuv422_rgb_row(const uint8_t *src, uint8_t *dst, const int pixels,
+	const int uyvy, const enum uvc_frame_format format, const enum uvc_color_space color_space) {
+
+	const _uvc_yuv_coefs_t *c = &yuv_coefs[color_space];
+	const int pixel_bytes = _uvc_packed_pixel_bytes(format);
+	// YUYV: y0 u y1 v, UYVY: u y0 v y1
+	const int iy0 = uyvy ? 1 : 0, iu = uyvy ? 0 : 1, iy1 = uyvy ? 3 : 2, iv = uyvy ? 2 : 3;
+	int i;
+
+	for (i = 0; i + 2 <= pixels; i += 2) {
+		const int u = src[iu] - 128;
+		const int v = src[iv] - 128;
+		const int r = c->rv * v;
+		const int g = c->gu * u + c->gv * v;
+		const int b = c->bu * u;
+		const int y0 = (src[iy0] - c->y_offset) * c->y_mul;
+		const int y1 = (src[iy1] - c->y_offset) * c->y_mul;
+		_uvc_put_rgb(dst, format, sat((y0 + r) >> 14), sat((y0 + g) >> 14), sat((y0 + b) >> 14));
+		_uvc_put_rgb(dst + pixel_bytes, format, sat((y1 + r) >> 14), sat((y1 + g) >> 14), sat((y1 + b) >> 14));
+		src += PIXEL2_YUYV;
+		dst += pixel_bytes * 2;
+	}
+	return i;
+}
 
-	uint8_t *prgb = in->data;
-	const uint8_t *prgb_end = prgb + in->data_bytes - PIXEL8_RGB;
-	uint8_t *prgbx = out->data;
-	const uint8_t *prgbx_end = prgbx + out->data_bytes - PIXEL8_RGBX;
+/** @internal
+ * Generic row converter from RGB888 to the other packed RGB
+ */
+static ALWAYS_INLINE int _uvc_rgb_row(const uint8_t *src, uint8_t *dst, const int pixels,
+	const enum uvc_frame_format format) {
 
-	// RGB888 to RGBX8888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			prgb = in->data + in->step * h;
-			prgbx = out->data + out->step * h;
-			for (; (prgbx <= prgbx_end) && (prgb <= prgb_end) && (w < ww) ;) {
-				RGB2RGBX_8(prgb, prgbx, 0, 0);
-
-				prgb += PIXEL8_RGB;
-				prgbx += PIXEL8_RGBX;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgbx <= prgbx_end) && (prgb <= prgb_end) ;) {
-			RGB2RGBX_8(prgb, prgbx, 0, 0);
+	const int pixel_bytes = _uvc_packed_pixel_bytes(format);
+	int i;
 
-			prgb += PIXEL8_RGB;
-			prgbx += PIXEL8_RGBX;
-		}
+	for (i = 0; i < pixels; i++) {
+		_uvc_put_rgb(dst, format, src[0], src[1], src[2]);
+		src += PIXEL_RGB;
+		dst += pixel_bytes;
 	}
-#else
-	for (; (prgbx <= prgbx_end) && (prgb <= prgb_end) ;) {
-		RGB2RGBX_8(prgb, prgbx, 0, 0);
+	return i;
+}
 
-		prgb += PIXEL8_RGB;
-		prgbx += PIXEL8_RGBX;
+#define YUV422_RGB_ROW(name, uyvy, format, color_space) \
+	static int name(const uint8_t *src, uint8_t *dst, int pixels) { \
+		return _uvc_yuv422_rgb_row(src, dst, pixels, uyvy, format, color_space); \
 	}
-#endif
-	return UVC_SUCCESS;
+#define YUV422_RGB_ROWS(src, uyvy, dst, format) \
+	YUV422_RGB_ROW(_uvc_##src##2##dst##_601f, uyvy, format, UVC_COLOR_SPACE_BT601_FULL) \
+	YUV422_RGB_ROW(_uvc_##src##2##dst##_601l, uyvy, format, UVC_COLOR_SPACE_BT601_LIMITED) \
+	YUV422_RGB_ROW(_uvc_##src##2##dst##_709f, uyvy, format, UVC_COLOR_SPACE_BT709_FULL) \
+	YUV422_RGB_ROW(_uvc_##src##2##dst##_709l, uyvy, format, UVC_COLOR_SPACE_BT709_LIMITED)
+#define YUV422_RGB_ROW_TABLE(src, dst) \
+	{ _uvc_##src##2##dst##_601f, _uvc_##src##2##dst##_601l, \
+	  _uvc_##src##2##dst##_709f, _uvc_##src##2##dst##_709l }
+
+YUV422_RGB_ROWS(yuyv, 0, rgbx, UVC_FRAME_FORMAT_RGBX)
+YUV422_RGB_ROWS(yuyv, 0, rgb, UVC_FRAME_FORMAT_RGB)
+YUV422_RGB_ROWS(yuyv, 0, bgr, UVC_FRAME_FORMAT_BGR)
+YUV422_RGB_ROWS(yuyv, 0, rgb565, UVC_FRAME_FORMAT_RGB565)
+YUV422_RGB_ROWS(uyvy, 1, rgbx, UVC_FRAME_FORMAT_RGBX)
+YUV422_RGB_ROWS(uyvy, 1, rgb, UVC_FRAME_FORMAT_RGB)
+YUV422_RGB_ROWS(uyvy, 1, bgr, UVC_FRAME_FORMAT_BGR)
+YUV422_RGB_ROWS(uyvy, 1, rgb565, UVC_FRAME_FORMAT_RGB565)
+
+/** scalar row converters, [uyvy][destination format index][color space] */
+static const uvc_convert_row_t yuv422_rgb_rows[2][4][UVC_COLOR_SPACE_COUNT] = {
+	{
+		YUV422_RGB_ROW_TABLE(yuyv, rgbx), YUV422_RGB_ROW_TABLE(yuyv, rgb),
+		YUV422_RGB_ROW_TABLE(yuyv, bgr), YUV422_RGB_ROW_TABLE(yuyv, rgb565),
+	},
+	{
+		YUV422_RGB_ROW_TABLE(uyvy, rgbx), YUV422_RGB_ROW_TABLE(uyvy, rgb),
+		YUV422_RGB_ROW_TABLE(uyvy, bgr), YUV422_RGB_ROW_TABLE(uyvy, rgb565),
+	},
+};
+
+static int _uvc_rgb2rgbx_row(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _uvc_rgb_row(src, dst, pixels, UVC_FRAME_FORMAT_RGBX);
 }
 
-// prgb565[0] = ((g << 3) & 0b11100000) | ((b >> 3) & 0b00011111);	// low byte
-// prgb565[1] = ((r & 0b11111000) | ((g >> 5) & 0b00000111)); 		// high byte
-#define RGB2RGB565_2(prgb, prgb565, ax, bx) { \
-		(prgb565)[bx+0] = (((prgb)[ax+1] << 3) & 0b11100000) | (((prgb)[ax+2] >> 3) & 0b00011111); \
-		(prgb565)[bx+1] = (((prgb)[ax+0] & 0b11111000) | (((prgb)[ax+1] >> 5) & 0b00000111)); \
-		(prgb565)[bx+2] = (((prgb)[ax+4] << 3) & 0b11100000) | (((prgb)[ax+5] >> 3) & 0b00011111); \
-		(prgb565)[bx+3] = (((prgb)[ax+3] & 0b11111000) | (((prgb)[ax+4] >> 5) & 0b00000111)); \
-    }
-#define RGB2RGB565_16(prgb, prgb565, ax, bx) \
-	RGB2RGB565_8(prgb, prgb565, ax, bx) \
-	RGB2RGB565_8(prgb, prgb565, ax + PIXEL8_RGB, bx + PIXEL8_RGB565);
-#define RGB2RGB565_8(prgb, prgb565, ax, bx) \
-	RGB2RGB565_4(prgb, prgb565, ax, bx) \
-	RGB2RGB565_4(prgb, prgb565, ax + PIXEL4_RGB, bx + PIXEL4_RGB565);
-#define RGB2RGB565_4(prgb, prgb565, ax, bx) \
-	RGB2RGB565_2(prgb, prgb565, ax, bx) \
-	RGB2RGB565_2(prgb, prgb565, ax + PIXEL2_RGB, bx + PIXEL2_RGB565);
+static int _uvc_rgb2rgb565_row(const uint8_t *src, uint8_t *dst, int pixels) {
+	return _uvc_rgb_row(src, dst, pixels, UVC_FRAME_FORMAT_RGB565);
+}
 
-/** @brief Convert a frame from RGB888 to RGB565
- * @ingroup frame
- * @param ini RGB888 frame
- * @param out RGB565 frame
+/** @internal
+ * index of yuv422_rgb_rows for the destination format, -1 if not packed RGB
  */
-uvc_error_t uvc_rgb2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_RGB))
-		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGB565) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB565;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGB565;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *prgb = in->data;
-	const uint8_t *prgb_end = prgb + in->data_bytes - PIXEL8_RGB;
-	uint8_t *prgb565 = out->data;
-	const uint8_t *prgb565_end = prgb565 + out->data_bytes - PIXEL8_RGB565;
+static inline int _uvc_rgb_format_index(const enum uvc_frame_format format) {
+	switch (format) {
+	case UVC_FRAME_FORMAT_RGBX:
+		return 0;
+	case UVC_FRAME_FORMAT_RGB:
+		return 1;
+	case UVC_FRAME_FORMAT_BGR:
+		return 2;
+	case UVC_FRAME_FORMAT_RGB565:
+		return 3;
+	default:
+		return -1;
+	}
+}
 
-	// RGB888 to RGB565
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			prgb = in->data + in->step * h;
-			prgb565 = out->data + out->step * h;
-			for (; (prgb565 <= prgb565_end) && (prgb <= prgb_end) && (w < ww) ;) {
-				RGB2RGB565_8(prgb, prgb565, 0, 0);
-
-				prgb += PIXEL8_RGB;
-				prgb565 += PIXEL8_RGB565;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgb565 <= prgb565_end) && (prgb <= prgb_end) ;) {
-			RGB2RGB565_8(prgb, prgb565, 0, 0);
+/** @internal
+ * SIMD kernel of the packed YUV422 to RGB conversion,
+ * the kernels only implement BT.601 full range
+ */
+static inline uvc_convert_row_t _uvc_yuv422_rgb_kernel(const int uyvy, const int index,
+	const enum uvc_color_space color_space) {
 
-			prgb += PIXEL8_RGB;
-			prgb565 += PIXEL8_RGB565;
-		}
-	}
-#else
-	for (; (prgb565 <= prgb565_end) && (prgb <= prgb_end) ;) {
-		RGB2RGB565_8(prgb, prgb565, 0, 0);
+	const uvc_convert_kernels_t *kernels;
 
-		prgb += PIXEL8_RGB;
-		prgb565 += PIXEL8_RGB565;
+	if (color_space != UVC_COLOR_SPACE_BT601_FULL)
+		return NULL;
+	kernels = uvc_get_convert_kernels();
+	switch (index) {
+	case 0:
+		return uyvy ? kernels->uyvy2rgbx : kernels->yuyv2rgbx;
+	case 1:
+		return uyvy ? kernels->uyvy2rgb : kernels->yuyv2rgb;
+	case 2:
+		return uyvy ? kernels->uyvy2bgr : kernels->yuyv2bgr;
+	default:
+		return uyvy ? kernels->uyvy2rgb565 : kernels->yuyv2rgb565;
 	}
-#endif
-	return UVC_SUCCESS;
 }
-/*
- #define YUYV2RGB_2(pyuv, prgb) { \
-    float r = 1.402f * ((pyuv)[3]-128); \
-    float g = -0.34414f * ((pyuv)[1]-128) - 0.71414f * ((pyuv)[3]-128); \
-    float b = 1.772f * ((pyuv)[1]-128); \
-    (prgb)[0] = sat(pyuv[0] + r); \
-    (prgb)[1] = sat(pyuv[0] + g); \
-    (prgb)[2] = sat(pyuv[0] + b); \
-    (prgb)[3] = sat(pyuv[2] + r); \
-    (prgb)[4] = sat(pyuv[2] + g); \
-    (prgb)[5] = sat(pyuv[2] + b); \
-    }
-*/
-
-#define IYUYV2RGB_2(pyuv, prgb, ax, bx) { \
-		const int d1 = (pyuv)[ax+1]; \
-		const int d3 = (pyuv)[ax+3]; \
-		const int r = (22987 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int g = (-5636 * (d1/*(pyuv)[ax+1]*/ - 128) - 11698 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int b = (29049 * (d1/*(pyuv)[ax+1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
-		(prgb)[bx+0] = sat(y0 + r); \
-		(prgb)[bx+1] = sat(y0 + g); \
-		(prgb)[bx+2] = sat(y0 + b); \
-		const int y2 = (pyuv)[ax+2]; \
-		(prgb)[bx+3] = sat(y2 + r); \
-		(prgb)[bx+4] = sat(y2 + g); \
-		(prgb)[bx+5] = sat(y2 + b); \
-    }
-#define IYUYV2RGB_16(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_8(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_8(pyuv, prgb, ax + PIXEL8_YUYV, bx + PIXEL8_RGB)
-#define IYUYV2RGB_8(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_4(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_4(pyuv, prgb, ax + PIXEL4_YUYV, bx + PIXEL4_RGB)
-#define IYUYV2RGB_4(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_2(pyuv, prgb, ax, bx) \
-	IYUYV2RGB_2(pyuv, prgb, ax + PIXEL2_YUYV, bx + PIXEL2_RGB)
 
-/** @brief Convert a frame from YUYV to RGB888
- * @ingroup frame
- *
- * @param in YUYV frame
- * @param out RGB888 frame
+/** @internal
+ * Convert a packed frame, the SIMD kernel(can be NULL) converts the head
+ * of each row and the scalar row converter converts the rest
  */
-uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
-		return UVC_ERROR_INVALID_PARAM;
+static uvc_error_t _uvc_convert_packed(uvc_frame_t *in, uvc_frame_t *out,
+	const enum uvc_frame_format format, const int src_pixel_bytes, const int dst_pixel_bytes,
+	uvc_convert_row_t kernel, uvc_convert_row_t scalar) {
 
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGB) < 0))
+	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * dst_pixel_bytes) < 0))
 		return UVC_ERROR_NO_MEM;
 
 	out->width = in->width;
 	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB;
+	out->frame_format = format;
 	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGB;
+		out->step = in->width * dst_pixel_bytes;
 	out->sequence = in->sequence;
 	out->capture_time = in->capture_time;
+	out->complete_time = in->complete_time;
 	out->source = in->source;
 
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
-	uint8_t *prgb = out->data;
-	const uint8_t *prgb_end = prgb + out->data_bytes - PIXEL8_RGB;
+	const uint8_t *src_end = (const uint8_t *)in->data + in->data_bytes;
+	const uint8_t *dst_end = (const uint8_t *)out->data + out->data_bytes;
+	uint8_t *src = in->data;
+	uint8_t *dst = out->data;
+	int w = 0;
 
 #if USE_STRIDE
 	if (in->step && out->step && (in->step != out->step)) {
 		const int hh = in->height < out->height ? in->height : out->height;
 		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
+		int h;
 		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgb = out->data + out->step * h;
-			for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IYUYV2RGB_8(pyuv, prgb, 0, 0);
-
-				prgb += PIXEL8_RGB;
-				pyuv += PIXEL8_YUYV;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
-			IYUYV2RGB_8(pyuv, prgb, 0, 0);
-
-			prgb += PIXEL8_RGB;
-			pyuv += PIXEL8_YUYV;
+			src = (uint8_t *)in->data + in->step * h;
+			dst = (uint8_t *)out->data + out->step * h;
+			w = kernel ? _uvc_convert_row(kernel, ww,
+				&src, src_end, src_pixel_bytes, &dst, dst_end, dst_pixel_bytes) : 0;
+			_uvc_convert_row(scalar, ww - w,
+				&src, src_end, src_pixel_bytes, &dst, dst_end, dst_pixel_bytes);
 		}
-	}
-#else
-	// YUYV => RGB888
-	for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
-		IYUYV2RGB_8(pyuv, prgb, 0, 0);
-
-		prgb += PIXEL8_RGB;
-		pyuv += PIXEL8_YUYV;
+		return UVC_SUCCESS;
 	}
 #endif
+	// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
+	if (kernel) {
+		w = _uvc_convert_row(kernel, INT_MAX,
+			&src, src_end, src_pixel_bytes, &dst, dst_end, dst_pixel_bytes);
+	}
+	_uvc_convert_row(scalar, INT_MAX - w,
+		&src, src_end, src_pixel_bytes, &dst, dst_end, dst_pixel_bytes);
 	return UVC_SUCCESS;
 }
 
-/** @brief Convert a frame from YUYV to RGB565
+/** @brief Color space of the uncompressed frames of the format
  * @ingroup frame
- * @param ini YUYV frame
- * @param out RGB565 frame
+ *
+ * BT.709 when the color matching descriptor of the format specifies it, otherwise BT.601.
+ * UVC does not tell the range, full range is returned to keep the same levels
+ * as uvc_yuyv2rgb etc. MJPEG is always BT.601 full range(JFIF) after decoding.
+ * @param format_desc format descriptor, can be NULL
  */
-uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
-		return UVC_ERROR_INVALID_PARAM;
+enum uvc_color_space uvc_get_color_space(const uvc_format_desc_t *format_desc) {
+	if (format_desc && (format_desc->bDescriptorSubtype != UVC_VS_FORMAT_MJPEG)
+		&& (format_desc->bMatrixCoefficients == 1)) {	// 1: BT.709
 
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGB565) < 0))
-		return UVC_ERROR_NO_MEM;
+		return UVC_COLOR_SPACE_BT709_FULL;
+	}
+	return UVC_COLOR_SPACE_BT601_FULL;
+}
 
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB565;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGB565;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
+/** @brief Convert a frame from packed YUV422 to packed RGB with the color space
+ * @ingroup frame
+ *
+ * @param in YUYV or UYVY frame
+ * @param out converted frame
+ * @param format UVC_FRAME_FORMAT_RGBX, RGB, BGR or RGB565
+ * @param color_space color matrix and range of in
+ */
+uvc_error_t uvc_yuv2rgb(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, enum uvc_color_space color_space) {
 
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
-	uint8_t *prgb565 = out->data;
-	const uint8_t *prgb565_end = prgb565 + out->data_bytes - PIXEL8_RGB565;
+	const int uyvy = in->frame_format == UVC_FRAME_FORMAT_UYVY;
+	const int index = _uvc_rgb_format_index(format);
 
-	uint8_t tmp[PIXEL8_RGB];	// for temporary rgb888 data(8pixel)
+	if (UNLIKELY((!uyvy && (in->frame_format != UVC_FRAME_FORMAT_YUYV))
+		|| (index < 0) || ((unsigned)color_space >= UVC_COLOR_SPACE_COUNT))) {
 
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgb565 = out->data + out->step * h;
-			for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IYUYV2RGB_8(pyuv, tmp, 0, 0);
-				RGB2RGB565_8(tmp, prgb565, 0, 0);
-
-				prgb565 += PIXEL8_YUYV;
-				pyuv += PIXEL8_RGB565;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
-			IYUYV2RGB_8(pyuv, tmp, 0, 0);
-			RGB2RGB565_8(tmp, prgb565, 0, 0);
-
-			prgb565 += PIXEL8_YUYV;
-			pyuv += PIXEL8_RGB565;
-		}
-	}
-#else
-	// YUYV => RGB565
-	for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
-		IYUYV2RGB_8(pyuv, tmp, 0, 0);
-		RGB2RGB565_8(tmp, prgb565, 0, 0);
-
-		prgb565 += PIXEL8_YUYV;
-		pyuv += PIXEL8_RGB565;
+		return UVC_ERROR_INVALID_PARAM;
 	}
-#endif
-	return UVC_SUCCESS;
+	return _uvc_convert_packed(in, out, format, PIXEL_YUYV, _uvc_packed_pixel_bytes(format),
+		_uvc_yuv422_rgb_kernel(uyvy, index, color_space),
+		yuv422_rgb_rows[uyvy][index][color_space]);
 }
 
-#define IYUYV2RGBX_2(pyuv, prgbx, ax, bx) { \
-		const int d1 = (pyuv)[ax+1]; \
-		const int d3 = (pyuv)[ax+3]; \
-		const int r = (22987 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int g = (-5636 * (d1/*(pyuv)[ax+1]*/ - 128) - 11698 * (d3/*(pyuv)[ax+3]*/ - 128)) >> 14; \
-		const int b = (29049 * (d1/*(pyuv)[ax+1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
-		(prgbx)[bx+0] = sat(y0 + r); \
-		(prgbx)[bx+1] = sat(y0 + g); \
-		(prgbx)[bx+2] = sat(y0 + b); \
-		(prgbx)[bx+3] = 0xff; \
-		const int y2 = (pyuv)[ax+2]; \
-		(prgbx)[bx+4] = sat(y2 + r); \
-		(prgbx)[bx+5] = sat(y2 + g); \
-		(prgbx)[bx+6] = sat(y2 + b); \
-		(prgbx)[bx+7] = 0xff; \
-    }
-#define IYUYV2RGBX_16(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_8(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_8(pyuv, prgbx, ax + PIXEL8_YUYV, bx + PIXEL8_RGBX);
-#define IYUYV2RGBX_8(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_4(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_4(pyuv, prgbx, ax + PIXEL4_YUYV, bx + PIXEL4_RGBX);
-#define IYUYV2RGBX_4(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_2(pyuv, prgbx, ax, bx) \
-	IYUYV2RGBX_2(pyuv, prgbx, ax + PIXEL2_YUYV, bx + PIXEL2_RGBX);
-
-/** @brief Convert a frame from YUYV to RGBX8888
+/** @brief Convert a frame from RGB888 to RGBX8888
  * @ingroup frame
- * @param ini YUYV frame
+ * @param ini RGB888 frame
  * @param out RGBX8888 frame
  */
-uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
+uvc_error_t uvc_rgb2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_RGB))
 		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGBX) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGBX;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGBX;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
-	uint8_t *prgbx = out->data;
-	const uint8_t *prgbx_end = prgbx + out->data_bytes - PIXEL8_RGBX;
-
-	// YUYV => RGBX8888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgbx = out->data + out->step * h;
-			for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
-
-				prgbx += PIXEL8_RGBX;
-				pyuv += PIXEL8_YUYV;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
-			IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
-
-			prgbx += PIXEL8_RGBX;
-			pyuv += PIXEL8_YUYV;
-		}
-	}
-#else
-	for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
-		IYUYV2RGBX_8(pyuv, prgbx, 0, 0);
-
-		prgbx += PIXEL8_RGBX;
-		pyuv += PIXEL8_YUYV;
-	}
-#endif
-	return UVC_SUCCESS;
+	return _uvc_convert_packed(in, out, UVC_FRAME_FORMAT_RGBX, PIXEL_RGB, PIXEL_RGBX,
+		uvc_get_convert_kernels()->rgb2rgbx, _uvc_rgb2rgbx_row);
 }
 
-#define IYUYV2BGR_2(pyuv, pbgr, ax, bx) { \
-		const int d1 = (pyuv)[1]; \
-		const int d3 = (pyuv)[3]; \
-	    const int r = (22987 * (d3/*(pyuv)[3]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d1/*(pyuv)[1]*/ - 128) - 11698 * (d3/*(pyuv)[3]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d1/*(pyuv)[1]*/ - 128)) >> 14; \
-		const int y0 = (pyuv)[ax+0]; \
-		(pbgr)[bx+0] = sat(y0 + b); \
-		(pbgr)[bx+1] = sat(y0 + g); \
-		(pbgr)[bx+2] = sat(y0 + r); \
-		const int y2 = (pyuv)[ax+2]; \
-		(pbgr)[bx+3] = sat(y2 + b); \
-		(pbgr)[bx+4] = sat(y2 + g); \
-		(pbgr)[bx+5] = sat(y2 + r); \
-    }
-#define IYUYV2BGR_16(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_8(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_8(pyuv, pbgr, ax + PIXEL8_YUYV, bx + PIXEL8_BGR)
-#define IYUYV2BGR_8(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_4(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_4(pyuv, pbgr, ax + PIXEL4_YUYV, bx + PIXEL4_BGR)
-#define IYUYV2BGR_4(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_2(pyuv, pbgr, ax, bx) \
-	IYUYV2BGR_2(pyuv, pbgr, ax + PIXEL2_YUYV, bx + PIXEL2_BGR)
+/** @brief Convert a frame from RGB888 to RGB565
+ * @ingroup frame
+ * @param ini RGB888 frame
+ * @param out RGB565 frame
+ */
+uvc_error_t uvc_rgb2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_RGB))
+		return UVC_ERROR_INVALID_PARAM;
+	return _uvc_convert_packed(in, out, UVC_FRAME_FORMAT_RGB565, PIXEL_RGB, PIXEL_RGB565,
+		uvc_get_convert_kernels()->rgb2rgb565, _uvc_rgb2rgb565_row);
+}
 
-/** @brief Convert a frame from YUYV to BGR888
+/** @brief Convert a frame from YUYV to RGB888
  * @ingroup frame
  *
  * @param in YUYV frame
- * @param out BGR888 frame
+ * @param out RGB888 frame
  */
-uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
 		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_BGR) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_BGR;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_BGR;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_YUYV;
-	uint8_t *pbgr = out->data;
-	uint8_t *pbgr_end = pbgr + out->data_bytes - PIXEL8_BGR;
-
-	// YUYV => BGR888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			pbgr = out->data + out->step * h;
-			for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IYUYV2BGR_8(pyuv, pbgr, 0, 0);
-
-				pbgr += PIXEL8_BGR;
-				pyuv += PIXEL8_YUYV;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
-			IYUYV2BGR_8(pyuv, pbgr, 0, 0);
-
-			pbgr += PIXEL8_BGR;
-			pyuv += PIXEL8_YUYV;
-		}
-	}
-#else
-	for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
-		IYUYV2BGR_8(pyuv, pbgr, 0, 0);
-
-		pbgr += PIXEL8_BGR;
-		pyuv += PIXEL8_YUYV;
-	}
-#endif
-	return UVC_SUCCESS;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGB, UVC_COLOR_SPACE_BT601_FULL);
 }
 
-#define IUYVY2RGB_2(pyuv, prgb, ax, bx) { \
-		const int d0 = (pyuv)[ax+0]; \
-		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
-		(prgb)[bx+0] = sat(y1 + r); \
-		(prgb)[bx+1] = sat(y1 + g); \
-		(prgb)[bx+2] = sat(y1 + b); \
-		const int y3 = (pyuv)[ax+3]; \
-		(prgb)[bx+3] = sat(y3 + r); \
-		(prgb)[bx+4] = sat(y3 + g); \
-		(prgb)[bx+5] = sat(y3 + b); \
-    }
-#define IUYVY2RGB_16(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_8(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_8(pyuv, prgb, ax + 16, bx + 24)
-#define IUYVY2RGB_8(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_4(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_4(pyuv, prgb, ax + 8, bx + 12)
-#define IUYVY2RGB_4(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_2(pyuv, prgb, ax, bx) \
-	IUYVY2RGB_2(pyuv, prgb, ax + 4, bx + 6)
-
-/** @brief Convert a frame from UYVY to RGB888
+/** @brief Convert a frame from YUYV to RGB565
  * @ingroup frame
- * @param ini UYVY frame
- * @param out RGB888 frame
+ * @param ini YUYV frame
+ * @param out RGB565 frame
  */
-uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+uvc_error_t uvc_yuyv2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
 		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGB) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGB;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
-	uint8_t *prgb = out->data;
-	const uint8_t *prgb_end = prgb + out->data_bytes - PIXEL8_RGB;
-
-	// UYVY => RGB888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgb = out->data + out->step * h;
-			for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IUYVY2RGB_8(pyuv, prgb, 0, 0);
-
-				prgb += PIXEL8_RGB;
-				pyuv += PIXEL8_UYVY;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
-			IUYVY2RGB_8(pyuv, prgb, 0, 0);
-
-			prgb += PIXEL8_RGB;
-			pyuv += PIXEL8_UYVY;
-		}
-	}
-#else
-	for (; ((prgb <= prgb_end) && (pyuv <= pyuv_end) ;) {
-		IUYVY2RGB_8(pyuv, prgb, 0, 0);
-
-		prgb += PIXEL8_RGB;
-		pyuv += PIXEL8_UYVY;
-	}
-#endif
-	return UVC_SUCCESS;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGB565, UVC_COLOR_SPACE_BT601_FULL);
 }
 
-/** @brief Convert a frame from UYVY to RGB565
+/** @brief Convert a frame from YUYV to RGBX8888
  * @ingroup frame
- * @param ini UYVY frame
- * @param out RGB565 frame
+ * @param ini YUYV frame
+ * @param out RGBX8888 frame
  */
-uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+uvc_error_t uvc_yuyv2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
 		return UVC_ERROR_INVALID_PARAM;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGBX, UVC_COLOR_SPACE_BT601_FULL);
+}
 
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGB565) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGB565;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGB565;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
-	uint8_t *prgb565 = out->data;
-	const uint8_t *prgb565_end = prgb565 + out->data_bytes - PIXEL8_RGB565;
-
-	uint8_t tmp[PIXEL8_RGB];		// for temporary rgb888 data(8pixel)
-
-	// UYVY => RGB565
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgb565 = out->data + out->step * h;
-			for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IUYVY2RGB_8(pyuv, tmp, 0, 0);
-				RGB2RGB565_8(tmp, prgb565, 0, 0);
-
-				prgb565 += PIXEL8_RGB565;
-				pyuv += PIXEL8_UYVY;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
-			IUYVY2RGB_8(pyuv, tmp, 0, 0);
-			RGB2RGB565_8(tmp, prgb565, 0, 0);
-
-			prgb565 += PIXEL8_RGB565;
-			pyuv += PIXEL8_UYVY;
-		}
-	}
-#else
-	for (; (prgb565 <= prgb565_end) && (pyuv <= pyuv_end) ;) {
-		IUYVY2RGB_8(pyuv, tmp, 0, 0);
-		RGB2RGB565_8(tmp, prgb565, 0, 0);
+/** @brief Convert a frame from YUYV to BGR888
+ * @ingroup frame
+ *
+ * @param in YUYV frame
+ * @param out BGR888 frame
+ */
+uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
+		return UVC_ERROR_INVALID_PARAM;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_BGR, UVC_COLOR_SPACE_BT601_FULL);
+}
 
-		prgb565 += PIXEL8_RGB565;
-		pyuv += PIXEL8_UYVY;
-	}
-#endif
-	return UVC_SUCCESS;
+/** @brief Convert a frame from UYVY to RGB888
+ * @ingroup frame
+ * @param ini UYVY frame
+ * @param out RGB888 frame
+ */
+uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+		return UVC_ERROR_INVALID_PARAM;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGB, UVC_COLOR_SPACE_BT601_FULL);
 }
 
-#define IUYVY2RGBX_2(pyuv, prgbx, ax, bx) { \
-		const int d0 = (pyuv)[ax+0]; \
-		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
-		(prgbx)[bx+0] = sat(y1 + r); \
-		(prgbx)[bx+1] = sat(y1 + g); \
-		(prgbx)[bx+2] = sat(y1 + b); \
-		(prgbx)[bx+3] = 0xff; \
-		const int y3 = (pyuv)[ax+3]; \
-		(prgbx)[bx+4] = sat(y3 + r); \
-		(prgbx)[bx+5] = sat(y3 + g); \
-		(prgbx)[bx+6] = sat(y3 + b); \
-		(prgbx)[bx+7] = 0xff; \
-    }
-#define IUYVY2RGBX_16(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_8(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_8(pyuv, prgbx, ax + PIXEL8_UYVY, bx + PIXEL8_RGBX)
-#define IUYVY2RGBX_8(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_4(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_4(pyuv, prgbx, ax + PIXEL4_UYVY, bx + PIXEL4_RGBX)
-#define IUYVY2RGBX_4(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_2(pyuv, prgbx, ax, bx) \
-	IUYVY2RGBX_2(pyuv, prgbx, ax + PIXEL2_UYVY, bx + PIXEL2_RGBX)
+/** @brief Convert a frame from UYVY to RGB565
+ * @ingroup frame
+ * @param ini UYVY frame
+ * @param out RGB565 frame
+ */
+uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+		return UVC_ERROR_INVALID_PARAM;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGB565, UVC_COLOR_SPACE_BT601_FULL);
+}
 
 /** @brief Convert a frame from UYVY to RGBX8888
  * @ingroup frame
@@ -914,87 +913,9 @@ uvc_error_t uvc_uyvy2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
 uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
 		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_RGBX) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_RGBX;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_RGBX;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
-	uint8_t *prgbx = out->data;
-	const uint8_t *prgbx_end = prgbx + out->data_bytes - PIXEL8_RGBX;
-
-	// UYVY => RGBX8888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			prgbx = out->data + out->step * h;
-			for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
-
-				prgbx += PIXEL8_RGBX;
-				pyuv += PIXEL8_UYVY;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
-			IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
-
-			prgbx += PIXEL8_RGBX;
-			pyuv += PIXEL8_UYVY;
-		}
-	}
-#else
-	for (; (prgbx <= prgbx_end) && (pyuv <= pyuv_end) ;) {
-		IUYVY2RGBX_8(pyuv, prgbx, 0, 0);
-
-		prgbx += PIXEL8_RGBX;
-		pyuv += PIXEL8_UYVY;
-	}
-#endif
-	return UVC_SUCCESS;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_RGBX, UVC_COLOR_SPACE_BT601_FULL);
 }
 
-#define IUYVY2BGR_2(pyuv, pbgr, ax, bx) { \
-		const int d0 = (pyuv)[ax+0]; \
-		const int d2 = (pyuv)[ax+2]; \
-	    const int r = (22987 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int g = (-5636 * (d0/*(pyuv)[ax+0]*/ - 128) - 11698 * (d2/*(pyuv)[ax+2]*/ - 128)) >> 14; \
-	    const int b = (29049 * (d0/*(pyuv)[ax+0]*/ - 128)) >> 14; \
-		const int y1 = (pyuv)[ax+1]; \
-		(pbgr)[bx+0] = sat(y1 + b); \
-		(pbgr)[bx+1] = sat(y1 + g); \
-		(pbgr)[bx+2] = sat(y1 + r); \
-		const int y3 = (pyuv)[ax+3]; \
-		(pbgr)[bx+3] = sat(y3 + b); \
-		(pbgr)[bx+4] = sat(y3 + g); \
-		(pbgr)[bx+5] = sat(y3 + r); \
-    }
-#define IUYVY2BGR_16(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_8(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_8(pyuv, pbgr, ax + PIXEL8_UYVY, bx + PIXEL8_BGR)
-#define IUYVY2BGR_8(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_4(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_4(pyuv, pbgr, ax + PIXEL4_UYVY, bx + PIXEL4_BGR)
-#define IUYVY2BGR_4(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_2(pyuv, pbgr, ax, bx) \
-	IUYVY2BGR_2(pyuv, pbgr, ax + PIXEL2_UYVY, bx + PIXEL2_BGR)
-
 /** @brief Convert a frame from UYVY to BGR888
  * @ingroup frame
  * @param ini UYVY frame
@@ -1003,60 +924,7 @@ uvc_error_t uvc_uyvy2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
 uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
 		return UVC_ERROR_INVALID_PARAM;
-
-	if (UNLIKELY(uvc_ensure_frame_size(out, in->width * in->height * PIXEL_BGR) < 0))
-		return UVC_ERROR_NO_MEM;
-
-	out->width = in->width;
-	out->height = in->height;
-	out->frame_format = UVC_FRAME_FORMAT_BGR;
-	if (out->library_owns_data)
-		out->step = in->width * PIXEL_BGR;
-	out->sequence = in->sequence;
-	out->capture_time = in->capture_time;
-	out->source = in->source;
-
-	uint8_t *pyuv = in->data;
-	const uint8_t *pyuv_end = pyuv + in->data_bytes - PIXEL8_UYVY;
-	uint8_t *pbgr = out->data;
-	const uint8_t *pbgr_end = pbgr + out->data_bytes - PIXEL8_BGR;
-
-	// UYVY => BGR888
-#if USE_STRIDE
-	if (in->step && out->step && (in->step != out->step)) {
-		const int hh = in->height < out->height ? in->height : out->height;
-		const int ww = in->width < out->width ? in->width : out->width;
-		int h, w;
-		for (h = 0; h < hh; h++) {
-			w = 0;
-			pyuv = in->data + in->step * h;
-			pbgr = out->data + out->step * h;
-			for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) && (w < ww) ;) {
-				IUYVY2BGR_8(pyuv, pbgr, 0, 0);
-
-				pbgr += PIXEL8_BGR;
-				pyuv += PIXEL8_UYVY;
-				w += 8;
-			}
-		}
-	} else {
-		// compressed format? XXX if only one of the frame in / out has step, this may lead to crash...
-		for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
-			IUYVY2BGR_8(pyuv, pbgr, 0, 0);
-
-			pbgr += PIXEL8_BGR;
-			pyuv += PIXEL8_UYVY;
-		}
-	}
-#else
-	for (; (pbgr <= pbgr_end) && (pyuv <= pyuv_end) ;) {
-		IUYVY2BGR_8(pyuv, pbgr, 0, 0);
-
-		pbgr += PIXEL8_BGR;
-		pyuv += PIXEL8_UYVY;
-	}
-#endif
-	return UVC_SUCCESS;
+	return uvc_yuv2rgb(in, out, UVC_FRAME_FORMAT_BGR, UVC_COLOR_SPACE_BT601_FULL);
 }
 
 int uvc_yuyv2yuv420P(uvc_frame_t *in, uvc_frame_t *out) {
@@ -1164,6 +1032,7 @@ uvc_error_t uvc_yuyv2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 	const int32_t dest_width = out->width = out->step = in->width;
 	const int32_t dest_height = out->height = in->height;
 
+	const uvc_split_row_t split = uvc_get_convert_kernels()->yuyv2nv12;
 	const uint32_t hh = src_height < dest_height ? src_height : dest_height;
 	uint8_t *uv = dest + dest_width * dest_height;
 	int h, w;
@@ -1171,7 +1040,14 @@ uvc_error_t uvc_yuyv2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 		uint8_t *y0 = dest + width * h;
 		uint8_t *y1 = y0 + width;
 		const uint8_t *yuv = src + src_width * h;
-		for (w = 0; w < width; w += 4) {
+		// chroma is taken from the even row only
+		w = split(yuv, y0, uv, width);
+		if (w) {
+			split(yuv + src_width, y1, NULL, w);
+			y0 += w; y1 += w; uv += w;
+			yuv += w * 2;
+		}
+		for (; w < width; w += 4) {
 			*(y0++) = yuv[0];	// y
 			*(y0++) = yuv[2];	// y'
 			*(y0++) = yuv[4];	// y''
@@ -1209,6 +1085,7 @@ uvc_error_t uvc_yuyv2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 	const int32_t dest_width = out->width = out->step = in->width;
 	const int32_t dest_height = out->height = in->height;
 
+	const uvc_split_row_t split = uvc_get_convert_kernels()->yuyv2nv21;
 	const uint32_t hh = src_height < dest_height ? src_height : dest_height;
 	uint8_t *uv = dest + dest_width * dest_height;
 	int h, w;
@@ -1216,7 +1093,14 @@ uvc_error_t uvc_yuyv2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 		uint8_t *y0 = dest + width * h;
 		uint8_t *y1 = y0 + width;
 		const uint8_t *yuv = src + src_width * h;
-		for (w = 0; w < width; w += 4) {
+		// chroma is taken from the even row only
+		w = split(yuv, y0, uv, width);
+		if (w) {
+			split(yuv + src_width, y1, NULL, w);
+			y0 += w; y1 += w; uv += w;
+			yuv += w * 2;
+		}
+		for (; w < width; w += 4) {
 			*(y0++) = yuv[0];	// y
 			*(y0++) = yuv[2];	// y'
 			*(y0++) = yuv[4];	// y''
@@ -1236,6 +1120,71 @@ uvc_error_t uvc_yuyv2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
 	RETURN(UVC_SUCCESS, uvc_error_t);
 }
 
+/** @internal
+ * Extract the luma of packed YUV422 row by row,
+ * @p y_offset is 0 for YUYV and 1 for UYVY
+ */
+static uvc_error_t _uvc_yuv422_to_gray8(uvc_frame_t *in, uvc_frame_t *out,
+	uvc_convert_row_t kernel, const int y_offset) {
+
+	const uint32_t width = in->width;
+	const uint32_t height = in->height;
+	size_t step = width;
+	uint32_t h;
+	int w;
+
+	if (!out->library_owns_data && (out->step > step))
+		step = out->step;	// keep the stride of the buffer supplied by the caller
+	if (UNLIKELY(!height))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(uvc_ensure_frame_size(out, step * (height - 1) + width) < 0))
+		return UVC_ERROR_NO_MEM;
+
+	out->width = width;
+	out->height = height;
+	out->frame_format = UVC_FRAME_FORMAT_GRAY8;
+	out->step = step;
+	out->actual_bytes = step * (height - 1) + width;
+	out->sequence = in->sequence;
+	out->capture_time = in->capture_time;
+	out->complete_time = in->complete_time;
+	out->source = in->source;
+
+	const size_t src_step = in->step ? in->step : width * PIXEL_YUYV;
+	for (h = 0; h < height; h++) {
+		const uint8_t *yuv = (const uint8_t *)in->data + src_step * h;
+		uint8_t *gray = (uint8_t *)out->data + step * h;
+		w = kernel(yuv, gray, width);
+		for (; w < width; w++)
+			gray[w] = yuv[w * PIXEL_YUYV + y_offset];
+	}
+	return UVC_SUCCESS;
+}
+
+/** @brief Convert a frame from YUYV to GRAY8(luma only)
+ * @ingroup frame
+ *
+ * @param in YUYV frame
+ * @param out GRAY8 frame, the step of out is kept when the caller owns the buffer
+ */
+uvc_error_t uvc_yuyv2gray8(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_YUYV))
+		return UVC_ERROR_INVALID_PARAM;
+	return _uvc_yuv422_to_gray8(in, out, uvc_get_convert_kernels()->yuyv2gray, 0);
+}
+
+/** @brief Convert a frame from UYVY to GRAY8(luma only)
+ * @ingroup frame
+ *
+ * @param in UYVY frame
+ * @param out GRAY8 frame, the step of out is kept when the caller owns the buffer
+ */
+uvc_error_t uvc_uyvy2gray8(uvc_frame_t *in, uvc_frame_t *out) {
+	if (UNLIKELY(in->frame_format != UVC_FRAME_FORMAT_UYVY))
+		return UVC_ERROR_INVALID_PARAM;
+	return _uvc_yuv422_to_gray8(in, out, uvc_get_convert_kernels()->uyvy2gray, 1);
+}
+
 /** @brief Convert a frame to RGB565
  * @ingroup frame
  *
@@ -1243,23 +1192,7 @@ uvc_error_t uvc_yuyv2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out RGB565 frame
  */
 uvc_error_t uvc_any2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
-
-	switch (in->frame_format) {
-#ifdef LIBUVC_HAS_JPEG
-	case UVC_FRAME_FORMAT_MJPEG:
-		return uvc_mjpeg2rgb565(in, out);
-#endif
-	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgb565(in, out);
-	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgb565(in, out);
-	case UVC_FRAME_FORMAT_RGB565:
-		return uvc_duplicate_frame(in, out);
-	case UVC_FRAME_FORMAT_RGB:
-		return uvc_rgb2rgb565(in, out);
-	default:
-		return UVC_ERROR_NOT_SUPPORTED;
-	}
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_RGB565);
 }
 
 /** @brief Convert a frame to RGB888
@@ -1269,21 +1202,7 @@ uvc_error_t uvc_any2rgb565(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out RGB888 frame
  */
 uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out) {
-
-	switch (in->frame_format) {
-#ifdef LIBUVC_HAS_JPEG
-	case UVC_FRAME_FORMAT_MJPEG:
-		return uvc_mjpeg2rgb(in, out);
-#endif
-	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgb(in, out);
-	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgb(in, out);
-	case UVC_FRAME_FORMAT_RGB:
-		return uvc_duplicate_frame(in, out);
-	default:
-		return UVC_ERROR_NOT_SUPPORTED;
-	}
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_RGB);
 }
 
 /** @brief Convert a frame to BGR888
@@ -1293,21 +1212,7 @@ uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out BGR888 frame
  */
 uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out) {
-
-	switch (in->frame_format) {
-#ifdef LIBUVC_HAS_JPEG
-	case UVC_FRAME_FORMAT_MJPEG:
-		return uvc_mjpeg2bgr(in, out);
-#endif
-	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2bgr(in, out);
-	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2bgr(in, out);
-	case UVC_FRAME_FORMAT_BGR:
-		return uvc_duplicate_frame(in, out);
-	default:
-		return UVC_ERROR_NOT_SUPPORTED;
-	}
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_BGR);
 }
 
 /** @brief Convert a frame to RGBX8888
@@ -1317,23 +1222,7 @@ uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out rgbx frame
  */
 uvc_error_t uvc_any2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
-
-	switch (in->frame_format) {
-#ifdef LIBUVC_HAS_JPEG
-	case UVC_FRAME_FORMAT_MJPEG:
-		return uvc_mjpeg2rgbx(in, out);
-#endif
-	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_yuyv2rgbx(in, out);
-	case UVC_FRAME_FORMAT_UYVY:
-		return uvc_uyvy2rgbx(in, out);
-	case UVC_FRAME_FORMAT_RGBX:
-		return uvc_duplicate_frame(in, out);
-	case UVC_FRAME_FORMAT_RGB:
-		return uvc_rgb2rgbx(in, out);
-	default:
-		return UVC_ERROR_NOT_SUPPORTED;
-	}
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_RGBX);
 }
 
 /** @brief Convert a frame to yuyv
@@ -1343,17 +1232,7 @@ uvc_error_t uvc_any2rgbx(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out yuyv frame
  */
 uvc_error_t uvc_any2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
-
-	switch (in->frame_format) {
-#ifdef LIBUVC_HAS_JPEG
-	case UVC_FRAME_FORMAT_MJPEG:
-		return uvc_mjpeg2yuyv(in, out);
-#endif
-	case UVC_FRAME_FORMAT_YUYV:
-		return uvc_duplicate_frame(in, out);
-	default:
-		return UVC_ERROR_NOT_SUPPORTED;
-	}
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_YUYV);
 }
 
 /** @brief Convert a frame to yuv420sp
@@ -1363,16 +1242,7 @@ uvc_error_t uvc_any2yuyv(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out yuv420sp frame
  */
 uvc_error_t uvc_any2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
-	uvc_error_t result = UVC_ERROR_NO_MEM;
-	uvc_frame_t *yuv = uvc_allocate_frame((in->width * in->height * 3) / 2);
-	if (yuv) {
-		result = uvc_any2yuyv(in, yuv);
-		if (LIKELY(!result)) {
-			result = uvc_yuyv2yuv420SP(yuv, out);
-		}
-		uvc_free_frame(yuv);
-	}
-	return result;
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_NV12);
 }
 
 /** @brief Convert a frame to iyuv420sp(NV21)
@@ -1382,14 +1252,390 @@ uvc_error_t uvc_any2yuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
  * @param out iyuv420SP(NV21) frame
  */
 uvc_error_t uvc_any2iyuv420SP(uvc_frame_t *in, uvc_frame_t *out) {
-	uvc_error_t result = UVC_ERROR_NO_MEM;
-	uvc_frame_t *yuv = uvc_allocate_frame((in->width * in->height * 3) / 2);
-	if (yuv) {
-		result = uvc_any2yuyv(in, yuv);
-		if (LIKELY(!result)) {
-			result = uvc_yuyv2iyuv420SP(yuv, out);
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_NV21);
+}
+
+/** @brief Convert a frame to GRAY8(luma only)
+ * @ingroup frame
+ *
+ * MJPEG frames are decoded without the chroma components, see uvc_mjpeg2gray8.
+ * @param in non-GRAY8 frame
+ * @param out GRAY8 frame
+ */
+uvc_error_t uvc_any2gray8(uvc_frame_t *in, uvc_frame_t *out) {
+	return uvc_any2format(in, out, UVC_FRAME_FORMAT_GRAY8);
+}
+
+/** @internal
+ * Clamp the crop rectangle into the frame and fill the default values of the scale,
+ * zero crop size means whole frame and zero output size means same as the crop size
+ * @param scale requested scale, can be NULL
+ * @param result normalized scale
+ */
+uvc_error_t uvc_normalize_scale(const uvc_scale_t *scale,
+	const uint32_t width, const uint32_t height, uvc_scale_t *result) {
+
+	if (scale) {
+		*result = *scale;
+	} else {
+		memset(result, 0, sizeof(uvc_scale_t));
+	}
+	if (UNLIKELY((result->crop_x >= width) || (result->crop_y >= height)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (!result->crop_width || (result->crop_width > width - result->crop_x))
+		result->crop_width = width - result->crop_x;
+	if (!result->crop_height || (result->crop_height > height - result->crop_y))
+		result->crop_height = height - result->crop_y;
+	if (!result->width)
+		result->width = result->crop_width;
+	if (!result->height)
+		result->height = result->crop_height;
+	result->width &= ~1;	// YUYV pairs
+	if (UNLIKELY(!result->width || !result->height))
+		return UVC_ERROR_INVALID_PARAM;
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * Box filter the crop rectangle of YUYV frame into YUYV rows of the output size,
+ * each output pixel is the average of the source pixels it covers
+ * (the nearest source pixel when upscaling).
+ * The crop rectangle of the output size is converted as is and the scaling by 1/2 and 1/4
+ * uses the averaging kernels, the other sizes sum the rows column by column
+ * and then the columns of each output pixel and divide with the reciprocals.
+ */
+typedef struct _uvc_box_scaler {
+	const uint8_t *src;
+	size_t src_step;
+	uvc_scale_t scale;
+	/** 1: crop only, 2 or 4: scaling by 1/factor with yuyv_half, 0: any size */
+	int factor;
+	/** first source pixel of the sums, crop_x rounded down to the pair */
+	uint32_t base;
+	/** [xs0[x], xs1[x]) is the source range of output pixel x(relative to base) */
+	uint32_t *xs0, *xs1;
+	/** 2^24 / the number of the columns of Y for each pixel and of U/V for each pair */
+	uint32_t *recip_y, *recip_uv;
+	/** sums of the rows for each byte of YUYV from base */
+	uint32_t *col_sum;
+	size_t span_bytes;
+	/** scaled YUYV row, rows scaled by 1/2 for the scaling by 1/4 */
+	uint8_t *row, *half0, *half1;
+} _uvc_box_scaler_t;
+
+#define AVG_UP(a, b) (((a) + (b) + 1) >> 1)
+
+/** @internal
+ * scale the rows by 1/2 into @p pixels output pixels, the rest of yuyv_half in the scalar code
+ */
+static void _uvc_yuyv_half_row(const uvc_convert_kernels_t *kernels,
+	const uint8_t *src0, const uint8_t *src1, uint8_t *dst, const int pixels) {
+
+	int i;
+
+	for (i = kernels->yuyv_half(src0, src1, dst, pixels); i < pixels; i += 2) {
+		const uint8_t *a = src0 + i * 2 * PIXEL_YUYV;
+		const uint8_t *b = src1 + i * 2 * PIXEL_YUYV;
+		uint8_t *yuyv = dst + i * PIXEL_YUYV;
+		yuyv[0] = AVG_UP(AVG_UP(a[0], b[0]), AVG_UP(a[2], b[2]));
+		yuyv[1] = AVG_UP(AVG_UP(a[1], b[1]), AVG_UP(a[5], b[5]));
+		yuyv[2] = AVG_UP(AVG_UP(a[4], b[4]), AVG_UP(a[6], b[6]));
+		yuyv[3] = AVG_UP(AVG_UP(a[3], b[3]), AVG_UP(a[7], b[7]));
+	}
+}
+
+/** @internal
+ * sum of the columns x (reciprocal x 2^24) x (reciprocal of the rows x 2^24), rounded
+ */
+#define BOX_AVERAGE(sum, recip, recip_rows) \
+	(uint8_t)(((uint64_t)(sum) * (recip) * (recip_rows) + (1ULL << 47)) >> 48)
+
+/** @internal
+ * @return YUYV row @p oy of the output size, the source row itself when not scaled
+ */
+static const uint8_t *_uvc_box_scale_row(_uvc_box_scaler_t *scaler,
+	const uvc_convert_kernels_t *kernels, const uint32_t oy) {
+
+	const uvc_scale_t *s = &scaler->scale;
+	const uint32_t ow = s->width;
+	const size_t step = scaler->src_step;
+	const uint8_t *line = scaler->src + step * s->crop_y + s->crop_x * PIXEL_YUYV;
+	uint32_t x, ox, sy;
+	size_t i;
+
+	switch (scaler->factor) {
+	case 1:
+		return line + step * oy;
+	case 2:
+		line += step * oy * 2;
+		_uvc_yuyv_half_row(kernels, line, line + step, scaler->row, ow);
+		return scaler->row;
+	case 4:
+		line += step * oy * 4;
+		_uvc_yuyv_half_row(kernels, line, line + step, scaler->half0, ow * 2);
+		_uvc_yuyv_half_row(kernels, line + step * 2, line + step * 3, scaler->half1, ow * 2);
+		_uvc_yuyv_half_row(kernels, scaler->half0, scaler->half1, scaler->row, ow);
+		return scaler->row;
+	}
+
+	const uint32_t ys0 = (uint64_t)oy * s->crop_height / s->height;
+	uint32_t ys1 = (uint64_t)(oy + 1) * s->crop_height / s->height;
+	if (ys1 <= ys0)
+		ys1 = ys0 + 1;
+	uint32_t *sum = scaler->col_sum;
+	const size_t span_bytes = scaler->span_bytes;
+	line = scaler->src + step * (s->crop_y + ys0) + scaler->base * PIXEL_YUYV;
+	for (i = 0; i < span_bytes; i++)
+		sum[i] = line[i];
+	for (sy = ys0 + 1; sy < ys1; sy++) {
+		line += step;
+		for (i = 0; i < span_bytes; i++)
+			sum[i] += line[i];
+	}
+	const uint64_t recip_rows = (1 << 24) / (ys1 - ys0);
+	uint8_t *yuyv = scaler->row;
+	for (ox = 0; ox < ow; ox += 2) {
+		uint32_t y0 = 0, y1 = 0, u = 0, v = 0;
+		for (x = scaler->xs0[ox]; x < scaler->xs1[ox]; x++) {
+			const uint32_t *pair = sum + (x & ~1) * PIXEL_YUYV;
+			y0 += sum[x * PIXEL_YUYV];
+			u += pair[1];
+			v += pair[3];
+		}
+		for (x = scaler->xs0[ox + 1]; x < scaler->xs1[ox + 1]; x++) {
+			const uint32_t *pair = sum + (x & ~1) * PIXEL_YUYV;
+			y1 += sum[x * PIXEL_YUYV];
+			u += pair[1];
+			v += pair[3];
+		}
+		*(yuyv++) = BOX_AVERAGE(y0, scaler->recip_y[ox], recip_rows);
+		*(yuyv++) = BOX_AVERAGE(u, scaler->recip_uv[ox >> 1], recip_rows);
+		*(yuyv++) = BOX_AVERAGE(y1, scaler->recip_y[ox + 1], recip_rows);
+		*(yuyv++) = BOX_AVERAGE(v, scaler->recip_uv[ox >> 1], recip_rows);
+	}
+	return scaler->row;
+}
+
+/** @internal
+ * Choose the way of the scaling and set up the work buffers
+ */
+static uvc_error_t _uvc_box_scaler_init(_uvc_box_scaler_t *scaler, uvc_frame_t *in) {
+	const uvc_scale_t *s = &scaler->scale;
+	const uint32_t ow = s->width;
+	uint32_t ox;
+	uint8_t *work;
+
+	scaler->src = in->data;
+	scaler->src_step = in->step ? in->step : in->width * PIXEL_YUYV;
+	scaler->factor = 0;
+	if (!(s->crop_x & 1)) {
+		// the pairs of the source are kept
+		if ((s->crop_width == ow) && (s->crop_height == s->height))
+			scaler->factor = 1;
+		else if ((s->crop_width == ow * 2) && (s->crop_height == s->height * 2))
+			scaler->factor = 2;
+		else if ((s->crop_width == ow * 4) && (s->crop_height == s->height * 4))
+			scaler->factor = 4;
+	}
+	switch (scaler->factor) {
+	case 1:
+		return UVC_SUCCESS;
+	case 2:
+		scaler->row = uvc_thread_scratch(ow * PIXEL_YUYV);
+		return LIKELY(scaler->row) ? UVC_SUCCESS : UVC_ERROR_NO_MEM;
+	case 4:
+		// the scaled row and two rows of twice the width
+		scaler->row = uvc_thread_scratch(ow * PIXEL_YUYV * 5);
+		if (UNLIKELY(!scaler->row))
+			return UVC_ERROR_NO_MEM;
+		scaler->half0 = scaler->row + ow * PIXEL_YUYV;
+		scaler->half1 = scaler->half0 + ow * 2 * PIXEL_YUYV;
+		return UVC_SUCCESS;
+	}
+
+	scaler->base = s->crop_x & ~1;
+	scaler->span_bytes = (((s->crop_x + s->crop_width + 1) & ~1) - scaler->base) * PIXEL_YUYV;
+	if (scaler->base * PIXEL_YUYV + scaler->span_bytes > scaler->src_step)
+		scaler->span_bytes = scaler->src_step - scaler->base * PIXEL_YUYV;	// odd width
+	// xs0, xs1, recip_y, recip_uv(ow / 2), col_sum and the scaled row
+	work = uvc_thread_scratch(sizeof(uint32_t) * (ow * 3 + (ow >> 1) + scaler->span_bytes)
+		+ ow * PIXEL_YUYV);
+	if (UNLIKELY(!work))
+		return UVC_ERROR_NO_MEM;
+	scaler->xs0 = (uint32_t *)work;
+	scaler->xs1 = scaler->xs0 + ow;
+	scaler->recip_y = scaler->xs1 + ow;
+	scaler->recip_uv = scaler->recip_y + ow;
+	scaler->col_sum = scaler->recip_uv + (ow >> 1);
+	scaler->row = (uint8_t *)(scaler->col_sum + scaler->span_bytes);
+	const uint32_t offset = s->crop_x - scaler->base;
+	for (ox = 0; ox < ow; ox++) {
+		scaler->xs0[ox] = offset + (uint64_t)ox * s->crop_width / ow;
+		scaler->xs1[ox] = offset + (uint64_t)(ox + 1) * s->crop_width / ow;
+		if (scaler->xs1[ox] <= scaler->xs0[ox])
+			scaler->xs1[ox] = scaler->xs0[ox] + 1;
+		scaler->recip_y[ox] = (1 << 24) / (scaler->xs1[ox] - scaler->xs0[ox]);
+	}
+	for (ox = 0; ox < ow; ox += 2) {
+		scaler->recip_uv[ox >> 1] = (1 << 24)
+			/ (scaler->xs1[ox] - scaler->xs0[ox] + scaler->xs1[ox + 1] - scaler->xs0[ox + 1]);
+	}
+	return UVC_SUCCESS;
+}
+
+/** @brief Crop, scale and convert a YUYV frame
+ * @ingroup frame
+ *
+ * The crop rectangle is box filtered into the output size row by row,
+ * and the color conversion runs on the scaled rows only, so the cost depends
+ * on the output size instead of the frame size (except reading the crop rectangle).
+ * Cropping without scaling and the scaling by 1/2 and 1/4 (with crop_x even)
+ * are the fast paths with the SIMD kernels.
+ * @param in YUYV frame
+ * @param out converted frame, the step of out is kept when the caller owns the buffer
+ * @param format UVC_FRAME_FORMAT_YUYV, RGBX, RGB, BGR, RGB565, NV12, NV21 or GRAY8
+ * @param scale crop rectangle and output size(the width should be even), NULL for no scaling
+ */
+uvc_error_t uvc_yuyv2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale) {
+
+	return uvc_yuyv2scaled_color(in, out, format, scale, UVC_COLOR_SPACE_BT601_FULL);
+}
+
+/** @internal
+ * @brief uvc_yuyv2scaled with the color space of the conversion to RGB
+ */
+uvc_error_t uvc_yuyv2scaled_color(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale,
+	enum uvc_color_space color_space) {
+
+	_uvc_box_scaler_t scaler;
+	int pixel_bytes;
+	uvc_error_t result;
+	uint32_t oy;
+
+	if (UNLIKELY((in->frame_format != UVC_FRAME_FORMAT_YUYV)
+		|| ((unsigned)color_space >= UVC_COLOR_SPACE_COUNT))) {
+
+		return UVC_ERROR_INVALID_PARAM;
+	}
+	switch (format) {
+	case UVC_FRAME_FORMAT_RGB565:
+	case UVC_FRAME_FORMAT_YUYV:
+		pixel_bytes = 2;
+		break;
+	case UVC_FRAME_FORMAT_RGB:
+	case UVC_FRAME_FORMAT_BGR:
+		pixel_bytes = 3;
+		break;
+	case UVC_FRAME_FORMAT_RGBX:
+		pixel_bytes = 4;
+		break;
+	case UVC_FRAME_FORMAT_NV12:
+	case UVC_FRAME_FORMAT_NV21:
+	case UVC_FRAME_FORMAT_GRAY8:
+		pixel_bytes = 1;	// for luma plane
+		break;
+	default:
+		return UVC_ERROR_NOT_SUPPORTED;
+	}
+	result = uvc_normalize_scale(scale, in->width, in->height, &scaler.scale);
+	if (UNLIKELY(result))
+		return result;
+
+	const uint32_t ow = scaler.scale.width;
+	const uint32_t oh = scaler.scale.height;
+	const int planar = (format == UVC_FRAME_FORMAT_NV12) || (format == UVC_FRAME_FORMAT_NV21);
+	size_t step = ow * pixel_bytes;
+	if (!planar && !out->library_owns_data && (out->step > step))
+		step = out->step;	// keep the stride of the buffer supplied by the caller
+	const size_t out_bytes = planar ? ow * oh + ow * ((oh + 1) >> 1) : step * (oh - 1) + ow * pixel_bytes;
+	if (UNLIKELY(uvc_ensure_frame_size(out, out_bytes) < 0))
+		return UVC_ERROR_NO_MEM;
+
+	result = _uvc_box_scaler_init(&scaler, in);
+	if (UNLIKELY(result))
+		return result;
+
+	out->width = ow;
+	out->height = oh;
+	out->frame_format = format;
+	out->step = planar ? ow : step;
+	out->actual_bytes = out_bytes;
+	out->sequence = in->sequence;
+	out->capture_time = in->capture_time;
+	out->complete_time = in->complete_time;
+	out->source = in->source;
+
+	const uvc_convert_kernels_t *kernels = uvc_get_convert_kernels();
+	const int rgb_index = _uvc_rgb_format_index(format);
+	const uvc_convert_row_t rgb_kernel = rgb_index >= 0
+		? _uvc_yuv422_rgb_kernel(0, rgb_index, color_space) : NULL;
+	const uvc_convert_row_t rgb_row = rgb_index >= 0
+		? yuv422_rgb_rows[0][rgb_index][color_space] : NULL;
+	uint8_t *uv_plane = (uint8_t *)out->data + ow * oh;
+	int i, n;
+	for (oy = 0; oy < oh; oy++) {
+		uint8_t *dst = (uint8_t *)out->data + step * oy;
+		const uint8_t *yuv = _uvc_box_scale_row(&scaler, kernels, oy);
+		switch (format) {
+		case UVC_FRAME_FORMAT_YUYV:
+			memcpy(dst, yuv, ow * PIXEL_YUYV);
+			break;
+		case UVC_FRAME_FORMAT_RGBX:
+		case UVC_FRAME_FORMAT_RGB:
+		case UVC_FRAME_FORMAT_BGR:
+		case UVC_FRAME_FORMAT_RGB565:
+			n = rgb_kernel ? rgb_kernel(yuv, dst, ow) : 0;
+			rgb_row(yuv + n * PIXEL_YUYV, dst + n * pixel_bytes, ow - n);
+			break;
+		case UVC_FRAME_FORMAT_GRAY8:
+			n = kernels->yuyv2gray(yuv, dst, ow);
+			for (i = n; i < ow; i++)
+				dst[i] = yuv[i * PIXEL_YUYV];
+			break;
+		default:	// NV12/NV21
+		{
+			// chroma is taken from the even row only
+			uint8_t *uv = oy & 1 ? NULL : uv_plane + ow * (oy >> 1);
+			const int vu = format == UVC_FRAME_FORMAT_NV21;
+			n = (vu ? kernels->yuyv2nv21 : kernels->yuyv2nv12)(yuv, dst, uv, ow);
+			for (i = n; i < ow; i += 2) {
+				dst[i] = yuv[i * PIXEL_YUYV];
+				dst[i + 1] = yuv[i * PIXEL_YUYV + 2];
+				if (uv) {
+					uv[i] = yuv[i * PIXEL_YUYV + (vu ? 3 : 1)];
+					uv[i + 1] = yuv[i * PIXEL_YUYV + (vu ? 1 : 3)];
+				}
+			}
+			break;
 		}
-		uvc_free_frame(yuv);
+		}
+	}
+	return UVC_SUCCESS;
+}
+
+/** @brief Crop, scale and convert a frame
+ * @ingroup frame
+ *
+ * MJPEG frames are decoded with the DCT scaling and only the rows/columns
+ * of the crop rectangle are decoded, see uvc_mjpeg_decode_scaled.
+ * @param in MJPEG or YUYV frame
+ * @param out converted frame
+ * @param format same as uvc_yuyv2scaled
+ * @param scale crop rectangle and output size, NULL for no scaling
+ */
+uvc_error_t uvc_any2scaled(uvc_frame_t *in, uvc_frame_t *out,
+	enum uvc_frame_format format, const uvc_scale_t *scale) {
+
+	switch (in->frame_format) {
+#ifdef LIBUVC_HAS_JPEG
+	case UVC_FRAME_FORMAT_MJPEG:
+		return uvc_mjpeg2scaled(in, out, format, scale);
+#endif
+	case UVC_FRAME_FORMAT_YUYV:
+		return uvc_yuyv2scaled(in, out, format, scale);
+	default:
+		return UVC_ERROR_NOT_SUPPORTED;
 	}
-	return result;
 }
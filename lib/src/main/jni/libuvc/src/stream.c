@@ -58,6 +58,7 @@
 #endif
 
 #include <assert.h>		// XXX add assert for debugging
+#include <errno.h>
 
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
@@ -67,6 +68,7 @@ uvc_frame_desc_t *uvc_find_frame_desc_stream(uvc_stream_handle_t *strmh,
 uvc_frame_desc_t *uvc_find_frame_desc(uvc_device_handle_t *devh,
 		uint16_t format_id, uint16_t frame_id);
 static void *_uvc_user_caller(void *arg);
+static void *_uvc_user_caller_zero_copy(void *arg);
 static void _uvc_populate_frame(uvc_stream_handle_t *strmh);
 
 struct format_table_entry {
@@ -596,11 +598,121 @@ uvc_error_t uvc_probe_stream_ctrl(uvc_device_handle_t *devh,
 	return UVC_SUCCESS;
 }
 
+/** @internal
+ * @brief Convert nanoseconds of CLOCK_MONOTONIC to struct timeval
+ */
+static inline void _uvc_ns_to_timeval(const int64_t ns, struct timeval *tv) {
+	tv->tv_sec = ns / 1000000000LL;
+	tv->tv_usec = (ns % 1000000000LL) / 1000;
+}
+
+/** @internal
+ * @brief Take the oldest frame from the completed frame ring
+ * must be called with stream cb lock held!
+ */
+static inline uvc_frame_t *_uvc_dequeue_frame(uvc_stream_handle_t *strmh) {
+	uvc_frame_t *frame = NULL;
+
+	if (LIKELY(strmh->hold_count > 0)) {
+		frame = strmh->hold_frames[strmh->hold_head];
+		strmh->hold_frames[strmh->hold_head] = NULL;
+		strmh->hold_head = (strmh->hold_head + 1) % strmh->hold_slots;
+		strmh->hold_count--;
+	}
+	return frame;
+}
+
+/** @internal
+ * @brief Publish the assembled frame and continue with a new frame from the pool (zero-copy mode)
+ * broken frames are never handed to consumers, the working frame is reused instead.
+ * When the ring is full, a frame is discarded according to drop_policy.
+ */
+static void _uvc_swap_frames(uvc_stream_handle_t *strmh) {
+	uvc_frame_t *frame = strmh->cur_frame;
+	uvc_frame_t *next, *dropped = NULL;
+
+	if (UNLIKELY(strmh->bfh_err || !frame)) {
+		UVC_STATS_INC(strmh, frames_broken);
+		goto reset;
+	}
+	UVC_STATS_INC(strmh, frames_completed);
+
+	next = uvc_frame_pool_get(strmh->frame_pool);
+	if (UNLIKELY(!next)) {
+		LOGW("failed to get frame from pool, frame dropped");
+		UVC_STATS_INC(strmh, frames_dropped);
+		goto reset;
+	}
+
+	frame->frame_format = strmh->frame_format;
+	frame->width = strmh->frame_width;
+	frame->height = strmh->frame_height;
+	frame->step = strmh->frame_step;
+	frame->actual_bytes = strmh->got_bytes;
+	frame->sequence = strmh->seq;
+	_uvc_ns_to_timeval(uvc_clock_frame_time(&strmh->clock, strmh->pts), &frame->capture_time);
+	_uvc_ns_to_timeval(strmh->clock.xfer_host_ns, &frame->complete_time);
+	frame->source = strmh->devh;
+
+	pthread_mutex_lock(&strmh->cb_mutex);
+	{
+		if (UNLIKELY(strmh->hold_count >= strmh->hold_slots)) {
+			// consumer did not keep up with the camera
+			UVC_STATS_INC(strmh, frames_dropped);
+			if (strmh->drop_policy == UVC_FRAME_DROP_NEWEST) {
+				dropped = frame;
+			} else {
+				dropped = _uvc_dequeue_frame(strmh);
+			}
+		}
+		if (LIKELY(dropped != frame)) {
+			strmh->hold_frames[(strmh->hold_head + strmh->hold_count) % strmh->hold_slots] = frame;
+			strmh->hold_count++;
+			strmh->hold_bfh_err = 0;
+			strmh->hold_bytes = strmh->got_bytes;
+			strmh->hold_last_scr = strmh->last_scr;
+			strmh->hold_pts = strmh->pts;
+			strmh->hold_seq = strmh->seq;
+
+			pthread_cond_broadcast(&strmh->cb_cond);
+		}
+	}
+	pthread_mutex_unlock(&strmh->cb_mutex);
+
+	if (dropped)
+		uvc_release_frame(dropped);
+
+	strmh->cur_frame = next;
+	strmh->outbuf = next->data;
+	strmh->size_buf = next->data_bytes;
+reset:
+	strmh->seq++;
+	strmh->got_bytes = 0;
+	strmh->last_scr = 0;
+	strmh->pts = 0;
+	strmh->bfh_err = 0;
+}
+
 /** @internal
  * @brief Swap the working buffer with the presented buffer and notify consumers
  */
 static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 	uint8_t *tmp_buf;
+	struct timeval capture_time, complete_time;
+
+	if (strmh->zero_copy) {
+		_uvc_swap_frames(strmh);
+		return;
+	}
+	if (UNLIKELY(strmh->bfh_err)) {
+		UVC_STATS_INC(strmh, frames_broken);
+		capture_time.tv_sec = capture_time.tv_usec = 0;
+		complete_time = capture_time;
+	} else {
+		UVC_STATS_INC(strmh, frames_completed);
+		_uvc_ns_to_timeval(uvc_clock_frame_time(&strmh->clock, strmh->pts), &capture_time);
+		_uvc_ns_to_timeval(strmh->clock.xfer_host_ns, &complete_time);
+	}
 
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
@@ -613,6 +725,8 @@ static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 		strmh->hold_last_scr = strmh->last_scr;
 		strmh->hold_pts = strmh->pts;
 		strmh->hold_seq = strmh->seq;
+		strmh->hold_capture_time = capture_time;
+		strmh->hold_complete_time = complete_time;
 
 		pthread_cond_broadcast(&strmh->cb_cond);
 	}
@@ -625,30 +739,39 @@ static void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
 	strmh->bfh_err = 0;	// XXX
 }
 
+/** @internal
+ * @brief Free the transfer and mark it as deleted
+ * must be called with stream cb lock held!
+ */
+static void _uvc_free_transfer_locked(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer) {
+	int i;
+
+	for (i = 0; i < LIBUVC_MAX_TRANSFER_BUFS; i++) {
+		if (strmh->transfers[i] == transfer) {
+			libusb_cancel_transfer(strmh->transfers[i]);	// XXX 20141112追加
+			UVC_DEBUG("Freeing transfer %d (%p)", i, transfer);
+			free(transfer->buffer);
+			libusb_free_transfer(transfer);
+			strmh->transfers[i] = NULL;
+			break;
+		}
+	}
+	if (UNLIKELY(i == LIBUVC_MAX_TRANSFER_BUFS)) {
+		UVC_DEBUG("transfer %p not found; not freeing!", transfer);
+	}
+}
+
 static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 	ENTER();
 
 //	MARK("");
 	uvc_stream_handle_t *strmh = transfer->user_data;
 	if (UNLIKELY(!strmh)) EXIT();		// XXX
-	int i;
 
 	pthread_mutex_lock(&strmh->cb_mutex);	// XXX crash while calling uvc_stop_streaming
 	{
 		// Mark transfer as deleted.
-		for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
-			if (strmh->transfers[i] == transfer) {
-				libusb_cancel_transfer(strmh->transfers[i]);	// XXX 20141112追加
-				UVC_DEBUG("Freeing transfer %d (%p)", i, transfer);
-				free(transfer->buffer);
-				libusb_free_transfer(transfer);
-				strmh->transfers[i] = NULL;
-				break;
-			}
-		}
-		if (UNLIKELY(i == LIBUVC_NUM_TRANSFER_BUFS)) {
-			UVC_DEBUG("transfer %p not found; not freeing!", transfer);
-		}
+		_uvc_free_transfer_locked(strmh, transfer);
 
 		pthread_cond_broadcast(&strmh->cb_cond);
 	}
@@ -656,6 +779,238 @@ static void _uvc_delete_transfer(struct libusb_transfer *transfer) {
 	EXIT();
 }
 
+/** @internal
+ * @brief Measure completion gaps and packet loss and adjust the transfer depth (auto tuning)
+ * Completions of isochronous transfers normally arrive at a constant interval.
+ * When the libusb event thread is late by about as many transfers as are queued,
+ * the host controller runs out of transfers and packets are lost.
+ * The depth is increased on loss or on small slack, and decreased slowly
+ * while the slack stays large to keep the latency low.
+ * Only called from the libusb event thread.
+ */
+static void _uvc_tune_transfers(uvc_stream_handle_t *strmh, const int isochronous) {
+	const int64_t now = strmh->clock.xfer_host_ns;
+	int64_t queued_ns;
+	uint32_t errors;
+	int depth;
+
+	if (LIKELY(strmh->tune_count)) {
+		if (now - strmh->tune_last_ns > strmh->tune_max_gap_ns)
+			strmh->tune_max_gap_ns = now - strmh->tune_last_ns;
+	} else {
+		strmh->tune_start_ns = now;
+		strmh->tune_max_gap_ns = 0;
+	}
+	strmh->tune_last_ns = now;
+	if (++strmh->tune_count < LIBUVC_XFER_TUNE_WINDOW)
+		return;
+
+	depth = strmh->xfer_depth;
+	errors = UVC_STATS_ADD(strmh, packets_error, 0) + UVC_STATS_ADD(strmh, transfers_failed, 0);
+	// time that the transfers except the one in processing can cover
+	queued_ns = isochronous
+		? (now - strmh->tune_start_ns) / (strmh->tune_count - 1) * (depth - 1) : 0;
+	if ((errors != strmh->tune_errors)
+		|| (isochronous && (strmh->tune_max_gap_ns >= queued_ns))) {
+		strmh->tune_clean_windows = 0;
+		if (depth < strmh->num_transfer_bufs)
+			depth++;
+	} else if (!isochronous || (strmh->tune_max_gap_ns * 2 < queued_ns)) {
+		if ((++strmh->tune_clean_windows >= LIBUVC_XFER_TUNE_SHRINK_WINDOWS)
+			&& (depth > LIBUVC_MIN_TRANSFER_BUFS)) {
+			strmh->tune_clean_windows = 0;
+			depth--;
+		}
+	} else {
+		strmh->tune_clean_windows = 0;
+	}
+	if (depth != strmh->xfer_depth) {
+		MARK("transfer depth %d -> %d", strmh->xfer_depth, depth);
+		strmh->xfer_depth = depth;
+	}
+	strmh->tune_errors = errors;
+	strmh->tune_count = 0;
+}
+
+/** @internal
+ * @brief Keep xfer_depth transfers in flight (auto tuning)
+ * parks the completed transfer when too many transfers are in flight,
+ * otherwise resubmits parked transfers until the depth is reached.
+ * @return 1 if the transfer was parked or deleted and must not be resubmitted
+ */
+static int _uvc_balance_transfers(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer) {
+	struct libusb_transfer *parked;
+	int handled = 0;
+
+	// xfer_in_flight does not include this transfer here
+	if (LIKELY((strmh->xfer_in_flight + 1 != strmh->xfer_depth)
+		&& (strmh->xfer_in_flight >= strmh->xfer_depth || strmh->num_parked))) {
+
+		pthread_mutex_lock(&strmh->cb_mutex);
+		{
+			if (UNLIKELY(!strmh->running)) {
+				// uvc_stream_stop already freed parked transfers
+				_uvc_free_transfer_locked(strmh, transfer);
+				pthread_cond_broadcast(&strmh->cb_cond);
+				handled = 1;
+			} else if (strmh->xfer_in_flight >= strmh->xfer_depth) {
+				strmh->parked_transfers[strmh->num_parked++] = transfer;
+				handled = 1;
+			} else {
+				for (; strmh->num_parked && (strmh->xfer_in_flight + 1 < strmh->xfer_depth) ;) {
+					parked = strmh->parked_transfers[--strmh->num_parked];
+					if (LIKELY(!libusb_submit_transfer(parked))) {
+						__sync_fetch_and_add(&strmh->xfer_in_flight, 1);
+					} else {
+						UVC_STATS_INC(strmh, resubmit_failed);
+						_uvc_free_transfer_locked(strmh, parked);
+						pthread_cond_broadcast(&strmh->cb_cond);
+					}
+				}
+			}
+		}
+		pthread_mutex_unlock(&strmh->cb_mutex);
+	}
+	return handled;
+}
+
+/** @internal
+ * @brief Enlarge the working frame when the camera sends more than dwMaxVideoFrameSize (zero-copy mode)
+ * @return 0 on success
+ */
+static int _uvc_grow_frame(uvc_stream_handle_t *strmh, size_t need_bytes) {
+	uvc_frame_t *frame = strmh->cur_frame;
+	size_t bytes;
+	void *data;
+
+	if (UNLIKELY(!frame || (need_bytes > LIBUVC_XFER_BUF_SIZE)))
+		return -1;
+	bytes = need_bytes + (need_bytes >> 2);
+	if (bytes > LIBUVC_XFER_BUF_SIZE)
+		bytes = LIBUVC_XFER_BUF_SIZE;
+	data = realloc(frame->data, bytes);
+	if (UNLIKELY(!data))
+		return -1;
+	UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, bytes);
+	frame->data = data;
+	frame->data_bytes = bytes;
+	strmh->outbuf = data;
+	strmh->size_buf = bytes;
+	// following frames from the pool will have same size
+	uvc_frame_pool_set_frame_bytes(strmh->frame_pool, bytes);
+	return 0;
+}
+
+/** @internal
+ * @brief Append payload data to the working buffer with boundary check
+ */
+static inline void _uvc_append_payload(uvc_stream_handle_t *strmh, const uint8_t *data, const size_t data_len) {
+	if (UNLIKELY(strmh->got_bytes + data_len > strmh->size_buf)) {
+		if (!strmh->zero_copy || _uvc_grow_frame(strmh, strmh->got_bytes + data_len)) {
+			if (!(strmh->bfh_err & UVC_STREAM_ERR))
+				UVC_STATS_INC(strmh, oversize_frames);	// count once per frame
+			strmh->bfh_err |= UVC_STREAM_ERR;
+			return;
+		}
+	}
+	memcpy(strmh->outbuf + strmh->got_bytes, data, data_len);
+	strmh->got_bytes += data_len;
+}
+
+/** @internal
+ * @brief Queue error recovery, called from the transfer completion callback
+ * this never blocks on USB, requests are coalesced until the worker executes them
+ * @param request UVC_RECOVERY_XXX bits
+ */
+static inline void _uvc_request_recovery(uvc_stream_handle_t *strmh, uint8_t request) {
+	pthread_mutex_lock(&strmh->recovery_mutex);
+	{
+		if ((strmh->recovery_request & request) != request) {
+			strmh->recovery_request |= request;
+			pthread_cond_signal(&strmh->recovery_cond);
+		}
+	}
+	pthread_mutex_unlock(&strmh->recovery_mutex);
+}
+
+/** @internal
+ * @brief Error recovery worker thread
+ * executes queued recovery at most once per LIBUVC_ERROR_RECOVERY_INTERVAL_MS
+ * so a burst of error packets results in one recovery
+ * @param arg stream handle
+ */
+static void *_uvc_recovery_thread_func(void *arg) {
+	uvc_stream_handle_t *strmh = (uvc_stream_handle_t *) arg;
+	uvc_vs_error_code_control_t vs_error_code;
+	struct timespec ts;
+	uint8_t request;
+
+	pthread_mutex_lock(&strmh->recovery_mutex);
+	for (; strmh->recovery_running ;) {
+		if (!strmh->recovery_request) {
+			pthread_cond_wait(&strmh->recovery_cond, &strmh->recovery_mutex);
+			continue;
+		}
+		request = strmh->recovery_request;
+		strmh->recovery_request = 0;
+		pthread_mutex_unlock(&strmh->recovery_mutex);
+
+		UVC_STATS_INC(strmh, recoveries);
+		if (request & UVC_RECOVERY_CLEAR_HALT) {
+			libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
+		}
+		if (request & UVC_RECOVERY_ERROR_CODE) {
+			if (!uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR)) {
+				MARK("vs error code=%d", vs_error_code);
+			}
+		}
+
+		pthread_mutex_lock(&strmh->recovery_mutex);
+		// rate limit, requests during this interval are executed together afterwards
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LIBUVC_ERROR_RECOVERY_INTERVAL_MS * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+		}
+		for (; strmh->recovery_running ;) {
+			if (pthread_cond_timedwait(&strmh->recovery_cond, &strmh->recovery_mutex, &ts) == ETIMEDOUT)
+				break;
+		}
+	}
+	pthread_mutex_unlock(&strmh->recovery_mutex);
+
+	return NULL; // return value ignored
+}
+
+/** @internal
+ * @brief Start the error recovery worker
+ */
+static uvc_error_t _uvc_start_recovery(uvc_stream_handle_t *strmh) {
+	strmh->recovery_request = 0;
+	strmh->recovery_running = 1;
+	if (UNLIKELY(pthread_create(&strmh->recovery_thread, NULL, _uvc_recovery_thread_func, (void *) strmh))) {
+		strmh->recovery_running = 0;
+		return UVC_ERROR_OTHER;
+	}
+	return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Stop the error recovery worker and wait for it, pending requests are discarded
+ */
+static void _uvc_stop_recovery(uvc_stream_handle_t *strmh) {
+	if (!strmh->recovery_running)
+		return;
+	pthread_mutex_lock(&strmh->recovery_mutex);
+	{
+		strmh->recovery_running = 0;
+		pthread_cond_signal(&strmh->recovery_cond);
+	}
+	pthread_mutex_unlock(&strmh->recovery_mutex);
+	pthread_join(strmh->recovery_thread, NULL);
+}
+
 #define USE_EOF
 
 /** @internal
@@ -673,8 +1028,6 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 	uint8_t header_info;
 	size_t data_len;
 	struct libusb_iso_packet_descriptor *pkt;
-	uvc_vc_error_code_control_t vc_error_code;
-	uvc_vs_error_code_control_t vs_error_code;
 
 	// magic numbers for identifying header packets from some iSight cameras
 	static const uint8_t isight_tag[] = {
@@ -726,9 +1079,8 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 		if (UNLIKELY(header_info & UVC_STREAM_ERR)) {
 //			strmh->bfh_err |= UVC_STREAM_ERR;
 			UVC_DEBUG("bad packet: error bit set");
-			libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
-//			uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-			uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+			UVC_STATS_INC(strmh, header_errors);
+			_uvc_request_recovery(strmh, UVC_RECOVERY_CLEAR_HALT | UVC_RECOVERY_ERROR_CODE);
 //			return;
 		}
 
@@ -736,6 +1088,7 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 			/* The frame ID bit was flipped, but we have image data sitting
 				around from prior transfers. This means the camera didn't send
 				an EOF for the last transfer of the previous frame. */
+			UVC_STATS_INC(strmh, fid_toggles);
 			_uvc_swap_buffers(strmh);
 		}
 
@@ -753,9 +1106,12 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 		}
 
 		if (header_info & UVC_STREAM_SCR) {
-			// @todo read the SOF token counter
 			// XXX saki some camera may send broken packet or failed to receive all data
-			if (LIKELY(variable_offset + 4 <= header_len)) {
+			if (LIKELY(variable_offset + 6 <= header_len)) {
+				strmh->last_scr = DW_TO_INT(payload + variable_offset);
+				uvc_clock_add_scr(&strmh->clock, strmh->last_scr, SW_TO_SHORT(payload + variable_offset + 4));
+				variable_offset += 6;
+			} else if (LIKELY(variable_offset + 4 <= header_len)) {
 				strmh->last_scr = DW_TO_INT(payload + variable_offset);
 				variable_offset += 4;
 			} else {
@@ -766,12 +1122,7 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 	}
 
 	if (LIKELY(data_len > 0)) {
-		if (LIKELY(strmh->got_bytes + data_len < strmh->size_buf)) {
-			memcpy(strmh->outbuf + strmh->got_bytes, payload + header_len, data_len);
-			strmh->got_bytes += data_len;
-		} else {
-			strmh->bfh_err |= UVC_STREAM_ERR;
-		}
+		_uvc_append_payload(strmh, payload + header_len, data_len);
 
 		if (header_info & UVC_STREAM_EOF/*(1 << 1)*/) {
 			// The EOF bit is set, so publish the complete frame
@@ -780,6 +1131,29 @@ static void _uvc_process_payload(uvc_stream_handle_t *strmh, const uint8_t *payl
 	}
 }
 
+/** @internal
+ * @brief Split a completed bulk transfer into payloads and process them
+ * Every payload except the last one fills dwMaxPayloadTransferSize,
+ * the last one is terminated by a short packet.
+ */
+static inline void _uvc_process_payload_bulk(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer) {
+	const size_t payload_bytes = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+	const uint8_t *payload = transfer->buffer;
+	size_t remain = transfer->actual_length;
+	size_t len;
+
+	if (UNLIKELY(!payload_bytes)) {
+		_uvc_process_payload(strmh, payload, remain);
+		return;
+	}
+	for (; remain > 0 ;) {
+		len = LIKELY(remain > payload_bytes) ? payload_bytes : remain;
+		_uvc_process_payload(strmh, payload, len);
+		payload += len;
+		remain -= len;
+	}
+}
+
 #if 0
 static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer) {
 	/* This is an isochronous mode transfer, so each packet has a payload transfer */
@@ -815,8 +1189,7 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 		0x11, 0x22, 0x33, 0x44, 0xde, 0xad,
 		0xbe, 0xef, 0xde, 0xad, 0xfa, 0xce };
 	int packet_id;
-	uvc_vc_error_code_control_t vc_error_code;
-	uvc_vs_error_code_control_t vs_error_code;
+	size_t received = 0;
 
 	for (packet_id = 0; packet_id < transfer->num_iso_packets; ++packet_id) {
 		check_header = 1;
@@ -826,17 +1199,18 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 		if (UNLIKELY(pkt->status != 0)) {
 			MARK("bad packet:status=%d,actual_length=%d", pkt->status, pkt->actual_length);
 			strmh->bfh_err |= UVC_STREAM_ERR;
-			libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
-//			uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-//			uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+			UVC_STATS_INC(strmh, packets_error);
+			_uvc_request_recovery(strmh, UVC_RECOVERY_CLEAR_HALT);
 			continue;
 		}
 
 		if (UNLIKELY(!pkt->actual_length)) {	// why transfered byte is zero...
 //			MARK("zero packet (transfer):");
 //			strmh->bfh_err |= UVC_STREAM_ERR;	// don't set this flag here
+			UVC_STATS_INC(strmh, packets_empty);
 			continue;
 		}
+		received += pkt->actual_length;
 		// XXX accessing to pktbuf could lead to crash on the original implementation
 		// because the substances of pktbuf will be deleted in uvc_stream_stop.
 		pktbuf = libusb_get_iso_packet_buffer_simple(transfer, packet_id);
@@ -866,9 +1240,8 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 				if (UNLIKELY(header_info & UVC_STREAM_ERR)) {
 //					strmh->bfh_err |= UVC_STREAM_ERR;
 					MARK("bad packet:status=0x%2x", header_info);
-					libusb_clear_halt(strmh->devh->usb_devh, strmh->stream_if->bEndpointAddress);
-//					uvc_vc_get_error_code(strmh->devh, &vc_error_code, UVC_GET_CUR);
-					uvc_vs_get_error_code(strmh->devh, &vs_error_code, UVC_GET_CUR);
+					UVC_STATS_INC(strmh, header_errors);
+					_uvc_request_recovery(strmh, UVC_RECOVERY_CLEAR_HALT | UVC_RECOVERY_ERROR_CODE);
 					continue;
 				}
 #ifdef USE_EOF
@@ -876,6 +1249,7 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 				/* The frame ID bit was flipped, but we have image data sitting
 	             around from prior transfers. This means the camera didn't send
     		     an EOF for the last transfer of the previous frame or some frames losted. */
+					UVC_STATS_INC(strmh, fid_toggles);
 					_uvc_swap_buffers(strmh);
 				}
 				strmh->fid = header_info & UVC_STREAM_FID;
@@ -897,7 +1271,10 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 
 				if (header_info & UVC_STREAM_SCR) {
 					// XXX saki some camera may send broken packet or failed to receive all data
-					if (LIKELY(header_len >= 10)) {
+					if (LIKELY(header_len >= 12)) {
+						strmh->last_scr = DW_TO_INT(pktbuf + 6);
+						uvc_clock_add_scr(&strmh->clock, strmh->last_scr, SW_TO_SHORT(pktbuf + 10));
+					} else if (LIKELY(header_len >= 10)) {
 						strmh->last_scr = DW_TO_INT(pktbuf + 6);
 					} else {
 						MARK("bogus packet: header info has UVC_STREAM_SCR, but no data");
@@ -929,11 +1306,8 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 			// from "if (pkt->actual_length - header_len > 0)"
 			if (LIKELY(pkt->actual_length > header_len)) {
 				const size_t odd_bytes = pkt->actual_length - header_len;
-				assert(strmh->got_bytes + odd_bytes < strmh->size_buf);
 				assert(strmh->outbuf);
-				assert(pktbuf);
-				memcpy(strmh->outbuf + strmh->got_bytes, pktbuf + header_len, odd_bytes);
-				strmh->got_bytes += odd_bytes;
+				_uvc_append_payload(strmh, pktbuf + header_len, odd_bytes);
 			}
 #ifdef USE_EOF
 			if ((pktbuf[1] & UVC_STREAM_EOF) && strmh->got_bytes != 0) {
@@ -947,6 +1321,7 @@ static inline void _uvc_process_payload_iso(uvc_stream_handle_t *strmh, struct l
 			continue;
 		}
 	}	// for
+	UVC_STATS_ADD(strmh, bytes_received, received);
 }
 #endif
 
@@ -965,6 +1340,7 @@ static void _uvc_stream_callback(struct libusb_transfer *transfer) {
 	if UNLIKELY(!strmh) return;
 
 	int resubmit = 1;
+	__sync_fetch_and_sub(&strmh->xfer_in_flight, 1);
 
 #ifndef NDEBUG
 	static int cnt = 0;
@@ -973,13 +1349,19 @@ static void _uvc_stream_callback(struct libusb_transfer *transfer) {
 #endif
 	switch (transfer->status) {
 	case LIBUSB_TRANSFER_COMPLETED:
+		UVC_STATS_INC(strmh, transfers_completed);
+		uvc_clock_begin_transfer(&strmh->clock);
 		if (!transfer->num_iso_packets) {
 			/* This is a bulk mode transfer, so it just has one payload transfer */
-			_uvc_process_payload(strmh, transfer->buffer, transfer->actual_length);
+			UVC_STATS_ADD(strmh, bytes_received, transfer->actual_length);
+			_uvc_process_payload_bulk(strmh, transfer);
 		} else {
 			/* This is an isochronous mode transfer, so each packet has a payload transfer */
 			_uvc_process_payload_iso(strmh, transfer);
 		}
+		uvc_clock_end_transfer(&strmh->clock);
+		if (strmh->xfer_auto_tune)
+			_uvc_tune_transfers(strmh, transfer->num_iso_packets != 0);
 	    break;
 	case LIBUSB_TRANSFER_NO_DEVICE:
 		strmh->running = 0;	// this needs for unexpected disconnect of cable otherwise hangup
@@ -989,6 +1371,8 @@ static void _uvc_stream_callback(struct libusb_transfer *transfer) {
 		UVC_DEBUG("not retrying transfer, status = %d", transfer->status);
 //		MARK("not retrying transfer, status = %d", transfer->status);
 //		_uvc_delete_transfer(transfer);
+		if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
+			UVC_STATS_INC(strmh, transfers_failed);
 		resubmit = 0;
 		break;
 	case LIBUSB_TRANSFER_TIMED_OUT:
@@ -996,11 +1380,20 @@ static void _uvc_stream_callback(struct libusb_transfer *transfer) {
 	case LIBUSB_TRANSFER_OVERFLOW:
 		UVC_DEBUG("retrying transfer, status = %d", transfer->status);
 //		MARK("retrying transfer, status = %d", transfer->status);
+		UVC_STATS_INC(strmh, transfers_failed);
 		break;
 	}
 
 	if (LIKELY(strmh->running && resubmit)) {
-		libusb_submit_transfer(transfer);
+		if (UNLIKELY(strmh->xfer_auto_tune) && _uvc_balance_transfers(strmh, transfer))
+			return;
+		if (UNLIKELY(libusb_submit_transfer(transfer) < 0)) {
+			// XXX this transfer never comes back, delete it here otherwise uvc_stream_stop waits forever
+			UVC_STATS_INC(strmh, resubmit_failed);
+			_uvc_delete_transfer(transfer);
+		} else {
+			__sync_fetch_and_add(&strmh->xfer_in_flight, 1);
+		}
 	} else {
 		// XXX delete non-reusing transfer
 		// real implementation of deleting transfer moves to _uvc_delete_transfer
@@ -1203,7 +1596,7 @@ static void _uvc_iso_callback(struct libusb_transfer *transfer) {
  * @param ctrl Control block, processed using {uvc_probe_stream_ctrl} or
  *             {uvc_get_stream_ctrl_format_size}
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
+ * @param flags Stream setup flags, zero or UVC_STREAM_FLAG_ZERO_COPY. The lower bit
  * is reserved for backward compatibility.
  */
 uvc_error_t uvc_start_streaming(uvc_device_handle_t *devh,
@@ -1220,7 +1613,7 @@ uvc_error_t uvc_start_streaming(uvc_device_handle_t *devh,
  *             {uvc_get_stream_ctrl_format_size}
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
  * @param bandwidth_factor [0.0f, 1.0f]
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
+ * @param flags Stream setup flags, zero or UVC_STREAM_FLAG_ZERO_COPY. The lower bit
  * is reserved for backward compatibility.
  */
 uvc_error_t uvc_start_streaming_bandwidth(uvc_device_handle_t *devh,
@@ -1319,9 +1712,14 @@ uvc_error_t uvc_stream_open_ctrl(uvc_device_handle_t *devh,
 		ret = UVC_ERROR_NO_MEM;
 		goto fail;
 	}
+	UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, sizeof(*strmh));
 	strmh->devh = devh;
 	strmh->stream_if = stream_if;
 	strmh->frame.library_owns_data = 1;
+	strmh->hold_slots = 1;
+	strmh->drop_policy = UVC_FRAME_DROP_OLDEST;
+	strmh->num_transfer_bufs = LIBUVC_NUM_TRANSFER_BUFS;
+	strmh->max_packets_per_transfer = LIBUVC_PACKETS_PER_TRANSFER;
 
 	ret = uvc_claim_if(strmh->devh, strmh->stream_if->bInterfaceNumber);
 	if (UNLIKELY(ret != UVC_SUCCESS))
@@ -1331,15 +1729,13 @@ uvc_error_t uvc_stream_open_ctrl(uvc_device_handle_t *devh,
 	if (UNLIKELY(ret != UVC_SUCCESS))
 		goto fail;
 
-	// Set up the streaming status and data space
+	// Set up the streaming status, data space is allocated in uvc_stream_start
 	strmh->running = 0;
-	/** @todo take only what we need */
-	strmh->outbuf = malloc(LIBUVC_XFER_BUF_SIZE);
-	strmh->holdbuf = malloc(LIBUVC_XFER_BUF_SIZE);
-	strmh->size_buf = LIBUVC_XFER_BUF_SIZE;	// xxx for boundary check
 
 	pthread_mutex_init(&strmh->cb_mutex, NULL);
 	pthread_cond_init(&strmh->cb_cond, NULL);
+	pthread_mutex_init(&strmh->recovery_mutex, NULL);
+	pthread_cond_init(&strmh->recovery_cond, NULL);
 
 	DL_APPEND(devh->streams, strmh);
 
@@ -1355,12 +1751,129 @@ fail:
 	return ret;
 }
 
+/** @internal
+ * @brief Bytes an isochronous endpoint can transfer per service interval
+ * USB2 high-bandwidth endpoints encode the additional transactions in wMaxPacketSize.
+ * SuperSpeed endpoints use bMaxBurst and Mult of the SuperSpeed endpoint companion
+ * descriptor instead, and SuperSpeedPlus endpoints may have an additional
+ * isochronous endpoint companion descriptor with dwBytesPerInterval.
+ * The companion descriptors are in the extra descriptors of the endpoint.
+ * @return 0 if the endpoint can not transfer any data (zero bandwidth altsetting)
+ */
+static size_t _uvc_endpoint_bytes_per_interval(const struct libusb_endpoint_descriptor *endpoint) {
+	const uint8_t *extra = endpoint->extra;
+	int remain = endpoint->extra_length;
+	const size_t max_packet_size = endpoint->wMaxPacketSize & 0x07ff;
+	size_t ss_bytes = 0, ssp_bytes = 0;
+	int has_ss = 0;
+
+	for (; remain >= 2 && extra[0] >= 2 && extra[0] <= remain ;) {
+		switch (extra[1]) {
+		case LIBUSB_DT_SS_ENDPOINT_COMPANION:
+			if (LIKELY(extra[0] >= LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE)) {
+				has_ss = 1;
+				// wBytesPerInterval, some devices leave this zero
+				ss_bytes = SW_TO_SHORT(extra + 4);
+				if (!ss_bytes) {
+					// (bMaxBurst + 1) * (Mult + 1) packets per service interval
+					ss_bytes = max_packet_size * (extra[2] + 1) * ((extra[3] & 0x03) + 1);
+				}
+			}
+			break;
+		case UVC_DT_SSP_ISOC_ENDPOINT_COMPANION:
+			if (LIKELY(extra[0] >= 8)) {
+				ssp_bytes = DW_TO_INT(extra + 4);	// dwBytesPerInterval
+			}
+			break;
+		}
+		remain -= extra[0];
+		extra += extra[0];
+	}
+	if (ssp_bytes)
+		return ssp_bytes;
+	if (has_ss)
+		return ss_bytes;
+	// wMaxPacketSize: [unused:2 (multiplier-1):3 size:11]
+	// bit10…0:		maximum packet size
+	// bit12…11:	the number of additional transaction opportunities per microframe for high-speed
+	//				00 = None (1 transaction per microframe)
+	//				01 = 1 additional (2 per microframe)
+	//				10 = 2 additional (3 per microframe)
+	//				11 = Reserved
+	return max_packet_size * (((endpoint->wMaxPacketSize >> 11) & 3) + 1);
+}
+
+/** @internal
+ * @brief Free the data space of the stream
+ * pooled frames still held by consumers stay valid until they are released.
+ */
+static void _uvc_stream_free_buffers(uvc_stream_handle_t *strmh) {
+	if (strmh->zero_copy) {
+		if (strmh->cur_frame) {
+			uvc_release_frame(strmh->cur_frame);
+			strmh->cur_frame = NULL;
+		}
+		for (; strmh->hold_count > 0 ;) {
+			uvc_release_frame(_uvc_dequeue_frame(strmh));
+		}
+		strmh->hold_head = 0;
+		uvc_frame_pool_detach(strmh->frame_pool);
+		strmh->frame_pool = NULL;
+	} else {
+		if (strmh->outbuf)
+			free(strmh->outbuf);
+		if (strmh->holdbuf)
+			free(strmh->holdbuf);
+	}
+	strmh->outbuf = strmh->holdbuf = NULL;
+	strmh->size_buf = 0;
+}
+
+/** @internal
+ * @brief Set up the data space of the stream
+ * @param zero_copy if true, payloads are assembled into pooled frames of frame_bytes,
+ * otherwise into outbuf/holdbuf
+ */
+static uvc_error_t _uvc_stream_alloc_buffers(uvc_stream_handle_t *strmh,
+		uint8_t zero_copy, size_t frame_bytes) {
+
+	if (zero_copy || (strmh->zero_copy != zero_copy)) {
+		_uvc_stream_free_buffers(strmh);
+	}
+	strmh->zero_copy = zero_copy;
+	if (zero_copy) {
+		// frames in the ring are outstanding too
+		strmh->frame_pool = uvc_frame_pool_create(frame_bytes,
+			LIBUVC_FRAME_POOL_SIZE + strmh->hold_slots,
+			LIBUVC_FRAME_POOL_PREALLOC + strmh->hold_slots - 1);
+		if (UNLIKELY(!strmh->frame_pool))
+			return UVC_ERROR_NO_MEM;
+		strmh->cur_frame = uvc_frame_pool_get(strmh->frame_pool);
+		if (UNLIKELY(!strmh->cur_frame))
+			return UVC_ERROR_NO_MEM;
+		strmh->outbuf = strmh->cur_frame->data;
+		strmh->size_buf = strmh->cur_frame->data_bytes;
+	} else if (!strmh->outbuf) {
+		/** @todo take only what we need */
+		strmh->outbuf = malloc(LIBUVC_XFER_BUF_SIZE);
+		strmh->holdbuf = malloc(LIBUVC_XFER_BUF_SIZE);
+		strmh->size_buf = LIBUVC_XFER_BUF_SIZE;	// xxx for boundary check
+		if (UNLIKELY(!strmh->outbuf || !strmh->holdbuf)) {
+			_uvc_stream_free_buffers(strmh);
+			return UVC_ERROR_NO_MEM;
+		}
+		UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, LIBUVC_XFER_BUF_SIZE * 2);
+	}
+
+	return UVC_SUCCESS;
+}
+
 /** Begin streaming video from the stream into the callback function.
  * @ingroup streaming
  *
  * @param strmh UVC stream
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
+ * @param flags Stream setup flags, zero or UVC_STREAM_FLAG_ZERO_COPY. The lower bit
  * is reserved for backward compatibility.
  */
 uvc_error_t uvc_stream_start(uvc_stream_handle_t *strmh,
@@ -1374,7 +1887,7 @@ uvc_error_t uvc_stream_start(uvc_stream_handle_t *strmh,
  * @param strmh UVC stream
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
  * @param bandwidth_factor [0.0f, 1.0f]
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
+ * @param flags Stream setup flags, zero or UVC_STREAM_FLAG_ZERO_COPY. The lower bit
  * is reserved for backward compatibility.
  */
 uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
@@ -1407,6 +1920,10 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	strmh->pts = 0;
 	strmh->last_scr = 0;
 	strmh->bfh_err = 0;	// XXX
+	memset(&strmh->stats, 0, sizeof(strmh->stats));
+	// XXX UVC 1.5 moved the clock frequency from VideoControl header to probe/commit control
+	uvc_clock_init(&strmh->clock, ctrl->dwClockFrequency
+		? ctrl->dwClockFrequency : strmh->devh->info->ctrl_if.dwClockFrequency);
 
 	frame_desc = uvc_find_frame_desc_stream(strmh, ctrl->bFormatIndex, ctrl->bFrameIndex);
 	if (UNLIKELY(!frame_desc)) {
@@ -1425,6 +1942,24 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	const uint32_t dwMaxVideoFrameSize = ctrl->dwMaxVideoFrameSize <= frame_desc->dwMaxVideoFrameBufferSize
 		? ctrl->dwMaxVideoFrameSize : frame_desc->dwMaxVideoFrameBufferSize;
 
+	strmh->frame_width = frame_desc->wWidth;
+	strmh->frame_height = frame_desc->wHeight;
+	switch (strmh->frame_format) {
+	case UVC_FRAME_FORMAT_YUYV:
+		strmh->frame_step = frame_desc->wWidth * 2;
+		break;
+	default:
+		strmh->frame_step = 0;
+		break;
+	}
+	// XXX some frame based format does not report dwMaxVideoFrameBufferSize
+	ret = _uvc_stream_alloc_buffers(strmh, (flags & UVC_STREAM_FLAG_ZERO_COPY) != 0,
+		dwMaxVideoFrameSize ? dwMaxVideoFrameSize : frame_desc->wWidth * frame_desc->wHeight * 2);
+	if (UNLIKELY(ret != UVC_SUCCESS)) {
+		LOGE("failed to allocate frame buffers");
+		goto fail;
+	}
+
 	// Get the interface that provides the chosen format and frame configuration
 	interface_id = strmh->stream_if->bInterfaceNumber;
 	interface = &strmh->devh->info->config->interface[interface_id];
@@ -1485,17 +2020,8 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 			for (ep_idx = 0; ep_idx < altsetting->bNumEndpoints; ep_idx++) {
 				endpoint = altsetting->endpoint + ep_idx;
 				if (endpoint->bEndpointAddress == format_desc->parent->bEndpointAddress) {
-					endpoint_bytes_per_packet = endpoint->wMaxPacketSize;
-					// wMaxPacketSize: [unused:2 (multiplier-1):3 size:11]
-					// bit10…0:		maximum packet size
-					// bit12…11:	the number of additional transaction opportunities per microframe for high-speed
-					//				00 = None (1 transaction per microframe)
-					//				01 = 1 additional (2 per microframe)
-					//				10 = 2 additional (3 per microframe)
-					//				11 = Reserved
-					endpoint_bytes_per_packet
-						= (endpoint_bytes_per_packet & 0x07ff)
-							* (((endpoint_bytes_per_packet >> 11) & 3) + 1);
+					// XXX one iso packet carries the data of one service interval
+					endpoint_bytes_per_packet = _uvc_endpoint_bytes_per_interval(endpoint);
 					break;
 				}
 			}
@@ -1510,8 +2036,8 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 							/ endpoint_bytes_per_packet;		// XXX cashed by zero divided exception occured
 
 					/* But keep a reasonable limit: Otherwise we start dropping data */
-					if (packets_per_transfer > 32)
-						packets_per_transfer = 32;
+					if (packets_per_transfer > strmh->max_packets_per_transfer)
+						packets_per_transfer = strmh->max_packets_per_transfer;
 
 					total_transfer_size = packets_per_transfer * endpoint_bytes_per_packet;
 					break;
@@ -1544,13 +2070,15 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 			UVC_DEBUG("libusb_set_interface_alt_setting failed");
 			goto fail;
 		}
+		strmh->alt_setting = altsetting->bAlternateSetting;
 
 		/* Set up the transfers */
 		MARK("Set up the transfers");
-		for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; ++transfer_id) {
+		for (transfer_id = 0; transfer_id < strmh->num_transfer_bufs; ++transfer_id) {
 			transfer = libusb_alloc_transfer(packets_per_transfer);
 			strmh->transfers[transfer_id] = transfer;
 			strmh->transfer_bufs[transfer_id] = malloc(total_transfer_size);
+			UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, total_transfer_size);
 
 			libusb_fill_iso_transfer(transfer, strmh->devh->usb_devh,
 				format_desc->parent->bEndpointAddress,
@@ -1562,15 +2090,36 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 		}
 	} else {
 		MARK("bulk transfer mode");
+		strmh->alt_setting = 0;
+		const size_t payload_bytes = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+		if (UNLIKELY(!payload_bytes)) {
+			LOGE("dwMaxPayloadTransferSize is zero");
+			ret = UVC_ERROR_INVALID_MODE;
+			goto fail;
+		}
+		/* XXX receive multiple payloads with one transfer to reduce URBs and completions.
+		 * A payload shorter than dwMaxPayloadTransferSize ends with a short packet
+		 * and completes the transfer, so a transfer never waits for the next frame
+		 * once the last payload of the frame has been received */
+		size_t payloads_per_transfer = (dwMaxVideoFrameSize + payload_bytes - 1) / payload_bytes;
+		if (payloads_per_transfer > strmh->max_packets_per_transfer)
+			payloads_per_transfer = strmh->max_packets_per_transfer;
+		if (payloads_per_transfer * payload_bytes > LIBUVC_MAX_BULK_TRANSFER_SIZE)
+			payloads_per_transfer = LIBUVC_MAX_BULK_TRANSFER_SIZE / payload_bytes;
+		if (!payloads_per_transfer)
+			payloads_per_transfer = 1;
+		total_transfer_size = payloads_per_transfer * payload_bytes;
+		MARK("payloads_per_transfer=%d, total_transfer_size=%d", (int)payloads_per_transfer, (int)total_transfer_size);
 		/** prepare for bulk transfer */
-		for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; ++transfer_id) {
+		for (transfer_id = 0; transfer_id < strmh->num_transfer_bufs; ++transfer_id) {
 			transfer = libusb_alloc_transfer(0);
 			strmh->transfers[transfer_id] = transfer;
-			strmh->transfer_bufs[transfer_id] = malloc(strmh->cur_ctrl.dwMaxPayloadTransferSize);
+			strmh->transfer_bufs[transfer_id] = malloc(total_transfer_size);
+			UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, total_transfer_size);
 			libusb_fill_bulk_transfer(transfer, strmh->devh->usb_devh,
 				format_desc->parent->bEndpointAddress,
 				strmh->transfer_bufs[transfer_id],
-				strmh->cur_ctrl.dwMaxPayloadTransferSize, _uvc_stream_callback,
+				total_transfer_size, _uvc_stream_callback,
 				(void *)strmh, 5000);
 		}
 	}
@@ -1578,20 +2127,38 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 	strmh->user_cb = cb;
 	strmh->user_ptr = user_ptr;
 
+	// XXX start the recovery worker first, the fail path below does not stop the callback thread
+	ret = _uvc_start_recovery(strmh);
+	if (UNLIKELY(ret != UVC_SUCCESS)) {
+		LOGE("failed to start error recovery worker");
+		goto fail;
+	}
 	/* If the user wants it, set up a thread that calls the user's function
 	 * with the contents of each frame.
 	 */
 	MARK("create callback thread");
 	if LIKELY(cb) {
-		pthread_create(&strmh->cb_thread, NULL, _uvc_user_caller, (void*) strmh);
+		pthread_create(&strmh->cb_thread, NULL,
+			strmh->zero_copy ? _uvc_user_caller_zero_copy : _uvc_user_caller, (void*) strmh);
 	}
 	MARK("submit transfers");
-	for (transfer_id = 0; transfer_id < LIBUVC_NUM_TRANSFER_BUFS; transfer_id++) {
+	// XXX auto tuning starts from the default depth, the rest is parked until needed
+	strmh->xfer_depth = strmh->xfer_auto_tune && (strmh->num_transfer_bufs > LIBUVC_NUM_TRANSFER_BUFS)
+		? LIBUVC_NUM_TRANSFER_BUFS : strmh->num_transfer_bufs;
+	strmh->xfer_in_flight = strmh->num_parked = 0;
+	strmh->tune_count = strmh->tune_clean_windows = 0;
+	strmh->tune_errors = 0;
+	for (transfer_id = 0; transfer_id < strmh->num_transfer_bufs; transfer_id++) {
+		if (transfer_id >= strmh->xfer_depth) {
+			strmh->parked_transfers[strmh->num_parked++] = strmh->transfers[transfer_id];
+			continue;
+		}
 		ret = libusb_submit_transfer(strmh->transfers[transfer_id]);
 		if (UNLIKELY(ret != UVC_SUCCESS)) {
 			UVC_DEBUG("libusb_submit_transfer failed");
 			break;
 		}
+		__sync_fetch_and_add(&strmh->xfer_in_flight, 1);
 	}
 
 	if (UNLIKELY(ret != UVC_SUCCESS)) {
@@ -1604,6 +2171,7 @@ uvc_error_t uvc_stream_start_bandwidth(uvc_stream_handle_t *strmh,
 fail:
 	LOGE("fail");
 	strmh->running = 0;
+	_uvc_stop_recovery(strmh);
 	UVC_EXIT(ret);
 	return ret;
 }
@@ -1646,6 +2214,9 @@ static void *_uvc_user_caller(void *arg) {
 				break;
 			}
 
+			// frames overwritten in holdbuf while the user callback was running
+			if (last_seq && (strmh->hold_seq - last_seq > 1))
+				UVC_STATS_ADD(strmh, frames_dropped, strmh->hold_seq - last_seq - 1);
 			last_seq = strmh->hold_seq;
 			if (LIKELY(!strmh->hold_bfh_err))	// XXX
 				_uvc_populate_frame(strmh);
@@ -1659,6 +2230,62 @@ static void *_uvc_user_caller(void *arg) {
 	return NULL; // return value ignored
 }
 
+/** @internal
+ * @brief User callback runner thread for zero-copy mode
+ * the ownership of each frame is passed to the user callback
+ * @param arg Device handle
+ */
+static void *_uvc_user_caller_zero_copy(void *arg) {
+	uvc_stream_handle_t *strmh = (uvc_stream_handle_t *) arg;
+	uvc_frame_t *frame;
+
+	for (; 1 ;) {
+		pthread_mutex_lock(&strmh->cb_mutex);
+		{
+			for (; strmh->running && !strmh->hold_count ;) {
+				pthread_cond_wait(&strmh->cb_cond, &strmh->cb_mutex);
+			}
+
+			if (UNLIKELY(!strmh->running)) {
+				pthread_mutex_unlock(&strmh->cb_mutex);
+				break;
+			}
+
+			frame = _uvc_dequeue_frame(strmh);
+		}
+		pthread_mutex_unlock(&strmh->cb_mutex);
+
+		strmh->user_cb(frame, strmh->user_ptr);	// call user callback function, it releases the frame
+	}
+
+	return NULL; // return value ignored
+}
+
+/** @internal
+ * @brief Take the frame for polling, must be called with stream cb lock held!
+ * in zero-copy mode the caller owns the returned frame.
+ */
+static inline uvc_frame_t *_uvc_take_polled_frame(uvc_stream_handle_t *strmh) {
+	uvc_frame_t *frame;
+
+	if (strmh->zero_copy) {
+		frame = _uvc_dequeue_frame(strmh);
+	} else {
+		// frames overwritten in holdbuf since the last poll
+		if (strmh->last_polled_seq && (strmh->hold_seq - strmh->last_polled_seq > 1))
+			UVC_STATS_ADD(strmh, frames_dropped, strmh->hold_seq - strmh->last_polled_seq - 1);
+		_uvc_populate_frame(strmh);
+		frame = &strmh->frame;
+	}
+	strmh->last_polled_seq = strmh->hold_seq;
+	return frame;
+}
+
+static inline int _uvc_has_polled_frame(uvc_stream_handle_t *strmh) {
+	return strmh->zero_copy ? strmh->hold_count > 0
+		: strmh->last_polled_seq < strmh->hold_seq;
+}
+
 /** @internal
  * @brief Populate the fields of a frame to be handed to user code
  * must be called with stream cb lock held!
@@ -1697,19 +2324,34 @@ void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
 
 	/* copy the image data from the hold buffer to the frame (unnecessary extra buf?) */
 	if (UNLIKELY(frame->data_bytes < strmh->hold_bytes)) {
-		frame->data = realloc(frame->data, strmh->hold_bytes);	// TODO add error handling when failed realloc
-		frame->data_bytes = strmh->hold_bytes;
+		// grow to the largest frame of the stream at once so that
+		// the MJPEG frames of varying size do not realloc again and again
+		size_t bytes = alloc_size;
+		if (bytes < strmh->hold_bytes + (strmh->hold_bytes >> 2))
+			bytes = strmh->hold_bytes + (strmh->hold_bytes >> 2);
+		void *data = realloc(frame->data, bytes);
+		if (UNLIKELY(!data)) {
+			LOGW("failed to grow frame buffer to %u bytes", (unsigned)bytes);
+			frame->actual_bytes = 0;
+			return;
+		}
+		UVC_ALLOC_TRACK(UVC_ALLOC_STREAM, bytes);
+		frame->data = data;
+		frame->data_bytes = bytes;
 	}
 	memcpy(frame->data, strmh->holdbuf, strmh->hold_bytes/*frame->data_bytes*/);	// XXX
 
-	/** @todo set the frame time */
+	frame->sequence = strmh->hold_seq;
+	frame->capture_time = strmh->hold_capture_time;
+	frame->complete_time = strmh->hold_complete_time;
 }
 
 /** Poll for a frame
  * @ingroup streaming
  *
  * @param devh UVC device
- * @param[out] frame Location to store pointer to captured frame (NULL on error)
+ * @param[out] frame Location to store pointer to captured frame (NULL on error).
+ * In zero-copy mode the caller owns the frame and must return it with uvc_release_frame
  * @param timeout_us >0: Wait at most N microseconds; 0: Wait indefinitely; -1: return immediately
  */
 uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
@@ -1727,10 +2369,8 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
-		if (strmh->last_polled_seq < strmh->hold_seq) {
-			_uvc_populate_frame(strmh);
-			*frame = &strmh->frame;
-			strmh->last_polled_seq = strmh->hold_seq;
+		if (_uvc_has_polled_frame(strmh)) {
+			*frame = _uvc_take_polled_frame(strmh);
 		} else if (timeout_us != -1) {
 			if (!timeout_us) {
 				pthread_cond_wait(&strmh->cb_cond, &strmh->cb_mutex);
@@ -1754,10 +2394,8 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
 				pthread_cond_timedwait(&strmh->cb_cond, &strmh->cb_mutex, &ts);
 			}
 
-			if (LIKELY(strmh->last_polled_seq < strmh->hold_seq)) {
-				_uvc_populate_frame(strmh);
-				*frame = &strmh->frame;
-				strmh->last_polled_seq = strmh->hold_seq;
+			if (LIKELY(_uvc_has_polled_frame(strmh))) {
+				*frame = _uvc_take_polled_frame(strmh);
 			} else {
 				*frame = NULL;
 			}
@@ -1811,7 +2449,11 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
 	pthread_mutex_lock(&strmh->cb_mutex);
 	{
-		for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
+		// parked transfers are not submitted and never come back to the callback
+		for (; strmh->num_parked > 0 ;) {
+			_uvc_free_transfer_locked(strmh, strmh->parked_transfers[--strmh->num_parked]);
+		}
+		for (i = 0; i < LIBUVC_MAX_TRANSFER_BUFS; i++) {
 			if (strmh->transfers[i]) {
 				int res = libusb_cancel_transfer(strmh->transfers[i]);
 				if ((res < 0) && (res != LIBUSB_ERROR_NOT_FOUND)) {
@@ -1829,11 +2471,11 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
 		/* Wait for transfers to complete/cancel */
 		for (; 1 ;) {
-			for (i = 0; i < LIBUVC_NUM_TRANSFER_BUFS; i++) {
+			for (i = 0; i < LIBUVC_MAX_TRANSFER_BUFS; i++) {
 				if (strmh->transfers[i] != NULL)
 					break;
 			}
-			if (i == LIBUVC_NUM_TRANSFER_BUFS)
+			if (i == LIBUVC_MAX_TRANSFER_BUFS)
 				break;
 			pthread_cond_wait(&strmh->cb_cond, &strmh->cb_mutex);
 		}
@@ -1844,6 +2486,9 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
 	/** @todo stop the actual stream, camera side? */
 
+	// no transfer is alive here, so no more recovery request is queued
+	_uvc_stop_recovery(strmh);
+
 	if (strmh->user_cb) {
 		/* wait for the thread to stop (triggered by LIBUSB_TRANSFER_CANCELLED transfer) */
 		pthread_join(strmh->cb_thread, NULL);
@@ -1874,20 +2519,131 @@ void uvc_stream_close(uvc_stream_handle_t *strmh) {
 		strmh->frame.data = NULL;
 	}
 
-	if (strmh->outbuf) {
-		free(strmh->outbuf);
-		strmh->outbuf = NULL;
-	}
-	if (strmh->holdbuf) {
-		free(strmh->holdbuf);
-		strmh->holdbuf = NULL;
-	}
+	_uvc_stream_free_buffers(strmh);
 
 	pthread_cond_destroy(&strmh->cb_cond);
 	pthread_mutex_destroy(&strmh->cb_mutex);
+	pthread_cond_destroy(&strmh->recovery_cond);
+	pthread_mutex_destroy(&strmh->recovery_mutex);
 
 	DL_DELETE(strmh->devh->streams, strmh);
 	free(strmh);
 
 	UVC_EXIT_VOID();
 }
+
+/** @brief Set up the ring of completed frames
+ * @ingroup streaming
+ *
+ * Completed frames wait in the ring until the user callback or uvc_stream_get_frame
+ * takes them, so the USB side can run ahead of a slow consumer for a while.
+ * When the ring is full, a frame is discarded according to the policy
+ * and counted in uvc_stream_get_dropped_frames.
+ * The ring is used in zero-copy mode (UVC_STREAM_FLAG_ZERO_COPY) only,
+ * otherwise a single hold buffer is used and overwritten frames are counted.
+ * Must be called before the stream is started.
+ *
+ * @param strmh UVC stream handle
+ * @param num_slots [1, LIBUVC_MAX_FRAME_RING], default is 1
+ * @param policy UVC_FRAME_DROP_OLDEST(default) or UVC_FRAME_DROP_NEWEST
+ */
+uvc_error_t uvc_stream_set_frame_ring(uvc_stream_handle_t *strmh,
+		int num_slots, enum uvc_frame_drop_policy policy) {
+
+	if (UNLIKELY(!strmh || (num_slots < 1) || (num_slots > LIBUVC_MAX_FRAME_RING)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	pthread_mutex_lock(&strmh->cb_mutex);
+	{
+		// release frames left from the previous run before changing the ring geometry
+		for (; strmh->hold_count > 0 ;) {
+			uvc_release_frame(_uvc_dequeue_frame(strmh));
+		}
+		strmh->hold_slots = num_slots;
+		strmh->hold_head = 0;
+		strmh->drop_policy = policy;
+	}
+	pthread_mutex_unlock(&strmh->cb_mutex);
+
+	return UVC_SUCCESS;
+}
+
+/** @brief Get the number of frames lost because the consumer did not keep up
+ * @ingroup streaming
+ *
+ * @param strmh UVC stream handle
+ * @return number of dropped frames since the stream was started
+ */
+uint32_t uvc_stream_get_dropped_frames(uvc_stream_handle_t *strmh) {
+	return LIKELY(strmh) ? UVC_STATS_ADD(strmh, frames_dropped, 0) : 0;
+}
+
+/** @brief Get transport statistics of the stream
+ * @ingroup streaming
+ *
+ * This does not take any lock, so it is safe to call frequently while streaming.
+ * The counters are reset when the stream is started.
+ *
+ * @param strmh UVC stream handle
+ * @param[out] stats statistics since the stream was started
+ */
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh, uvc_stream_stats_t *stats) {
+	if (UNLIKELY(!strmh || !stats))
+		return UVC_ERROR_INVALID_PARAM;
+
+	// each 32bit counter is read atomically, 64bit counter needs atomic access on 32bit arch
+	*stats = strmh->stats;
+	stats->bytes_received = UVC_STATS_ADD(strmh, bytes_received, 0);
+	stats->transfer_depth = strmh->running ? strmh->xfer_depth : 0;
+
+	return UVC_SUCCESS;
+}
+
+/** @brief Set up the transfer queue of the stream
+ * @ingroup streaming
+ *
+ * A deep queue absorbs scheduling delays of the libusb event thread on busy
+ * systems and hubs, a shallow queue keeps the memory usage and the latency low.
+ * With auto tuning, num_transfers transfers are allocated but only as many as
+ * needed are kept in flight: the depth grows on packet loss or when completions
+ * are late by almost the whole queue, and shrinks while there is plenty of slack.
+ * The current depth is reported in uvc_stream_stats_t::transfer_depth.
+ * Must be called before the stream is started.
+ *
+ * @param strmh UVC stream handle
+ * @param num_transfers [1, LIBUVC_MAX_TRANSFER_BUFS], 0 for the default (10),
+ * upper limit of the depth when auto tuning
+ * @param packets_per_transfer upper limit of iso packets per transfer, or of payloads
+ * per transfer for bulk transfer [1, LIBUVC_MAX_PACKETS_PER_TRANSFER], 0 for the default (32).
+ * The actual number is also limited to one frame of data.
+ * @param auto_tune non-zero to adjust the number of transfers in flight while streaming
+ */
+uvc_error_t uvc_stream_set_transfer_config(uvc_stream_handle_t *strmh,
+		int num_transfers, int packets_per_transfer, uint8_t auto_tune) {
+
+	if (UNLIKELY(!strmh
+		|| (num_transfers < 0) || (num_transfers > LIBUVC_MAX_TRANSFER_BUFS)
+		|| (packets_per_transfer < 0) || (packets_per_transfer > LIBUVC_MAX_PACKETS_PER_TRANSFER)))
+		return UVC_ERROR_INVALID_PARAM;
+	if (UNLIKELY(strmh->running))
+		return UVC_ERROR_BUSY;
+
+	strmh->num_transfer_bufs = num_transfers ? num_transfers : LIBUVC_NUM_TRANSFER_BUFS;
+	strmh->max_packets_per_transfer = packets_per_transfer
+		? packets_per_transfer : LIBUVC_PACKETS_PER_TRANSFER;
+	strmh->xfer_auto_tune = auto_tune && (strmh->num_transfer_bufs > LIBUVC_MIN_TRANSFER_BUFS);
+
+	return UVC_SUCCESS;
+}
+
+/** @brief Get the alternate setting of the streaming interface selected on start
+ * @ingroup streaming
+ *
+ * @param strmh UVC stream handle
+ * @return alternate setting, 0 for bulk transfer or when the stream has not been started
+ */
+uint8_t uvc_stream_get_alt_setting(uvc_stream_handle_t *strmh) {
+	return LIKELY(strmh) ? strmh->alt_setting : 0;
+}